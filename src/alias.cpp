@@ -10,11 +10,13 @@
 #include "auxpow.h"
 #include "script.h"
 #include "main.h"
+#include "decodecache.h"
 
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_writer_template.h"
 
 #include <boost/xpressive/xpressive_dynamic.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -24,7 +26,12 @@ extern CAliasDB *paliasdb;
 
 map<vector<unsigned char>, uint256> mapMyAliases;
 map<vector<unsigned char>, set<uint256> > mapAliasesPending;
-list<CAliasFee> lstAliasFees;
+CFeeWindow aliasFeeWindow;
+// alias ops of recent Syscoin transactions
+static CDecodeCache<CServiceTxDecode> aliasDecodeCache(10000);
+
+// span of the long fee subsidy window, in seconds
+static const unsigned int ALIAS_FEE_WINDOW = 60 * 60 * 12;
 
 #ifdef GUI
 extern std::map<uint160, std::vector<unsigned char> > mapMyNameHashes;
@@ -59,8 +66,6 @@ extern bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey,
 		int nHashType);
 extern bool IsConflictedAliasTx(CBlockTreeDB& txdb, const CTransaction& tx,
 		vector<unsigned char>& name);
-extern void rescanforaliases(CBlockIndex *pindexRescan);
-extern void rescanforoffers(CBlockIndex *pindexRescan);
 //extern Value sendtoaddress(const Array& params, bool fHelp);
 
 CScript RemoveAliasScriptPrefix(const CScript& scriptIn);
@@ -94,22 +99,6 @@ void RemoveAliasTxnFromMemoryPool(const CTransaction& tx) {
 	}
 }
 
-void PutToAliasList(std::vector<CAliasIndex> &aliasList, CAliasIndex& index) {
-	int i = aliasList.size() - 1;
-	BOOST_REVERSE_FOREACH(CAliasIndex &o, aliasList) {
-        if(index.nHeight != 0 && o.nHeight == index.nHeight) {
-        	aliasList[i] = index;
-            return;
-        }
-        else if(o.txHash != 0 && o.txHash == index.txHash) {
-        	aliasList[i] = index;
-            return;
-        }
-        i--;
-	}
-    aliasList.push_back(index);
-}
-
 
 
 int GetMinActivateDepth() {
@@ -125,76 +114,32 @@ bool IsAliasOp(int op) {
 }
 
 bool InsertAliasFee(CBlockIndex *pindex, uint256 hash, uint64 vValue) {
-	TRY_LOCK(cs_main, cs_trymain);
-	list<CAliasFee> txnDup;
-	CAliasFee txnVal(hash, pindex->nTime, pindex->nHeight, vValue);
-	bool bFound = false;
-
-	BOOST_FOREACH(CAliasFee &nmTxnValue, lstAliasFees) {
-		if (txnVal.hash == nmTxnValue.hash
-				&& txnVal.nHeight == nmTxnValue.nHeight) {
-			nmTxnValue = txnVal;
-			bFound = true;
-			break;
-		}
-	}
-	if (!bFound)
-		lstAliasFees.push_front(txnVal);
-	return bFound;
+	return aliasFeeWindow.Insert(
+			CFeeWindowEntry(hash, pindex->nHeight, pindex->nTime, vValue), true);
 }
 
 bool RemoveAliasFee(CAliasFee &txnVal) {
-	TRY_LOCK(cs_main, cs_trymain);
-	CAliasFee *theval = NULL;
-	if(lstAliasFees.size()==0) return false;
-
-	BOOST_FOREACH(CAliasFee &nmTxnValue, lstAliasFees) {
-		if (txnVal.hash == nmTxnValue.hash
-		 && txnVal.nHeight == nmTxnValue.nHeight) {
-			theval = &nmTxnValue;
-			break;
-		}
-	}
+	return aliasFeeWindow.Remove(txnVal.hash, txnVal.nHeight);
+}
 
-	if(theval)
-		lstAliasFees.remove(*theval);
-	return theval != NULL;
+bool LoadAliasFees(unsigned int nHeight) {
+	aliasFeeWindow.Attach(paliasdb, "namefee");
+
+	vector<CAliasFee> vFees;
+	if (paliasdb->ReadLegacyAliasTxFees(vFees)) {
+		printf("LoadAliasFees() : upgrading %"PRIszu" alias fees to per-record storage\n", vFees.size());
+		aliasFeeWindow.clear();
+		BOOST_REVERSE_FOREACH(const CAliasFee &fee, vFees)
+			aliasFeeWindow.push_back(
+					CFeeWindowEntry(fee.hash, fee.nHeight, fee.nBlockTime, fee.nValue));
+		return paliasdb->UpgradeAliasTxFees(aliasFeeWindow);
+	}
+	return aliasFeeWindow.Load(nHeight, FEE_WINDOW_LOAD_DEPTH, ALIAS_FEE_WINDOW);
 }
 
 uint64 GetAliasFeeSubsidy(unsigned int nHeight) {
 	uint64 hr1 = 1, hr12 = 1;
-	{
-		TRY_LOCK(cs_main, cs_trymain);
-
-		unsigned int h12 = 60 * 60 * 12;
-		unsigned int nTargetTime = 0;
-		unsigned int nTarget1hrTime = 0;
-		unsigned int blk1hrht = nHeight - 1, blk12hrht = nHeight - 1;
-		bool bFound = false;
-
-		BOOST_FOREACH(CAliasFee &nmTxnValue, lstAliasFees) {
-			if (nmTxnValue.nHeight <= nHeight)
-				bFound = true;
-			if (bFound) {
-				if (nTargetTime == 0) {
-					hr1 = hr12 = 0;
-					nTargetTime = nmTxnValue.nBlockTime - h12;
-					nTarget1hrTime = nmTxnValue.nBlockTime - (h12 / 12);
-				}
-				if (nmTxnValue.nBlockTime > nTargetTime) {
-					hr12 += nmTxnValue.nValue;
-					blk12hrht = nmTxnValue.nHeight;
-					if (nmTxnValue.nBlockTime > nTarget1hrTime) {
-						hr1 += nmTxnValue.nValue;
-						blk1hrht = nmTxnValue.nHeight;
-					}
-				}
-			}
-		}
-		hr12 /= (nHeight - blk12hrht) + 1;
-		hr1 /= (nHeight - blk1hrht) + 1;
-	//	printf("GetAliasFeeSubsidy() : Alias fee mining reward for height %d: %llu\n", nHeight, nSubsidyOut);
-	}
+	aliasFeeWindow.GetWindowAverages(nHeight, ALIAS_FEE_WINDOW, hr1, hr12);
 	return (hr12 + hr1) / 2;
 }
 
@@ -242,13 +187,10 @@ int64 GetAliasNetFee(const CTransaction& tx) {
 }
 
 int GetAliasHeight(vector<unsigned char> vchName) {
-	vector<CAliasIndex> vtxPos;
+	CAliasIndex txPos;
 	if (paliasdb->ExistsAlias(vchName)) {
-		if (!paliasdb->ReadAlias(vchName, vtxPos))
-			return error("GetAliasHeight() : failed to read from alias DB");
-		if (vtxPos.empty())
+		if (!paliasdb->ReadAliasLast(vchName, txPos))
 			return -1;
-		CAliasIndex& txPos = vtxPos.back();
 		return txPos.nHeight;
 	}
 	return -1;
@@ -281,7 +223,7 @@ bool IsAliasMine(const CTransaction& tx) {
 
 	const CTxOut& txout = tx.vout[nOut];
 	if (IsMyAlias(tx, txout)) {
-		printf("IsAliasMine()  : found my transaction %s value %d\n",
+		LogPrint(LOG_ALIAS, "IsAliasMine()  : found my transaction %s value %d\n",
 				tx.GetHash().GetHex().c_str(), (int) txout.nValue);
 		return true;
 	}
@@ -308,14 +250,14 @@ bool IsAliasMine(const CTransaction& tx, const CTxOut& txout,
 		return false;
 
 	if (IsMyAlias(tx, txout)) {
-		printf("IsAliasMine()  : found my transaction %s value %d\n",
+		LogPrint(LOG_ALIAS, "IsAliasMine()  : found my transaction %s value %d\n",
 				tx.GetHash().GetHex().c_str(), (int) txout.nValue);
 		return true;
 	}
 	return false;
 }
 
-bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+bool VerifyAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 		CValidationState &state, CCoinsViewCache &inputs,
 		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock,
 		bool fMiner, bool fJustCheck) {
@@ -351,7 +293,7 @@ bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 
 		// decode alias info from transaction
 		vector<vector<unsigned char> > vvchArgs;
-		int op, nOut, nPrevHeight;
+		int op, nOut;
 		int64 nDepth;
 		if (!DecodeAliasTx(tx, op, nOut, vvchArgs, -1))
 			return error(
@@ -359,7 +301,7 @@ bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 					tx.GetHash().GetHex().c_str());
 		int64 nNetFee;
 
-		printf("%s : name=%s, tx=%s\n", aliasFromOp(op).c_str(),
+		LogPrint(LOG_ALIAS, "%s : name=%s, tx=%s\n", aliasFromOp(op).c_str(),
 				stringFromVch(
 						op == OP_ALIAS_NEW ?
 								vchFromString(HexStr(vvchArgs[0])) :
@@ -377,7 +319,7 @@ bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 			if (vvchArgs[0].size() != 20)
 				return error("aliasnew tx with incorrect hash length");
 
-			printf("CONNECTED ALIAS: name=%s  op=%s  hash=%s  height=%d\n",
+			LogPrint(LOG_ALIAS, "CONNECTED ALIAS: name=%s  op=%s  hash=%s  height=%d\n",
 					HexStr(vvchArgs[0]).c_str(), aliasFromOp(op).c_str(),
 					tx.GetHash().ToString().c_str(), pindexBlock->nHeight);
 
@@ -428,13 +370,6 @@ bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 					return error(
 							"CheckAliasInputs() : aliasactivate cannot be mined if aliasnew is not already in chain and unexpired");
 
-				nPrevHeight = GetAliasHeight(vvchArgs[0]);
-				if (!fBlock && nPrevHeight >= 0
-						&& pindexBlock->nHeight - nPrevHeight
-								< GetAliasExpirationDepth(pindexBlock->nHeight))
-					return error(
-							"CheckAliasInputs() : aliasactivate on an unexpired alias");
-
 				// BOOST_FOREACH(const MAPTESTPOOLTYPE &s, mapTestPool) {
 				//     if (s.first == vvchArgs[0]) {
 				//         return error("CheckAliasInputs() : will not mine %s because it clashes with %s",
@@ -483,79 +418,102 @@ bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 			return error(
 					"CheckAliasInputs() : alias transaction has unknown op");
 		}
+	}
+	return true;
+}
 
-		if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
+bool ConnectAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+		CCoinsViewCache &inputs,
+		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock,
+		bool fMiner, bool fJustCheck) {
 
-			if (op != OP_ALIAS_NEW) {
+	if (tx.IsCoinBase() || tx.nVersion != SYSCOIN_TX_VERSION)
+		return true;
 
-				// get the alias from the DB
-				vector<CAliasIndex> vtxPos;
-				if (paliasdb->ExistsAlias(vvchArgs[0])) {
-					if (!paliasdb->ReadAlias(vvchArgs[0], vtxPos)
-							&& op == OP_ALIAS_UPDATE && !fJustCheck)
-						return error(
-								"CheckAliasInputs() : failed to read from alias DB");
-				}
+	// the input spent, as VerifyAliasInputs() found it
+	const COutPoint *prevOutput = NULL;
+	for (int i = 0; i < (int) tx.vin.size(); i++) {
+		prevOutput = &tx.vin[i].prevout;
+		const CCoins &prevCoins = inputs.GetCoins(prevOutput->hash);
+		int prevOp;
+		vector<vector<unsigned char> > vvch;
+		if (DecodeAliasScript(prevCoins.vout[prevOutput->n].scriptPubKey,
+				prevOp, vvch))
+			break;
+	}
 
-				//// if an update then check for a prevtx and error out if not found
-				// if (fJustCheck && op == OP_ALIAS_UPDATE && !CheckAliasTxPos(vtxPos, prevCoins->nHeight)) {
-				// 	printf("CheckAliasInputs() : tx %s rejected, since previous tx (%s) is not in the alias DB\n",
-				// 		tx.GetHash().ToString().c_str(), prevOutput->hash.ToString().c_str());
-				// 	return false;
-				// }
+	vector<vector<unsigned char> > vvchArgs;
+	int op, nOut;
+	if (!DecodeAliasTx(tx, op, nOut, vvchArgs, -1))
+		return error(
+				"ConnectAliasInputs() : could not decode syscoin alias info from tx %s",
+				tx.GetHash().GetHex().c_str());
 
-				if (!fMiner && !fJustCheck
-						&& pindexBlock->nHeight != pindexBest->nHeight) {
-					
-					int nHeight = pindexBlock->nHeight;
+	if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
 
-					CAliasIndex txPos2;		
-					const vector<unsigned char> &vchVal = vvchArgs[
-						op == OP_ALIAS_ACTIVATE ? 2 : 1];
-					txPos2.nHeight = nHeight;
-					txPos2.vValue = vchVal;
-					txPos2.txHash = tx.GetHash();
-					txPos2.txPrevOut = *prevOutput;
+		if (op != OP_ALIAS_NEW) {
 
-					PutToAliasList(vtxPos, txPos2);
+			//// if an update then check for a prevtx and error out if not found
+			// if (fJustCheck && op == OP_ALIAS_UPDATE && !CheckAliasTxPos(vtxPos, prevCoins->nHeight)) {
+			// 	printf("CheckAliasInputs() : tx %s rejected, since previous tx (%s) is not in the alias DB\n",
+			// 		tx.GetHash().ToString().c_str(), prevOutput->hash.ToString().c_str());
+			// 	return false;
+			// }
 
-					{
-					TRY_LOCK(cs_main, cs_trymain);
-
-					if (!paliasdb->WriteName(vvchArgs[0], vtxPos))
-						return error( "CheckAliasInputs() :  failed to write to alias DB");
-					mapTestPool[vvchArgs[0]] = tx.GetHash();
-
-					// write alias fees to db
-					int64 nTheFee = GetAliasNetFee(tx);
-					InsertAliasFee(pindexBlock, tx.GetHash(), nTheFee);
-					if (nTheFee != 0)
-						printf( "ALIAS FEES: Added %lf in fees to track for regeneration.\n",
-								(double) nTheFee / COIN);
-
-					vector<CAliasFee> vAliasFees(lstAliasFees.begin(),
-							lstAliasFees.end());
-					if (!paliasdb->WriteAliasTxFees(vAliasFees))
-						return error( "CheckOfferInputs() : failed to write fees to alias DB");
-					
-						std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi =
-								mapAliasesPending.find(vvchArgs[0]);
-						if (mi != mapAliasesPending.end())
-							mi->second.erase(tx.GetHash());
-					}
+			if (!fMiner && !fJustCheck
+					&& pindexBlock->nHeight != pindexBest->nHeight) {
+				
+				int nHeight = pindexBlock->nHeight;
 
-					printf(
-							"CONNECTED ALIAS: name=%s  op=%s  hash=%s  height=%d\n",
-							stringFromVch(vvchArgs[0]).c_str(),
-							aliasFromOp(op).c_str(),
-							tx.GetHash().ToString().c_str(), nHeight);
+				CAliasIndex txPos2;		
+				const vector<unsigned char> &vchVal = vvchArgs[
+					op == OP_ALIAS_ACTIVATE ? 2 : 1];
+				txPos2.nHeight = nHeight;
+				txPos2.vValue = vchVal;
+				txPos2.txHash = tx.GetHash();
+				txPos2.txPrevOut = *prevOutput;
+
+				{
+				TRY_LOCK(cs_main, cs_trymain);
+
+				// track alias fees, written together with the alias
+				int64 nTheFee = GetAliasNetFee(tx);
+				InsertAliasFee(pindexBlock, tx.GetHash(), nTheFee);
+				if (nTheFee != 0)
+					LogPrint(LOG_ALIAS, "ALIAS FEES: Added %lf in fees to track for regeneration.\n",
+							(double) nTheFee / COIN);
+
+				if (!paliasdb->WriteName(vvchArgs[0], txPos2, aliasFeeWindow))
+					return error( "CheckAliasInputs() :  failed to write to alias DB");
+				mapTestPool[vvchArgs[0]] = tx.GetHash();
+				
+					std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi =
+							mapAliasesPending.find(vvchArgs[0]);
+					if (mi != mapAliasesPending.end())
+						mi->second.erase(tx.GetHash());
 				}
+
+				LogPrint(LOG_ALIAS, 
+						"CONNECTED ALIAS: name=%s  op=%s  hash=%s  height=%d\n",
+						stringFromVch(vvchArgs[0]).c_str(),
+						aliasFromOp(op).c_str(),
+						tx.GetHash().ToString().c_str(), nHeight);
 			}
 		}
 	}
 	return true;
 }
 
+bool CheckAliasInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+		CValidationState &state, CCoinsViewCache &inputs,
+		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock,
+		bool fMiner, bool fJustCheck) {
+	return VerifyAliasInputs(pindexBlock, tx, state, inputs, mapTestPool,
+			fBlock, fMiner, fJustCheck)
+			&& ConnectAliasInputs(pindexBlock, tx, inputs, mapTestPool,
+					fBlock, fMiner, fJustCheck);
+}
+
 bool ExtractAliasAddress(const CScript& script, string& address) {
 	if (script.size() == 1 && script[0] == OP_RETURN) {
 		address = string("network fee");
@@ -622,129 +580,53 @@ string stringFromVch(const vector<unsigned char> &vch) {
 bool CAliasDB::ScanNames(const std::vector<unsigned char>& vchName,
 		unsigned int nMax,
 		std::vector<std::pair<std::vector<unsigned char>, CAliasIndex> >& nameScan) {
-
-	leveldb::Iterator *pcursor = paliasdb->NewIterator();
-
-	CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-	ssKeySet << make_pair(string("namei"), vchName);
-	string sType;
-	pcursor->Seek(ssKeySet.str());
-
-	while (pcursor->Valid()) {
-		boost::this_thread::interruption_point();
-		try {
-			leveldb::Slice slKey = pcursor->key();
-			CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(),
-					SER_DISK, CLIENT_VERSION);
-
-			ssKey >> sType;
-			if (sType == "namei") {
-				vector<unsigned char> vchName;
-				ssKey >> vchName;
-				leveldb::Slice slValue = pcursor->value();
-				CDataStream ssValue(slValue.data(),
-						slValue.data() + slValue.size(), SER_DISK,
-						CLIENT_VERSION);
-				vector<CAliasIndex> vtxPos;
-				ssValue >> vtxPos;
-				CAliasIndex txPos;
-				if (!vtxPos.empty())
-					txPos = vtxPos.back();
-				nameScan.push_back(make_pair(vchName, txPos));
-			}
-			if (nameScan.size() >= nMax)
-				break;
-
-			pcursor->Next();
-		} catch (std::exception &e) {
-			return error("%s() : deserialize error", __PRETTY_FUNCTION__);
-		}
-	}
-	delete pcursor;
-	return true;
+	return history.Scan(vchName, nMax, nameScan);
 }
 
-void rescanforaliases(CBlockIndex *pindexRescan) {
-	printf("Scanning blockchain for names to create fast index...\n");
-	paliasdb->ReconstructNameIndex(pindexRescan);
-}
+bool CAliasDB::ReconstructBlock(const CBlock &block, CBlockIndex *pindex) {
+	int nHeight = pindex->nHeight;
 
-bool CAliasDB::ReconstructNameIndex(CBlockIndex *pindexRescan) {
-	CDiskTxPos txindex;
-	CBlockIndex* pindex = pindexRescan;
-
-	{
-		TRY_LOCK(pwalletMain->cs_wallet, cs_trylock);
-		while (pindex) {
-			CBlock block;
-			block.ReadFromDisk(pindex);
-			int nHeight = pindex->nHeight;
-			uint256 txblkhash;
+	BOOST_FOREACH(const CTransaction& tx, block.vtx) {
 
-			BOOST_FOREACH(CTransaction& tx, block.vtx) {
-
-				if (tx.nVersion != SYSCOIN_TX_VERSION)
-					continue;
-
-				vector<vector<unsigned char> > vvchArgs;
-				int op, nOut;
+		if (tx.nVersion != SYSCOIN_TX_VERSION)
+			continue;
 
-				// decode the alias op
-				bool o = DecodeAliasTx(tx, op, nOut, vvchArgs, -1);
-				if (!o || !IsAliasOp(op))
-					continue;
-				if (op == OP_ALIAS_NEW)
-					continue;
+		vector<vector<unsigned char> > vvchArgs;
+		int op, nOut;
 
-				const vector<unsigned char> &vchName = vvchArgs[0];
-				const vector<unsigned char> &vchValue = vvchArgs[
-						op == OP_ALIAS_ACTIVATE ? 2 : 1];
-
-				if (!GetTransaction(tx.GetHash(), tx, txblkhash, true))
-					continue;
-
-				// if name exists in DB, read it to verify
-				vector<CAliasIndex> vtxPos;
-				if (ExistsAlias(vchName)) {
-					if (!ReadAlias(vchName, vtxPos))
-						return error(
-								"ReconstructNameIndex() : failed to read from alias DB");
-				}
+		// decode the alias op
+		bool o = DecodeAliasTx(tx, op, nOut, vvchArgs, -1);
+		if (!o || !IsAliasOp(op))
+			continue;
+		if (op == OP_ALIAS_NEW)
+			continue;
 
-				// rebuild the alias object, store to DB
-				CAliasIndex txName;
-				txName.nHeight = nHeight;
-				txName.vValue = vchValue;
-				txName.txHash = tx.GetHash();
+		const vector<unsigned char> &vchName = vvchArgs[0];
+		const vector<unsigned char> &vchValue = vvchArgs[
+				op == OP_ALIAS_ACTIVATE ? 2 : 1];
 
-				PutToAliasList(vtxPos, txName);
+		// rebuild the alias object, store to DB
+		CAliasIndex txName;
+		txName.nHeight = nHeight;
+		txName.vValue = vchValue;
+		txName.txHash = tx.GetHash();
 
-				if (!WriteName(vchName, vtxPos))
-					return error(
-							"ReconstructNameIndex() : failed to write to alias DB");
+		// get fees for txn and add them to regenerate list
+		int64 nTheFee = GetAliasNetFee(tx);
+		InsertAliasFee(pindex, tx.GetHash(), nTheFee);
 
-				// get fees for txn and add them to regenerate list
-				int64 nTheFee = GetAliasNetFee(tx);
-				InsertAliasFee(pindex, tx.GetHash(), nTheFee);
-				vector<CAliasFee> vAliasFees(lstAliasFees.begin(),
-					lstAliasFees.end());
-				if (!paliasdb->WriteAliasTxFees(vAliasFees))
-					return error(
-							"CheckOfferInputs() : failed to write fees to alias DB");
+		if (!WriteName(vchName, txName, aliasFeeWindow))
+			return error(
+					"ReconstructBlock() : failed to write to alias DB");
 
+		LogPrint(LOG_ALIAS, 
+				"RECONSTRUCT ALIAS: op=%s alias=%s value=%s hash=%s height=%d fees=%llu\n",
+				aliasFromOp(op).c_str(), stringFromVch(vchName).c_str(),
+				stringFromVch(vchValue).c_str(),
+				tx.GetHash().ToString().c_str(), nHeight,
+				nTheFee / COIN);
 
-				printf(
-						"RECONSTRUCT ALIAS: op=%s alias=%s value=%s hash=%s height=%d fees=%llu\n",
-						aliasFromOp(op).c_str(), stringFromVch(vchName).c_str(),
-						stringFromVch(vchValue).c_str(),
-						tx.GetHash().ToString().c_str(), nHeight,
-						nTheFee / COIN);
-
-			} /* TX */
-			pindex = pindex->pnext;
-		} /* BLOCK */
-		Flush();
-	} /* LOCK */
+	} /* TX */
 	return true;
 }
 
@@ -1068,11 +950,10 @@ bool GetValueOfAliasTxHash(const uint256 &txHash, vector<unsigned char>& vchValu
 
 bool GetValueOfName(CAliasDB& dbName, const vector<unsigned char> &vchName,
 		vector<unsigned char>& vchValue, int& nHeight) {
-	vector<CAliasIndex> vtxPos;
-	if (!paliasdb->ReadAlias(vchName, vtxPos) || vtxPos.empty())
+	CAliasIndex txPos;
+	if (!paliasdb->ReadAliasLast(vchName, txPos))
 		return false;
 
-	CAliasIndex& txPos = vtxPos.back();
 	nHeight = txPos.nHeight;
 	vchValue = txPos.vValue;
 	return true;
@@ -1080,10 +961,9 @@ bool GetValueOfName(CAliasDB& dbName, const vector<unsigned char> &vchName,
 
 bool GetTxOfAlias(CAliasDB& dbName, const vector<unsigned char> &vchName,
 		CTransaction& tx) {
-	vector<CAliasIndex> vtxPos;
-	if (!paliasdb->ReadAlias(vchName, vtxPos) || vtxPos.empty())
+	CAliasIndex txPos;
+	if (!paliasdb->ReadAliasLast(vchName, txPos))
 		return false;
-	CAliasIndex& txPos = vtxPos.back();
 	int nHeight = txPos.nHeight;
 	if (nHeight + GetAliasExpirationDepth(pindexBest->nHeight)
 			< pindexBest->nHeight) {
@@ -1132,17 +1012,15 @@ void GetAliasValue(const std::string& strName, std::string& strAddress) {
 			throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Alias not found");
 
 		// check for alias existence in DB
-		vector<CAliasIndex> vtxPos;
-		if (!paliasdb->ReadAlias(vchName, vtxPos))
+		CAliasIndex txPos;
+		if (!paliasdb->ReadAliasLast(vchName, txPos))
 			throw JSONRPCError(RPC_WALLET_ERROR,
 					"failed to read from alias DB");
-		if (vtxPos.size() < 1)
-			throw JSONRPCError(RPC_WALLET_ERROR, "no alias result returned");
 
 		// get transaction pointed to by alias
 		uint256 blockHash;
 		CTransaction tx;
-		uint256 txHash = vtxPos.back().txHash;
+		uint256 txHash = txPos.txHash;
 		if (!GetTransaction(txHash, tx, blockHash, true))
 			throw JSONRPCError(RPC_WALLET_ERROR,
 					"failed to read transaction from disk");
@@ -1231,11 +1109,10 @@ bool GetValueOfAliasTx(const CTransaction& tx, vector<unsigned char>& value) {
 	}
 }
 
-bool DecodeAliasTx(const CTransaction& tx, int& op, int& nOut,
-		vector<vector<unsigned char> >& vvch, int nHeight) {
+static bool DecodeAliasTxOutputs(const CTransaction& tx, int& op, int& nOut,
+		vector<vector<unsigned char> >& vvch) {
 	bool found = false;
 
-
 	// Strict check - bug disallowed
 	for (unsigned int i = 0; i < tx.vout.size(); i++) {
 		const CTxOut& out = tx.vout[i];
@@ -1253,6 +1130,21 @@ bool DecodeAliasTx(const CTransaction& tx, int& op, int& nOut,
 	return found;
 }
 
+bool DecodeAliasTx(const CTransaction& tx, int& op, int& nOut,
+		vector<vector<unsigned char> >& vvch, int nHeight) {
+	// other transactions are not worth hashing to look them up
+	if (tx.nVersion != SYSCOIN_TX_VERSION)
+		return DecodeAliasTxOutputs(tx, op, nOut, vvch);
+
+	uint256 hash = tx.GetHash();
+	CServiceTxDecode decode;
+	if (!aliasDecodeCache.Get(hash, decode)) {
+		decode.fFound = DecodeAliasTxOutputs(tx, decode.op, decode.nOut, decode.vvch);
+		aliasDecodeCache.Insert(hash, decode);
+	}
+	return decode.Get(op, nOut, vvch);
+}
+
 bool GetValueOfAliasTx(const CCoins& tx, vector<unsigned char>& value) {
 	vector<vector<unsigned char> > vvch;
 
@@ -1594,10 +1486,13 @@ Value aliaslist(const Array& params, bool fHelp) {
 	
 		vector<unsigned char> vchValue;
 		int nHeight;
-		BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet) {
-			// get txn hash, read txn index
-			hash = item.second.GetHash();
-			if (!GetTransaction(hash, tx, blockHash, true))
+		// only the wallet's transactions on aliases
+		vector<uint256> vHashes;
+		pwalletMain->ListServiceTxs(pwalletMain->mapAliasTxs, vchNameUniq, vHashes);
+		BOOST_FOREACH(const uint256& hashTx, vHashes) {
+			// get txn hash, read the wallet's copy
+			hash = hashTx;
+			if (!pwalletMain->GetServiceTx(hash, tx))
 				continue;
 
 			// skip non-syscoin txns
@@ -1630,36 +1525,32 @@ Value aliaslist(const Array& params, bool fHelp) {
 			if (vNamesI.find(vchName) != vNamesI.end() && (nHeight < vNamesI[vchName] || vNamesI[vchName] < 0))
 				continue;
 
-			// Read the database for the latest alias (vtxPos.back()) and ensure it is not transferred (isaliasmine).. 
+			// Read the database for the latest alias and ensure it is not transferred (isaliasmine).. 
 			// if it IS transferred then skip over this alias whenever it is found(above vNamesI check) in your mapwallet
 			// check for alias existence in DB
 			// will only read the alias from the db once per name to ensure that it is not mine.
-			vector<CAliasIndex> vtxPos;
-			if (vNamesI.find(vchName) == vNamesI.end() && paliasdb->ReadAlias(vchName, vtxPos))
+			CAliasIndex txPos;
+			if (vNamesI.find(vchName) == vNamesI.end() && paliasdb->ReadAliasLast(vchName, txPos))
 			{
-				if (vtxPos.size() > 0)
+				// get transaction pointed to by alias
+				uint256 txHash = txPos.txHash;
+				if(GetTransaction(txHash, dbtx, blockHash, true))
 				{
-					// get transaction pointed to by alias
-					uint256 txHash = vtxPos.back().txHash;
-					if(GetTransaction(txHash, dbtx, blockHash, true))
+				
+					nHeight = GetAliasTxHashHeight(txHash);
+					// Is the latest alais in the db transferred?
+					if(!IsAliasMine(dbtx))
+					{	
+						// by setting this to -1, subsequent aliases with the same name won't be read from disk (optimization) 
+						// because the latest alias tx doesn't belong to us anymore
+						vNamesI[vchName] = -1;
+						continue;
+					}
+					else
 					{
-					
-						nHeight = GetAliasTxHashHeight(txHash);
-						// Is the latest alais in the db transferred?
-						if(!IsAliasMine(dbtx))
-						{	
-							// by setting this to -1, subsequent aliases with the same name won't be read from disk (optimization) 
-							// because the latest alias tx doesn't belong to us anymore
-							vNamesI[vchName] = -1;
-							continue;
-						}
-						else
-						{
-							// get the value of the alias txn of the latest alias (from db)
-							GetValueOfAliasTx(dbtx, vchValue);
-						}
+						// get the value of the alias txn of the latest alias (from db)
+						GetValueOfAliasTx(dbtx, vchValue);
 					}
-					
 				}
 			}
 			else
@@ -1706,16 +1597,14 @@ Value aliasinfo(const Array& params, bool fHelp) {
 	{
 
 		// check for alias existence in DB
-		vector<CAliasIndex> vtxPos;
-		if (!paliasdb->ReadAlias(vchName, vtxPos))
+		CAliasIndex txPos;
+		if (!paliasdb->ReadAliasLast(vchName, txPos))
 			throw JSONRPCError(RPC_WALLET_ERROR,
 					"failed to read from alias DB");
-		if (vtxPos.size() < 1)
-			throw JSONRPCError(RPC_WALLET_ERROR, "no result returned");
 
 		// get transaction pointed to by alias
 		uint256 blockHash;
-		uint256 txHash = vtxPos.back().txHash;
+		uint256 txHash = txPos.txHash;
 		if (!GetTransaction(txHash, tx, blockHash, true))
 			throw JSONRPCError(RPC_WALLET_ERROR,
 					"failed to read transaction from disk");
@@ -1796,9 +1685,9 @@ Value aliashistory(const Array& params, bool fHelp) {
 				string strAddress = "";
 				GetAliasAddress(tx, strAddress);
 				oName.push_back(Pair("address", strAddress));
-	            oName.push_back(Pair("lastupdate_height", nHeight));
-	            oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
-	            oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
+				oName.push_back(Pair("lastupdate_height", nHeight));
+				oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
+				oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
 				if (nHeight + GetAliasDisplayExpirationDepth(nHeight)
 						- pindexBest->nHeight <= 0) {
 					oName.push_back(Pair("expired", 1));
@@ -1855,61 +1744,61 @@ Value aliasfilter(const Array& params, bool fHelp) {
 
 	Array oRes;
 
-	vector<unsigned char> vchName;
-	vector<pair<vector<unsigned char>, CAliasIndex> > nameScan;
-	if (!paliasdb->ScanNames(vchName, 100000000, nameScan))
-		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
+	// max age: only the aliases updated since nMinHeight are looked at
+	int64 nMinHeight = 0;
+	if (nMaxAge != 0)
+		nMinHeight = max((int64) 0, (int64) pindexBest->nHeight - nMaxAge + 1);
+	boost::scoped_ptr<CServiceHistory<CAliasIndex>::CScanCursor> pcursor(nMaxAge != 0
+			? paliasdb->NewUpdatedNameCursor(nMinHeight)
+			: paliasdb->NewNameCursor(vector<unsigned char>(), false));
 
-	pair<vector<unsigned char>, CAliasIndex> pairScan;
-	BOOST_FOREACH(pairScan, nameScan) {
-		string name = stringFromVch(pairScan.first);
-
-		// regexp
-		using namespace boost::xpressive;
-		smatch nameparts;
-		sregex cregex = sregex::compile(strRegexp);
-		if (strRegexp != "" && !regex_search(name, nameparts, cregex))
-			continue;
+	using namespace boost::xpressive;
+	sregex cregex;
+	if (strRegexp != "")
+		cregex = sregex::compile(strRegexp);
 
-		CAliasIndex txName = pairScan.second;
-		int nHeight = txName.nHeight;
+	vector<unsigned char> vchName;
+	try {
+		while (pcursor->NextName(vchName)) {
+			string name = stringFromVch(vchName);
 
-		// max age
-		if (nMaxAge != 0 && pindexBest->nHeight - nHeight >= nMaxAge)
-			continue;
+			// regexp
+			smatch nameparts;
+			if (strRegexp != "" && !regex_search(name, nameparts, cregex))
+				continue;
 
-		// from limits
-		nCountFrom++;
-		if (nCountFrom < nFrom + 1)
-			continue;
+			// from limits
+			nCountFrom++;
+			if (nCountFrom < nFrom + 1)
+				continue;
 
+			CAliasIndex txName;
+			if (!paliasdb->ReadAliasLast(vchName, txName))
+				continue;
+			int nHeight = txName.nHeight;
 
+			Object oName;
+			oName.push_back(Pair("name", name));
+			if (nHeight + GetAliasDisplayExpirationDepth(nHeight)
+					- pindexBest->nHeight <= 0) {
+				oName.push_back(Pair("expired", 1));
+			} else {
+				string value = stringFromVch(txName.vValue);
+				oName.push_back(Pair("value", value));
+				oName.push_back(Pair("txid", txName.txHash.GetHex()));
+				oName.push_back(Pair("lastupdate_height", nHeight));
+				oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
+				oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
+			}
+			oRes.push_back(oName);
 
-		Object oName;
-		oName.push_back(Pair("name", name));
-		CTransaction tx;
-		uint256 blockHash;
-		uint256 txHash = txName.txHash;
-		if ((nHeight + GetAliasDisplayExpirationDepth(nHeight)
-				- pindexBest->nHeight <= 0)
-				|| !GetTransaction(txHash, tx, blockHash, true)) {
-			oName.push_back(Pair("expired", 1));
-		} else {
-			vector<unsigned char> vchValue;
-			GetValueOfAliasTx(tx, vchValue);
-			string value = stringFromVch(vchValue);
-			oName.push_back(Pair("value", value));
-			oName.push_back(Pair("txid", txHash.GetHex()));
-            oName.push_back(Pair("lastupdate_height", nHeight));
-            oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
-            oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
+			nCountNb++;
+			// nb limits
+			if (nNb > 0 && nCountNb >= nNb)
+				break;
 		}
-		oRes.push_back(oName);
-
-		nCountNb++;
-		// nb limits
-		if (nNb > 0 && nCountNb >= nNb)
-			break;
+	} catch (std::exception &e) {
+		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
 	}
 
 	if (fStat) {
@@ -1929,13 +1818,17 @@ Value aliasfilter(const Array& params, bool fHelp) {
  * @return        [description]
  */
 Value aliasscan(const Array& params, bool fHelp) {
-	if (fHelp || 2 > params.size())
+	if (fHelp || 2 > params.size() || params.size() > 3)
 		throw runtime_error(
-				"aliasscan [<start-name>] [<max-returned>]\n"
-						"scan all aliases, starting at start-name and returning a maximum number of entries (default 500)\n");
+				"aliasscan [<start-name>] [<max-returned>] [<continuation>]\n"
+						"scan all aliases, starting at start-name and returning a maximum number of entries (default 500)\n"
+						"[continuation] : \"\" to start paging, or the continuation of the previous page; "
+						"returns {\"aliases\", \"continuation\"}, with an empty continuation after the last page\n");
 
 	vector<unsigned char> vchName;
 	int nMax = 500;
+	bool fPaged = false;
+	bool fAfter = false;
 	if (params.size() > 0)
 		vchName = vchFromValue(params[0]);
 	if (params.size() > 1) {
@@ -1943,40 +1836,61 @@ Value aliasscan(const Array& params, bool fHelp) {
 		ConvertTo<double>(vMax);
 		nMax = (int) vMax.get_real();
 	}
+	if (params.size() > 2) {
+		// the continuation is the last alias of the previous page
+		string strContinuation = params[2].get_str();
+		if (!IsHex(strContinuation) && strContinuation != "")
+			throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid continuation");
+		if (strContinuation != "") {
+			vchName = ParseHex(strContinuation);
+			fAfter = true;
+		}
+		fPaged = true;
+	}
 
 	Array oRes;
 
-	vector<pair<vector<unsigned char>, CAliasIndex> > nameScan;
-	if (!paliasdb->ScanNames(vchName, nMax, nameScan))
-		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
-
-	pair<vector<unsigned char>, CAliasIndex> pairScan;
-	BOOST_FOREACH(pairScan, nameScan) {
-		Object oName;
-		string name = stringFromVch(pairScan.first);
-		oName.push_back(Pair("name", name));
-		CTransaction tx;
-		CAliasIndex txName = pairScan.second;
-		uint256 blockHash;
+	boost::scoped_ptr<CServiceHistory<CAliasIndex>::CScanCursor> pcursor(paliasdb->NewNameCursor(vchName, fAfter));
+	vector<unsigned char> vchKeyName;
+	CAliasIndex txName;
+	bool fMore = false;
+	try {
+		while ((int) oRes.size() < nMax && (fMore = pcursor->Next(vchKeyName, txName))) {
+			Object oName;
+			string name = stringFromVch(vchKeyName);
+			oName.push_back(Pair("name", name));
 
-		int nHeight = txName.nHeight;
-		vector<unsigned char> vchValue = txName.vValue;
-		if ((nHeight + GetAliasDisplayExpirationDepth(nHeight)
-				- pindexBest->nHeight <= 0)
-				|| !GetTransaction(txName.txHash, tx, blockHash, true)) {
-			oName.push_back(Pair("expired", 1));
-		} else {
-			string value = stringFromVch(vchValue);
-			oName.push_back(Pair("txid", txName.txHash.GetHex()));
-			oName.push_back(Pair("value", value));
-            oName.push_back(Pair("lastupdate_height", nHeight));
-            oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
-            oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
+			int nHeight = txName.nHeight;
+			vector<unsigned char> vchValue = txName.vValue;
+			if (nHeight + GetAliasDisplayExpirationDepth(nHeight)
+					- pindexBest->nHeight <= 0) {
+				oName.push_back(Pair("expired", 1));
+			} else {
+				string value = stringFromVch(vchValue);
+				oName.push_back(Pair("txid", txName.txHash.GetHex()));
+				oName.push_back(Pair("value", value));
+				oName.push_back(Pair("lastupdate_height", nHeight));
+				oName.push_back(Pair("expires_on", nHeight + GetAliasDisplayExpirationDepth(nHeight)));
+				oName.push_back(Pair("expires_in", nHeight + GetAliasDisplayExpirationDepth(nHeight)- pindexBest->nHeight ));
+			}
+			oRes.push_back(oName);
+		}
+		// a full page only has a next one if there is an alias left
+		if (fMore) {
+			CAliasIndex txNext;
+			vector<unsigned char> vchNext;
+			fMore = pcursor->Next(vchNext, txNext);
 		}
-		oRes.push_back(oName);
+	} catch (std::exception &e) {
+		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
 	}
 
-	return oRes;
+	if (!fPaged)
+		return oRes;
+	Object oPage;
+	oPage.push_back(Pair("aliases", oRes));
+	oPage.push_back(Pair("continuation", fMore ? HexStr(vchKeyName) : string()));
+	return oPage;
 }
 
 void UnspendInputs(CWalletTx& wtx) {
@@ -1998,6 +1912,7 @@ void UnspendInputs(CWalletTx& wtx) {
 		if (prev.vfSpent[nOut]) {
 			prev.vfSpent[nOut] = false;
 			prev.fAvailableCreditCached = false;
+			pwalletMain->IndexUnspent(txin.prevout.hash, prev);
 			prev.WriteToDisk();
 		}
 #ifdef GUI
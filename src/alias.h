@@ -2,7 +2,9 @@
 #define NAMEDB_H
 
 #include "bitcoinrpc.h"
-#include "leveldb.h"
+#include "servicedb.h"
+#include "feewindow.h"
+#include "servicehistory.h"
 
 class CAliasIndex {
 public:
@@ -83,33 +85,71 @@ public:
         return !(a == b);
     }
 };
-extern std::list<CAliasFee> lstAliasFees;
+extern CFeeWindow aliasFeeWindow;
+
+class CAliasDB : public CServiceDB {
+private:
+	// one record per alias version, plus the height of the latest one
+	CServiceHistory<CAliasIndex> history;
 
-class CAliasDB : public CLevelDB {
 public:
-    CAliasDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB(GetDataDir() / "aliases", nCacheSize, fMemory, fWipe) {
+    CAliasDB(size_t nCacheSize, bool fMemory, bool fWipe) : CServiceDB(GetDataDir() / "aliases", nCacheSize, fMemory, fWipe),
+        history(*this, "namev", "namel", "namei", "nameu") {
     }
 
-	bool WriteName(const std::vector<unsigned char>& name, std::vector<CAliasIndex>& vtxPos) {
-		return Write(make_pair(std::string("namei"), name), vtxPos);
+	bool WriteName(const std::vector<unsigned char>& name, const CAliasIndex& txPos, CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		history.Write(batch, name, txPos);
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
 
-	bool EraseName(const std::vector<unsigned char>& name) {
-	    return Erase(make_pair(std::string("namei"), name));
+	// drop the latest versions of name written by txHash
+	bool PopName(const std::vector<unsigned char>& name, const uint256& txHash, CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		if (!history.Pop(batch, name, txHash))
+			return false;
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
+
 	bool ReadAlias(const std::vector<unsigned char>& name, std::vector<CAliasIndex>& vtxPos) {
-		return Read(make_pair(std::string("namei"), name), vtxPos);
+		return history.ReadAll(name, vtxPos);
+	}
+	bool ReadAliasLast(const std::vector<unsigned char>& name, CAliasIndex& txPos) {
+		return history.ReadLatest(name, txPos);
 	}
 	bool ExistsAlias(const std::vector<unsigned char>& name) {
-	    return Exists(make_pair(std::string("namei"), name));
+	    return history.Exists(name);
+	}
+
+	// walk the aliases updated at nMinHeight or later, in name order
+	CServiceHistory<CAliasIndex>::CScanCursor *NewUpdatedNameCursor(uint64 nMinHeight) {
+		return new CServiceHistory<CAliasIndex>::CScanCursor(history, nMinHeight);
+	}
+
+	// aliases used to keep their whole history in one vector, and were
+	// not indexed by update height
+	bool UpgradeAliasIndex() {
+		return history.Upgrade();
 	}
 
-	bool WriteAliasTxFees(std::vector<CAliasFee>& vtxPos) {
-		return Write(std::string("nametxf"), vtxPos);
+	bool WriteAliasTxFees(CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
-	bool ReadAliasTxFees(std::vector<CAliasFee>& vtxPos) {
+
+	// fees used to be stored as one vector under a single key
+	bool ReadLegacyAliasTxFees(std::vector<CAliasFee>& vtxPos) {
 		return Read(std::string("nametxf"), vtxPos);
 	}
+	bool UpgradeAliasTxFees(CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		fees.WriteChanges(batch);
+		batch.Erase(std::string("nametxf"));
+		return WriteBatch(batch);
+	}
 
     bool WriteAliasIndex(std::vector<std::vector<unsigned char> >& vtxIndex) {
         return Write(std::string("namendx"), vtxIndex);
@@ -123,7 +163,13 @@ public:
             unsigned int nMax,
             std::vector<std::pair<std::vector<unsigned char>, CAliasIndex> >& nameScan);
 
-    bool ReconstructNameIndex(CBlockIndex *pindexRescan);
+    // walk the aliases in name order from vchName, or from just after it
+    CServiceHistory<CAliasIndex>::CScanCursor *NewNameCursor(const std::vector<unsigned char>& vchName, bool fAfter) {
+        return new CServiceHistory<CAliasIndex>::CScanCursor(history, vchName, fAfter);
+    }
+
+    // replay the operations of one block during a rescan
+    bool ReconstructBlock(const CBlock &block, CBlockIndex *pindex);
 };
 
 
@@ -147,6 +193,18 @@ bool CheckAliasInputs(
     CBlockIndex *pindex, const CTransaction &tx, CValidationState &state,
 	CCoinsViewCache &inputs, std::map<std::vector<unsigned char>,uint256> &mapTestPool, 
     bool fBlock, bool fMiner, bool fJustCheck);
+/** The checks of CheckAliasInputs() that only read the transaction, the
+ *  coins it spends and the chain; safe to run off the main thread. */
+bool VerifyAliasInputs(
+    CBlockIndex *pindex, const CTransaction &tx, CValidationState &state,
+    CCoinsViewCache &inputs, std::map<std::vector<unsigned char>,uint256> &mapTestPool,
+    bool fBlock, bool fMiner, bool fJustCheck);
+/** The alias DB writes of CheckAliasInputs(), for a transaction that
+ *  VerifyAliasInputs() accepts. */
+bool ConnectAliasInputs(
+    CBlockIndex *pindex, const CTransaction &tx, CCoinsViewCache &inputs,
+    std::map<std::vector<unsigned char>,uint256> &mapTestPool,
+    bool fBlock, bool fMiner, bool fJustCheck);
 bool ExtractAliasAddress(const CScript& script, std::string& address);
 bool IsAliasMine(const CTransaction& tx);
 bool IsAliasMine2(const CTransaction& tx);
@@ -181,5 +239,6 @@ bool IsAliasOp(int op);
 int GetAliasDisplayExpirationDepth(int nHeight);
 void UnspendInputs(CWalletTx& wtx);
 bool RemoveAliasFee(CAliasFee &txnVal);
+bool LoadAliasFees(unsigned int nHeight);
 
 #endif // NAMEDB_H
@@ -0,0 +1,101 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_BLOCKCACHE_H
+#define SYSCOIN_BLOCKCACHE_H
+
+#include "uint256.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+class CBlock;
+
+/** Deserialized blocks, keyed by block hash, so that blocks read again and
+ *  again (the recent ones, mostly) are handed out without going to disk.
+ *  Blocks are kept until their serialized sizes add up to more than
+ *  nMaxBytes, dropping the least recently used first. Blocks are shared
+ *  between threads, so the merkle tree of a block must be built before it
+ *  is inserted, and nothing may call BuildMerkleTree() on it after. */
+class CBlockCache
+{
+private:
+    struct CEntry
+    {
+        boost::shared_ptr<const CBlock> pblock;
+        unsigned int nBytes;
+        std::list<uint256>::iterator it;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<uint256, CEntry> mapBlocks;
+    // most recently used first
+    std::list<uint256> listUsed;
+    uint64 nBytes;
+    uint64 nMaxBytes;
+    // lookups that found the block, and that did not
+    uint64 nHits;
+    uint64 nMisses;
+
+public:
+    CBlockCache(uint64 nMaxBytesIn) : nBytes(0), nMaxBytes(nMaxBytesIn), nHits(0), nMisses(0) {}
+
+    /** The block with hash, or NULL; counted in the hit rate. */
+    boost::shared_ptr<const CBlock> Lookup(const uint256 &hash) {
+        LOCK(cs);
+        std::map<uint256, CEntry>::iterator mi = mapBlocks.find(hash);
+        if (mi == mapBlocks.end()) {
+            nMisses++;
+            return boost::shared_ptr<const CBlock>();
+        }
+        nHits++;
+        listUsed.splice(listUsed.begin(), listUsed, mi->second.it);
+        return mi->second.pblock;
+    }
+
+    /** Keep pblock, whose serialized size is nBlockBytes, as the most
+     *  recently used block. */
+    void Insert(const uint256 &hash, const boost::shared_ptr<const CBlock> &pblock, unsigned int nBlockBytes) {
+        LOCK(cs);
+        if (nBlockBytes > nMaxBytes)
+            return;
+        std::map<uint256, CEntry>::iterator mi = mapBlocks.find(hash);
+        if (mi != mapBlocks.end()) {
+            listUsed.splice(listUsed.begin(), listUsed, mi->second.it);
+            return;
+        }
+        while (nBytes + nBlockBytes > nMaxBytes) {
+            std::map<uint256, CEntry>::iterator miOld = mapBlocks.find(listUsed.back());
+            nBytes -= miOld->second.nBytes;
+            mapBlocks.erase(miOld);
+            listUsed.pop_back();
+        }
+        listUsed.push_front(hash);
+        CEntry &entry = mapBlocks[hash];
+        entry.pblock = pblock;
+        entry.nBytes = nBlockBytes;
+        entry.it = listUsed.begin();
+        nBytes += nBlockBytes;
+    }
+
+    void Clear() {
+        LOCK(cs);
+        mapBlocks.clear();
+        listUsed.clear();
+        nBytes = 0;
+    }
+
+    void GetStats(unsigned int &nSize, uint64 &nBytesOut, uint64 &nMaxBytesOut, uint64 &nHitsOut, uint64 &nMissesOut) const {
+        LOCK(cs);
+        nSize = mapBlocks.size();
+        nBytesOut = nBytes;
+        nMaxBytesOut = nMaxBytes;
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+#endif
@@ -5,11 +5,13 @@
 #include "auxpow.h"
 #include "script.h"
 #include "main.h"
+#include "decodecache.h"
 
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_writer_template.h"
 
 #include <boost/xpressive/xpressive_dynamic.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -20,7 +22,13 @@ std::map<std::vector<unsigned char>, uint256> mapMyCertIssuers;
 std::map<std::vector<unsigned char>, uint256> mapMyCertItems;
 std::map<std::vector<unsigned char>, std::set<uint256> > mapCertIssuerPending;
 std::map<std::vector<unsigned char>, std::set<uint256> > mapCertItemPending;
-std::list<CCertFee> lstCertIssuerFees;
+CFeeWindow certFeeWindow;
+// cert ops and decoded cert issuers of recent Syscoin transactions
+static CDecodeCache<CServiceTxDecode> certDecodeCache(10000);
+static CDecodeCache<CCertIssuer> certPayloadCache(1000);
+
+// span of the long fee subsidy window, in seconds
+static const unsigned int CERT_FEE_WINDOW = 360 * 12;
 
 #ifdef GUI
 extern std::map<uint160, std::vector<unsigned char> > mapMyCertIssuerHashes;
@@ -127,24 +135,37 @@ string certissuerFromOp(int op) {
 }
 
 bool CCertIssuer::UnserializeFromTx(const CTransaction &tx) {
+    uint256 hash = tx.GetHash();
+    if (certPayloadCache.Get(hash, *this))
+        return true;
     try {
-        CDataStream dsCertIssuer(vchFromString(DecodeBase64(stringFromVch(tx.data))), SER_NETWORK, PROTOCOL_VERSION);
-        dsCertIssuer >> *this;
+        if (tx.IsBinaryData()) {
+            // parsed in place, after the version byte
+            const char *pbegin = (const char*) &tx.data[0];
+            CDataStream dsCertIssuer(pbegin + 1, pbegin + tx.data.size(), SER_NETWORK, PROTOCOL_VERSION);
+            dsCertIssuer >> *this;
+        } else {
+            CDataStream dsCertIssuer(vchFromString(DecodeBase64(stringFromVch(tx.data))), SER_NETWORK, PROTOCOL_VERSION);
+            dsCertIssuer >> *this;
+        }
     } catch (std::exception &e) {
         return false;
     }
+    certPayloadCache.Insert(hash, *this);
     return true;
 }
 
-void CCertIssuer::SerializeToTx(CTransaction &tx) {
-    vector<unsigned char> vchData = vchFromString(SerializeToString());
+void CCertIssuer::SerializeToTx(CTransaction &tx, int nHeight) {
+    vector<unsigned char> vchData = vchFromString(SerializeToString(nHeight));
     tx.data = vchData;
 }
 
-string CCertIssuer::SerializeToString() {
+string CCertIssuer::SerializeToString(int nHeight) {
     // serialize certissuer object
     CDataStream dsCertIssuer(SER_NETWORK, PROTOCOL_VERSION);
     dsCertIssuer << *this;
+    if (nHeight >= GetBinaryPayloadStartBlock())
+        return string(1, (char) SYSCOIN_PAYLOAD_BINARY) + string(dsCertIssuer.begin(), dsCertIssuer.end());
     vector<unsigned char> vchData(dsCertIssuer.begin(), dsCertIssuer.end());
     return EncodeBase64(vchData.data(), vchData.size());
 }
@@ -152,165 +173,98 @@ string CCertIssuer::SerializeToString() {
 //TODO implement
 bool CCertDB::ScanCertIssuers(const std::vector<unsigned char>& vchCertIssuer, unsigned int nMax,
         std::vector<std::pair<std::vector<unsigned char>, CCertIssuer> >& certissuerScan) {
-
-    leveldb::Iterator *pcursor = pcertdb->NewIterator();
-
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair(string("certissueri"), vchCertIssuer);
-    string sType;
-    pcursor->Seek(ssKeySet.str());
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-
-            ssKey >> sType;
-            if(sType == "certissueri") {
-                vector<unsigned char> vchCertIssuer;
-                ssKey >> vchCertIssuer;
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                vector<CCertIssuer> vtxPos;
-                ssValue >> vtxPos;
-                CCertIssuer txPos;
-                if (!vtxPos.empty())
-                    txPos = vtxPos.back();
-                certissuerScan.push_back(make_pair(vchCertIssuer, txPos));
-            }
-            if (certissuerScan.size() >= nMax)
-                break;
-
-            pcursor->Next();
-        } catch (std::exception &e) {
-            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
-        }
-    }
-    delete pcursor;
-    return true;
+    return history.Scan(vchCertIssuer, nMax, certissuerScan);
 }
 
-/**
- * [CCertDB::ReconstructCertIndex description]
- * @param  pindexRescan [description]
- * @return              [description]
- */
-bool CCertDB::ReconstructCertIndex(CBlockIndex *pindexRescan) {
-    CBlockIndex* pindex = pindexRescan;
+bool CCertDB::ReconstructBlock(const CBlock &block, CBlockIndex *pindex) {
+    int nHeight = pindex->nHeight;
 
-    {
-    TRY_LOCK(pwalletMain->cs_wallet, cs_trylock);
-    while (pindex) {
-
-        int nHeight = pindex->nHeight;
-        CBlock block;
-        block.ReadFromDisk(pindex);
-        uint256 txblkhash;
-
-        BOOST_FOREACH(CTransaction& tx, block.vtx) {
-
-            if (tx.nVersion != SYSCOIN_TX_VERSION)
-                continue;
-
-            vector<vector<unsigned char> > vvchArgs;
-            int op, nOut;
-
-            // decode the certissuer op, params, height
-            bool o = DecodeCertTx(tx, op, nOut, vvchArgs, nHeight);
-            if (!o || !IsCertOp(op)) continue;
-            if (op == OP_CERTISSUER_NEW) continue;
-
-            vector<unsigned char> vchCertIssuer = vvchArgs[0];
-
-            // get the transaction
-            if(!GetTransaction(tx.GetHash(), tx, txblkhash, true))
-                continue;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
 
-            // attempt to read certissuer from txn
-            CCertIssuer txCertIssuer;
-            CCertItem txCA;
-            if(!txCertIssuer.UnserializeFromTx(tx))
-                return error("ReconstructCertIndex() : failed to unserialize certissuer from tx");
-
-            // save serialized certissuer
-            CCertIssuer serializedCertIssuer = txCertIssuer;
-
-            // read certissuer from DB if it exists
-            vector<CCertIssuer> vtxPos;
-            if (ExistsCertIssuer(vchCertIssuer)) {
-                if (!ReadCertIssuer(vchCertIssuer, vtxPos))
-                    return error("ReconstructCertIndex() : failed to read certissuer from DB");
-                if(vtxPos.size()!=0) {
-                    txCertIssuer.nHeight = nHeight;
-                    txCertIssuer.GetCertFromList(vtxPos);
-                }
-            }
-
-            // read the certissuer certitem from db if exists
-            if(op == OP_CERT_NEW || op == OP_CERT_TRANSFER) {
-                bool bReadCertIssuer = false;
-                vector<unsigned char> vchCertItem = vvchArgs[1];
-                if (ExistsCertItem(vchCertItem)) {
-                    if (!ReadCertItem(vchCertItem, vchCertIssuer))
-                        printf("ReconstructCertIndex() : warning - failed to read certissuer certitem from certissuer DB\n");
-                    else bReadCertIssuer = true;
-                }
-                if(!bReadCertIssuer && !txCertIssuer.GetCertItemByHash(vchCertItem, txCA))
-                    printf("ReconstructCertIndex() : failed to read certissuer certitem from certissuer\n");
-
-                // add txn-specific values to certissuer certitem object
-                txCA.vchRand = vvchArgs[1];
-                txCA.nTime = pindex->nTime;
-                txCA.txHash = tx.GetHash();
-                txCA.nHeight = nHeight;
-                txCertIssuer.PutCertItem(txCA);
-            }
+        if (tx.nVersion != SYSCOIN_TX_VERSION)
+            continue;
 
-            // use the txn certissuer as master on updates,
-            // but grab the certitems from the DB first
-            if(op == OP_CERTISSUER_UPDATE) {
-                serializedCertIssuer.certs = txCertIssuer.certs;
-                txCertIssuer = serializedCertIssuer;
+        vector<vector<unsigned char> > vvchArgs;
+        int op, nOut;
+
+        // decode the certissuer op, params, height
+        bool o = DecodeCertTx(tx, op, nOut, vvchArgs, nHeight);
+        if (!o || !IsCertOp(op)) continue;
+        if (op == OP_CERTISSUER_NEW) continue;
+
+        vector<unsigned char> vchCertIssuer = vvchArgs[0];
+
+        // attempt to read certissuer from txn
+        CCertIssuer txCertIssuer;
+        CCertItem txCA;
+        if(!txCertIssuer.UnserializeFromTx(tx))
+            return error("ReconstructBlock() : failed to unserialize certissuer from tx");
+
+        // save serialized certissuer
+        CCertIssuer serializedCertIssuer = txCertIssuer;
+
+        // read the certissuer version at this height, or the latest, from DB if it exists
+        CCertIssuer dbCertIssuer;
+        if (ReadCertIssuerAt(vchCertIssuer, nHeight, dbCertIssuer))
+            txCertIssuer = dbCertIssuer;
+
+        // read the certissuer certitem from db if exists
+        if(op == OP_CERT_NEW || op == OP_CERT_TRANSFER) {
+            bool bReadCertIssuer = false;
+            vector<unsigned char> vchCertItem = vvchArgs[1];
+            if (ExistsCertItem(vchCertItem)) {
+                if (!ReadCertItem(vchCertItem, vchCertIssuer))
+                    LogPrint(LOG_CERT, "ReconstructBlock() : warning - failed to read certissuer certitem from certissuer DB\n");
+                else bReadCertIssuer = true;
             }
+            if(!bReadCertIssuer && !txCertIssuer.GetCertItemByHash(vchCertItem, txCA))
+                LogPrint(LOG_CERT, "ReconstructBlock() : failed to read certissuer certitem from certissuer\n");
+
+            // add txn-specific values to certissuer certitem object
+            txCA.vchRand = vvchArgs[1];
+            txCA.nTime = pindex->nTime;
+            txCA.txHash = tx.GetHash();
+            txCA.nHeight = nHeight;
+            txCertIssuer.PutCertItem(txCA);
+        }
 
-            if(op != OP_CERTISSUER_NEW) {
-                // txn-specific values to certissuer object
-                txCertIssuer.vchRand = vvchArgs[0];
-                txCertIssuer.txHash = tx.GetHash();
-                txCertIssuer.nHeight = nHeight;
-                txCertIssuer.nTime = pindex->nTime;
-                txCertIssuer.PutToCertIssuerList(vtxPos);
+        // use the txn certissuer as master on updates,
+        // but grab the certitems from the DB first
+        if(op == OP_CERTISSUER_UPDATE) {
+            serializedCertIssuer.certs = txCertIssuer.certs;
+            txCertIssuer = serializedCertIssuer;
+        }
 
-                if (!WriteCertIssuer(vchCertIssuer, vtxPos))
-                    return error("ReconstructCertIndex() : failed to write to certissuer DB");
-            }
+        if(op != OP_CERTISSUER_NEW) {
+            // txn-specific values to certissuer object
+            txCertIssuer.vchRand = vvchArgs[0];
+            txCertIssuer.txHash = tx.GetHash();
+            txCertIssuer.nHeight = nHeight;
+            txCertIssuer.nTime = pindex->nTime;
 
-            if(op == OP_CERT_NEW || op == OP_CERT_TRANSFER)
-                if (!WriteCertItem(vvchArgs[1], vvchArgs[0]))
-                    return error("ReconstructCertIndex() : failed to write to certissuer DB");
-
-            // insert certissuers fees to regenerate list, write certissuer to
-            // master index
-            int64 nTheFee = GetCertNetFee(tx);
-            InsertCertFee(pindex, tx.GetHash(), nTheFee);
-			vector<CCertFee> vCertFees(lstCertIssuerFees.begin(),
-				lstCertIssuerFees.end());
-			if (!pcertdb->WriteCertFees(vCertFees))
-				return error("CheckOfferInputs() : failed to write fees to alias DB");
-
-
-            printf( "RECONSTRUCT CERT: op=%s certissuer=%s title=%s hash=%s height=%d fees=%llu\n",
-                    certissuerFromOp(op).c_str(),
-                    stringFromVch(vvchArgs[0]).c_str(),
-                    stringFromVch(txCertIssuer.vchTitle).c_str(),
-                    tx.GetHash().ToString().c_str(),
-                    nHeight,
-                    nTheFee);
+            if (!WriteCertIssuer(vchCertIssuer, txCertIssuer, certFeeWindow))
+                return error("ReconstructBlock() : failed to write to certissuer DB");
         }
-        pindex = pindex->pnext;
-        Flush();
-    }
+
+        if(op == OP_CERT_NEW || op == OP_CERT_TRANSFER)
+            if (!WriteCertItem(vvchArgs[1], vvchArgs[0]))
+                return error("ReconstructBlock() : failed to write to certissuer DB");
+
+        // insert certissuers fees to regenerate list, write certissuer to
+        // master index
+        int64 nTheFee = GetCertNetFee(tx);
+        InsertCertFee(pindex, tx.GetHash(), nTheFee);
+		if (!WriteCertFees(certFeeWindow))
+			return error("ReconstructBlock() : failed to write fees to certissuer DB");
+
+
+        LogPrint(LOG_CERT, "RECONSTRUCT CERT: op=%s certissuer=%s title=%s hash=%s height=%d fees=%llu\n",
+                certissuerFromOp(op).c_str(),
+                stringFromVch(vvchArgs[0]).c_str(),
+                stringFromVch(txCertIssuer.vchTitle).c_str(),
+                tx.GetHash().ToString().c_str(),
+                nHeight,
+                nTheFee);
     }
     return true;
 }
@@ -334,79 +288,36 @@ int GetCertTxHashHeight(const uint256 txHash) {
 }
 
 uint64 GetCertFeeSubsidy(unsigned int nHeight) {
-
-    unsigned int h12 = 360 * 12;
-    unsigned int nTargetTime = 0;
-    unsigned int nTarget1hrTime = 0;
-    unsigned int blk1hrht = nHeight - 1;
-    unsigned int blk12hrht = nHeight - 1;
-    bool bFound = false;
-    uint64 hr1 = 1, hr12 = 1;
-
-    BOOST_FOREACH(CCertFee &nmFee, lstCertIssuerFees) {
-        if(nmFee.nHeight <= nHeight)
-            bFound = true;
-        if(bFound) {
-            if(nTargetTime==0) {
-                hr1 = hr12 = 0;
-                nTargetTime = nmFee.nTime - h12;
-                nTarget1hrTime = nmFee.nTime - (h12/12);
-            }
-            if(nmFee.nTime > nTargetTime) {
-                hr12 += nmFee.nFee;
-                blk12hrht = nmFee.nHeight;
-                if(nmFee.nTime > nTarget1hrTime) {
-                    hr1 += nmFee.nFee;
-                    blk1hrht = nmFee.nHeight;
-                }
-            }
-        }
-    }
-    hr12 /= (nHeight - blk12hrht) + 1;
-    hr1 /= (nHeight - blk1hrht) + 1;
-    uint64 nSubsidyOut = hr1 > hr12 ? hr1 : hr12;
-    return nSubsidyOut;
+	uint64 hr1 = 1, hr12 = 1;
+	certFeeWindow.GetWindowAverages(nHeight, CERT_FEE_WINDOW, hr1, hr12);
+	uint64 nSubsidyOut = hr1 > hr12 ? hr1 : hr12;
+	return nSubsidyOut;
 }
 
 bool RemoveCertFee(CCertFee &txnVal) {
-	TRY_LOCK(cs_main, cs_trymain);
-
-	CCertFee *theval = NULL;
-
-	BOOST_FOREACH(CCertFee &nmTxnValue, lstCertIssuerFees) {
-		if (txnVal.hash == nmTxnValue.hash
-		 && txnVal.nHeight == nmTxnValue.nHeight) {
-			theval = &nmTxnValue;
-			break;
-		}
-	}
-
-	if(theval)
-		lstCertIssuerFees.remove(*theval);
-
-	return theval != NULL;
+	return certFeeWindow.Remove(txnVal.hash, txnVal.nHeight);
 }
 
 bool InsertCertFee(CBlockIndex *pindex, uint256 hash, uint64 nValue) {
-	TRY_LOCK(cs_main, cs_trymain);
-    list<CCertFee> txnDup;
-    CCertFee oFee;
-    oFee.nTime = pindex->nTime;
-    oFee.nHeight = pindex->nHeight;
-    oFee.nFee = nValue;
-    bool bFound = false;
-
-    BOOST_FOREACH(CCertFee &nmFee, lstCertIssuerFees) {
-        if (oFee.hash == nmFee.hash
-                && oFee.nHeight == nmFee.nHeight) {
-            bFound = true;
-            break;
-        }
-    }
-    if (!bFound)
-        lstCertIssuerFees.push_front(oFee);
+	// cert fees have always been tracked by height alone (one per block),
+	// the first fee seen at a height is kept
+	return certFeeWindow.Insert(
+			CFeeWindowEntry(0, pindex->nHeight, pindex->nTime, nValue), false);
+}
 
-    return bFound;
+bool LoadCertFees(unsigned int nHeight) {
+	certFeeWindow.Attach(pcertdb, "certfee");
+
+	vector<CCertFee> vFees;
+	if (pcertdb->ReadLegacyCertFees(vFees)) {
+		printf("LoadCertFees() : upgrading %"PRIszu" cert fees to per-record storage\n", vFees.size());
+		certFeeWindow.clear();
+		BOOST_REVERSE_FOREACH(const CCertFee &fee, vFees)
+			certFeeWindow.push_back(
+					CFeeWindowEntry(fee.hash, fee.nHeight, fee.nTime, fee.nFee));
+		return pcertdb->UpgradeCertFees(certFeeWindow);
+	}
+	return certFeeWindow.Load(nHeight, FEE_WINDOW_LOAD_DEPTH, CERT_FEE_WINDOW);
 }
 
 int64 GetCertNetFee(const CTransaction& tx) {
@@ -420,12 +331,10 @@ int64 GetCertNetFee(const CTransaction& tx) {
 }
 
 int GetCertHeight(vector<unsigned char> vchCertIssuer) {
-    vector<CCertIssuer> vtxPos;
+    CCertIssuer txPos;
     if (pcertdb->ExistsCertIssuer(vchCertIssuer)) {
-        if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos))
-            return error("GetCertHeight() : failed to read from certissuer DB");
-        if (vtxPos.empty()) return -1;
-        CCertIssuer& txPos = vtxPos.back();
+        if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, txPos))
+            return -1;
         return txPos.nHeight;
     }
     return -1;
@@ -527,7 +436,7 @@ bool IsCertMine(const CTransaction& tx) {
 
     const CTxOut& txout = tx.vout[nOut];
     if (IsMyCert(tx, txout)) {
-        printf("IsCertMine() : found my transaction %s nout %d\n",
+        LogPrint(LOG_CERT, "IsCertMine() : found my transaction %s nout %d\n",
                 tx.GetHash().GetHex().c_str(), nOut);
         return true;
     }
@@ -553,7 +462,7 @@ bool IsCertMine(const CTransaction& tx, const CTxOut& txout,
         return false;
 
     if (IsMyCert(tx, txout)) {
-        printf("IsCertMine() : found my transaction %s value %d\n",
+        LogPrint(LOG_CERT, "IsCertMine() : found my transaction %s value %d\n",
                 tx.GetHash().GetHex().c_str(), (int) txout.nValue);
         return true;
     }
@@ -575,11 +484,10 @@ bool GetValueOfCertIssuerTxHash(const uint256 &txHash,
 
 bool GetValueOfCertIssuer(CCertDB& dbCert, const vector<unsigned char> &vchCertIssuer,
         vector<unsigned char>& vchValue, int& nHeight) {
-    vector<CCertIssuer> vtxPos;
-    if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos) || vtxPos.empty())
+    CCertIssuer txPos;
+    if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, txPos))
         return false;
 
-    CCertIssuer& txPos = vtxPos.back();
     nHeight = txPos.nHeight;
     vchValue = txPos.vchRand;
     return true;
@@ -587,10 +495,9 @@ bool GetValueOfCertIssuer(CCertDB& dbCert, const vector<unsigned char> &vchCertI
 
 bool GetTxOfCertIssuer(CCertDB& dbCert, const vector<unsigned char> &vchCertIssuer,
         CTransaction& tx) {
-    vector<CCertIssuer> vtxPos;
-    if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos) || vtxPos.empty())
+    CCertIssuer txPos;
+    if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, txPos))
         return false;
-    CCertIssuer& txPos = vtxPos.back();
     int nHeight = txPos.nHeight;
     if (nHeight + GetCertExpirationDepth(pindexBest->nHeight)
             < pindexBest->nHeight) {
@@ -608,11 +515,9 @@ bool GetTxOfCertIssuer(CCertDB& dbCert, const vector<unsigned char> &vchCertIssu
 
 bool GetTxOfCertItem(CCertDB& dbCert, const vector<unsigned char> &vchCertItem,
         CCertIssuer &txPos, CTransaction& tx) {
-    vector<CCertIssuer> vtxPos;
     vector<unsigned char> vchCertIssuer;
     if (!pcertdb->ReadCertItem(vchCertItem, vchCertIssuer)) return false;
-    if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos)) return false;
-    txPos = vtxPos.back();
+    if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, txPos)) return false;
     int nHeight = txPos.nHeight;
     if (nHeight + GetCertExpirationDepth(pindexBest->nHeight)
             < pindexBest->nHeight) {
@@ -628,11 +533,10 @@ bool GetTxOfCertItem(CCertDB& dbCert, const vector<unsigned char> &vchCertItem,
     return true;
 }
 
-bool DecodeCertTx(const CTransaction& tx, int& op, int& nOut,
-        vector<vector<unsigned char> >& vvch, int nHeight) {
+static bool DecodeCertTxOutputs(const CTransaction& tx, int& op, int& nOut,
+        vector<vector<unsigned char> >& vvch) {
     bool found = false;
 
-
     // Strict check - bug disallowed
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& out = tx.vout[i];
@@ -643,7 +547,22 @@ bool DecodeCertTx(const CTransaction& tx, int& op, int& nOut,
         }
     }
     if (!found) vvch.clear();
-    return found && IsCertOp(op);
+    return found;
+}
+
+bool DecodeCertTx(const CTransaction& tx, int& op, int& nOut,
+        vector<vector<unsigned char> >& vvch, int nHeight) {
+    // other transactions are not worth hashing to look them up
+    if (tx.nVersion != SYSCOIN_TX_VERSION)
+        return DecodeCertTxOutputs(tx, op, nOut, vvch) && IsCertOp(op);
+
+    uint256 hash = tx.GetHash();
+    CServiceTxDecode decode;
+    if (!certDecodeCache.Get(hash, decode)) {
+        decode.fFound = DecodeCertTxOutputs(tx, decode.op, decode.nOut, decode.vvch);
+        certDecodeCache.Insert(hash, decode);
+    }
+    return decode.Get(op, nOut, vvch) && IsCertOp(op);
 }
 
 bool GetValueOfCertIssuerTx(const CCoins& tx, vector<unsigned char>& value) {
@@ -974,17 +893,17 @@ CScript RemoveCertIssuerScriptPrefix(const CScript& scriptIn) {
     if (!DecodeCertScript(scriptIn, op, vvch, pc))
         //throw runtime_error(
         //        "RemoveCertIssuerScriptPrefix() : could not decode certissuer script");
-	printf ("RemoveCertIssuerScriptPrefix() : Could not decode certissuer script (softfail). This is is known to happen for some OPs annd prevents those from getting displayed or accounted for.");
+	LogPrint(LOG_CERT, "RemoveCertIssuerScriptPrefix() : Could not decode certissuer script (softfail). This is is known to happen for some OPs annd prevents those from getting displayed or accounted for.");
     return CScript(pc, scriptIn.end());
 }
 
-bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+bool VerifyCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
         CValidationState &state, CCoinsViewCache &inputs,
         map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
         bool fJustCheck) {
 
     if (!tx.IsCoinBase()) {
-        printf("*** %d %d %s %s %s %s\n", pindexBlock->nHeight,
+        LogPrint(LOG_CERT, "*** %d %d %s %s %s %s\n", pindexBlock->nHeight,
                 pindexBest->nHeight, tx.GetHash().ToString().c_str(),
                 fBlock ? "BLOCK" : "", fMiner ? "MINER" : "",
                 fJustCheck ? "JUSTCHECK" : "");
@@ -1022,7 +941,12 @@ bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
         bool good = DecodeCertTx(tx, op, nOut, vvchArgs, pindexBlock->nHeight);
         if (!good)
             return error("CheckCertInputs() : could not decode a syscoin tx");
-        int nPrevHeight;
+
+        // binary payloads are only valid from the fork on; the mempool and
+        // the miner check for the next block
+        int nTxHeight = fBlock ? pindexBlock->nHeight : pindexBlock->nHeight + 1;
+        if (tx.IsBinaryData() && nTxHeight < GetBinaryPayloadStartBlock())
+            return error("CheckCertInputs() : binary certissuer payload before block %d", GetBinaryPayloadStartBlock());
         int nDepth;
         int64 nNetFee;
 
@@ -1096,13 +1020,6 @@ bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
                     return error(
                             "CheckCertInputs() : certissueractivate cannot be mined if certissuernew is not already in chain and unexpired");
 
-                nPrevHeight = GetCertHeight(vchCertIssuer);
-                if (!fBlock && nPrevHeight >= 0
-                        && pindexBlock->nHeight - nPrevHeight
-                                < GetCertExpirationDepth(pindexBlock->nHeight))
-                    return error(
-                            "CheckCertInputs() : certissueractivate on an unexpired certissuer.");
-
                 if(pindexBlock->nHeight == pindexBest->nHeight) {
                     BOOST_FOREACH(const MAPTESTPOOLTYPE& s, mapTestPool) {
                         if (vvchArgs[0] == s.first) {
@@ -1159,11 +1076,8 @@ bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 
             if (fBlock && !fJustCheck) {
                 // Check hash
-                const vector<unsigned char> &vchCertIssuer = vvchArgs[0];
                 const vector<unsigned char> &vchCertItemRand = vvchArgs[1];
 
-                nPrevHeight = GetCertHeight(vchCertIssuer);
-
                 if(!theCertIssuer.GetCertItemByHash(vchCertItemRand, theCertItem))
                     return error("could not read certitem from certissuer txn");
 
@@ -1207,8 +1121,6 @@ bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
                             "CheckCertInputs() : certtransfer prev hash mismatch : %s vs %s",
                             HexStr(stringFromVch(vvchPrevArgs[2])).c_str(), HexStr(stringFromVch(vchToHash)).c_str());
 
-                nPrevHeight = GetCertHeight(vchCertIssuer);
-
                 if(!theCertIssuer.GetCertItemByHash(vchCertItem, theCertItem))
                     return error("could not read certitem from certissuer txn");
 
@@ -1241,121 +1153,139 @@ bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
             return error( "CheckCertInputs() : certissuer transaction has unknown op");
         }
 
-        // save serialized certissuer for later use
-        CCertIssuer serializedCertIssuer = theCertIssuer;
+    }
+    return true;
+}
 
-        // if not an certissuernew, load the certissuer data from the DB
-        vector<CCertIssuer> vtxPos;
-        if(op != OP_CERTISSUER_NEW)
-            if (pcertdb->ExistsCertIssuer(vvchArgs[0])) {
-                if (!pcertdb->ReadCertIssuer(vvchArgs[0], vtxPos))
-                    return error(
-                            "CheckCertInputs() : failed to read from certissuer DB");
-            }
+bool ConnectCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+        map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
+        bool fJustCheck) {
 
-//todo fucking suspect
-        // // for certissuerupdate or certtransfer check to make sure the previous txn exists and is valid
-        // if (!fBlock && fJustCheck && (op == OP_CERTISSUER_UPDATE || op == OP_CERT_TRANSFER)) {
-        // 	if (!CheckCertIssuerTxPos(vtxPos, prevCoins->nHeight))
-        // 		return error(
-        // 				"CheckCertInputs() : tx %s rejected, since previous tx (%s) is not in the certissuer DB\n",
-        // 				tx.GetHash().ToString().c_str(),
-        // 				prevOutput->hash.ToString().c_str());
-        // }
-
-        // these ifs are problably total bullshit except for the certissuernew
-        if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
-            if (op != OP_CERTISSUER_NEW) {
-                if (!fMiner && !fJustCheck && pindexBlock->nHeight != pindexBest->nHeight) {
-                    int nHeight = pindexBlock->nHeight;
-
-                    // get the latest certissuer from the db
-                    theCertIssuer.nHeight = nHeight;
-                    theCertIssuer.GetCertFromList(vtxPos);
-
-                    // If update, we make the serialized certissuer the master
-                    // but first we assign the certitems from the DB since
-                    // they are not shipped in an update txn to keep size down
-                    if(op == OP_CERTISSUER_UPDATE) {
-                        serializedCertIssuer.certs = theCertIssuer.certs;
-                        theCertIssuer = serializedCertIssuer;
-                    }
+    if (tx.IsCoinBase() || tx.nVersion != SYSCOIN_TX_VERSION)
+        return true;
 
-                    if (op == OP_CERT_NEW || op == OP_CERT_TRANSFER) {
-                        // get the certitem out of the certissuer object in the txn
-                        if(!serializedCertIssuer.GetCertItemByHash(vvchArgs[1], theCertItem))
-                            return error("could not read certitem from certissuer txn");
-
-                        // set the certissuer certitem txn-dependent values and add to the txn
-                        theCertItem.vchRand = vvchArgs[1];
-                        theCertItem.txHash = tx.GetHash();
-                        theCertItem.nTime = pindexBlock->nTime;
-                        theCertItem.nHeight = nHeight;
-                        theCertIssuer.PutCertItem(theCertItem);
-
-                        if (!pcertdb->WriteCertItem(vvchArgs[1], vvchArgs[0]))
-                            return error( "CheckCertInputs() : failed to write to cert DB");
-                        mapTestPool[vvchArgs[1]] = tx.GetHash();
-                    }
+    vector<vector<unsigned char> > vvchArgs;
+    int op;
+    int nOut;
+    if (!DecodeCertTx(tx, op, nOut, vvchArgs, pindexBlock->nHeight))
+        return error("ConnectCertInputs() : could not decode a syscoin tx");
+
+    CCertIssuer theCertIssuer;
+    CCertItem theCertItem;
+    theCertIssuer.UnserializeFromTx(tx);
 
-                    if(op == OP_CERTISSUER_ACTIVATE || op == OP_CERTISSUER_UPDATE)
-                        theCertIssuer.nHeight = pindexBlock->nHeight;
+    // save serialized certissuer for later use
+    CCertIssuer serializedCertIssuer = theCertIssuer;
 
-                    // set the certissuer's txn-dependent values
-                    theCertIssuer.vchRand = vvchArgs[0];
-                    theCertIssuer.txHash = tx.GetHash();
-                    theCertIssuer.nTime = pindexBlock->nTime;
-                    theCertIssuer.PutToCertIssuerList(vtxPos);
+//todo fucking suspect
+    // // for certissuerupdate or certtransfer check to make sure the previous txn exists and is valid
+    // if (!fBlock && fJustCheck && (op == OP_CERTISSUER_UPDATE || op == OP_CERT_TRANSFER)) {
+    // 	if (!CheckCertIssuerTxPos(vtxPos, prevCoins->nHeight))
+    // 		return error(
+    // 				"CheckCertInputs() : tx %s rejected, since previous tx (%s) is not in the certissuer DB\n",
+    // 				tx.GetHash().ToString().c_str(),
+    // 				prevOutput->hash.ToString().c_str());
+    // }
+
+    // these ifs are problably total bullshit except for the certissuernew
+    if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
+        if (op != OP_CERTISSUER_NEW) {
+            if (!fMiner && !fJustCheck && pindexBlock->nHeight != pindexBest->nHeight) {
+                int nHeight = pindexBlock->nHeight;
+
+                // get the certissuer version at this height, or the latest, from the db
+                theCertIssuer.nHeight = nHeight;
+                CCertIssuer dbCertIssuer;
+                if (pcertdb->ReadCertIssuerAt(vvchArgs[0], nHeight, dbCertIssuer))
+                    theCertIssuer = dbCertIssuer;
+
+                // If update, we make the serialized certissuer the master
+                // but first we assign the certitems from the DB since
+                // they are not shipped in an update txn to keep size down
+                if(op == OP_CERTISSUER_UPDATE) {
+                    serializedCertIssuer.certs = theCertIssuer.certs;
+                    theCertIssuer = serializedCertIssuer;
+                }
+
+                if (op == OP_CERT_NEW || op == OP_CERT_TRANSFER) {
+                    // get the certitem out of the certissuer object in the txn
+                    if(!serializedCertIssuer.GetCertItemByHash(vvchArgs[1], theCertItem))
+                        return error("could not read certitem from certissuer txn");
 
-                    // write cert issuer 
-                    if (!pcertdb->WriteCertIssuer(vvchArgs[0], vtxPos))
+                    // set the certissuer certitem txn-dependent values and add to the txn
+                    theCertItem.vchRand = vvchArgs[1];
+                    theCertItem.txHash = tx.GetHash();
+                    theCertItem.nTime = pindexBlock->nTime;
+                    theCertItem.nHeight = nHeight;
+                    theCertIssuer.PutCertItem(theCertItem);
+
+                    if (!pcertdb->WriteCertItem(vvchArgs[1], vvchArgs[0]))
                         return error( "CheckCertInputs() : failed to write to cert DB");
-                    mapTestPool[vvchArgs[0]] = tx.GetHash();
-                    
-
-                    // compute verify and write fee data to DB
-                    int64 nTheFee = GetCertNetFee(tx);
-                    InsertCertFee(pindexBlock, tx.GetHash(), nTheFee);
-                    if(nTheFee > 0) printf("CERT FEES: Added %lf in fees to track for regeneration.\n", (double) nTheFee / COIN);
-                    vector<CCertFee> vCertIssuerFees(lstCertIssuerFees.begin(), lstCertIssuerFees.end());
-                    if (!pcertdb->WriteCertFees(vCertIssuerFees))
-                        return error( "CheckCertInputs() : failed to write fees to certissuer DB");
-
-                    // remove certissuer from pendings
-
-                    // activate or update - seller txn
-                    if (op == OP_CERTISSUER_NEW || op == OP_CERTISSUER_ACTIVATE || op == OP_CERTISSUER_UPDATE) {
-                        vector<unsigned char> vchCertIssuer = op == OP_CERTISSUER_NEW ?
-                                    vchFromString(HexStr(vvchArgs[0])) : vvchArgs[0];
-                        TRY_LOCK(cs_main, cs_trymain);
-                        std::map<std::vector<unsigned char>, std::set<uint256> >::iterator
-                                mi = mapCertIssuerPending.find(vchCertIssuer);
-                        if (mi != mapCertIssuerPending.end())
-                            mi->second.erase(tx.GetHash());
-                    }
+                    mapTestPool[vvchArgs[1]] = tx.GetHash();
+                }
 
-                    // certitem or pay - buyer txn
-                    else {
-                        TRY_LOCK(cs_main, cs_trymain);
-                        std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapCertItemPending.find(vvchArgs[1]);
-                        if (mi != mapCertItemPending.end())
-                            mi->second.erase(tx.GetHash());
-                    }
+                if(op == OP_CERTISSUER_ACTIVATE || op == OP_CERTISSUER_UPDATE)
+                    theCertIssuer.nHeight = pindexBlock->nHeight;
+
+                // set the certissuer's txn-dependent values
+                theCertIssuer.vchRand = vvchArgs[0];
+                theCertIssuer.txHash = tx.GetHash();
+                theCertIssuer.nTime = pindexBlock->nTime;
+
+                // compute verify and track fee data
+                int64 nTheFee = GetCertNetFee(tx);
+                InsertCertFee(pindexBlock, tx.GetHash(), nTheFee);
+                if(nTheFee > 0) LogPrint(LOG_CERT, "CERT FEES: Added %lf in fees to track for regeneration.\n", (double) nTheFee / COIN);
+
+                // write cert issuer and fee changes together
+                if (!pcertdb->WriteCertIssuer(vvchArgs[0], theCertIssuer, certFeeWindow))
+                    return error( "CheckCertInputs() : failed to write to cert DB");
+                mapTestPool[vvchArgs[0]] = tx.GetHash();
+
+                // remove certissuer from pendings
+
+                // activate or update - seller txn
+                if (op == OP_CERTISSUER_NEW || op == OP_CERTISSUER_ACTIVATE || op == OP_CERTISSUER_UPDATE) {
+                    vector<unsigned char> vchCertIssuer = op == OP_CERTISSUER_NEW ?
+                                vchFromString(HexStr(vvchArgs[0])) : vvchArgs[0];
+                    TRY_LOCK(cs_main, cs_trymain);
+                    std::map<std::vector<unsigned char>, std::set<uint256> >::iterator
+                            mi = mapCertIssuerPending.find(vchCertIssuer);
+                    if (mi != mapCertIssuerPending.end())
+                        mi->second.erase(tx.GetHash());
+                }
 
-                    // debug
-                    printf( "CONNECTED CERT: op=%s certissuer=%s title=%s hash=%s height=%d fees=%llu\n",
-                            certissuerFromOp(op).c_str(),
-                            stringFromVch(vvchArgs[0]).c_str(),
-                            stringFromVch(theCertIssuer.vchTitle).c_str(),
-                            tx.GetHash().ToString().c_str(),
-                            nHeight, nTheFee / COIN);
+                // certitem or pay - buyer txn
+                else {
+                    TRY_LOCK(cs_main, cs_trymain);
+                    std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapCertItemPending.find(vvchArgs[1]);
+                    if (mi != mapCertItemPending.end())
+                        mi->second.erase(tx.GetHash());
                 }
+
+                // debug
+                LogPrint(LOG_CERT, "CONNECTED CERT: op=%s certissuer=%s title=%s hash=%s height=%d fees=%llu\n",
+                        certissuerFromOp(op).c_str(),
+                        stringFromVch(vvchArgs[0]).c_str(),
+                        stringFromVch(theCertIssuer.vchTitle).c_str(),
+                        tx.GetHash().ToString().c_str(),
+                        nHeight, nTheFee / COIN);
             }
         }
     }
     return true;
 }
 
+bool CheckCertInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+        CValidationState &state, CCoinsViewCache &inputs,
+        map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
+        bool fJustCheck) {
+    return VerifyCertInputs(pindexBlock, tx, state, inputs, mapTestPool,
+            fBlock, fMiner, fJustCheck)
+            && ConnectCertInputs(pindexBlock, tx, mapTestPool, fBlock,
+                    fMiner, fJustCheck);
+}
+
 bool ExtractCertIssuerAddress(const CScript& script, string& address) {
     if (script.size() == 1 && script[0] == OP_RETURN) {
         address = string("network fee");
@@ -1385,11 +1315,6 @@ bool ExtractCertIssuerAddress(const CScript& script, string& address) {
     return true;
 }
 
-void rescanforcertissuers(CBlockIndex *pindexRescan) {
-    printf("Scanning blockchain for certissuers to create fast index...\n");
-    pcertdb->ReconstructCertIndex(pindexRescan);
-}
-
 int GetCertTxPosHeight(const CDiskTxPos& txPos) {
     // Read block header
     CBlock block;
@@ -1469,7 +1394,7 @@ Value certissuernew(const Array& params, bool fHelp) {
     newCertIssuer.vchTitle = vchTitle;
     newCertIssuer.vchData = vchData;
 
-    string bdata = newCertIssuer.SerializeToString();
+    string bdata = newCertIssuer.SerializeToString(nBestHeight + 1);
 
     // create transaction keys
     CPubKey newDefaultKey;
@@ -1580,7 +1505,7 @@ Value certissueractivate(const Array& params, bool fHelp) {
         newCertIssuer.vchRand = vchCertIssuer;
         newCertIssuer.nFee = nNetFee;
 
-        string bdata = newCertIssuer.SerializeToString();
+        string bdata = newCertIssuer.SerializeToString(nBestHeight + 1);
         vector<unsigned char> vchbdata = vchFromString(bdata);
 
         // check this hash against previous, ensure they match
@@ -1682,10 +1607,8 @@ Value certissuerupdate(const Array& params, bool fHelp) {
             throw runtime_error("cannot unserialize certissuer from txn");
 
         // get the certissuer from DB
-        vector<CCertIssuer> vtxPos;
-        if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos))
+        if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, theCertIssuer))
             throw runtime_error("could not read certissuer from DB");
-        theCertIssuer = vtxPos.back();
         theCertIssuer.certs.clear();
 
         // calculate network fees
@@ -1697,7 +1620,7 @@ Value certissuerupdate(const Array& params, bool fHelp) {
         theCertIssuer.nFee += nNetFee;
 
         // serialize certissuer object
-        string bdata = theCertIssuer.SerializeToString();
+        string bdata = theCertIssuer.SerializeToString(nBestHeight + 1);
 
         CWalletTx& wtxIn = pwalletMain->mapWallet[wtxInHash];
         string strError = SendCertMoneyWithInputTx(scriptPubKey, MIN_AMOUNT, nNetFee,
@@ -1778,10 +1701,8 @@ Value certnew(const Array& params, bool fHelp) {
             throw runtime_error("could not unserialize certificate issuer from txn");
 
         // get the certissuer id from DB
-        vector<CCertIssuer> vtxPos;
-        if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos))
+        if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, theCertIssuer))
             throw runtime_error("could not read certificate issuer with this key from DB");
-        theCertIssuer = vtxPos.back();
 
         // create certitem object
         CCertItem txCertItem;
@@ -1792,7 +1713,7 @@ Value certnew(const Array& params, bool fHelp) {
         theCertIssuer.PutCertItem(txCertItem);
 
         // serialize certissuer object
-        string bdata = theCertIssuer.SerializeToString();
+        string bdata = theCertIssuer.SerializeToString(nBestHeight + 1);
 
         string strError = pwalletMain->SendMoney(scriptPubKey, MIN_AMOUNT, wtx,
                 false, bdata);
@@ -1860,18 +1781,18 @@ Value certtransfer(const Array& params, bool fHelp) {
 
     // get the certissuer id from DB
     vector<unsigned char> vchCertIssuer;
-    vector<CCertIssuer> vtxPos;
+    CCertIssuer dbCertIssuer;
     if (!pcertdb->ReadCertItem(vchCertKey, vchCertIssuer))
         throw runtime_error("could not read certificate from DB");
-    if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos))
+    if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, dbCertIssuer))
         throw runtime_error("could not read certificate issuer with this key from DB");
 
     // hashes should match
-    if(vtxPos.back().vchRand != theCertIssuer.vchRand)
+    if(dbCertIssuer.vchRand != theCertIssuer.vchRand)
         throw runtime_error("certificate issuer hash mismatch.");
 
     // use the certissuer and certificate from the DB as basis
-    theCertIssuer = vtxPos.back();
+    theCertIssuer = dbCertIssuer;
     if(!theCertIssuer.GetCertItemByHash(vchCertKey, theCertItem))
         throw runtime_error("could not find a certificate with this hash in DB");
 
@@ -1897,7 +1818,7 @@ Value certtransfer(const Array& params, bool fHelp) {
     // send the certissuer pay txn
     CWalletTx& wtxIn = pwalletMain->mapWallet[wtxInHash];
     string strError = SendCertMoneyWithInputTx(scriptPubKey, MIN_AMOUNT, nNetFee,
-            wtxIn, wtx, false, theCertIssuer.SerializeToString());
+            wtxIn, wtx, false, theCertIssuer.SerializeToString(nBestHeight + 1));
     if (strError != "")
         throw JSONRPCError(RPC_WALLET_ERROR, strError);
     }
@@ -1919,22 +1840,18 @@ Value certissuerinfo(const Array& params, bool fHelp) {
     vector<unsigned char> vchCertIssuer = vchFromValue(params[0]);
     string certissuer = stringFromVch(vchCertIssuer);
     {
-        vector<CCertIssuer> vtxPos;
-        if (!pcertdb->ReadCertIssuer(vchCertIssuer, vtxPos))
+        CCertIssuer theCertIssuer;
+        if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, theCertIssuer))
             throw JSONRPCError(RPC_WALLET_ERROR,
                     "failed to read from certissuer DB");
-        if (vtxPos.size() < 1)
-            throw JSONRPCError(RPC_WALLET_ERROR, "no result returned");
 
         // get transaction pointed to by alias
         CTransaction tx;
         uint256 blockHash;
-        uint256 txHash = vtxPos.back().txHash;
+        uint256 txHash = theCertIssuer.txHash;
         if (!GetTransaction(txHash, tx, blockHash, true))
             throw JSONRPCError(RPC_WALLET_ERROR, "failed to read transaction from disk");
 
-        CCertIssuer theCertIssuer = vtxPos.back();
-
         Object oCertIssuer;
         vector<unsigned char> vchValue;
         Array aoCertItems;
@@ -2066,12 +1983,15 @@ Value certissuerlist(const Array& params, bool fHelp) {
         vector<unsigned char> vchValue;
         int nHeight;
 
-        BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet)
+        // only the wallet's transactions on cert issuers
+        vector<uint256> vHashes;
+        pwalletMain->ListServiceTxs(pwalletMain->mapCertIssuerTxs, vchNameUniq, vHashes);
+        BOOST_FOREACH(const uint256& hashTx, vHashes)
         {
-            // get txn hash, read txn index
-            hash = item.second.GetHash();
+            // get txn hash, read the wallet's copy
+            hash = hashTx;
 
-            if (!GetTransaction(hash, tx, blockHash, true))
+            if (!pwalletMain->GetServiceTx(hash, tx))
                 continue;
 
             // skip non-syscoin txns
@@ -2223,57 +2143,62 @@ Value certissuerfilter(const Array& params, bool fHelp) {
     //CCertDB dbCert("r");
     Array oRes;
 
-    vector<unsigned char> vchCertIssuer;
-    vector<pair<vector<unsigned char>, CCertIssuer> > certissuerScan;
-    if (!pcertdb->ScanCertIssuers(vchCertIssuer, 100000000, certissuerScan))
-        throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
+    // max age: only the cert issuers updated since nMinHeight are looked at
+    int64 nMinHeight = 0;
+    if (nMaxAge != 0)
+        nMinHeight = max((int64) 0, (int64) pindexBest->nHeight - nMaxAge + 1);
+    boost::scoped_ptr<CServiceHistory<CCertIssuer>::CScanCursor> pcursor(nMaxAge != 0
+            ? pcertdb->NewUpdatedCertIssuerCursor(nMinHeight)
+            : pcertdb->NewCertIssuerCursor(vector<unsigned char>(), false));
 
-    pair<vector<unsigned char>, CCertIssuer> pairScan;
-    BOOST_FOREACH(pairScan, certissuerScan) {
-        string certissuer = stringFromVch(pairScan.first);
+    using namespace boost::xpressive;
+    sregex cregex;
+    if (strRegexp != "")
+        cregex = sregex::compile(strRegexp);
 
-        // regexp
-        using namespace boost::xpressive;
-        smatch certissuerparts;
-        sregex cregex = sregex::compile(strRegexp);
-        if (strRegexp != "" && !regex_search(certissuer, certissuerparts, cregex))
-            continue;
+    vector<unsigned char> vchCertIssuer;
+    try {
+        while (pcursor->NextName(vchCertIssuer)) {
+            string certissuer = stringFromVch(vchCertIssuer);
 
-        CCertIssuer txCertIssuer = pairScan.second;
-        int nHeight = txCertIssuer.nHeight;
+            // regexp
+            smatch certissuerparts;
+            if (strRegexp != "" && !regex_search(certissuer, certissuerparts, cregex))
+                continue;
 
-        // max age
-        if (nMaxAge != 0 && pindexBest->nHeight - nHeight >= nMaxAge)
-            continue;
+            // from limits
+            nCountFrom++;
+            if (nCountFrom < nFrom + 1)
+                continue;
 
-        // from limits
-        nCountFrom++;
-        if (nCountFrom < nFrom + 1)
-            continue;
+            CCertIssuer txCertIssuer;
+            if (!pcertdb->ReadCertIssuerLast(vchCertIssuer, txCertIssuer))
+                continue;
+            int nHeight = txCertIssuer.nHeight;
 
-        Object oCertIssuer;
-        oCertIssuer.push_back(Pair("certissuer", certissuer));
-        CTransaction tx;
-        uint256 blockHash;
-        uint256 txHash = txCertIssuer.txHash;
-        if ((nHeight + GetCertDisplayExpirationDepth(nHeight) - pindexBest->nHeight
-                <= 0) || !GetTransaction(txHash, tx, blockHash, true)) {
-            oCertIssuer.push_back(Pair("expired", 1));
-        } else {
-            vector<unsigned char> vchValue = txCertIssuer.vchTitle;
-            string value = stringFromVch(vchValue);
-            oCertIssuer.push_back(Pair("value", value));
-            oCertIssuer.push_back(
-                    Pair("expires_in",
-                            nHeight + GetCertDisplayExpirationDepth(nHeight)
-                                    - pindexBest->nHeight));
-        }
-        oRes.push_back(oCertIssuer);
+            Object oCertIssuer;
+            oCertIssuer.push_back(Pair("certissuer", certissuer));
+            if (nHeight + GetCertDisplayExpirationDepth(nHeight) - pindexBest->nHeight
+                    <= 0) {
+                oCertIssuer.push_back(Pair("expired", 1));
+            } else {
+                vector<unsigned char> vchValue = txCertIssuer.vchTitle;
+                string value = stringFromVch(vchValue);
+                oCertIssuer.push_back(Pair("value", value));
+                oCertIssuer.push_back(
+                        Pair("expires_in",
+                                nHeight + GetCertDisplayExpirationDepth(nHeight)
+                                        - pindexBest->nHeight));
+            }
+            oRes.push_back(oCertIssuer);
 
-        nCountNb++;
-        // nb limits
-        if (nNb > 0 && nCountNb >= nNb)
-            break;
+            nCountNb++;
+            // nb limits
+            if (nNb > 0 && nCountNb >= nNb)
+                break;
+        }
+    } catch (std::exception &e) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
     }
 
     if (fStat) {
@@ -2288,13 +2213,17 @@ Value certissuerfilter(const Array& params, bool fHelp) {
 }
 
 Value certissuerscan(const Array& params, bool fHelp) {
-    if (fHelp || 2 > params.size())
+    if (fHelp || 2 > params.size() || params.size() > 3)
         throw runtime_error(
-                "certissuerscan [<start-certissuer>] [<max-returned>]\n"
-                        "scan all certissuers, starting at start-certissuer and returning a maximum number of entries (default 500)\n");
+                "certissuerscan [<start-certissuer>] [<max-returned>] [<continuation>]\n"
+                        "scan all certissuers, starting at start-certissuer and returning a maximum number of entries (default 500)\n"
+                        "[continuation] : \"\" to start paging, or the continuation of the previous page; "
+                        "returns {\"certissuers\", \"continuation\"}, with an empty continuation after the last page\n");
 
     vector<unsigned char> vchCertIssuer;
     int nMax = 500;
+    bool fPaged = false;
+    bool fAfter = false;
     if (params.size() > 0) {
         vchCertIssuer = vchFromValue(params[0]);
     }
@@ -2305,43 +2234,61 @@ Value certissuerscan(const Array& params, bool fHelp) {
         nMax = (int) vMax.get_real();
     }
 
-    //CCertDB dbCert("r");
-    Array oRes;
+    if (params.size() > 2) {
+        // the continuation is the last certissuer of the previous page
+        string strContinuation = params[2].get_str();
+        if (!IsHex(strContinuation) && strContinuation != "")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid continuation");
+        if (strContinuation != "") {
+            vchCertIssuer = ParseHex(strContinuation);
+            fAfter = true;
+        }
+        fPaged = true;
+    }
 
-    vector<pair<vector<unsigned char>, CCertIssuer> > certissuerScan;
-    if (!pcertdb->ScanCertIssuers(vchCertIssuer, nMax, certissuerScan))
-        throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
+    Array oRes;
 
-    pair<vector<unsigned char>, CCertIssuer> pairScan;
-    BOOST_FOREACH(pairScan, certissuerScan) {
-        Object oCertIssuer;
-        string certissuer = stringFromVch(pairScan.first);
-        oCertIssuer.push_back(Pair("certissuer", certissuer));
-        CTransaction tx;
-        CCertIssuer txCertIssuer = pairScan.second;
-        uint256 blockHash;
+    boost::scoped_ptr<CServiceHistory<CCertIssuer>::CScanCursor> pcursor(pcertdb->NewCertIssuerCursor(vchCertIssuer, fAfter));
+    vector<unsigned char> vchKeyName;
+    CCertIssuer txCertIssuer;
+    bool fMore = false;
+    try {
+        while ((int) oRes.size() < nMax && (fMore = pcursor->Next(vchKeyName, txCertIssuer))) {
+            Object oCertIssuer;
+            string certissuer = stringFromVch(vchKeyName);
+            oCertIssuer.push_back(Pair("certissuer", certissuer));
 
-        int nHeight = txCertIssuer.nHeight;
-        vector<unsigned char> vchValue = txCertIssuer.vchTitle;
-        if ((nHeight + GetCertDisplayExpirationDepth(nHeight) - pindexBest->nHeight
-                <= 0) || !GetTransaction(txCertIssuer.txHash, tx, blockHash, true)) {
-            oCertIssuer.push_back(Pair("expired", 1));
-        } else {
-            string value = stringFromVch(vchValue);
-            //string strAddress = "";
-            //GetCertAddress(tx, strAddress);
-            oCertIssuer.push_back(Pair("value", value));
-            //oCertIssuer.push_back(Pair("txid", tx.GetHash().GetHex()));
-            //oCertIssuer.push_back(Pair("address", strAddress));
-            oCertIssuer.push_back(
-                    Pair("expires_in",
-                            nHeight + GetCertDisplayExpirationDepth(nHeight)
-                                    - pindexBest->nHeight));
+            int nHeight = txCertIssuer.nHeight;
+            vector<unsigned char> vchValue = txCertIssuer.vchTitle;
+            if (nHeight + GetCertDisplayExpirationDepth(nHeight) - pindexBest->nHeight
+                    <= 0) {
+                oCertIssuer.push_back(Pair("expired", 1));
+            } else {
+                string value = stringFromVch(vchValue);
+                oCertIssuer.push_back(Pair("value", value));
+                oCertIssuer.push_back(
+                        Pair("expires_in",
+                                nHeight + GetCertDisplayExpirationDepth(nHeight)
+                                        - pindexBest->nHeight));
+            }
+            oRes.push_back(oCertIssuer);
+        }
+        // a full page only has a next one if there is a certissuer left
+        if (fMore) {
+            CCertIssuer txNext;
+            vector<unsigned char> vchNext;
+            fMore = pcursor->Next(vchNext, txNext);
         }
-        oRes.push_back(oCertIssuer);
+    } catch (std::exception &e) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
     }
 
-    return oRes;
+    if (!fPaged)
+        return oRes;
+    Object oPage;
+    oPage.push_back(Pair("certissuers", oRes));
+    oPage.push_back(Pair("continuation", fMore ? HexStr(vchKeyName) : string()));
+    return oPage;
 }
 
 
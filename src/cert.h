@@ -2,8 +2,11 @@
 #define CERT_H
 
 #include "bitcoinrpc.h"
-#include "leveldb.h"
+#include "servicedb.h"
+#include "feewindow.h"
+#include "servicehistory.h"
 
+class CBlock;
 class CTransaction;
 class CTxOut;
 class CValidationState;
@@ -16,6 +19,14 @@ class CDiskTxPos;
 
 bool CheckCertInputs(CBlockIndex *pindex, const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs,
                      std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
+/** The checks of CheckCertInputs() that only read the transaction, the
+ *  coins it spends and the chain; safe to run off the main thread. */
+bool VerifyCertInputs(CBlockIndex *pindex, const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs,
+                      std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
+/** The cert DB writes of CheckCertInputs(), for a transaction that
+ *  VerifyCertInputs() accepts. */
+bool ConnectCertInputs(CBlockIndex *pindex, const CTransaction &tx,
+                       std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
 bool IsCertMine(const CTransaction& tx);
 bool IsCertMine(const CTransaction& tx, const CTxOut& txout, bool ignore_aliasnew = false);
 std::string SendCertMoneyWithInputTx(CScript scriptPubKey, int64 nValue, int64 nNetFee, CWalletTx& wtxIn,
@@ -162,17 +173,6 @@ public:
         certs.push_back(theOA);
     }
 
-    void PutToCertIssuerList(std::vector<CCertIssuer> &certIssuerList) {
-        for(unsigned int i=0;i<certIssuerList.size();i++) {
-            CCertIssuer o = certIssuerList[i];
-            if(o.nHeight == nHeight) {
-                certIssuerList[i] = *this;
-                return;
-            }
-        }
-        certIssuerList.push_back(*this);
-    }
-
     bool GetCertFromList(const std::vector<CCertIssuer> &certIssuerList) {
         if(certIssuerList.size() == 0) return false;
         for(unsigned int i=0;i<certIssuerList.size();i++) {
@@ -223,8 +223,10 @@ public:
     bool IsNull() const { return (n == 0 && txHash == 0 && hash == 0 && nHeight == 0 && vchRand.size() == 0); }
 
     bool UnserializeFromTx(const CTransaction &tx);
-    void SerializeToTx(CTransaction &tx);
-    std::string SerializeToString();
+    /** nHeight is the height of the block the transaction is meant for,
+     *  which picks the payload format */
+    void SerializeToTx(CTransaction &tx, int nHeight);
+    std::string SerializeToString(int nHeight);
 };
 
 class CCertFee {
@@ -267,25 +269,59 @@ public:
     bool IsNull() const { return (nTime == 0 && nFee == 0 && hash == 0 && nHeight == 0); }
 };
 bool RemoveCertFee(CCertFee &txnVal);
+bool LoadCertFees(unsigned int nHeight);
 
-class CCertDB : public CLevelDB {
-public:
-    CCertDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB(GetDataDir() / "certificates", nCacheSize, fMemory, fWipe) {}
+class CCertDB : public CServiceDB {
+private:
+    // one record per cert issuer version, plus the height of the latest one
+    CServiceHistory<CCertIssuer> history;
 
-    bool WriteCertIssuer(const std::vector<unsigned char>& name, std::vector<CCertIssuer>& vtxPos) {
-        return Write(make_pair(std::string("certissueri"), name), vtxPos);
+public:
+    CCertDB(size_t nCacheSize, bool fMemory, bool fWipe) : CServiceDB(GetDataDir() / "certificates", nCacheSize, fMemory, fWipe),
+        history(*this, "certissuerv", "certissuerl", "certissueri", "certissueru") {}
+
+    bool WriteCertIssuer(const std::vector<unsigned char>& name, const CCertIssuer& certIssuer, CFeeWindow& fees) {
+        CLevelDBBatch batch;
+        history.Write(batch, name, certIssuer);
+        fees.WriteChanges(batch);
+        return WriteBatch(batch);
     }
 
-    bool EraseCertIssuer(const std::vector<unsigned char>& name) {
-        return Erase(make_pair(std::string("certissueri"), name));
+    // drop the latest versions of name written by txHash
+    bool PopCertIssuer(const std::vector<unsigned char>& name, const uint256& txHash, CFeeWindow& fees) {
+        CLevelDBBatch batch;
+        if (!history.Pop(batch, name, txHash))
+            return false;
+        fees.WriteChanges(batch);
+        return WriteBatch(batch);
     }
 
     bool ReadCertIssuer(const std::vector<unsigned char>& name, std::vector<CCertIssuer>& vtxPos) {
-        return Read(make_pair(std::string("certissueri"), name), vtxPos);
+        return history.ReadAll(name, vtxPos);
+    }
+
+    bool ReadCertIssuerLast(const std::vector<unsigned char>& name, CCertIssuer& certIssuer) {
+        return history.ReadLatest(name, certIssuer);
+    }
+
+    // the version written at nHeight, or else the latest one
+    bool ReadCertIssuerAt(const std::vector<unsigned char>& name, uint64 nHeight, CCertIssuer& certIssuer) {
+        return history.ReadVersion(name, nHeight, certIssuer) || history.ReadLatest(name, certIssuer);
     }
 
     bool ExistsCertIssuer(const std::vector<unsigned char>& name) {
-        return Exists(make_pair(std::string("certissueri"), name));
+        return history.Exists(name);
+    }
+
+    // walk the cert issuers updated at nMinHeight or later, in name order
+    CServiceHistory<CCertIssuer>::CScanCursor *NewUpdatedCertIssuerCursor(uint64 nMinHeight) {
+        return new CServiceHistory<CCertIssuer>::CScanCursor(history, nMinHeight);
+    }
+
+    // cert issuers used to keep their whole history in one vector, and
+    // were not indexed by update height
+    bool UpgradeCertIssuerIndex() {
+        return history.Upgrade();
     }
 
     bool WriteCertItem(const std::vector<unsigned char>& name, std::vector<unsigned char>& vchValue) {
@@ -304,22 +340,38 @@ public:
         return Exists(make_pair(std::string("certissuera"), name));
     }
 
-    bool WriteCertFees(std::vector<CCertFee>& vtxPos) {
-        return Write(make_pair(std::string("certissuera"), std::string("certissuertxf")), vtxPos);
+    bool WriteCertFees(CFeeWindow& fees) {
+        CLevelDBBatch batch;
+        fees.WriteChanges(batch);
+        return WriteBatch(batch);
     }
 
-    bool ReadCertFees(std::vector<CCertFee>& vtxPos) {
+    // fees used to be stored as one vector under a single key
+    bool ReadLegacyCertFees(std::vector<CCertFee>& vtxPos) {
         return Read(make_pair(std::string("certissuera"), std::string("certissuertxf")), vtxPos);
     }
 
+    bool UpgradeCertFees(CFeeWindow& fees) {
+        CLevelDBBatch batch;
+        fees.WriteChanges(batch);
+        batch.Erase(make_pair(std::string("certissuera"), std::string("certissuertxf")));
+        return WriteBatch(batch);
+    }
+
     bool ScanCertIssuers(
             const std::vector<unsigned char>& vchName,
             unsigned int nMax,
             std::vector<std::pair<std::vector<unsigned char>, CCertIssuer> >& certIssuerScan);
 
-    bool ReconstructCertIndex(CBlockIndex *pindexRescan);
+    // walk the cert issuers in name order from vchName, or from just after it
+    CServiceHistory<CCertIssuer>::CScanCursor *NewCertIssuerCursor(const std::vector<unsigned char>& vchName, bool fAfter) {
+        return new CServiceHistory<CCertIssuer>::CScanCursor(history, vchName, fAfter);
+    }
+
+    // replay the operations of one block during a rescan
+    bool ReconstructBlock(const CBlock &block, CBlockIndex *pindex);
 };
-extern std::list<CCertFee> lstCertIssuerFees;
+extern CFeeWindow certFeeWindow;
 
 
 bool GetTxOfCertIssuer(CCertDB& dbCertIssuer, const std::vector<unsigned char> &vchCertIssuer, CTransaction& tx);
@@ -0,0 +1,81 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_DECODECACHE_H
+#define SYSCOIN_DECODECACHE_H
+
+#include "uint256.h"
+#include "sync.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+/** What decoding the outputs of a transaction for one kind of Syscoin
+ *  operation found: whether an output matched, the op read last, and the
+ *  output and arguments of the match. */
+class CServiceTxDecode
+{
+public:
+    bool fFound;
+    // op is only set when some output started with an op
+    int op;
+    int nOut;
+    std::vector<std::vector<unsigned char> > vvch;
+
+    CServiceTxDecode() : fFound(false), op(-1), nOut(0) {}
+
+    /** Hand the result back the way decoding the outputs directly would. */
+    bool Get(int &opOut, int &nOutOut, std::vector<std::vector<unsigned char> > &vvchOut) const {
+        if (op != -1)
+            opOut = op;
+        if (fFound) {
+            nOutOut = nOut;
+            vvchOut = vvch;
+        } else
+            vvchOut.clear();
+        return fFound;
+    }
+};
+
+/** Results of decoding Syscoin transactions, keyed by txid, shared by every
+ *  caller that would otherwise decode the same transaction again. Only the
+ *  nMaxSize most recently added transactions are kept. */
+template<typename V> class CDecodeCache
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<uint256, V> map;
+    std::deque<uint256> queue;
+    unsigned int nMaxSize;
+
+public:
+    CDecodeCache(unsigned int nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    bool Get(const uint256 &hash, V &value) const {
+        LOCK(cs);
+        typename std::map<uint256, V>::const_iterator mi = map.find(hash);
+        if (mi == map.end())
+            return false;
+        value = mi->second;
+        return true;
+    }
+
+    void Insert(const uint256 &hash, const V &value) {
+        LOCK(cs);
+        if (!map.insert(std::make_pair(hash, value)).second)
+            return;
+        queue.push_back(hash);
+        while (queue.size() > nMaxSize) {
+            map.erase(queue.front());
+            queue.pop_front();
+        }
+    }
+
+    unsigned int size() const {
+        LOCK(cs);
+        return map.size();
+    }
+};
+
+#endif
@@ -0,0 +1,453 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_FEEWINDOW_H
+#define SYSCOIN_FEEWINDOW_H
+
+#include "uint256.h"
+#include "servicedb.h"
+#include "util.h"
+
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+/** Blocks below the tip whose fee subsidy is answerable without going back
+ *  to disk after CFeeWindow::Load(). */
+static const unsigned int FEE_WINDOW_LOAD_DEPTH = 2880;
+
+/** A single service fee tracked for block reward regeneration. */
+class CFeeWindowEntry {
+public:
+    uint256 hash;
+    uint64 nHeight;
+    uint64 nTime;
+    uint64 nValue;
+    // highest nTime and nHeight of this entry and every entry inserted before it
+    uint64 nMaxTime;
+    uint64 nMaxHeight;
+
+    CFeeWindowEntry() : hash(0), nHeight(0), nTime(0), nValue(0), nMaxTime(0), nMaxHeight(0) {}
+    CFeeWindowEntry(const uint256& hashIn, uint64 nHeightIn, uint64 nTimeIn, uint64 nValueIn) :
+        hash(hashIn), nHeight(nHeightIn), nTime(nTimeIn), nValue(nValueIn), nMaxTime(nTimeIn), nMaxHeight(nHeightIn) {}
+
+    IMPLEMENT_SERIALIZE (
+        READWRITE(hash);
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nTime));
+        READWRITE(VARINT(nValue));
+        READWRITE(VARINT(nMaxTime));
+        READWRITE(VARINT(nMaxHeight));
+    )
+};
+
+/** Insertion-ordered fee history with time-windowed subsidy queries.
+ *
+ * The fee subsidy has always been defined by a newest-first walk of the
+ * whole fee list: the newest entry at or below the queried height anchors a
+ * time window, and every entry inserted before it whose block time falls
+ * inside that window is summed. Each entry carries the running maximum block
+ * time of everything inserted before it, so the walk stops as soon as no
+ * older entry can still land in the window, and the last result is kept
+ * until the history changes. Results are identical to the full scan.
+ *
+ * When attached to a database, every entry is stored under its own key and
+ * only changed entries are written. Load() brings back just the tail that
+ * queries near the tip can reach; older entries are read on demand.
+ *
+ * Queries update the memoized result and may read entries in from disk,
+ * so every public member takes cs_window, queries included.
+ */
+class CFeeWindow
+{
+public:
+    typedef std::map<uint64, CFeeWindowEntry>::const_iterator const_iterator;
+    typedef std::map<uint64, CFeeWindowEntry>::const_reverse_iterator const_reverse_iterator;
+
+private:
+    typedef std::pair<uint64, uint256> key_type;
+
+    // entries by insertion sequence, oldest first
+    std::map<uint64, CFeeWindowEntry> mapEntries;
+    // (height, hash) -> sequence of the newest entry with that key
+    std::map<key_type, uint64> mapKeys;
+    uint64 nNextSeq;
+
+    // backing store; entries below nFloorSeq are only on disk unless fComplete
+    CServiceDB *pdb;
+    std::string strPrefix;
+    bool fComplete;
+    uint64 nFloorSeq;
+    uint64 nFloorMaxTime;
+    uint64 nFloorMaxHeight;
+    std::set<uint64> setDirty;
+    std::set<uint64> setErased;
+
+    mutable CCriticalSection cs_window;
+
+    // memoized result of the last query
+    uint64 nGeneration;
+    uint64 nCacheGeneration;
+    unsigned int nCacheHeight;
+    unsigned int nCacheWindow;
+    uint64 nCacheShort;
+    uint64 nCacheLong;
+
+    void Changed() { nGeneration++; }
+
+    void Add(uint64 nSeq, const CFeeWindowEntry& entry)
+    {
+        mapEntries[nSeq] = entry;
+        // a newer entry with the same key always wins the lookup
+        std::map<key_type, uint64>::iterator mi = mapKeys.find(key_type(entry.nHeight, entry.hash));
+        if (mi == mapKeys.end())
+            mapKeys.insert(std::make_pair(key_type(entry.nHeight, entry.hash), nSeq));
+        else if (mi->second < nSeq)
+            mi->second = nSeq;
+    }
+
+    // recompute running maxima from it onwards after an in-place change
+    void RepairMaxima(std::map<uint64, CFeeWindowEntry>::iterator it)
+    {
+        uint64 nMaxTime = fComplete ? 0 : nFloorMaxTime;
+        uint64 nMaxHeight = fComplete ? 0 : nFloorMaxHeight;
+        if (it != mapEntries.begin())
+        {
+            std::map<uint64, CFeeWindowEntry>::iterator prev = it;
+            --prev;
+            nMaxTime = prev->second.nMaxTime;
+            nMaxHeight = prev->second.nMaxHeight;
+        }
+        for (; it != mapEntries.end(); ++it)
+        {
+            CFeeWindowEntry& entry = it->second;
+            if (entry.nTime > nMaxTime)
+                nMaxTime = entry.nTime;
+            if (entry.nHeight > nMaxHeight)
+                nMaxHeight = entry.nHeight;
+            if (entry.nMaxTime != nMaxTime || entry.nMaxHeight != nMaxHeight)
+            {
+                entry.nMaxTime = nMaxTime;
+                entry.nMaxHeight = nMaxHeight;
+                setDirty.insert(it->first);
+            }
+        }
+    }
+
+    // read every record with a sequence below nBefore (newest first) into memory;
+    // with fPartial, stop at the first record that cannot reach nCutoff
+    bool ReadRecords(uint64 nBefore, bool fPartial, unsigned int nHeight, unsigned int nDepth, unsigned int nWindow)
+    {
+        leveldb::Iterator *pcursor = pdb->NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << std::make_pair(strPrefix, CBigEndianKey(nBefore));
+        pcursor->Seek(ssKeySet.str());
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+
+        bool fAnchored = false;
+        uint64 nMinTime = std::numeric_limits<uint64>::max();
+        unsigned int nCutoff = 0;
+        fComplete = true;
+        while (pcursor->Valid()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                std::string strType;
+                ssKey >> strType;
+                if (strType != strPrefix)
+                    break;
+                CBigEndianKey key;
+                ssKey >> key;
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CFeeWindowEntry entry;
+                ssValue >> entry;
+
+                if (nNextSeq <= key.n)
+                    nNextSeq = key.n + 1;
+                if (fPartial && fAnchored && entry.nMaxTime <= nCutoff)
+                {
+                    fComplete = false;
+                    nFloorSeq = key.n + 1;
+                    nFloorMaxTime = entry.nMaxTime;
+                    nFloorMaxHeight = entry.nMaxHeight;
+                    break;
+                }
+                Add(key.n, entry);
+                if (fPartial && !fAnchored)
+                {
+                    // every query at or above nHeight - nDepth anchors at this
+                    // entry or a newer one, and looks back at most nWindow
+                    // seconds from the earliest of their block times
+                    if (entry.nTime < nMinTime)
+                        nMinTime = entry.nTime;
+                    if (entry.nHeight + nDepth <= nHeight)
+                    {
+                        fAnchored = true;
+                        nCutoff = nMinTime - nWindow;
+                    }
+                }
+                pcursor->Prev();
+            } catch (std::exception &e) {
+                delete pcursor;
+                return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+            }
+        }
+        delete pcursor;
+        Changed();
+        return true;
+    }
+
+    // bring the entries that were left on disk by Load() into memory
+    bool LoadAll()
+    {
+        if (fComplete)
+            return true;
+        return ReadRecords(nFloorSeq, false, 0, 0, 0);
+    }
+
+public:
+    CFeeWindow() : nNextSeq(0), pdb(NULL), fComplete(true), nFloorSeq(0), nFloorMaxTime(0), nFloorMaxHeight(0),
+        nGeneration(1), nCacheGeneration(0), nCacheHeight(0), nCacheWindow(0), nCacheShort(0), nCacheLong(0) {}
+
+    // the iterators are not guarded, and are for single threaded use only
+    const_iterator begin() const { return mapEntries.begin(); }
+    const_iterator end() const { return mapEntries.end(); }
+    const_reverse_iterator rbegin() const { return mapEntries.rbegin(); }
+    const_reverse_iterator rend() const { return mapEntries.rend(); }
+    size_t size() const { LOCK(cs_window); return mapEntries.size(); }
+    bool empty() const { LOCK(cs_window); return mapEntries.empty(); }
+
+    /** Store entries in pdbIn under keys (strPrefixIn, sequence). */
+    void Attach(CServiceDB *pdbIn, const std::string& strPrefixIn)
+    {
+        LOCK(cs_window);
+        pdb = pdbIn;
+        strPrefix = strPrefixIn;
+    }
+
+    /** Forget everything in memory; records already written are left alone. */
+    void clear()
+    {
+        LOCK(cs_window);
+        mapEntries.clear();
+        mapKeys.clear();
+        setDirty.clear();
+        setErased.clear();
+        nNextSeq = 0;
+        fComplete = true;
+        nFloorSeq = nFloorMaxTime = nFloorMaxHeight = 0;
+        Changed();
+    }
+
+    /** Read the records needed to answer queries at heights from
+     *  nHeight - nDepth upwards with windows up to nWindow seconds. */
+    bool Load(unsigned int nHeight, unsigned int nDepth, unsigned int nWindow)
+    {
+        LOCK(cs_window);
+        clear();
+        if (!pdb)
+            return true;
+        return ReadRecords(std::numeric_limits<uint64>::max(), true, nHeight, nDepth, nWindow);
+    }
+
+    /** Queue every entry added, changed or removed since the last call. */
+    void WriteChanges(CLevelDBBatch& batch)
+    {
+        LOCK(cs_window);
+        BOOST_FOREACH(uint64 nSeq, setErased)
+            batch.Erase(std::make_pair(strPrefix, CBigEndianKey(nSeq)));
+        BOOST_FOREACH(uint64 nSeq, setDirty)
+        {
+            std::map<uint64, CFeeWindowEntry>::const_iterator it = mapEntries.find(nSeq);
+            if (it != mapEntries.end())
+                batch.Write(std::make_pair(strPrefix, CBigEndianKey(nSeq)), it->second);
+        }
+        setErased.clear();
+        setDirty.clear();
+    }
+
+    /** Append an entry as the newest one without looking for duplicates. */
+    void push_back(const CFeeWindowEntry& entryIn)
+    {
+        LOCK(cs_window);
+        CFeeWindowEntry entry = entryIn;
+        entry.nMaxTime = entry.nTime;
+        entry.nMaxHeight = entry.nHeight;
+        uint64 nPrevMaxTime = fComplete ? 0 : nFloorMaxTime;
+        uint64 nPrevMaxHeight = fComplete ? 0 : nFloorMaxHeight;
+        if (!mapEntries.empty())
+        {
+            nPrevMaxTime = mapEntries.rbegin()->second.nMaxTime;
+            nPrevMaxHeight = mapEntries.rbegin()->second.nMaxHeight;
+        }
+        if (nPrevMaxTime > entry.nMaxTime)
+            entry.nMaxTime = nPrevMaxTime;
+        if (nPrevMaxHeight > entry.nMaxHeight)
+            entry.nMaxHeight = nPrevMaxHeight;
+        Add(nNextSeq, entry);
+        setDirty.insert(nNextSeq);
+        nNextSeq++;
+        Changed();
+    }
+
+    /** Add a fee unless one with the same height and hash is already tracked,
+     *  in which case it is overwritten in place when fReplace is set.
+     *  Returns true if an entry with that key already existed, and false
+     *  without adding it if the older fees could not be read. */
+    bool Insert(const CFeeWindowEntry& entry, bool fReplace)
+    {
+        LOCK(cs_window);
+        std::map<key_type, uint64>::iterator mi = mapKeys.find(key_type(entry.nHeight, entry.hash));
+        if (mi == mapKeys.end() && !fComplete && entry.nHeight <= nFloorMaxHeight)
+        {
+            if (!LoadAll())
+                return error("CFeeWindow::Insert() : failed to load fees for height %"PRI64u, entry.nHeight);
+            mi = mapKeys.find(key_type(entry.nHeight, entry.hash));
+        }
+        if (mi == mapKeys.end())
+        {
+            push_back(entry);
+            return false;
+        }
+        if (fReplace)
+        {
+            std::map<uint64, CFeeWindowEntry>::iterator it = mapEntries.find(mi->second);
+            bool fTimeChanged = it->second.nTime != entry.nTime;
+            it->second.nTime = entry.nTime;
+            it->second.nValue = entry.nValue;
+            setDirty.insert(it->first);
+            if (fTimeChanged)
+                RepairMaxima(it);
+            Changed();
+        }
+        return true;
+    }
+
+    /** Remove the fee with the given height and hash. */
+    bool Remove(const uint256& hash, uint64 nHeight)
+    {
+        LOCK(cs_window);
+        std::map<key_type, uint64>::iterator mi = mapKeys.find(key_type(nHeight, hash));
+        if (mi == mapKeys.end() && !fComplete)
+        {
+            if (!LoadAll())
+                return error("CFeeWindow::Remove() : failed to load fees for height %"PRI64u, nHeight);
+            mi = mapKeys.find(key_type(nHeight, hash));
+        }
+        if (mi == mapKeys.end())
+            return false;
+        std::map<uint64, CFeeWindowEntry>::iterator it = mapEntries.find(mi->second);
+        mapKeys.erase(mi);
+        setDirty.erase(it->first);
+        setErased.insert(it->first);
+        mapEntries.erase(it++);
+        RepairMaxima(it);
+        Changed();
+        return true;
+    }
+
+    /** Zero the value of the newest entry with nStart <= height < nEnd. */
+    bool ClearNewestInRange(uint64 nStart, uint64 nEnd)
+    {
+        LOCK(cs_window);
+        while (true)
+        {
+            for (std::map<uint64, CFeeWindowEntry>::reverse_iterator it = mapEntries.rbegin(); it != mapEntries.rend(); ++it)
+            {
+                if (it->second.nHeight >= nStart && it->second.nHeight < nEnd)
+                {
+                    it->second.nValue = 0;
+                    setDirty.insert(it->first);
+                    Changed();
+                    return true;
+                }
+            }
+            if (fComplete)
+                return false;
+            if (!LoadAll())
+                return error("CFeeWindow::ClearNewestInRange() : failed to load fees");
+        }
+    }
+
+    /** Fees inside the long (nWindow seconds) and short (nWindow/12 seconds)
+     *  windows ending at the newest entry at or below nHeight, each divided
+     *  by the number of blocks it spans. */
+    void GetWindowAverages(unsigned int nHeight, unsigned int nWindow, uint64& hrShort, uint64& hrLong)
+    {
+        LOCK(cs_window);
+        if (nCacheGeneration == nGeneration && nCacheHeight == nHeight && nCacheWindow == nWindow)
+        {
+            hrShort = nCacheShort;
+            hrLong = nCacheLong;
+            return;
+        }
+
+        uint64 hr1 = 1, hr12 = 1;
+        unsigned int nTargetTime = 0;
+        unsigned int nTarget1hrTime = 0;
+        unsigned int blk1hrht = nHeight - 1, blk12hrht = nHeight - 1;
+
+        const_reverse_iterator it = mapEntries.rbegin();
+        while (it != mapEntries.rend() && it->second.nHeight > nHeight)
+            ++it;
+        if (it == mapEntries.rend() && !fComplete)
+        {
+            // anchored below everything in memory
+            if (!LoadAll())
+            {
+                error("CFeeWindow::GetWindowAverages() : failed to load fees below height %u", nHeight);
+                return;
+            }
+            GetWindowAverages(nHeight, nWindow, hrShort, hrLong);
+            return;
+        }
+        if (it != mapEntries.rend())
+        {
+            hr1 = hr12 = 0;
+            nTargetTime = it->second.nTime - nWindow;
+            nTarget1hrTime = it->second.nTime - (nWindow / 12);
+            for (; it != mapEntries.rend() && it->second.nMaxTime > nTargetTime; ++it)
+            {
+                const CFeeWindowEntry& entry = it->second;
+                if (entry.nTime > nTargetTime)
+                {
+                    hr12 += entry.nValue;
+                    blk12hrht = entry.nHeight;
+                    if (entry.nTime > nTarget1hrTime)
+                    {
+                        hr1 += entry.nValue;
+                        blk1hrht = entry.nHeight;
+                    }
+                }
+            }
+            if (it == mapEntries.rend() && !fComplete && nFloorMaxTime > nTargetTime)
+            {
+                // the window reaches past what is in memory
+                if (!LoadAll())
+                {
+                    error("CFeeWindow::GetWindowAverages() : failed to load fees below height %u", nHeight);
+                    return;
+                }
+                GetWindowAverages(nHeight, nWindow, hrShort, hrLong);
+                return;
+            }
+        }
+        hr12 /= (nHeight - blk12hrht) + 1;
+        hr1 /= (nHeight - blk1hrht) + 1;
+
+        nCacheGeneration = nGeneration;
+        nCacheHeight = nHeight;
+        nCacheWindow = nWindow;
+        nCacheShort = hrShort = hr1;
+        nCacheLong = hrLong = hr12;
+    }
+};
+
+#endif
@@ -29,10 +29,6 @@ extern CAliasDB *paliasdb;
 extern COfferDB *pofferdb;
 extern CCertDB *pcertdb;
 
-void rescanforaliases(CBlockIndex *pindexRescan);
-void rescanforoffers(CBlockIndex *pindexRescan);
-void rescanforcertissuers(CBlockIndex *pindexRescan);
-
 CWallet* pwalletMain;
 CClientUIInterface uiInterface;
 
@@ -119,12 +115,8 @@ void Shutdown()
             pblocktree->Flush();
         if (pcoinsTip)
             pcoinsTip->Flush();
-        if (paliasdb)
-            paliasdb->Flush();        
-        if (pofferdb)
-            pofferdb->Flush(); 
-        if (pcertdb)
-            pcertdb->Flush();   
+        if (pcoinsTip && paliasdb && pofferdb && pcertdb)
+            CommitSyscoinChanges();
         delete pcoinsTip; pcoinsTip = NULL;
         delete pcoinsdbview; pcoinsdbview = NULL;
         delete pblocktree; pblocktree = NULL;
@@ -139,6 +131,7 @@ void Shutdown()
     if (pwalletMain)
         delete pwalletMain;
     printf("Shutdown : done\n");
+    StopDebugLog();
 }
 
 //
@@ -360,6 +353,7 @@ std::string HelpMessage()
         "  -testnet               " + _("Use the test network") + "\n" +
         "  -cakenet               " + _("Use the cake network") + "\n" +
         "  -debug                 " + _("Output extra debugging information. Implies all other -debug* options") + "\n" +
+        "  -debug=<category>      " + _("Output debugging information of one category: alias, offer, cert or net") + "\n" +
         "  -debugnet              " + _("Output extra network debugging information") + "\n" +
         "  -logtimestamps         " + _("Prepend debug output with timestamp (default: 1)") + "\n" +
         "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n" +
@@ -585,11 +579,17 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
-    // -debug implies fDebug*
+    // -debug implies fDebug* and every category, -debug=<category> the
+    // categories named
+    nLogCategories = fDebug ? LOG_ALL : 0;
+    BOOST_FOREACH(const std::string& strCategory, mapMultiArgs["-debug"])
+        nLogCategories |= GetLogCategory(strCategory);
     if (fDebug)
         fDebugNet = true;
     else
-        fDebugNet = GetBoolArg("-debugnet");
+        fDebugNet = GetBoolArg("-debugnet") || (nLogCategories & LOG_NET);
+    if (fDebugNet)
+        nLogCategories |= LOG_NET;
 
     if (fDaemon)
         fServer = true;
@@ -686,6 +686,10 @@ bool AppInit2(boost::thread_group& threadGroup)
         printf("Using %u threads for script verification\n", nScriptCheckThreads);
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadPoWCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadServiceCheck);
     }
 
     int64 nStart;
@@ -909,6 +913,13 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pofferdb = new COfferDB(nNameDBCache*2, false, fReindex);
                 pcertdb = new CCertDB(nNameDBCache*2, false, fReindex);
 
+                // move service histories stored as one vector per record
+                // to one record per version, indexed by update height
+                if (!paliasdb->UpgradeAliasIndex() || !pofferdb->UpgradeOfferIndex() || !pcertdb->UpgradeCertIssuerIndex()) {
+                    strLoadError = _("Error upgrading alias, offer and certificate databases");
+                    break;
+                }
+
                 if (fReindex) pblocktree->WriteReindexing(true);
 
                 if (!LoadBlockIndex()) {
@@ -933,6 +944,14 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // replay the blocks the alias, offer and certificate
+                // databases missed since their last commit
+                uiInterface.InitMessage(_("Rescanning..."));
+                if (!SyncSyscoinIndexes(GetBoolArg("-rescan"))) {
+                    strLoadError = _("Error rescanning alias, offer and certificate databases");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (!VerifyDB(GetArg("-checklevel", 4),
                               GetArg( "-checkblocks", 288))) {
@@ -1105,9 +1124,6 @@ bool AppInit2(boost::thread_group& threadGroup)
             pwalletMain->ScanForWalletTransactions(pindexRescan, true);
             printf(" rescan      %15"PRI64d"ms\n", GetTimeMillis() - nStart);
             pwalletMain->SetBestChain(CBlockLocator(pindexBest));
-    		rescanforaliases(pindexRescan);
-    		rescanforoffers(pindexRescan);
-    		rescanforcertissuers(pindexRescan);
             nWalletDBUpdated++;
         }
     } // (!fDisableWallet)
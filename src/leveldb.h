@@ -19,10 +19,40 @@ public:
 
 void HandleError(const leveldb::Status &status) throw(leveldb_error);
 
+// 64-bit key component serialized big-endian, so that LevelDB iterates
+// keys that share a prefix in numeric order
+class CBigEndianKey
+{
+public:
+    uint64 n;
+
+    CBigEndianKey(uint64 nIn = 0) : n(nIn) {}
+
+    unsigned int GetSerializeSize(int, int=0) const {
+        return sizeof(n);
+    }
+
+    template<typename Stream> void Serialize(Stream& s, int, int=0) const {
+        unsigned char buf[sizeof(n)];
+        for (unsigned int i = 0; i < sizeof(n); i++)
+            buf[i] = (n >> (8 * (sizeof(n) - 1 - i))) & 0xff;
+        s.write((char*)buf, sizeof(buf));
+    }
+
+    template<typename Stream> void Unserialize(Stream& s, int, int=0) {
+        unsigned char buf[sizeof(n)];
+        s.read((char*)buf, sizeof(buf));
+        n = 0;
+        for (unsigned int i = 0; i < sizeof(n); i++)
+            n = (n << 8) | buf[i];
+    }
+};
+
 // Batch of changes queued to be written to a CLevelDB
 class CLevelDBBatch
 {
     friend class CLevelDB;
+    friend class CServiceDB;
 
 private:
     leveldb::WriteBatch batch;
@@ -50,6 +80,10 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear() {
+        batch.Clear();
+    }
 };
 
 class CLevelDB
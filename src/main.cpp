@@ -34,14 +34,15 @@ unsigned int nTransactionsUpdated = 0;
 map<uint256, CBlockIndex*> mapBlockIndex;
 uint256 hashGenesisBlock(
 		"0xc84c8d0f52a7418b28a24e7b5354d6febed47c8cc33b3fa20fdbe4b3a1fcd9c4");
-static CBigNum bnProofOfWorkLimit(~uint256(0) >> 20); // Syscoin: starting difficulty is 1 / 2^12
-static CBigNum bnProofOfWorkLimitCake(~uint256(0) >> 11); // Syscoin: cakenet is cake
+static const uint256 bnProofOfWorkLimit(~uint256(0) >> 20); // Syscoin: starting difficulty is 1 / 2^12
+static const uint256 bnProofOfWorkLimitCake(~uint256(0) >> 11); // Syscoin: cakenet is cake
 CBlockIndex* pindexGenesisBlock = NULL;
 int nBestHeight = -1;
 uint256 nBestChainWork = 0;
 uint256 nBestInvalidWork = 0;
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
+std::vector<CBlockIndex*> vBlockIndexByHeight;
 set<CBlockIndex*, CBlockIndexWorkComparator> setBlockIndexValid; // may contain all CBlockIndex*'s that have validness >=BLOCK_VALID_TRANSACTIONS, and must contain those who aren't failed
 int64 nTimeBestReceived = 0;
 int nScriptCheckThreads = 0;
@@ -198,6 +199,15 @@ int GetAuxPowStartBlock() {
 		return AUXPOW_START_MAINNET;
 }
 
+int GetBinaryPayloadStartBlock() {
+	if (fTestNet)
+		return BINARY_PAYLOAD_START_TESTNET;
+	else if (fCakeNet)
+		return BINARY_PAYLOAD_START_CAKENET;
+	else
+		return BINARY_PAYLOAD_START_MAINNET;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CCoinsView implementations
@@ -1061,14 +1071,119 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTransaction &tx) {
 	// Add to memory pool without checking anything.  Don't call this directly,
 	// call CTxMemPool::accept to properly check the transaction first.
 	{
-		mapTx[hash] = tx;
+		CTxMemPoolEntry &entry = mapTx[hash];
+		unindex(hash, entry);
+		entry = CTxMemPoolEntry(tx);
+		setInputsStale.insert(hash);
 		for (unsigned int i = 0; i < tx.vin.size(); i++)
-			mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+			mapNextTx[tx.vin[i].prevout] = CInPoint(&entry.tx, i);
+		// transactions already here that spend this one, as after a reorg,
+		// now wait for it
+		std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(
+				COutPoint(hash, 0));
+		while (it != mapNextTx.end() && it->first.hash == hash) {
+			markInputsStale(it->second.ptx->GetHash());
+			it++;
+		}
+		vAdded.push_back(hash);
+		if (vAdded.size() > 10000) {
+			// templates this far behind are created anew
+			vAdded.erase(vAdded.begin(), vAdded.begin() + 5000);
+			nAddedBase += 5000;
+		}
 		nTransactionsUpdated++;
 	}
 	return true;
 }
 
+void CTxMemPool::index(const uint256& hash, const CTxMemPoolEntry &entry) {
+	double dFeePerKb = entry.GetFeePerKb();
+	setByFee.insert(make_pair(dFeePerKb, hash));
+	setByPriority.insert(make_pair(make_pair(entry.GetPriority(nPriorityHeight), dFeePerKb), hash));
+}
+
+void CTxMemPool::unindex(const uint256& hash, const CTxMemPoolEntry &entry) {
+	if (!entry.fInputsRead)
+		return;
+	double dFeePerKb = entry.GetFeePerKb();
+	setByFee.erase(make_pair(dFeePerKb, hash));
+	setByPriority.erase(make_pair(make_pair(entry.GetPriority(nPriorityHeight), dFeePerKb), hash));
+}
+
+void CTxMemPool::markInputsStale(const uint256& hash) {
+	std::map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.find(hash);
+	if (mi == mapTx.end())
+		return;
+	unindex(hash, mi->second);
+	mi->second.MarkInputsStale();
+	setInputsStale.insert(hash);
+}
+
+// Fee and priority inputs of entry, from the chain through view and from the
+// transactions in the pool it spends
+bool CTxMemPool::readInputs(CTxMemPoolEntry &entry, CCoinsViewCache &view) {
+	const CTransaction &tx = entry.tx;
+	entry.MarkInputsStale();
+	if (tx.IsCoinBase())
+		return false;
+
+	int64 nTotalIn = 0;
+	BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+		if (!view.HaveCoins(txin.prevout.hash)) {
+			// This should never happen; all transactions in the memory
+			// pool should connect to either transactions in the chain
+			// or other transactions in the memory pool.
+			std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mapTx.find(
+					txin.prevout.hash);
+			if (mi == mapTx.end()) {
+				printf("ERROR: mempool transaction missing input\n");
+				entry.MarkInputsStale();
+				return false;
+			}
+			entry.setParents.insert(txin.prevout.hash);
+			nTotalIn += mi->second.tx.vout[txin.prevout.n].nValue;
+			continue;
+		}
+		const CCoins &coins = view.GetCoins(txin.prevout.hash);
+
+		int64 nValueIn = coins.vout[txin.prevout.n].nValue;
+		nTotalIn += nValueIn;
+		entry.nValueInChain += nValueIn;
+		entry.dValueHeightInChain += (double) nValueIn * coins.nHeight;
+	}
+	entry.nFee = nTotalIn - tx.GetValueOut();
+	entry.fInputsRead = true;
+	return true;
+}
+
+// Bring the fee and priority indexes up to date for a block at nHeight. Only
+// the entries that came in or whose parents changed since the last call are
+// read; a new height re-sorts the priorities once.
+void CTxMemPool::updateIndexes(CCoinsViewCache &view, int nHeight) {
+	LOCK(cs);
+	if (nHeight != nPriorityHeight) {
+		nPriorityHeight = nHeight;
+		setByPriority.clear();
+		for (std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mapTx.begin();
+				mi != mapTx.end(); ++mi)
+			if (mi->second.fInputsRead)
+				setByPriority.insert(make_pair(make_pair(mi->second.GetPriority(nHeight),
+						mi->second.GetFeePerKb()), mi->first));
+	}
+
+	std::set<uint256> setStillStale;
+	BOOST_FOREACH(const uint256& hash, setInputsStale) {
+		std::map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.find(hash);
+		if (mi == mapTx.end())
+			continue;
+		if (readInputs(mi->second, view))
+			index(hash, mi->second);
+		else if (!mi->second.tx.IsCoinBase())
+			setStillStale.insert(hash);
+	}
+	setInputsStale.swap(setStillStale);
+}
+
 
 bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive) {
 	// Remove transaction from memory pool
@@ -1083,10 +1198,22 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive) {
 					remove(*it->second.ptx, true);
 			}
 		}
-		if (mapTx.count(hash)) {
+		std::map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.find(hash);
+		if (mi != mapTx.end()) {
 			BOOST_FOREACH(const CTxIn& txin, tx.vin)
 				mapNextTx.erase(txin.prevout);
-			mapTx.erase(hash);
+			unindex(hash, mi->second);
+			setInputsStale.erase(hash);
+			mapTx.erase(mi);
+			nRemoved++;
+			// what spends it stays, as when it was mined, and finds its
+			// inputs in the chain now
+			std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(
+					COutPoint(hash, 0));
+			while (it != mapNextTx.end() && it->first.hash == hash) {
+				markInputsStale(it->second.ptx->GetHash());
+				it++;
+			}
 			nTransactionsUpdated++;
 		}
 	}
@@ -1112,6 +1239,13 @@ void CTxMemPool::clear() {
 	LOCK(cs);
 	mapTx.clear();
 	mapNextTx.clear();
+	setByFee.clear();
+	setByPriority.clear();
+	setInputsStale.clear();
+	nPriorityHeight = -1;
+	nAddedBase += vAdded.size();
+	vAdded.clear();
+	nRemoved++;
 	++nTransactionsUpdated;
 }
 
@@ -1120,7 +1254,7 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid) {
 
 	LOCK(cs);
 	vtxid.reserve(mapTx.size());
-	for (map<uint256, CTransaction>::iterator mi = mapTx.begin();
+	for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin();
 			mi != mapTx.end(); ++mi)
 		vtxid.push_back((*mi).first);
 }
@@ -1248,30 +1382,130 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
 // CBlock and CBlockIndex
 //
 
-static CBlockIndex* pblockindexFBBHLast;
 CBlockIndex* FindBlockByHeight(int nHeight) {
-	CBlockIndex *pblockindex;
-	if (nHeight < nBestHeight / 2)
-		pblockindex = pindexGenesisBlock;
-	else
-		pblockindex = pindexBest;
-	if (pblockindexFBBHLast
-			&& abs(nHeight - pblockindex->nHeight)
-					> abs(nHeight - pblockindexFBBHLast->nHeight))
-		pblockindex = pblockindexFBBHLast;
-	while (pblockindex->nHeight > nHeight)
-		pblockindex = pblockindex->pprev;
-	while (pblockindex->nHeight < nHeight)
-		pblockindex = pblockindex->pnext;
-	pblockindexFBBHLast = pblockindex;
-	return pblockindex;
+	if (nHeight < 0 || nHeight >= (int) vBlockIndexByHeight.size())
+		return NULL;
+	return vBlockIndexByHeight[nHeight];
+}
+
+// make vBlockIndexByHeight the chain ending in pindexNew, rewriting only
+// the entries above the fork with the chain it held before
+static void SetBlockIndexByHeight(CBlockIndex* pindexNew) {
+	if (pindexNew == NULL) {
+		vBlockIndexByHeight.clear();
+		return;
+	}
+	vBlockIndexByHeight.resize(pindexNew->nHeight + 1);
+	for (CBlockIndex* pindex = pindexNew;
+			pindex && vBlockIndexByHeight[pindex->nHeight] != pindex;
+			pindex = pindex->pprev)
+		vBlockIndexByHeight[pindex->nHeight] = pindex;
 }
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex) {
-	if (!ReadFromDisk(pindex->GetBlockPos()))
+	boost::shared_ptr<const CBlock> pblock = GetCachedBlock(pindex);
+	if (!pblock) {
+		SetNull();
 		return false;
-	if (GetHash() != pindex->GetBlockHash())
-		return error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
+	}
+	*this = *pblock;
+	return true;
+}
+
+boost::shared_ptr<const CBlock> GetCachedBlock(const CBlockIndex* pindex) {
+	uint256 hash = pindex->GetBlockHash();
+	boost::shared_ptr<const CBlock> pblock = blockCache.Lookup(hash);
+	if (pblock)
+		return pblock;
+
+	CBlock *pblockRead = new CBlock();
+	pblock.reset(pblockRead);
+	if (!pblockRead->ReadFromDisk(pindex->GetBlockPos()))
+		return boost::shared_ptr<const CBlock>();
+	if (pblockRead->GetHash() != hash) {
+		error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
+		return boost::shared_ptr<const CBlock>();
+	}
+	// the cached block is shared between threads as const, so its memory
+	// only members are filled now; GetMerkleBranch() would build them lazily
+	pblockRead->BuildMerkleTree();
+	blockCache.Insert(hash, pblock, ::GetSerializeSize(*pblockRead, SER_DISK, CLIENT_VERSION));
+	return pblock;
+}
+
+// number of mappings open on each block file; FlushBlockFile() does not
+// truncate a file under them, as touching a page past the new end of a
+// mapped file raises SIGBUS. Protected by cs_LastBlockFile.
+static std::map<int, int> mapMappedBlockFiles;
+
+// map block file nFile for reading, keeping it from being truncated until
+// UnmapBlockFile()
+static bool MapBlockFile(CMappedFile &mapped, FILE *file, int nFile, bool fSequential) {
+	LOCK(cs_LastBlockFile);
+	if (!mapped.Open(file, fSequential))
+		return false;
+	mapMappedBlockFiles[nFile]++;
+	return true;
+}
+
+static void UnmapBlockFile(CMappedFile &mapped, int nFile) {
+	LOCK(cs_LastBlockFile);
+	if (!mapped.IsOpen())
+		return;
+	mapped.Close();
+	if (--mapMappedBlockFiles[nFile] == 0)
+		mapMappedBlockFiles.erase(nFile);
+}
+
+CBlockFileReader::~CBlockFileReader() {
+	for (std::map<int, CMappedFile*>::iterator mi = mapFiles.begin(); mi != mapFiles.end(); ++mi) {
+		if (mi->second)
+			UnmapBlockFile(*mi->second, mi->first);
+		delete mi->second;
+	}
+}
+
+const CMappedFile *CBlockFileReader::GetFile(int nFile) {
+	LOCK(cs);
+	std::map<int, CMappedFile*>::iterator mi = mapFiles.find(nFile);
+	if (mi != mapFiles.end())
+		return mi->second;
+	CMappedFile *pfile = NULL;
+	FILE *file = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+	if (file) {
+		pfile = new CMappedFile();
+		if (!MapBlockFile(*pfile, file, nFile, true)) {
+			delete pfile;
+			pfile = NULL;
+		}
+		fclose(file);
+	}
+	mapFiles[nFile] = pfile;
+	return pfile;
+}
+
+bool CBlockFileReader::ReadBlock(CBlock &block, const CBlockIndex *pindex) {
+	CDiskBlockPos pos = pindex->GetBlockPos();
+	const CMappedFile *pfile = GetFile(pos.nFile);
+	// the block is preceded by its size
+	unsigned int nSize = 0;
+	if (pfile && pos.nPos >= sizeof(nSize) && pos.nPos <= pfile->size())
+		memcpy(&nSize, pfile->begin() + pos.nPos - sizeof(nSize), sizeof(nSize));
+	if (nSize < 80 || nSize > MAX_BLOCK_SIZE || nSize > pfile->size() - pos.nPos)
+		return block.ReadFromDisk(pindex);
+
+	block.SetNull();
+	pfile->WillNeed(pos.nPos, nSize);
+	try {
+		CMemoryStream blkdat(pfile->begin() + pos.nPos, nSize, SER_DISK, CLIENT_VERSION);
+		blkdat >> block;
+	} catch (std::exception &e) {
+		return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+	}
+	if (!block.CheckProofOfWork(INT_MAX))
+		return error("CBlockFileReader::ReadBlock() : errors in block header");
+	if (block.GetHash() != pindex->GetBlockHash())
+		return error("CBlockFileReader::ReadBlock() : GetHash() doesn't match index");
 	return true;
 }
 
@@ -1353,7 +1587,7 @@ unsigned int ComputeMinWork(unsigned int nBase, int64 nTime) {
 	if (fCakeNet && nTime > nTargetSpacing * 2)
 		return bnProofOfWorkLimitCake.GetCompact();
 
-	CBigNum bnResult;
+	uint256 bnResult;
 	if(fCakeNet) {
 		bnResult.SetCompact(nBase);
 		while (nTime > 0 && bnResult < bnProofOfWorkLimitCake) {
@@ -1389,13 +1623,13 @@ unsigned int static KimotoGravityWell(const CBlockIndex* pindexLast,
 	int64 PastRateActualSeconds = 0;
 	int64 PastRateTargetSeconds = 0;
 	double PastRateAdjustmentRatio = double(1);
-	CBigNum PastDifficultyAverage;
-	CBigNum PastDifficultyAveragePrev;
+	uint256 PastDifficultyAverage;
+	uint256 PastDifficultyAveragePrev;
 	double EventHorizonDeviation;
 	double EventHorizonDeviationFast;
 	double EventHorizonDeviationSlow;
 
-	CBigNum bnPOWLimit = fCakeNet ? bnProofOfWorkLimitCake : bnProofOfWorkLimit;
+	uint256 bnPOWLimit = fCakeNet ? bnProofOfWorkLimitCake : bnProofOfWorkLimit;
 	if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0
 			|| (uint64) BlockLastSolved->nHeight < PastBlocksMin) {
 		return bnPOWLimit.GetCompact();
@@ -1409,10 +1643,18 @@ unsigned int static KimotoGravityWell(const CBlockIndex* pindexLast,
 
 		if (i == 1)
 			PastDifficultyAverage.SetCompact(BlockReading->nBits);
-		else
-			PastDifficultyAverage = ((CBigNum().SetCompact(BlockReading->nBits)
-					- PastDifficultyAveragePrev) / i)
-					+ PastDifficultyAveragePrev;
+		else {
+			// ((nBits - prev) / i) + prev, the division truncating toward
+			// zero as it did on signed bignums
+			uint256 bnBits;
+			bnBits.SetCompact(BlockReading->nBits);
+			if (bnBits >= PastDifficultyAveragePrev)
+				PastDifficultyAverage = PastDifficultyAveragePrev
+						+ (bnBits - PastDifficultyAveragePrev) / i;
+			else
+				PastDifficultyAverage = PastDifficultyAveragePrev
+						- (PastDifficultyAveragePrev - bnBits) / i;
+		}
 
 		PastDifficultyAveragePrev = PastDifficultyAverage;
 		PastRateActualSeconds = BlockLastSolved->GetBlockTime()
@@ -1448,10 +1690,21 @@ unsigned int static KimotoGravityWell(const CBlockIndex* pindexLast,
 		BlockReading = BlockReading->pprev;
 	}
 
-	CBigNum bnNew(PastDifficultyAverage);
+	uint256 bnNew(PastDifficultyAverage);
 	if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0) {
-		bnNew *= PastRateActualSeconds;
-		bnNew /= PastRateTargetSeconds;
+		// bnNew * actual / target, split as (q * target + r) * actual / target
+		// so that it cannot overflow: the block times are 32 bits, so both
+		// r * actual and the target fit in 64, and a quotient whose product
+		// would pass the limit is capped right away
+		uint32_t nActual = (uint32_t) PastRateActualSeconds;
+		uint32_t nTarget = (uint32_t) PastRateTargetSeconds;
+		uint256 bnQuotient = bnNew / nTarget;
+		uint64 nRemainder = (bnNew - bnQuotient * nTarget).Get64();
+		if (bnQuotient > bnPOWLimit / nActual)
+			bnNew = bnPOWLimit;
+		else
+			bnNew = bnQuotient * nActual
+					+ uint256(nRemainder * nActual / nTarget);
 	}
 
 	if (bnNew > bnPOWLimit)
@@ -1461,31 +1714,63 @@ unsigned int static KimotoGravityWell(const CBlockIndex* pindexLast,
 }
 
 // Using KGW
-unsigned int static GetNextWorkRequired(const CBlockIndex* pindexLast,
+unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast,
 		const CBlockHeader *pblock) {
 	static const int64 BlocksTargetSpacing = 60;
 	uint64 PastBlocksMin = 7;
 	uint64 PastBlocksMax = 98;
 
-	return KimotoGravityWell(pindexLast, pblock, BlocksTargetSpacing,
-			PastBlocksMin, PastBlocksMax);
+	// The well only looks at pindexLast and its ancestors, which never
+	// change once indexed, so the walk is done once per block and kept
+	// alongside it for AcceptBlock() and every template built on top.
+	// Its running averages start from pindexLast itself, so nothing of
+	// the walk of the parent can be carried over.
+	if (pindexLast && pindexLast->nBitsNext != 0)
+		return pindexLast->nBitsNext;
+
+	unsigned int nBitsNext = KimotoGravityWell(pindexLast, pblock,
+			BlocksTargetSpacing, PastBlocksMin, PastBlocksMax);
+	if (pindexLast)
+		pindexLast->nBitsNext = nBitsNext;
+	return nBitsNext;
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits) {
-	CBigNum bnTarget;
-	bnTarget.SetCompact(nBits);
+	bool fNegative;
+	bool fOverflow;
+	uint256 bnTarget;
+	bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
 	// Check range
-	if ( ( bnTarget <= 0 || bnTarget > bnProofOfWorkLimit ) && !fCakeNet)
+	if ( ( fNegative || bnTarget == 0 || fOverflow || bnTarget > bnProofOfWorkLimit ) && !fCakeNet)
 		return error("CheckProofOfWork() : nBits below minimum work");
 
 	// Check proof of work matches claimed amount
-	if (hash > bnTarget.getuint256())
+	if (hash > bnTarget)
 		return error("CheckProofOfWork() : hash doesn't match nBits");
 
 	return true;
 }
 
+void GetPoWHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHash) {
+	// the header whose scrypt hash is the proof of work: the parent block's
+	// for merge-mined blocks
+	std::vector<const CBlockHeader*> vPoWHeaders;
+	vPoWHeaders.reserve(vHeaders.size());
+	BOOST_FOREACH(const CBlockHeader* pheader, vHeaders)
+		vPoWHeaders.push_back(pheader->auxpow.get() != NULL ? &pheader->auxpow->parentBlockHeader : pheader);
+	vHash.assign(vPoWHeaders.size(), 0);
+	if (vPoWHeaders.empty())
+		return;
+
+	std::vector<char> vInput(80 * vPoWHeaders.size());
+	for (unsigned int i = 0; i < vPoWHeaders.size(); i++)
+		memcpy(&vInput[80 * i], BEGIN(vPoWHeaders[i]->nVersion), 80);
+	std::vector<char> vScratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+	scrypt_1024_1_1_256_sp_multi(&vInput[0], BEGIN(vHash[0]), &vScratchpad[0],
+			vPoWHeaders.size());
+}
+
 // Return maximum amount of blocks that other nodes claim to have
 int GetNumBlocksOfPeers() {
 	return std::max(cPeerBlockCounts.median(),
@@ -1525,7 +1810,7 @@ void static InvalidChainFound(CBlockIndex* pindexNew) {
 	if (pindexBest
 			&& nBestInvalidWork
 					> nBestChainWork
-							+ (pindexBest->GetBlockWork() * 6).getuint256())
+							+ pindexBest->GetBlockWork() * 6)
 		printf(
 				"InvalidChainFound: Warning: Displayed transactions may not be correct! You may need to upgrade, or other nodes may need to upgrade.\n");
 }
@@ -1545,37 +1830,218 @@ bool LoadSyscoinFees() {
 	TRY_LOCK(cs_main, cs_maintry);
     // read alias and offer indexes
 
-    // read alias network fees
-    lstAliasFees.clear();
-    vector<CAliasFee> va;
-    paliasdb->ReadAliasTxFees(va);
-    list<CAliasFee> lAF(va.begin(), va.end());
-    lstAliasFees = lAF;
-	BOOST_FOREACH(CAliasFee& fee, lstAliasFees) {
-		printf("Alias Fee - height: %llu \t value: %llu\n", fee.nHeight, fee.nValue);
+    // read the recent part of each network fee history; older records
+    // are paged in on demand
+    if (!LoadAliasFees(nBestHeight))
+        return error("LoadSyscoinFees() : failed to read alias fees");
+    if (!LoadOfferFees(nBestHeight))
+        return error("LoadSyscoinFees() : failed to read offer fees");
+    if (!LoadCertFees(nBestHeight))
+        return error("LoadSyscoinFees() : failed to read cert issuer fees");
+
+    return true;
+}
+
+// Drop the Syscoin service changes of blocks that were not accepted, and
+// reread the fee windows they touched
+static void DiscardSyscoinChanges() {
+	paliasdb->Discard();
+	pofferdb->Discard();
+	pcertdb->Discard();
+	LoadSyscoinFees();
+}
+
+bool CommitSyscoinChanges() {
+	CBlockIndex *pindex = pcoinsTip->GetBestBlock();
+	if (pindex == NULL)
+		return true;
+	uint256 hashBlock = pindex->GetBlockHash();
+	return paliasdb->Commit(hashBlock) && pofferdb->Commit(hashBlock)
+			&& pcertdb->Commit(hashBlock);
+}
+
+// First block a Syscoin service database is missing, or NULL if it is up to
+// date; the genesis block when it was marked with a block off the main chain
+static CBlockIndex *GetSyscoinRescanStart(CServiceDB &db) {
+	uint256 hashBlock;
+	// databases written by older versions were updated block by block
+	if (!db.ReadBestBlock(hashBlock) || hashBlock == pindexBest->GetBlockHash())
+		return NULL;
+	map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+	if (mi == mapBlockIndex.end() || mi->second->pnext == NULL)
+		return pindexGenesisBlock;
+	return mi->second->pnext;
+}
+
+static const int SYSCOIN_RESCAN_COMMIT_INTERVAL = 1000;
+
+/** Reads the blocks of the main chain from a starting block onwards on
+ *  worker threads, a bounded number of blocks ahead of the one consumer
+ *  that takes them in order. Transactions of other versions than
+ *  SYSCOIN_TX_VERSION are dropped on the worker.
+ */
+class CSyscoinBlockReader {
+private:
+	boost::mutex mutex;
+	boost::condition_variable cond;
+	boost::thread_group threads;
+
+	CBlockFileReader blockfiles;
+	std::vector<CBlockIndex*> vIndex;
+	// blocks read but not taken yet, by position, with whether the read succeeded
+	std::map<unsigned int, std::pair<bool, CBlock> > mapRead;
+	unsigned int nNextRead;
+	unsigned int nNextTaken;
+	unsigned int nAhead;
+	bool fStop;
+
+	void Worker() {
+		while (true) {
+			unsigned int nPos;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				while (!fStop && nNextRead < vIndex.size() && nNextRead >= nNextTaken + nAhead)
+					cond.wait(lock);
+				if (fStop || nNextRead >= vIndex.size())
+					return;
+				nPos = nNextRead++;
+			}
+			CBlock block;
+			bool fRead = blockfiles.ReadBlock(block, vIndex[nPos]);
+			std::vector<CTransaction> vtx;
+			BOOST_FOREACH(const CTransaction &tx, block.vtx)
+				if (tx.nVersion == SYSCOIN_TX_VERSION)
+					vtx.push_back(tx);
+			block.vtx.swap(vtx);
+			{
+				boost::unique_lock<boost::mutex> lock(mutex);
+				std::pair<bool, CBlock> &entry = mapRead[nPos];
+				entry.first = fRead;
+				entry.second = block;
+			}
+			cond.notify_all();
+		}
+	}
+
+public:
+	CSyscoinBlockReader(CBlockIndex *pindexStart, int nThreads, unsigned int nAheadIn) :
+			nNextRead(0), nNextTaken(0), nAhead(nAheadIn), fStop(false) {
+		if (pindexStart && FindBlockByHeight(pindexStart->nHeight) == pindexStart)
+			vIndex.assign(vBlockIndexByHeight.begin() + pindexStart->nHeight, vBlockIndexByHeight.end());
+		for (int i = 0; i < nThreads; i++)
+			threads.create_thread(boost::bind(&CSyscoinBlockReader::Worker, this));
 	}
 
-    // read offer network fees
-    lstOfferFees.clear();
-    vector<COfferFee> vo;
-    pofferdb->ReadOfferTxFees(vo);
-    list<COfferFee> lOF(vo.begin(), vo.end());
-    lstOfferFees = lOF;
-	BOOST_FOREACH(COfferFee& fee, lstOfferFees) {
-		printf("Offer Fee - height: %llu \t value: %llu\n", fee.nHeight, fee.nFee);
+	~CSyscoinBlockReader() {
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			fStop = true;
+		}
+		cond.notify_all();
+		threads.join_all();
 	}
 
-    // read cert issuer network fees
-    lstCertIssuerFees.clear();
-    vector<CCertFee> vc;
-    pcertdb->ReadCertFees(vc);
-    list<CCertFee> lCF(vc.begin(), vc.end());
-    lstCertIssuerFees = lCF;
-	BOOST_FOREACH(CCertFee& fee, lstCertIssuerFees) {
-		printf("Cert Fee - height: %llu \t value: %llu\n", fee.nHeight, fee.nFee);
+	/** Wait for the next block in chain order; false once every block has
+	 *  been taken. fRead tells whether it could be read from disk. */
+	bool Next(CBlockIndex *&pindex, CBlock &block, bool &fRead) {
+		boost::unique_lock<boost::mutex> lock(mutex);
+		if (nNextTaken >= vIndex.size())
+			return false;
+		std::map<unsigned int, std::pair<bool, CBlock> >::iterator mi;
+		while ((mi = mapRead.find(nNextTaken)) == mapRead.end())
+			cond.wait(lock);
+		pindex = vIndex[nNextTaken];
+		fRead = mi->second.first;
+		block = mi->second.second;
+		mapRead.erase(mi);
+		nNextTaken++;
+		cond.notify_all();
+		return true;
 	}
+};
 
-    return true;
+// Rebuild the Syscoin service databases from the given blocks on (NULL for
+// one that is up to date) in a single pass over the chain. Blocks are read
+// and deserialized ahead on worker threads, and the changes committed in
+// batches of SYSCOIN_RESCAN_COMMIT_INTERVAL blocks, so an interrupted rescan
+// resumes at the last batch.
+static bool ReconstructSyscoinIndexes(CBlockIndex *pindexAlias, CBlockIndex *pindexOffer, CBlockIndex *pindexCert) {
+	// the block readers never take cs_main, so the chain can be held still
+	// for the whole pass
+	LOCK(cs_main);
+	CBlockIndex *pindexStart = NULL;
+	CBlockIndex *vpindex[] = { pindexAlias, pindexOffer, pindexCert };
+	BOOST_FOREACH(CBlockIndex *pindex, vpindex)
+		if (pindex && (!pindexStart || pindex->nHeight < pindexStart->nHeight))
+			pindexStart = pindex;
+	if (!pindexStart)
+		return true;
+
+	printf("Scanning blockchain from block %d to rebuild Syscoin service indexes...\n", pindexStart->nHeight);
+	int64 nStart = GetTimeMillis();
+	if (pindexOffer)
+		offerFeeWindow.ClearNewestInRange(pindexOffer->nHeight, pindexBest->nHeight);
+
+	CSyscoinBlockReader reader(pindexStart, std::max(nScriptCheckThreads, 1), 256);
+	CBlockIndex *pindex;
+	CBlock block;
+	bool fRead;
+	int nBlocks = 0;
+	while (reader.Next(pindex, block, fRead)) {
+		if (!fRead)
+			return error("ReconstructSyscoinIndexes() : failed to read block %s",
+					pindex->GetBlockHash().ToString().c_str());
+		nBlocks++;
+
+		bool fAlias = pindexAlias && pindex->nHeight >= pindexAlias->nHeight;
+		bool fOffer = pindexOffer && pindex->nHeight >= pindexOffer->nHeight;
+		bool fCert = pindexCert && pindex->nHeight >= pindexCert->nHeight;
+		if ((fAlias && !paliasdb->ReconstructBlock(block, pindex))
+				|| (fOffer && !pofferdb->ReconstructBlock(block, pindex))
+				|| (fCert && !pcertdb->ReconstructBlock(block, pindex)))
+			return false;
+
+		// only databases that have caught up with this block may be marked with it
+		if (nBlocks % SYSCOIN_RESCAN_COMMIT_INTERVAL == 0 || pindex == pindexBest) {
+			uint256 hashBlock = pindex->GetBlockHash();
+			if ((fAlias && !(paliasdb->Flush() && paliasdb->Commit(hashBlock)))
+					|| (fOffer && !(pofferdb->Flush() && pofferdb->Commit(hashBlock)))
+					|| (fCert && !(pcertdb->Flush() && pcertdb->Commit(hashBlock))))
+				return error("ReconstructSyscoinIndexes() : failed to write to Syscoin service databases");
+		}
+	}
+	printf(" rescan      %15"PRI64d"ms (%d blocks)\n", GetTimeMillis() - nStart, nBlocks);
+	return true;
+}
+
+bool SyncSyscoinIndexes(bool fRescan) {
+	if (pindexBest == NULL)
+		return true;
+
+	CBlockIndex *pindexAlias = fRescan ? pindexGenesisBlock : GetSyscoinRescanStart(*paliasdb);
+	CBlockIndex *pindexOffer = fRescan ? pindexGenesisBlock : GetSyscoinRescanStart(*pofferdb);
+	CBlockIndex *pindexCert = fRescan ? pindexGenesisBlock : GetSyscoinRescanStart(*pcertdb);
+	// a database rebuilt from the genesis block may hold entries of blocks
+	// that left the main chain, so it starts over empty
+	if ((pindexAlias == pindexGenesisBlock && !paliasdb->Clear())
+			|| (pindexOffer == pindexGenesisBlock && !pofferdb->Clear())
+			|| (pindexCert == pindexGenesisBlock && !pcertdb->Clear()))
+		return error("SyncSyscoinIndexes() : failed to clear Syscoin service databases");
+	LoadSyscoinFees();
+	if (pindexAlias)
+		printf("Alias DB is %d blocks behind\n", pindexBest->nHeight - pindexAlias->nHeight + 1);
+	if (pindexOffer)
+		printf("Offer DB is %d blocks behind\n", pindexBest->nHeight - pindexOffer->nHeight + 1);
+	if (pindexCert)
+		printf("Certificate DB is %d blocks behind\n", pindexBest->nHeight - pindexCert->nHeight + 1);
+	if (!ReconstructSyscoinIndexes(pindexAlias, pindexOffer, pindexCert))
+		return error("SyncSyscoinIndexes() : rescan failed");
+
+	// also stores upgraded records and stamps databases that had no marker yet
+	uint256 hashBlock = pindexBest->GetBlockHash();
+	return paliasdb->Flush() && paliasdb->Commit(hashBlock)
+			&& pofferdb->Flush() && pofferdb->Commit(hashBlock)
+			&& pcertdb->Flush() && pcertdb->Commit(hashBlock);
 }
 
 bool ConnectBestBlock(CValidationState &state) {
@@ -1728,9 +2194,47 @@ bool VerifySignature(const CCoins& txFrom, const CTransaction& txTo,
 	return CScriptCheck(txFrom, txTo, nIn, flags, nHashType)();
 }
 
+CServiceCheck::CServiceCheck(CBlockIndex *pindexIn, const CTransaction &txIn,
+		CCoinsViewCache &inputs, std::map<std::vector<unsigned char>,uint256> &mapTestPoolIn,
+		bool fBlockIn, bool fMinerIn, bool fJustCheckIn) :
+		pindex(pindexIn), ptx(&txIn), pmapTestPool(&mapTestPoolIn),
+		fBlock(fBlockIn), fMiner(fMinerIn), fJustCheck(fJustCheckIn) {
+	BOOST_FOREACH(const CTxIn &txin, txIn.vin) {
+		const uint256 &hash = txin.prevout.hash;
+		bool fHave = false;
+		for (unsigned int i = 0; i < vPrevCoins.size() && !fHave; i++)
+			fHave = vPrevCoins[i].first == hash;
+		if (!fHave)
+			vPrevCoins.push_back(std::make_pair(hash, inputs.GetCoins(hash)));
+	}
+}
+
+bool CServiceCheck::operator()() const {
+	CCoinsView dummy;
+	CCoinsViewCache view(dummy);
+	for (unsigned int i = 0; i < vPrevCoins.size(); i++)
+		view.SetCoins(vPrevCoins[i].first, vPrevCoins[i].second);
+
+	CValidationState state;
+	vector<vector<unsigned char> > vvchArgs;
+	int op;
+	int nOut;
+	if (DecodeAliasTx(*ptx, op, nOut, vvchArgs, -1) && IsAliasOp(op)
+			&& !VerifyAliasInputs(pindex, *ptx, state, view, *pmapTestPool, fBlock, fMiner, fJustCheck))
+		return false;
+	if (DecodeOfferTx(*ptx, op, nOut, vvchArgs, pindex->nHeight) && IsOfferOp(op)
+			&& !VerifyOfferInputs(pindex, *ptx, state, view, *pmapTestPool, fBlock, fMiner, fJustCheck))
+		return false;
+	if (DecodeCertTx(*ptx, op, nOut, vvchArgs, pindex->nHeight) && IsCertOp(op)
+			&& !VerifyCertInputs(pindex, *ptx, state, view, *pmapTestPool, fBlock, fMiner, fJustCheck))
+		return false;
+	return true;
+}
+
 bool CTransaction::CheckInputs(CBlockIndex *pindex, CValidationState &state, CCoinsViewCache &inputs,
 		bool fScriptChecks, unsigned int flags, std::map<std::vector<unsigned char>,uint256> &mapTestPool,
-		std::vector<CScriptCheck> *pvChecks, bool bJustCheck, bool fBlock, bool fMiner) const {
+		std::vector<CScriptCheck> *pvChecks, bool bJustCheck, bool fBlock, bool fMiner,
+		std::vector<CServiceCheck> *pvServiceChecks) const {
 	
 	if (!IsCoinBase()) {
 		if (pvChecks)
@@ -1772,23 +2276,38 @@ bool CTransaction::CheckInputs(CBlockIndex *pindex, CValidationState &state, CCo
 		vector<vector<unsigned char> > vvchArgs;
 		int op;
 		int nOut;
+		bool fService = false;
 
+		// with pvServiceChecks the checks that only read are queued below
+		// and only the DB writes, which must follow block order, run here
 		bool bGood = DecodeAliasTx(*this, op, nOut, vvchArgs, -1);
 		if(bGood && IsAliasOp(op)) {
-			if (!CheckAliasInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
+			if (pvServiceChecks ? !ConnectAliasInputs(pindex, *this, inputs, mapTestPool, fBlock, fMiner, bJustCheck)
+					: !CheckAliasInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
 				return false;
+			fService = true;
 		}
 		
 		bGood = DecodeOfferTx(*this, op, nOut, vvchArgs, pindex->nHeight);
 		if (bGood && IsOfferOp(op)) {
-			if (!CheckOfferInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
+			if (pvServiceChecks ? !ConnectOfferInputs(pindex, *this, mapTestPool, fBlock, fMiner, bJustCheck)
+					: !CheckOfferInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
 				return false;
+			fService = true;
 		} 
 		
 		bGood = DecodeCertTx(*this, op, nOut, vvchArgs, pindex->nHeight);
 		if (bGood && IsCertOp(op)) {
-			if (!CheckCertInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
+			if (pvServiceChecks ? !ConnectCertInputs(pindex, *this, mapTestPool, fBlock, fMiner, bJustCheck)
+					: !CheckCertInputs(pindex, *this, state, inputs, mapTestPool, fBlock, fMiner, bJustCheck))
 				return false;
+			fService = true;
+		}
+
+		if (fService && pvServiceChecks) {
+			CServiceCheck check(pindex, *this, inputs, mapTestPool, fBlock, fMiner, bJustCheck);
+			pvServiceChecks->push_back(CServiceCheck());
+			check.swap(pvServiceChecks->back());
 		}
 
 		if (nValueIn < GetValueOut())
@@ -1857,25 +2376,14 @@ bool DisconnectAlias( CBlockIndex *pindex, const CTransaction &tx, int op, vecto
 	if(op != OP_ALIAS_NEW) {
 
 		string opName = aliasFromOp(op);
-		vector<CAliasIndex> vtxPos;
-		if (!paliasdb->ReadAlias(vvchArgs[0], vtxPos))
+		if (!paliasdb->ExistsAlias(vvchArgs[0]))
 			return error("DisconnectBlock() : failed to read from alias DB for %s %s\n",
 					opName.c_str(), stringFromVch(vvchArgs[0]).c_str());
 
-		// vtxPos might be empty if we pruned expired transactions.  However, it should normally still not
-		// be empty, since a reorg cannot go that far back.  Be safe anyway and do not try to pop if empty.
-		if (vtxPos.size()) {
-			CDiskTxPos txindex;
-			if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
-				return error("DisconnectBlock() : failed to read tx index for %s %s %s\n",
-						opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
-			if (vtxPos.back().txHash == tx.GetHash())
-				vtxPos.pop_back();
-			// TODO validate that the first pos is the current tx pos
-		}
-
-		if(!paliasdb->WriteName(vvchArgs[0], vtxPos))
-			return error("DisconnectBlock() : failed to write to alias DB");
+		CDiskTxPos txindex;
+		if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
+			return error("DisconnectBlock() : failed to read tx index for %s %s %s\n",
+					opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
 
 		CAliasFee theFeeObject;
 		theFeeObject.hash =  tx.GetHash();
@@ -1883,9 +2391,10 @@ bool DisconnectAlias( CBlockIndex *pindex, const CTransaction &tx, int op, vecto
 		theFeeObject.nValue = 0;
 		//RemoveAliasFee(theFeeObject);
 		InsertAliasFee(pindex, tx.GetHash(), 0);
-		vector<CAliasFee> vAliasFees(lstAliasFees.begin(), lstAliasFees.end());
-		if (!paliasdb->WriteAliasTxFees(vAliasFees))
-			return error( "DisconnectBlock() : failed to write fees to alias DB");
+
+		// drop the version this tx wrote, if it is still the latest
+		if(!paliasdb->PopName(vvchArgs[0], tx.GetHash(), aliasFeeWindow))
+			return error("DisconnectBlock() : failed to write to alias DB");
 
 	}
 
@@ -1907,8 +2416,7 @@ bool DisconnectOffer( CBlockIndex *pindex, const CTransaction &tx, int op, vecto
 
     if(op != OP_OFFER_NEW) {
         // make sure a DB record exists for this offer
-        vector<COffer> vtxPos;
-        if (!pofferdb->ReadOffer(vvchArgs[0], vtxPos))
+        if (!pofferdb->ExistsOffer(vvchArgs[0]))
             return error("DisconnectBlock() : failed to read from offer DB for %s %s\n",
             		opName.c_str(), stringFromVch(vvchArgs[0]).c_str());
 
@@ -1926,30 +2434,16 @@ bool DisconnectOffer( CBlockIndex *pindex, const CTransaction &tx, int op, vecto
 	        	pofferdb->EraseOfferAccept(vvchOfferAccept);
         }
 
-        // vtxPos might be empty if we pruned expired transactions.  However, it should normally still not
-        // be empty, since a reorg cannot go that far back.  Be safe anyway and do not try to pop if empty.
-        if (vtxPos.size()) {
-            CDiskTxPos txindex;
-            if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
-                return error("DisconnectBlock() : failed to read tx index for offer %s %s %s\n",
-                		opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
+        CDiskTxPos txindex;
+        if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
+            return error("DisconnectBlock() : failed to read tx index for offer %s %s %s\n",
+            		opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
 
-            while(vtxPos.back().txHash == tx.GetHash())
-                vtxPos.pop_back();
-        }
+		InsertOfferFee(pindex, tx.GetHash(), 0);
 
-        // write new offer state to db
-		if(!pofferdb->WriteOffer(vvchArgs[0], vtxPos))
+        // drop the versions this tx wrote and write fee changes to db
+		if(!pofferdb->PopOffer(vvchArgs[0], tx.GetHash(), offerFeeWindow))
 			return error("DisconnectBlock() : failed to write to offer DB");
-
-		COfferFee theFeeObject;
-		theFeeObject.hash =  tx.GetHash();
-		theFeeObject.nHeight = pindex->nHeight;
-		//RemoveOfferFee(theFeeObject);
-		InsertOfferFee(pindex, tx.GetHash(), 0);
-		vector<COfferFee> vOfferFees(lstOfferFees.begin(), lstOfferFees.end());
-		if (!pofferdb->WriteOfferTxFees(vOfferFees))
-			return error( "DisconnectBlock() : failed to write fees to offer DB");
 	}
 
 	printf("DISCONNECTED offer TXN: offer=%s op=%s hash=%s  height=%d\n",
@@ -1970,8 +2464,7 @@ bool DisconnectCertificate( CBlockIndex *pindex, const CTransaction &tx, int op,
 
 	if(op != OP_CERTISSUER_NEW) {
 		// make sure a DB record exists for this cert
-		vector<CCertIssuer> vtxPos;
-		if (!pcertdb->ReadCertIssuer(vvchArgs[0], vtxPos))
+		if (!pcertdb->ExistsCertIssuer(vvchArgs[0]))
 			return error("DisconnectBlock() : failed to read from certificate DB for %s %s\n",
 					opName.c_str(), stringFromVch(vvchArgs[0]).c_str());
 
@@ -1989,31 +2482,16 @@ bool DisconnectCertificate( CBlockIndex *pindex, const CTransaction &tx, int op,
 				pcertdb->EraseCertItem(vvchCert);
 		}
 
-		// vtxPos might be empty if we pruned expired transactions.  However, it should normally still not
-		// be empty, since a reorg cannot go that far back.  Be safe anyway and do not try to pop if empty.
-		if (vtxPos.size()) {
-			CDiskTxPos txindex;
-			if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
-				return error("DisconnectBlock() : failed to read tx index for offer %s %s %s\n",
-						opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
-			while(vtxPos.back().txHash == tx.GetHash())
-				vtxPos.pop_back();
-			// TODO validate that the first pos is the current tx pos
-		}
-
-		// write new offer state to db
-		if(!pcertdb->WriteCertIssuer(vvchArgs[0], vtxPos))
-			return error("DisconnectBlock() : failed to write to offer DB");
+		CDiskTxPos txindex;
+		if (!pblocktree->ReadTxIndex(tx.GetHash(), txindex))
+			return error("DisconnectBlock() : failed to read tx index for offer %s %s %s\n",
+					opName.c_str(), stringFromVch(vvchArgs[0]).c_str(), tx.GetHash().ToString().c_str());
 
-		CCertFee theFeeObject;
-		theFeeObject.hash =  tx.GetHash();
-		theFeeObject.nHeight = pindex->nHeight;
-		theFeeObject.nFee = 0;
-		//RemoveCertFee(theFeeObject);
 		InsertCertFee(pindex, tx.GetHash(), 0);
-		vector<CCertFee> vCertIssuerFees(lstCertIssuerFees.begin(), lstCertIssuerFees.end());
-		if (!pcertdb->WriteCertFees(vCertIssuerFees))
-			return error( "DisconnectBlock() : failed to write fees to certissuer DB");
+
+		// drop the versions this tx wrote and write fee changes to db
+		if(!pcertdb->PopCertIssuer(vvchArgs[0], tx.GetHash(), certFeeWindow))
+			return error("DisconnectBlock() : failed to write to offer DB");
 	}
 
 	printf("DISCONNECTED CERT TXN: title=%s hash=%s height=%d\n",
@@ -2149,7 +2627,8 @@ void static FlushBlockFile(bool fFinalize = false) {
 
 	FILE *fileOld = OpenBlockFile(posOld);
 	if (fileOld) {
-		if (fFinalize)
+		// a mapped file keeps its preallocated tail, which readers skip
+		if (fFinalize && !mapMappedBlockFiles.count(nLastBlockFile))
 			TruncateFile(fileOld, infoLastBlockFile.nSize);
 		FileCommit(fileOld);
 		fclose(fileOld);
@@ -2174,6 +2653,13 @@ void ThreadScriptCheck() {
 	scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CServiceCheck> servicecheckqueue(16);
+
+void ThreadServiceCheck() {
+	RenameThread("bitcoin-servicech");
+	servicecheckqueue.Thread();
+}
+
 bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex,
 		CCoinsViewCache &view, bool fJustCheck) {
 //	printf( "*** ConnectBlock height %d %s\n", pindex->nHeight, fJustCheck ? "JUSTCHECK" : "" );
@@ -2230,6 +2716,9 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex,
 
 	CCheckQueueControl<CScriptCheck> control(
 			fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+	// the alias, offer and cert checks that only read run alongside
+	CCheckQueueControl<CServiceCheck> servicecontrol(
+			nScriptCheckThreads ? &servicecheckqueue : NULL);
 
 	int64 nStart = GetTimeMicros();
 	int nInputs = 0;
@@ -2264,12 +2753,15 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex,
 			nFees += tx.GetValueIn(view) - tx.GetValueOut();
 
 			std::vector<CScriptCheck> vChecks;
+			std::vector<CServiceCheck> vServiceChecks;
 
 			if (!tx.CheckInputs(pindex, state, view, fScriptChecks, flags, dummyTestPool,
-					nScriptCheckThreads ? &vChecks : NULL, fJustCheck, true, false))
+					nScriptCheckThreads ? &vChecks : NULL, fJustCheck, true, false,
+					nScriptCheckThreads ? &vServiceChecks : NULL))
 				return false;
 
 			control.Add(vChecks);
+			servicecontrol.Add(vServiceChecks);
 		}
 
 		CTxUndo txundo;
@@ -2318,6 +2810,9 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex,
         return printf("%s", strHex.c_str());
     }
 
+	// a failed alias, offer or cert check fails the block as it did inline
+	if (!servicecontrol.Wait())
+		return false;
 	if (!control.Wait())
 		return state.DoS(100, false);
 	int64 nTime2 = GetTimeMicros() - nStart;
@@ -2364,6 +2859,10 @@ bool CBlock::ConnectBlock(CValidationState &state, CBlockIndex* pindex,
 	for (unsigned int i = 0; i < vtx.size(); i++)
 		SyncWithWallets(GetTxHash(i), vtx[i], this, true);
 
+	// the block just connected is the one most likely to be read next
+	blockCache.Insert(pindex->GetBlockHash(), boost::shared_ptr<const CBlock>(new CBlock(*this)),
+			::GetSerializeSize(*this, SER_DISK, CLIENT_VERSION));
+
 	return true;
 }
 bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
@@ -2409,12 +2908,16 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 	vector<CTransaction> vResurrect;
 	BOOST_FOREACH(CBlockIndex* pindex, vDisconnect) {
 		CBlock block;
-		if (!block.ReadFromDisk(pindex))
+		if (!block.ReadFromDisk(pindex)) {
+			DiscardSyscoinChanges();
 			return state.Abort(_("Failed to read block"));
+		}
 		int64 nStart = GetTimeMicros();
-		if (!block.DisconnectBlock(state, pindex, view))
+		if (!block.DisconnectBlock(state, pindex, view)) {
+			DiscardSyscoinChanges();
 			return error("SetBestBlock() : DisconnectBlock %s failed",
 					pindex->GetBlockHash().ToString().c_str());
+		}
 		if (fBenchmark)
 			printf("- Disconnect: %.2fms\n",
 					(GetTimeMicros() - nStart) * 0.001);
@@ -2432,10 +2935,13 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 	vector<CTransaction> vDelete;
 	BOOST_FOREACH(CBlockIndex *pindex, vConnect) {
 		CBlock block;
-		if (!block.ReadFromDisk(pindex))
+		if (!block.ReadFromDisk(pindex)) {
+			DiscardSyscoinChanges();
 			return state.Abort(_("Failed to read block"));
+		}
 		int64 nStart = GetTimeMicros();
 		if (!block.ConnectBlock(state, pindex, view)) {
+			DiscardSyscoinChanges();
 			if (state.IsInvalid()) {
 				InvalidChainFound(pindexNew);
 				InvalidBlockFound(pindex);
@@ -2451,7 +2957,8 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 			vDelete.push_back(tx);
 	}
 
-	// Flush changes to global coin state
+	// Flush changes to global coin state, and accept the Syscoin service
+	// changes that go with them
 	int64 nStart = GetTimeMicros();
 	int nModified = view.GetCacheSize();
 	assert(view.Flush());
@@ -2477,6 +2984,8 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 		pblocktree->Sync();
 		if (!pcoinsTip->Flush())
 			return state.Abort(_("Failed to write to coin database"));
+		if (!CommitSyscoinChanges())
+			return state.Abort(_("Failed to write to Syscoin service databases"));
 	}
 
 	// At this point, all changes have been done to the database.
@@ -2491,6 +3000,7 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 	BOOST_FOREACH(CBlockIndex* pindex, vConnect)
 		if (pindex->pprev)
 			pindex->pprev->pnext = pindex;
+	SetBlockIndexByHeight(pindexNew);
 
 	// Resurrect memory transactions that were in the disconnected branch
 	BOOST_FOREACH(CTransaction& tx, vResurrect) {
@@ -2516,7 +3026,6 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew) {
 	// New best block
 	hashBestChain = pindexNew->GetBlockHash();
 	pindexBest = pindexNew;
-	pblockindexFBBHLast = NULL;
 	nBestHeight = pindexBest->nHeight;
 	nBestChainWork = pindexNew->nChainWork;
 	nTimeBestReceived = GetTime();
@@ -2583,7 +3092,7 @@ bool CBlock::AddToBlockIndex(CValidationState &state,
 	pindexNew->nTx = vtx.size();
 	pindexNew->nChainWork =
 			(pindexNew->pprev ? pindexNew->pprev->nChainWork : 0)
-					+ pindexNew->GetBlockWork().getuint256();
+					+ pindexNew->GetBlockWork();
 	pindexNew->nChainTx = (pindexNew->pprev ? pindexNew->pprev->nChainTx : 0)
 			+ pindexNew->nTx;
 	pindexNew->nFile = pos.nFile;
@@ -2621,7 +3130,24 @@ int GetOurChainID() {
     return 0x0001;
 }
 
-bool CBlockHeader::CheckProofOfWork(int nHeight) const {
+// Headers whose proof of work checked out
+CPoWCache powCache(20000);
+
+// about 32MB of serialized blocks, the last few dozen of a busy chain
+CBlockCache blockCache(32 * 1024 * 1024);
+
+// the hash powCache knows a header by: the block hash, together with the
+// auxpow for merge-mined blocks
+static uint256 PoWCacheHash(const CBlockHeader& header) {
+	uint256 hash = header.GetHash();
+	if (header.auxpow.get() != NULL) {
+		uint256 hashAuxPow = SerializeHash(*header.auxpow);
+		hash = Hash(BEGIN(hash), END(hash), BEGIN(hashAuxPow), END(hashAuxPow));
+	}
+	return hash;
+}
+
+bool CBlockHeader::CheckProofOfWork(int nHeight, const uint256 *phashPoW) const {
 	if (nHeight >= GetAuxPowStartBlock()) {
 		// Prevent same work from being submitted twice:
 		// - this block must have our chain ID
@@ -2630,31 +3156,96 @@ bool CBlockHeader::CheckProofOfWork(int nHeight) const {
 		if (!fTestNet && !fCakeNet && nHeight != INT_MAX && GetChainID() != GetOurChainID())
 			return error(
 					"CheckProofOfWork() : block does not have our chain ID");
-
-		if (auxpow.get() != NULL) {
-			if (!auxpow->Check(GetHash(), GetChainID()))
-				return error("CheckProofOfWork() : AUX POW is not valid");
-			// Check proof of work matches claimed amount
-			if (!::CheckProofOfWork(auxpow->GetParentBlockHash(), nBits))
-				return error("CheckProofOfWork() : AUX proof of work failed");
-		} else {
-			// Check proof of work matches claimed amount
-			if (!::CheckProofOfWork(GetPoWHash(), nBits))
-				return error("CheckProofOfWork() : proof of work failed");
-		}
 	} else {
 		if (auxpow.get() != NULL) {
 			return error(
 					"CheckProofOfWork() : AUX POW is not allowed at this block");
 		}
+	}
 
-		// Check if proof of work marches claimed amount
-		if (!::CheckProofOfWork(GetPoWHash(), nBits))
+	// the rest does not depend on the height
+	uint256 hashCache = PoWCacheHash(*this);
+	if (powCache.Lookup(hashCache, nBits))
+		return true;
+
+	if (auxpow.get() != NULL) {
+		if (!auxpow->Check(GetHash(), GetChainID()))
+			return error("CheckProofOfWork() : AUX POW is not valid");
+		// Check proof of work matches claimed amount
+		if (!::CheckProofOfWork(phashPoW ? *phashPoW : auxpow->GetParentBlockHash(), nBits))
+			return error("CheckProofOfWork() : AUX proof of work failed");
+	} else {
+		// Check proof of work matches claimed amount
+		if (!::CheckProofOfWork(phashPoW ? *phashPoW : GetPoWHash(), nBits))
 			return error("CheckProofOfWork() : proof of work failed");
 	}
+
+	powCache.Insert(hashCache, nBits);
 	return true;
 }
 
+/** Closure representing the proof-of-work check of a few headers, hashed
+ *  together. It always succeeds: the outcome is left in powCache, and
+ *  every header is checked again in order by CheckBlock(). */
+class CPoWCheck {
+private:
+	std::vector<const CBlockHeader*> vpheader;
+
+public:
+	CPoWCheck() {}
+	CPoWCheck(std::vector<const CBlockHeader*>::const_iterator first,
+			std::vector<const CBlockHeader*>::const_iterator last) :
+		vpheader(first, last) {}
+
+	bool operator()() {
+		std::vector<uint256> vHash;
+		GetPoWHashes(vpheader, vHash);
+		for (unsigned int i = 0; i < vpheader.size(); i++)
+			vpheader[i]->CheckProofOfWork(INT_MAX, &vHash[i]);
+		return true;
+	}
+
+	void swap(CPoWCheck &check) {
+		vpheader.swap(check.vpheader);
+	}
+};
+
+static CCheckQueue<CPoWCheck> powcheckqueue(1);
+// the queue takes one master at a time
+static CCriticalSection cs_powcheckqueue;
+
+void ThreadPoWCheck() {
+	RenameThread("bitcoin-powch");
+	powcheckqueue.Thread();
+}
+
+// most bytes of blocks gathered for one batch of proof-of-work checks
+static const unsigned int MAX_POWCHECK_BATCH_SIZE = 8 * MAX_BLOCK_SIZE;
+
+// how many blocks to gather for one batch: two kernel calls per thread
+static unsigned int GetPoWCheckBatch() {
+	return 2 * scrypt_ways() * std::max(nScriptCheckThreads, 1);
+}
+
+void PreCheckProofOfWork(const std::vector<const CBlockHeader*>& vHeaders) {
+	// as many headers per check as the scrypt kernel hashes at once
+	const unsigned int nWays = scrypt_ways();
+	std::vector<CPoWCheck> vChecks;
+	for (unsigned int i = 0; i < vHeaders.size(); i += nWays)
+		vChecks.push_back(CPoWCheck(vHeaders.begin() + i,
+				vHeaders.begin() + std::min(i + nWays, (unsigned int) vHeaders.size())));
+
+	if (!nScriptCheckThreads) {
+		BOOST_FOREACH(CPoWCheck& check, vChecks)
+			check();
+		return;
+	}
+	LOCK(cs_powcheckqueue);
+	CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+	control.Add(vChecks);
+	control.Wait();
+}
+
 bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos,
 		unsigned int nAddSize, unsigned int nHeight, uint64 nTime, bool fKnown =
 				false) {
@@ -2976,11 +3567,13 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock,
 					error(
 							"ProcessBlock() : block with timestamp before last checkpoint"));
 		}
-		CBigNum bnNewBlock;
-		bnNewBlock.SetCompact(pblock->nBits);
-		CBigNum bnRequired;
+		bool fNegative;
+		bool fOverflow;
+		uint256 bnNewBlock;
+		bnNewBlock.SetCompact(pblock->nBits, &fNegative, &fOverflow);
+		uint256 bnRequired;
 		bnRequired.SetCompact(ComputeMinWork(pcheckpoint->nBits, deltaTime));
-		if (bnNewBlock > bnRequired) {
+		if (!fNegative && (fOverflow || bnNewBlock > bnRequired)) {
 			return state.DoS(100,
 					error(
 							"ProcessBlock() : block with too little proof-of-work"));
@@ -3272,7 +3865,7 @@ bool static LoadBlockIndexDB() {
 	BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight) {
 		CBlockIndex* pindex = item.second;
 		pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0)
-				+ pindex->GetBlockWork().getuint256();
+				+ pindex->GetBlockWork();
 		pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0)
 				+ pindex->nTx;
 		if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS
@@ -3317,6 +3910,7 @@ bool static LoadBlockIndexDB() {
 		pindexPrev->pnext = pindex;
 		pindex = pindexPrev;
 	}
+	SetBlockIndexByHeight(pindexBest);
 	printf("LoadBlockIndexDB(): hashBestChain=%s  height=%d date=%s\n",
 			hashBestChain.ToString().c_str(), nBestHeight,
 			DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexBest->GetBlockTime()).c_str());
@@ -3324,13 +3918,7 @@ bool static LoadBlockIndexDB() {
 	return true;
 }
 
-bool VerifyDB(int nCheckLevel, int nCheckDepth) {
-	if (pindexBest == NULL || pindexBest->pprev == NULL)
-		return true;
-
-	printf("Loading Syscoin service fees from DB.\n");
-	LoadSyscoinFees();
-
+static bool VerifyBlocks(int nCheckLevel, int nCheckDepth) {
 	// Verify blocks in the best chain
 	if (nCheckDepth <= 0)
 		nCheckDepth = 1000000000; // suffices until the year 19000
@@ -3422,8 +4010,23 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth) {
 	return true;
 }
 
+bool VerifyDB(int nCheckLevel, int nCheckDepth) {
+	if (pindexBest == NULL || pindexBest->pprev == NULL)
+		return true;
+
+	printf("Loading Syscoin service fees from DB.\n");
+	LoadSyscoinFees();
+
+	// the memory-only disconnects and reconnects also go through the
+	// Syscoin service databases; none of their changes may stay behind
+	bool fRet = VerifyBlocks(nCheckLevel, nCheckDepth);
+	DiscardSyscoinChanges();
+	return fRet;
+}
+
 void UnloadBlockIndex() {
 	mapBlockIndex.clear();
+	blockCache.Clear();
 	setBlockIndexValid.clear();
 	pindexGenesisBlock = NULL;
 	nBestHeight = 0;
@@ -3431,6 +4034,7 @@ void UnloadBlockIndex() {
 	nBestInvalidWork = 0;
 	hashBestChain = 0;
 	pindexBest = NULL;
+	SetBlockIndexByHeight(NULL);
 }
 
 bool LoadBlockIndex() {
@@ -3522,7 +4126,7 @@ bool InitBlockIndex() {
 			printf("Searching for genesis block...\n");
 			// This will figure out a valid hash and Nonce if you're
 			// creating a different genesis block:
-			uint256 hashTarget = CBigNum().SetCompact(block.nBits).getuint256();
+			uint256 hashTarget = uint256().SetCompact(block.nBits);
 			uint256 thash;
 			char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
 
@@ -3632,71 +4236,122 @@ void PrintBlockTree() {
 	}
 }
 
+// process the blocks read by LoadExternalBlockFile, in order; false when
+// an error stops the load
+static bool ProcessExternalBlocks(std::vector<CBlock>& vBlocks,
+		std::vector<uint64>& vBlockPos, CDiskBlockPos *dbp, int& nLoaded) {
+	std::vector<const CBlockHeader*> vHeaders;
+	BOOST_FOREACH(const CBlock& block, vBlocks)
+		vHeaders.push_back(&block);
+	PreCheckProofOfWork(vHeaders);
+
+	bool fOk = true;
+	for (unsigned int i = 0; i < vBlocks.size() && fOk; i++) {
+		LOCK(cs_main);
+		if (dbp)
+			dbp->nPos = vBlockPos[i];
+		CValidationState state;
+		if (ProcessBlock(state, NULL, &vBlocks[i], dbp))
+			nLoaded++;
+		if (state.IsError())
+			fOk = false;
+	}
+	vBlocks.clear();
+	vBlockPos.clear();
+	return fOk;
+}
+
+// scan blkdat, a CBufferedFile or a CMemoryStream, for blocks and process
+// those from nStartByte on
+template<typename Stream>
+static void LoadExternalBlocks(Stream& blkdat, uint64 nStartByte,
+		CDiskBlockPos *dbp, int& nLoaded) {
+	uint64 nRewind = blkdat.GetPos();
+	// blocks read ahead, whose proof of work is checked in one batch
+	std::vector<CBlock> vBlocks;
+	std::vector<uint64> vBlockPos;
+	unsigned int nBatchSize = 0;
+	const unsigned int nBatch = GetPoWCheckBatch();
+	while (blkdat.good() && !blkdat.eof()) {
+		boost::this_thread::interruption_point();
+
+		blkdat.SetPos(nRewind);
+		nRewind++; // start one byte further next time, in case of failure
+		blkdat.SetLimit(); // remove former limit
+		unsigned int nSize = 0;
+		try {
+			// locate a header
+			unsigned char buf[4];
+			blkdat.FindByte(pchMessageStart[0]);
+			nRewind = blkdat.GetPos() + 1;
+			blkdat >> FLATDATA(buf);
+			if (memcmp(buf, pchMessageStart, 4))
+				continue;
+			// read size
+			blkdat >> nSize;
+			if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+				continue;
+		} catch (std::exception &e) {
+			// no valid block header found; don't complain
+			break;
+		}
+		try {
+			// read block
+			uint64 nBlockPos = blkdat.GetPos();
+			blkdat.SetLimit(nBlockPos + nSize);
+			CBlock block;
+			blkdat >> block;
+			nRewind = blkdat.GetPos();
+
+			if (nBlockPos >= nStartByte) {
+				vBlocks.push_back(block);
+				vBlockPos.push_back(nBlockPos);
+				nBatchSize += nSize;
+			}
+		} catch (std::exception &e) {
+			printf("%s() : Deserialize or I/O error caught during load\n",
+					__PRETTY_FUNCTION__);
+		}
+		if (vBlocks.size() >= nBatch || nBatchSize >= MAX_POWCHECK_BATCH_SIZE) {
+			nBatchSize = 0;
+			if (!ProcessExternalBlocks(vBlocks, vBlockPos, dbp, nLoaded))
+				break;
+		}
+	}
+	ProcessExternalBlocks(vBlocks, vBlockPos, dbp, nLoaded);
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp) {
 	int64 nStart = GetTimeMillis();
 
 	int nLoaded = 0;
 	try {
-		CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8,
-				SER_DISK, CLIENT_VERSION);
 		uint64 nStartByte = 0;
 		if (dbp) {
 			// (try to) skip already indexed part
 			CBlockFileInfo info;
-			if (pblocktree->ReadBlockFileInfo(dbp->nFile, info)) {
+			if (pblocktree->ReadBlockFileInfo(dbp->nFile, info))
 				nStartByte = info.nSize;
-				blkdat.Seek(info.nSize);
-			}
 		}
-		uint64 nRewind = blkdat.GetPos();
-		while (blkdat.good() && !blkdat.eof()) {
-			boost::this_thread::interruption_point();
-
-			blkdat.SetPos(nRewind);
-			nRewind++; // start one byte further next time, in case of failure
-			blkdat.SetLimit(); // remove former limit
-			unsigned int nSize = 0;
-			try {
-				// locate a header
-				unsigned char buf[4];
-				blkdat.FindByte(pchMessageStart[0]);
-				nRewind = blkdat.GetPos() + 1;
-				blkdat >> FLATDATA(buf);
-				if (memcmp(buf, pchMessageStart, 4))
-					continue;
-				// read size
-				blkdat >> nSize;
-				if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-					continue;
-			} catch (std::exception &e) {
-				// no valid block header found; don't complain
-				break;
-			}
-			try {
-				// read block
-				uint64 nBlockPos = blkdat.GetPos();
-				blkdat.SetLimit(nBlockPos + nSize);
-				CBlock block;
-				blkdat >> block;
-				nRewind = blkdat.GetPos();
-
-				// process block
-				if (nBlockPos >= nStartByte) {
-					LOCK(cs_main);
-					if (dbp)
-						dbp->nPos = nBlockPos;
-					CValidationState state;
-					if (ProcessBlock(state, NULL, &block, dbp))
-						nLoaded++;
-					if (state.IsError())
-						break;
-				}
-			} catch (std::exception &e) {
-				printf("%s() : Deserialize or I/O error caught during load\n",
-						__PRETTY_FUNCTION__);
-			}
+		// read the file where it is mapped, with the kernel reading ahead,
+		// and through a buffer when it cannot be mapped. A block file of our
+		// own is kept from being truncated while it is mapped.
+		CMappedFile mapped;
+		if (dbp ? MapBlockFile(mapped, fileIn, dbp->nFile, true) : mapped.Open(fileIn, true)) {
+			fclose(fileIn);
+			CMemoryStream blkdat(mapped.begin(), mapped.size(), SER_DISK, CLIENT_VERSION);
+			blkdat.Seek(nStartByte);
+			LoadExternalBlocks(blkdat, nStartByte, dbp, nLoaded);
+			if (dbp)
+				UnmapBlockFile(mapped, dbp->nFile);
+		} else {
+			CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8,
+					SER_DISK, CLIENT_VERSION);
+			if (nStartByte)
+				blkdat.Seek(nStartByte);
+			LoadExternalBlocks(blkdat, nStartByte, dbp, nLoaded);
+			fclose(fileIn);
 		}
-		fclose(fileIn);
 	} catch (std::runtime_error &e) {
 		AbortNode(_("Error: system error: ") + e.what());
 	}
@@ -3737,7 +4392,7 @@ string GetWarnings(string strFor) {
 	if (pindexBest
 			&& nBestInvalidWork
 					> nBestChainWork
-							+ (pindexBest->GetBlockWork() * 6).getuint256()) {
+							+ pindexBest->GetBlockWork() * 6) {
 		nPriority = 2000;
 		strStatusBar =
 				strRPC =
@@ -3836,9 +4491,11 @@ void static ProcessGetData(CNode* pfrom) {
 					send = false;
 				}
 				if (send) {
-					// Send block from disk
-					CBlock block;
-					block.ReadFromDisk((*mi).second);
+					// Send block from the cache of recent blocks or from disk
+					boost::shared_ptr<const CBlock> pblock = GetCachedBlock((*mi).second);
+					if (!pblock)
+						pblock.reset(new CBlock());
+					const CBlock &block = *pblock;
 					if (inv.type == MSG_BLOCK)
 						pfrom->PushMessage("block", block);
 					else // MSG_FILTERED_BLOCK)
@@ -3927,9 +4584,8 @@ void static ProcessGetData(CNode* pfrom) {
 bool static ProcessMessage(CNode* pfrom, string strCommand,
 		CDataStream& vRecv) {
 	RandAddSeedPerfmon();
-	if (fDebug)
-		printf("received: %s (%"PRIszu" bytes)\n", strCommand.c_str(),
-				vRecv.size());
+	LogPrint(LOG_NET, "received: %s (%"PRIszu" bytes)\n", strCommand.c_str(),
+			vRecv.size());
 	if (mapArgs.count("-dropmessagestest")
 			&& GetRand(atoi(mapArgs["-dropmessagestest"])) == 0) {
 		printf("dropmessagestest DROPPING RECV MESSAGE\n");
@@ -4134,9 +4790,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand,
 			pfrom->AddInventoryKnown(inv);
 
 			bool fAlreadyHave = AlreadyHave(inv);
-			if (fDebug)
-				printf("  got inventory: %s  %s\n", inv.ToString().c_str(),
-						fAlreadyHave ? "have" : "new");
+			LogPrint(LOG_NET, "  got inventory: %s  %s\n", inv.ToString().c_str(),
+					fAlreadyHave ? "have" : "new");
 
 			if (!fAlreadyHave) {
 				if (!fImporting && !fReindex)
@@ -4150,8 +4805,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand,
 				// the last block in an inv bundle sent in response to getblocks. Try to detect
 				// this situation and push another getblocks to continue.
 				pfrom->PushGetBlocks(mapBlockIndex[inv.hash], uint256(0));
-				if (fDebug)
-					printf("force request: %s\n", inv.ToString().c_str());
+				LogPrint(LOG_NET, "force request: %s\n", inv.ToString().c_str());
 			}
 
 			// Track requests for our stuff
@@ -4473,6 +5127,45 @@ bool static ProcessMessage(CNode* pfrom, string strCommand,
 }
 
 // requires LOCK(cs_vRecvMsg)
+// Check the proof of work of the blocks waiting in pfrom's receive queue
+// on the worker threads, when the next message is a block not seen yet,
+// so that processing them one by one does not hash them serially
+static void PreCheckBlockMessages(CNode* pfrom) {
+	if (!nScriptCheckThreads || fImporting || fReindex)
+		return;
+
+	std::vector<CBlockHeader> vHeaders;
+	unsigned int nBatchSize = 0;
+	const unsigned int nBatch = GetPoWCheckBatch();
+	BOOST_FOREACH(const CNetMessage& msg, pfrom->vRecvMsg) {
+		if (!msg.complete() || msg.hdr.GetCommand() != "block")
+			break;
+		if (vHeaders.size() >= nBatch || nBatchSize >= MAX_POWCHECK_BATCH_SIZE)
+			break;
+		try {
+			CDataStream vRecv(msg.vRecv.begin(), msg.vRecv.end(), SER_NETWORK,
+					pfrom->nRecvVersion);
+			CBlockHeader header;
+			vRecv >> header;
+			vHeaders.push_back(header);
+		} catch (std::exception &e) {
+			break;
+		}
+		nBatchSize += msg.hdr.nMessageSize;
+
+		// the earlier batch already covered the rest
+		if (vHeaders.size() == 1 && powCache.Contains(PoWCacheHash(vHeaders[0]), vHeaders[0].nBits))
+			return;
+	}
+	if (vHeaders.size() < 2)
+		return;
+
+	std::vector<const CBlockHeader*> vpheader;
+	BOOST_FOREACH(const CBlockHeader& header, vHeaders)
+		vpheader.push_back(&header);
+	PreCheckProofOfWork(vpheader);
+}
+
 bool ProcessMessages(CNode* pfrom) {
 	//if (fDebug)
 	//    printf("ProcessMessages(%zu messages)\n", pfrom->vRecvMsg.size());
@@ -4550,6 +5243,8 @@ bool ProcessMessages(CNode* pfrom) {
 		// Process message
 		bool fRet = false;
 		try {
+			if (strCommand == "block")
+				PreCheckBlockMessages(pfrom);
 			{
 				LOCK(cs_main);
 				fRet = ProcessMessage(pfrom, strCommand, vRecv);
@@ -4726,8 +5421,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle) {
 				&& (*pto->mapAskFor.begin()).first <= nNow) {
 			const CInv& inv = (*pto->mapAskFor.begin()).second;
 			if (!AlreadyHave(inv)) {
-				if (fDebugNet)
-					printf("sending getdata: %s\n", inv.ToString().c_str());
+				LogPrint(LOG_NET, "sending getdata: %s\n", inv.ToString().c_str());
 				vGetData.push_back(inv);
 				if (vGetData.size() >= 1000) {
 					pto->PushMessage("getdata", vGetData);
@@ -4782,32 +5476,11 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit) {
 		((uint32_t*) pstate)[i] = ctx.h[i];
 }
 
-// Some explaining would be appreciated
-class COrphan {
-public:
-	CTransaction* ptx;
-	set<uint256> setDependsOn;
-	double dPriority;
-	double dFeePerKb;
-
-	COrphan(CTransaction* ptxIn) {
-		ptx = ptxIn;
-		dPriority = dFeePerKb = 0;
-	}
-
-	void print() const {
-		printf("COrphan(hash=%s, dPriority=%.1f, dFeePerKb=%.1f)\n",
-				ptx->GetHash().ToString().c_str(), dPriority, dFeePerKb);
-		BOOST_FOREACH(uint256 hash, setDependsOn)
-			printf("   setDependsOn %s\n", hash.ToString().c_str());
-	}
-};
-
 uint64 nLastBlockTx = 0;
 uint64 nLastBlockSize = 0;
 
 // We want to sort transactions by priority and fee, so:
-typedef boost::tuple<double, double, CTransaction*> TxPriority;
+typedef boost::tuple<double, double, uint256> TxPriority;
 class TxPriorityCompare {
 	bool byFee;
 public:
@@ -4827,6 +5500,62 @@ public:
 	}
 };
 
+static void GetBlockSizeLimits(unsigned int& nBlockMaxSize,
+		unsigned int& nBlockPrioritySize, unsigned int& nBlockMinSize) {
+	// Largest block you're willing to create:
+	nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+	// Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+	nBlockMaxSize = std::max((unsigned int) 1000,
+			std::min((unsigned int) (MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
+
+	// How much of the block should be dedicated to high-priority transactions,
+	// included regardless of the fees they pay
+	nBlockPrioritySize = GetArg("-blockprioritysize",
+			DEFAULT_BLOCK_PRIORITY_SIZE);
+	nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+	// Minimum block size you want to create; block will be filled with free transactions
+	// until there are no more or the block reaches this size:
+	nBlockMinSize = GetArg("-blockminsize", 0);
+	nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+}
+
+// Check tx against the coins and Syscoin services of the template so far and
+// add it, unless it does not connect or takes the block over the sigop limit
+static bool AddToBlockTemplate(CBlockTemplate& tmpl, CTransaction& tx,
+		const uint256& hash, unsigned int nTxSize, unsigned int nTxSigOps) {
+	CCoinsViewCache& view = *tmpl.pview;
+	if (!tx.HaveInputs(view))
+		return false;
+
+	int64 nTxFees = tx.GetValueIn(view) - tx.GetValueOut();
+
+	nTxSigOps += tx.GetP2SHSigOpCount(view);
+	if (tmpl.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+		return false;
+
+	// for (unsigned int i = 0; i < tx.vin.size(); i++) {
+	// 	mapTestPool[tx.vin[i].prevout.hash] = tx.GetHash();
+	// }
+
+	CValidationState state;
+	if (!tx.CheckInputs(tmpl.pindexPrev, state, view, true, SCRIPT_VERIFY_P2SH,
+			tmpl.mapTestPool, NULL, false, true, false))
+		return false;
+
+	CTxUndo txundo;
+	tx.UpdateCoins(state, view, txundo, tmpl.pindexPrev->nHeight + 1, hash);
+
+	// Added
+	tmpl.block.vtx.push_back(tx);
+	tmpl.vTxFees.push_back(nTxFees);
+	tmpl.vTxSigOps.push_back(nTxSigOps);
+	tmpl.nBlockSize += nTxSize;
+	tmpl.nBlockSigOps += nTxSigOps;
+	tmpl.nFees += nTxFees;
+	return true;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn) {
 	// Create new block
 	auto_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
@@ -4846,142 +5575,130 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn) {
 	pblocktemplate->vTxFees.push_back(-1); // updated at end
 	pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-	// Largest block you're willing to create:
-	unsigned int nBlockMaxSize = GetArg("-blockmaxsize",
-			DEFAULT_BLOCK_MAX_SIZE);
-	// Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-	nBlockMaxSize = std::max((unsigned int) 1000,
-			std::min((unsigned int) (MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
-
-	// How much of the block should be dedicated to high-priority transactions,
-	// included regardless of the fees they pay
-	unsigned int nBlockPrioritySize = GetArg("-blockprioritysize",
-			DEFAULT_BLOCK_PRIORITY_SIZE);
-	nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-	// Minimum block size you want to create; block will be filled with free transactions
-	// until there are no more or the block reaches this size:
-	unsigned int nBlockMinSize = GetArg("-blockminsize", 0);
-	nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+	unsigned int nBlockMaxSize, nBlockPrioritySize, nBlockMinSize;
+	GetBlockSizeLimits(nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
 
 	// Collect memory pool transactions into the block
-	int64 nFees = 0;
 	{
 		LOCK2(cs_main, mempool.cs);
 		CBlockIndex* pindexPrev = pindexBest;
-		CCoinsViewCache view(*pcoinsTip, true);
+		pblocktemplate->pindexPrev = pindexPrev;
+		pblocktemplate->pview.reset(new CCoinsViewCache(*pcoinsTip, true));
+		CCoinsViewCache& view = *pblocktemplate->pview;
+		// transactions the pool takes in after this are for UpdateBlockTemplate()
+		pblocktemplate->nMempoolNext = mempool.nAddedBase + mempool.vAdded.size();
+		pblocktemplate->nMempoolRemoved = mempool.nRemoved;
 
-		// Priority order to process transactions
-		list<COrphan> vOrphan; // list memory doesn't move
-		map<uint256, vector<COrphan*> > mapDependers;
 		bool fPrintPriority = GetBoolArg("-printpriority");
-
-		// This vector will be sorted into a priority queue:
-		vector<TxPriority> vecPriority;
-		vecPriority.reserve(mempool.mapTx.size());
-		for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin();
-				mi != mempool.mapTx.end(); ++mi) {
-			CTransaction& tx = (*mi).second;
-			if (tx.IsCoinBase() || !tx.IsFinal())
-				continue;
-
-			COrphan* porphan = NULL;
-			double dPriority = 0;
-			int64 nTotalIn = 0;
-			bool fMissingInputs = false;
-			BOOST_FOREACH(const CTxIn& txin, tx.vin) {
-				// Read prev transaction
-				if (!view.HaveCoins(txin.prevout.hash)) {
-					// This should never happen; all transactions in the memory
-					// pool should connect to either transactions in the chain
-					// or other transactions in the memory pool.
-					if (!mempool.mapTx.count(txin.prevout.hash)) {
-						printf("ERROR: mempool transaction missing input\n");
-						if (fDebug)
-							assert("mempool transaction missing input" == 0);
-						fMissingInputs = true;
-						if (porphan)
-							vOrphan.pop_back();
-						break;
-					}
-
-					// Has to wait for dependencies
-					if (!porphan) {
-						// Use list for automatic deletion
-						vOrphan.push_back(COrphan(&tx));
-						porphan = &vOrphan.back();
-					}
-					mapDependers[txin.prevout.hash].push_back(porphan);
-					porphan->setDependsOn.insert(txin.prevout.hash);
-					nTotalIn +=
-							mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
-					continue;
-				}
-				const CCoins &coins = view.GetCoins(txin.prevout.hash);
-
-				int64 nValueIn = coins.vout[txin.prevout.n].nValue;
-				nTotalIn += nValueIn;
-
-				int nConf = pindexPrev->nHeight - coins.nHeight + 1;
-
-				dPriority += (double) nValueIn * nConf;
-			}
-			if (fMissingInputs)
-				continue;
-
-			// Priority is sum(valuein * age) / txsize
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK,
-					PROTOCOL_VERSION);
-			dPriority /= nTxSize;
-
-			// This is a more accurate fee-per-kilobyte than is used by the client code, because the
-			// client code rounds up the size to the nearest 1K. That's good, because it gives an
-			// incentive to create smaller transactions.
-			double dFeePerKb = double(nTotalIn - tx.GetValueOut())
-					/ (double(nTxSize) / 1000.0);
-
-			if (porphan) {
-				porphan->dPriority = dPriority;
-				porphan->dFeePerKb = dFeePerKb;
-			} else
-				vecPriority.push_back(
-						TxPriority(dPriority, dFeePerKb, &(*mi).second));
-		}
+		int nHeight = pindexPrev->nHeight + 1;
+
+		// Size, fees and priority inputs come with the pool entries, and the
+		// pool keeps them sorted by priority and by fee; only the transactions
+		// that came in since the last template are read here
+		mempool.updateIndexes(view, nHeight);
+
+		// Transactions that spend others in the pool wait for those to be
+		// in the block, then join the released ones in whichever order is used
+		map<uint256, vector<uint256> > mapDependers;
+		map<uint256, set<uint256> > mapWaitingFor;
+		vector<TxPriority> vecReleased;
+		set<uint256> setConsidered;
+		set<uint256> setInBlock;
+		CTxMemPool::priority_index::reverse_iterator itPriority = mempool.setByPriority.rbegin();
+		CTxMemPool::fee_index::reverse_iterator itFee = mempool.setByFee.rbegin();
 
 		// Collect transactions into block
-		map<vector<unsigned char>,uint256> mapTestPool;
-		uint64 nBlockSize = 1000;
+		uint64& nBlockSize = pblocktemplate->nBlockSize;
 		uint64 nBlockTx = 0;
-		int nBlockSigOps = 100;
+		int& nBlockSigOps = pblocktemplate->nBlockSigOps;
+		int nConsecutiveFull = 0;
 		bool fSortedByFee = (nBlockPrioritySize <= 0);
 
 		TxPriorityCompare comparer(fSortedByFee);
-		std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
-		while (!vecPriority.empty()) {
-			// Take highest priority transaction off the priority queue:
-			double dPriority = vecPriority.front().get<0>();
-			double dFeePerKb = vecPriority.front().get<1>();
-			CTransaction& tx = *(vecPriority.front().get<2>());
+		while (true) {
+			// Next from the index in use, skipping what was seen already
+			TxPriority next;
+			bool fNext = false;
+			if (!fSortedByFee) {
+				while (itPriority != mempool.setByPriority.rend()
+						&& setConsidered.count(itPriority->second))
+					++itPriority;
+				if (itPriority != mempool.setByPriority.rend()) {
+					next = TxPriority(itPriority->first.first,
+							itPriority->first.second, itPriority->second);
+					fNext = true;
+				}
+			} else {
+				while (itFee != mempool.setByFee.rend()
+						&& setConsidered.count(itFee->second))
+					++itFee;
+				if (itFee != mempool.setByFee.rend()) {
+					next = TxPriority(
+							mempool.mapTx[itFee->second].GetPriority(nHeight),
+							itFee->first, itFee->second);
+					fNext = true;
+				}
+			}
 
-			std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-			vecPriority.pop_back();
+			// Take highest priority transaction, indexed or released:
+			TxPriority top;
+			bool fReleased = !vecReleased.empty()
+					&& (!fNext || comparer(next, vecReleased.front()));
+			if (fReleased) {
+				top = vecReleased.front();
+				std::pop_heap(vecReleased.begin(), vecReleased.end(), comparer);
+				vecReleased.pop_back();
+			} else if (fNext)
+				top = next;
+			else
+				break;
+			double dPriority = top.get<0>();
+			double dFeePerKb = top.get<1>();
+			uint256 hash = top.get<2>();
+			setConsidered.insert(hash);
+			CTxMemPoolEntry& entry = mempool.mapTx[hash];
+			CTransaction& tx = entry.tx;
+
+			if (!tx.IsFinal())
+				continue;
+
+			// Has to wait for dependencies
+			if (!fReleased) {
+				BOOST_FOREACH(const uint256& hashParent, entry.setParents) {
+					if (setInBlock.count(hashParent))
+						continue;
+					mapDependers[hashParent].push_back(hash);
+					mapWaitingFor[hash].insert(hashParent);
+				}
+				if (mapWaitingFor.count(hash))
+					continue;
+			}
 
 			// Size limits
-			unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK,
-					PROTOCOL_VERSION);
-			if (nBlockSize + nTxSize >= nBlockMaxSize)
+			unsigned int nTxSize = entry.nTxSize;
+			if (nBlockSize + nTxSize >= nBlockMaxSize) {
+				// stop looking once the block is full to within a few small
+				// transactions, rather than trying every one left
+				if (++nConsecutiveFull > 50 && nBlockSize > nBlockMaxSize - 1000)
+					break;
 				continue;
+			}
+			nConsecutiveFull = 0;
 
 			// Legacy limits on sigOps:
-			unsigned int nTxSigOps = tx.GetLegacySigOpCount();
+			unsigned int nTxSigOps = entry.nLegacySigOps;
 			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
 				continue;
 
 			// Skip free transactions if we're past the minimum block size:
 			if (fSortedByFee && (dFeePerKb < CTransaction::nMinTxFee)
-					&& (nBlockSize + nTxSize >= nBlockMinSize))
+					&& (nBlockSize + nTxSize >= nBlockMinSize)) {
+				// and all the indexed ones after it pay less still
+				if (!fReleased && nBlockSize >= nBlockMinSize)
+					itFee = mempool.setByFee.rend();
 				continue;
+			}
 
 			// Prioritize by fee once past the priority size or we run out of high-priority
 			// transactions:
@@ -4990,57 +5707,33 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn) {
 							|| (dPriority < COIN * 1440 / 250))) {
 				fSortedByFee = true;
 				comparer = TxPriorityCompare(fSortedByFee);
-				std::make_heap(vecPriority.begin(), vecPriority.end(),
+				std::make_heap(vecReleased.begin(), vecReleased.end(),
 						comparer);
 			}
 
-			if (!tx.HaveInputs(view))
-				continue;
-
-			int64 nTxFees = tx.GetValueIn(view) - tx.GetValueOut();
-
-			nTxSigOps += tx.GetP2SHSigOpCount(view);
-			if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+			if (!AddToBlockTemplate(*pblocktemplate, tx, hash, nTxSize, nTxSigOps))
 				continue;
-
-	        // for (unsigned int i = 0; i < tx.vin.size(); i++) {
-	        // 	mapTestPool[tx.vin[i].prevout.hash] = tx.GetHash();
-	        // }
-
-	        CValidationState state;
-			if (!tx.CheckInputs(pindexPrev, state, view, true, SCRIPT_VERIFY_P2SH,
-					mapTestPool, NULL, false, true, false))
-				continue;
-
-			CTxUndo txundo;
-			uint256 hash = tx.GetHash();
-			tx.UpdateCoins(state, view, txundo, pindexPrev->nHeight + 1, hash);
-
-			// Added
-			pblock->vtx.push_back(tx);
-			pblocktemplate->vTxFees.push_back(nTxFees);
-			pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-			nBlockSize += nTxSize;
 			++nBlockTx;
-			nBlockSigOps += nTxSigOps;
-			nFees += nTxFees;
+			setInBlock.insert(hash);
 
 			if (fPrintPriority) {
 				printf("priority %.1f feeperkb %.1f txid %s\n", dPriority,
-						dFeePerKb, tx.GetHash().ToString().c_str());
+						dFeePerKb, hash.ToString().c_str());
 			}
 
-			// Add transactions that depend on this one to the priority queue
+			// Release transactions that were waiting on this one
 			if (mapDependers.count(hash)) {
-				BOOST_FOREACH(COrphan* porphan, mapDependers[hash]) {
-					if (!porphan->setDependsOn.empty()) {
-						porphan->setDependsOn.erase(hash);
-						if (porphan->setDependsOn.empty()) {
-							vecPriority.push_back(
-									TxPriority(porphan->dPriority,
-											porphan->dFeePerKb, porphan->ptx));
-							std::push_heap(vecPriority.begin(),
-									vecPriority.end(), comparer);
+				BOOST_FOREACH(const uint256& hashDepender, mapDependers[hash]) {
+					set<uint256>& setWaitingFor = mapWaitingFor[hashDepender];
+					if (!setWaitingFor.empty()) {
+						setWaitingFor.erase(hash);
+						if (setWaitingFor.empty()) {
+							const CTxMemPoolEntry& depender = mempool.mapTx[hashDepender];
+							vecReleased.push_back(
+									TxPriority(depender.GetPriority(nHeight),
+											depender.GetFeePerKb(), hashDepender));
+							std::push_heap(vecReleased.begin(),
+									vecReleased.end(), comparer);
 						}
 					}
 				}
@@ -5051,8 +5744,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn) {
 		nLastBlockSize = nBlockSize;
 		printf("CreateNewBlock(): total size %"PRI64u"\n", nBlockSize);
 
-		pblock->vtx[0].vout[0].nValue = GetBlockValue(pindexPrev->nHeight+1, nFees, 0);
-		pblocktemplate->vTxFees[0] = -nFees;
+		pblock->vtx[0].vout[0].nValue = GetBlockValue(pindexPrev->nHeight+1, pblocktemplate->nFees, 0);
+		pblocktemplate->vTxFees[0] = -pblocktemplate->nFees;
 
 		// Fill in header
 		//pblock->vtx[0].vout[0].nValue += pindexPrev->nHeight < 1 ? GetFeeAssign() : 0;
@@ -5075,6 +5768,97 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn) {
 	return pblocktemplate.release();
 }
 
+// Templates handed out stay as they are, as work on them may still come back,
+// so the additions go into a copy. Transactions are appended in the order the
+// pool took them in, which keeps parents ahead of their children; the
+// coinbase value follows the fees, and callers set the extranonce and with
+// it the merkle root as they do for a new template. The copy is checked as
+// a block the way CreateNewBlock() checks a new one.
+CBlockTemplate* UpdateBlockTemplate(CBlockTemplate* pblocktemplateOld) {
+	if (!pblocktemplateOld)
+		return NULL;
+	LOCK2(cs_main, mempool.cs);
+	CBlockTemplate& old = *pblocktemplateOld;
+	uint64 nAddedEnd = mempool.nAddedBase + mempool.vAdded.size();
+	if (!old.pview || old.pindexPrev != pindexBest
+			|| old.nMempoolRemoved != mempool.nRemoved
+			|| old.nMempoolNext < mempool.nAddedBase)
+		return NULL;
+	if (old.nMempoolNext == nAddedEnd)
+		return pblocktemplateOld;
+
+	auto_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(old));
+	pblocktemplate->pview.reset(new CCoinsViewCache(*old.pview));
+	CBlock *pblock = &pblocktemplate->block;
+	CCoinsViewCache& view = *pblocktemplate->pview;
+
+	unsigned int nBlockMaxSize, nBlockPrioritySize, nBlockMinSize;
+	GetBlockSizeLimits(nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+	int nHeight = old.pindexPrev->nHeight + 1;
+
+	unsigned int nTxBefore = pblock->vtx.size();
+	for (uint64 n = old.nMempoolNext; n < nAddedEnd; n++) {
+		const uint256& hash = mempool.vAdded[n - mempool.nAddedBase];
+		std::map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.find(hash);
+		if (mi == mempool.mapTx.end())
+			continue;
+		CTxMemPoolEntry& entry = mi->second;
+		CTransaction& tx = entry.tx;
+		if (tx.IsCoinBase() || !tx.IsFinal())
+			continue;
+
+		// Size and legacy sigop limits
+		unsigned int nTxSize = entry.nTxSize;
+		if (pblocktemplate->nBlockSize + nTxSize >= nBlockMaxSize)
+			continue;
+		if (pblocktemplate->nBlockSigOps + entry.nLegacySigOps >= MAX_BLOCK_SIGOPS)
+			continue;
+		// parents not in the block leave inputs missing
+		if (!tx.HaveInputs(view))
+			continue;
+
+		// Free transactions past the minimum size only go in on priority,
+		// within the room kept for it
+		int64 nTxFees = tx.GetValueIn(view) - tx.GetValueOut();
+		double dFeePerKb = double(nTxFees) / (double(nTxSize) / 1000.0);
+		if (dFeePerKb < CTransaction::nMinTxFee
+				&& pblocktemplate->nBlockSize + nTxSize >= nBlockMinSize) {
+			double dPriority = 0;
+			BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+				const CCoins &coins = view.GetCoins(txin.prevout.hash);
+				dPriority += (double) coins.vout[txin.prevout.n].nValue
+						* (nHeight - coins.nHeight);
+			}
+			dPriority /= nTxSize;
+			if (pblocktemplate->nBlockSize + nTxSize >= nBlockPrioritySize
+					|| dPriority < COIN * 1440 / 250)
+				continue;
+		}
+
+		AddToBlockTemplate(*pblocktemplate, tx, hash, nTxSize, entry.nLegacySigOps);
+	}
+
+	// the old template need not be looked at again for what came before
+	old.nMempoolNext = nAddedEnd;
+	if (pblock->vtx.size() == nTxBefore)
+		return pblocktemplateOld;
+	pblocktemplate->nMempoolNext = nAddedEnd;
+
+	pblock->vtx[0].vout[0].nValue = GetBlockValue(nHeight, pblocktemplate->nFees, 0);
+	pblocktemplate->vTxFees[0] = -pblocktemplate->nFees;
+
+	// no ConnectBlock() check of the whole block, as CreateNewBlock() does:
+	// what came before was checked then, and every transaction appended has
+	// been checked by AddToBlockTemplate() against the template's own view
+	old.pview.reset();
+
+	nLastBlockTx = pblock->vtx.size() - 1;
+	nLastBlockSize = pblocktemplate->nBlockSize;
+	printf("UpdateBlockTemplate(): added %"PRIszu" transactions, total size %"PRI64u"\n",
+			pblock->vtx.size() - nTxBefore, pblocktemplate->nBlockSize);
+	return pblocktemplate.release();
+}
+
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey) {
 	CPubKey pubkey;
 	if (!reservekey.GetReservedKey(pubkey))
@@ -5145,7 +5929,7 @@ void FormatHashBuffers(CBlock* pblock, char* pmidstate, char* pdata,
 
 bool CheckWork(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey) {
 	uint256 hash = pblock->GetPoWHash();
-	uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+	uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
 	CAuxPow *auxpow = pblock->auxpow.get();
 
@@ -5229,12 +6013,8 @@ CBlockHeader CBlockIndex::GetBlockHeader() const {
 	CBlockHeader block;
 
 	if (nVersion & BLOCK_VERSION_AUXPOW) {
-		CDiskBlockIndex diskblockindex;
-		// auxpow is not in memory, load CDiskBlockHeader
-		// from database to get it
-
-		pblocktree->ReadDiskBlockIndex(*phashBlock, diskblockindex);
-		block.auxpow = diskblockindex.auxpow;
+		// auxpow is not in memory, read it from the database
+		pblocktree->ReadAuxPow(*phashBlock, block.auxpow);
 	}
 
 	block.nVersion = nVersion;
@@ -5256,6 +6036,12 @@ void static ScryptMiner(CWallet *pwallet) {
 	CReserveKey reservekey(pwallet);
 	unsigned int nExtraNonce = 0;
 
+	// headers and hashes of the nonces tried at once, and their scratchpad
+	const int nWays = scrypt_ways();
+	std::vector<char> vHeaders(80 * nWays);
+	std::vector<uint256> vHashes(nWays);
+	std::vector<char> vScratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+
 	try {
 		loop {
 			while (vNodes.empty())
@@ -5300,26 +6086,36 @@ void static ScryptMiner(CWallet *pwallet) {
 			//
 			int64 nStart = GetTime();
 			uint256 hashTarget =
-					CBigNum().SetCompact(pblock->nBits).getuint256();
+					uint256().SetCompact(pblock->nBits);
 			loop {
 				unsigned int nHashesDone = 0;
 
-				uint256 thash;
-				char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+				// hash as many nonces at once as the scrypt kernel takes
 				loop {
-					scrypt_1024_1_1_256_sp_generic(BEGIN(pblock->nVersion),
-							BEGIN(thash), scratchpad);
-
-					if (thash <= hashTarget) {
-						// Found a solution
+					for (int i = 0; i < nWays; i++) {
+						memcpy(&vHeaders[80 * i], BEGIN(pblock->nVersion), 80);
+						*(unsigned int*) &vHeaders[80 * i + 76] = pblock->nNonce + i;
+					}
+					scrypt_1024_1_1_256_sp_multi(&vHeaders[0], BEGIN(vHashes[0]),
+							&vScratchpad[0], nWays);
+
+					bool fFound = false;
+					for (int i = 0; i < nWays && !fFound; i++) {
+						if (vHashes[i] <= hashTarget) {
+							// Found a solution
+							pblock->nNonce += i;
+							fFound = true;
+						}
+					}
+					if (fFound) {
 						SetThreadPriority(THREAD_PRIORITY_NORMAL);
 						CheckWork(pblock, *pwallet, reservekey);
 						SetThreadPriority(THREAD_PRIORITY_LOWEST);
 						break;
 					}
-					pblock->nNonce += 1;
-					nHashesDone += 1;
-					if ((pblock->nNonce & 0xFF) == 0)
+					pblock->nNonce += nWays;
+					nHashesDone += nWays;
+					if ((pblock->nNonce & 0xFF) < (unsigned int) nWays)
 						break;
 				}
 
@@ -5368,7 +6164,7 @@ void static ScryptMiner(CWallet *pwallet) {
 					// Changing pblock->nTime can change work required on testnet:
 					nBlockBits = ByteReverse(pblock->nBits);
 					hashTarget =
-							CBigNum().SetCompact(pblock->nBits).getuint256();
+							uint256().SetCompact(pblock->nBits);
 				}
 			}
 		}
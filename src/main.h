@@ -10,11 +10,14 @@
 #include "net.h"
 #include "script.h"
 #include "scrypt.h"
+#include "powcache.h"
+#include "blockcache.h"
 
 #include <list>
 
 class CWallet;
 class CBlock;
+class CBlockHeader;
 class CBlockIndex;
 class CKeyItem;
 class CReserveKey;
@@ -87,6 +90,8 @@ extern uint256 nBestChainWork;
 extern uint256 nBestInvalidWork;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
+/** The blocks of the best chain, by height */
+extern std::vector<CBlockIndex*> vBlockIndexByHeight;
 extern unsigned int nTransactionsUpdated;
 extern uint64 nLastBlockTx;
 extern uint64 nLastBlockSize;
@@ -103,6 +108,8 @@ extern bool fBenchmark;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern unsigned int nCoinCacheSize;
+extern CPoWCache powCache;
+extern CBlockCache blockCache;
 
 // Settings
 extern int64 nTransactionFee;
@@ -114,6 +121,12 @@ static const int AUXPOW_START_MAINNET = 17000;
 static const int AUXPOW_START_TESTNET = 200;
 static const int AUXPOW_START_CAKENET = 30;
 static const int MM_FEEREGEN_HARDFORK = AUXPOW_START_MAINNET;
+static const int BINARY_PAYLOAD_START_MAINNET = 200000;
+static const int BINARY_PAYLOAD_START_TESTNET = 2000;
+static const int BINARY_PAYLOAD_START_CAKENET = 60;
+/** Version byte of offer and cert payloads stored as is rather than in
+ *  base64; base64 text never starts with it */
+static const unsigned char SYSCOIN_PAYLOAD_BINARY = 0x01;
 
 class CWalletTx;
 class CDiskTxPos;
@@ -127,6 +140,7 @@ class CTxUndo;
 class CCoinsView;
 class CCoinsViewCache;
 class CScriptCheck;
+class CServiceCheck;
 class CValidationState;
 
 struct CBlockTemplate;
@@ -145,6 +159,8 @@ bool CheckDiskSpace(uint64 nAdditionalBytes = 0);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** The block of pindex, from blockCache or else read from disk and cached; NULL when it cannot be read */
+boost::shared_ptr<const CBlock> GetCachedBlock(const CBlockIndex* pindex);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -155,6 +171,10 @@ bool LoadBlockIndex();
 void UnloadBlockIndex();
 /** Verify consistency of the block and coin databases */
 bool VerifyDB(int nCheckLevel, int nCheckDepth);
+/** Replay the blocks the alias, offer and cert databases are missing since their last commit */
+bool SyncSyscoinIndexes(bool fRescan);
+/** Write the alias, offer and cert changes accepted so far, once the coins they belong to are on disk */
+bool CommitSyscoinChanges();
 /** Print the loaded block tree */
 void PrintBlockTree();
 /** Find a block by height in the currently-connected chain */
@@ -165,11 +185,19 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the alias, offer and cert checking thread */
+void ThreadServiceCheck();
+/** Run an instance of the proof-of-work checking thread */
+void ThreadPoWCheck();
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey);
+/** A copy of a template with the transactions the pool took in since added;
+ *  the template itself when nothing could be added, and NULL when it has to
+ *  be created anew with CreateNewBlock() */
+CBlockTemplate* UpdateBlockTemplate(CBlockTemplate* pblocktemplateOld);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 void IncrementExtraNonceWithAux(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce, std::vector<unsigned char>& vchAux);
@@ -179,8 +207,16 @@ void FormatHashBuffers(CBlock* pblock, char* pmidstate, char* pdata, char* phash
 bool CheckWork(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey);
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits);
+/** Hash the proof of work of several headers at once: the scrypt hash of
+ *  each header, or of its parent block header if it is merge-mined */
+void GetPoWHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHash);
+/** Check the proof of work of the headers on the worker threads, so that
+ *  checking them again in CheckBlock() is a lookup */
+void PreCheckProofOfWork(const std::vector<const CBlockHeader*>& vHeaders);
 /** Calculate the minimum amount of work a received block needs, without knowing its direct parent */
 unsigned int ComputeMinWork(unsigned int nBase, int64 nTime);
+/** Calculate the nBits required of the block after pindexLast */
+unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock);
 /** Get the number of active peers */
 int GetNumBlocksOfPeers();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -201,6 +237,8 @@ bool VerifySignature(const CCoins& txFrom, const CTransaction& txTo, unsigned in
 /** Abort with a message */
 bool AbortNode(const std::string &msg);
 int GetAuxPowStartBlock();
+/** First block whose transactions may carry binary offer and cert payloads */
+int GetBinaryPayloadStartBlock();
 bool GetWalletFile(CWallet* pwallet, std::string &strWalletFileOut);
 
 std::string stringFromVch(const std::vector<unsigned char> &vch);
@@ -524,11 +562,19 @@ public:
         return SerializeHash(*this, SER_GETAUXHASH | SER_GETHASH);
     }
 	
+    bool IsBinaryData() const {
+        return !data.empty() && data[0] == SYSCOIN_PAYLOAD_BINARY;
+    }
+
     std::string GetBase64Data() const {
+        if (IsBinaryData())
+            return EncodeBase64(&data[0] + 1, data.size() - 1);
         return stringFromVch(data);
     }
 
     std::string GetData() const {
+        if (IsBinaryData())
+            return std::string(data.begin() + 1, data.end());
         return DecodeBase64(stringFromVch(data));
     }
 
@@ -710,12 +756,14 @@ public:
 
     // Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
     // This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
-    // instead of being performed inline.
+    // instead of being performed inline. If pvServiceChecks is not NULL, the read-only part of the
+    // alias, offer and cert checks is pushed onto it, and only their DB writes are done inline.
     bool CheckInputs(CBlockIndex *pindex, CValidationState &state, CCoinsViewCache &view, bool fScriptChecks = true,
                      unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC,
                      std::map<std::vector<unsigned char>,uint256> &mapTestPool = dummyTestPool,
                      std::vector<CScriptCheck> *pvChecks = NULL, bool bCheckInputs = true,
-                     bool fBlock = false, bool fMiner = false) const;
+                     bool fBlock = false, bool fMiner = false,
+                     std::vector<CServiceCheck> *pvServiceChecks = NULL) const;
 
     // Apply the effects of this transaction on the UTXO set represented by view
     void UpdateCoins(CValidationState &state, CCoinsViewCache &view, CTxUndo &txundo, int nHeight, const uint256 &txhash) const;
@@ -1160,6 +1208,40 @@ public:
     }
 };
 
+/** Closure running the alias, offer and cert checks of a transaction that
+ *  only read: VerifyAliasInputs(), VerifyOfferInputs() and VerifyCertInputs().
+ *  It keeps a copy of the coins the transaction spends, which the caller
+ *  goes on to update, and a reference to the transaction itself. */
+class CServiceCheck
+{
+private:
+    CBlockIndex *pindex;
+    const CTransaction *ptx;
+    std::vector<std::pair<uint256, CCoins> > vPrevCoins;
+    std::map<std::vector<unsigned char>,uint256> *pmapTestPool;
+    bool fBlock;
+    bool fMiner;
+    bool fJustCheck;
+
+public:
+    CServiceCheck() : pindex(NULL), ptx(NULL), pmapTestPool(NULL), fBlock(false), fMiner(false), fJustCheck(false) {}
+    CServiceCheck(CBlockIndex *pindexIn, const CTransaction &txIn, CCoinsViewCache &inputs,
+                  std::map<std::vector<unsigned char>,uint256> &mapTestPoolIn,
+                  bool fBlockIn, bool fMinerIn, bool fJustCheckIn);
+
+    bool operator()() const;
+
+    void swap(CServiceCheck &check) {
+        std::swap(pindex, check.pindex);
+        std::swap(ptx, check.ptx);
+        vPrevCoins.swap(check.vPrevCoins);
+        std::swap(pmapTestPool, check.pmapTestPool);
+        std::swap(fBlock, check.fBlock);
+        std::swap(fMiner, check.fMiner);
+        std::swap(fJustCheck, check.fJustCheck);
+    }
+};
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
@@ -1408,7 +1490,8 @@ public:
 		return (int64)nTime;
     }
 
-    bool CheckProofOfWork(int nHeight) const;
+    /** phashPoW, if given, is the proof of work hash from GetPoWHashes() */
+    bool CheckProofOfWork(int nHeight, const uint256 *phashPoW = NULL) const;
 
     void UpdateTime(const CBlockIndex* pindexPrev);
 };
@@ -1616,6 +1699,28 @@ public:
     bool AcceptBlock(CValidationState &state, CDiskBlockPos *dbp = NULL);
 };
 
+/** Reads blocks straight out of the block files mapped into memory, for
+ *  passes over many blocks that would otherwise open and seek a file for
+ *  each. A file is mapped the first time one of its blocks is read and
+ *  stays mapped, and is not truncated by FlushBlockFile(), while the
+ *  reader lives; blocks past what was mapped are read with
+ *  CBlock::ReadFromDisk(). May be shared between threads.
+ */
+class CBlockFileReader
+{
+private:
+    CCriticalSection cs;
+    // NULL for files that could not be mapped
+    std::map<int, CMappedFile*> mapFiles;
+
+    const CMappedFile *GetFile(int nFile);
+
+public:
+    ~CBlockFileReader();
+
+    bool ReadBlock(CBlock &block, const CBlockIndex *pindex);
+};
+
 
 
 
@@ -1746,6 +1851,10 @@ public:
     unsigned int nBits;
     unsigned int nNonce;
 
+    // (memory only) nBits required of the blocks on top of this one, or 0
+    // until GetNextWorkRequired() has worked it out
+    mutable unsigned int nBitsNext;
+
 
     CBlockIndex()
     {
@@ -1766,6 +1875,7 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
+        nBitsNext      = 0;
     }
 
     CBlockIndex(CBlockHeader& block)
@@ -1787,6 +1897,7 @@ public:
         nTime          = block.nTime;
         nBits          = block.nBits;
         nNonce         = block.nNonce;
+        nBitsNext      = 0;
     }
 
     IMPLEMENT_SERIALIZE
@@ -1835,13 +1946,17 @@ public:
         return (int64)nTime;
     }
 
-    CBigNum GetBlockWork() const
+    uint256 GetBlockWork() const
     {
-        CBigNum bnTarget;
-        bnTarget.SetCompact(nBits);
-        if (bnTarget <= 0)
+        uint256 bnTarget;
+        bool fNegative;
+        bool fOverflow;
+        bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
+        if (fNegative || fOverflow || bnTarget == 0)
             return 0;
-        return (CBigNum(1)<<256) / (bnTarget+1);
+        // 2**256 / (bnTarget+1) does not fit a uint256, but as 2**256 is at
+        // least as large as bnTarget+1 it equals ~bnTarget / (bnTarget+1) + 1
+        return (~bnTarget / (bnTarget + 1)) + 1;
     }
 
     bool IsInMainChain() const
@@ -1928,7 +2043,9 @@ class CDiskBlockIndex : public CBlockIndex
 public:
     uint256 hashPrev;
 
-    // if this is an aux work block
+    // if this is an aux work block; stored apart from the index entry
+    // (see CBlockTreeDB::WriteDiskBlockIndex) so loading the index does not
+    // have to read it
     boost::shared_ptr<CAuxPow> auxpow;
 
     CDiskBlockIndex() {
@@ -1958,7 +2075,6 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
-        ReadWriteAuxPow(s, auxpow, nType, this->nVersion, ser_action);
     )
 
     uint256 CalcBlockHash() const
@@ -2184,12 +2300,86 @@ public:
 
 
 
+/** A transaction in the memory pool, with what block assembly needs to know
+ *  of it worked out once instead of for every block template. */
+class CTxMemPoolEntry
+{
+public:
+    CTransaction tx;
+    unsigned int nTxSize;
+    unsigned int nLegacySigOps;
+
+    // the rest is only good once the inputs have been read, which is done
+    // again whenever a transaction this one spends enters or leaves the pool
+    bool fInputsRead;
+    int64 nFee;
+    // inputs in the chain: their total value, and the total of value times
+    // height, from which the priority at any height follows
+    int64 nValueInChain;
+    double dValueHeightInChain;
+    // transactions in the pool this one spends
+    std::set<uint256> setParents;
+
+    CTxMemPoolEntry() : nTxSize(0), nLegacySigOps(0)
+    {
+        MarkInputsStale();
+    }
+
+    CTxMemPoolEntry(const CTransaction& txIn) : tx(txIn)
+    {
+        nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        nLegacySigOps = tx.GetLegacySigOpCount();
+        MarkInputsStale();
+    }
+
+    void MarkInputsStale()
+    {
+        fInputsRead = false;
+        nFee = 0;
+        nValueInChain = 0;
+        dValueHeightInChain = 0;
+        setParents.clear();
+    }
+
+    // sum(valuein * age) / txsize in a block at nHeight, counting the inputs
+    // in the chain only
+    double GetPriority(int nHeight) const
+    {
+        return ((double)nValueInChain * nHeight - dValueHeightInChain) / nTxSize;
+    }
+
+    // This is a more accurate fee-per-kilobyte than is used by the client code, because the
+    // client code rounds up the size to the nearest 1K. That's good, because it gives an
+    // incentive to create smaller transactions.
+    double GetFeePerKb() const
+    {
+        return double(nFee) / (double(nTxSize) / 1000.0);
+    }
+};
+
 class CTxMemPool
 {
 public:
+    // entries with their inputs read, lowest first: by fee per kB, and by
+    // priority at nPriorityHeight with fee per kB to break ties
+    typedef std::set<std::pair<double, uint256> > fee_index;
+    typedef std::set<std::pair<std::pair<double, double>, uint256> > priority_index;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
+    std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
+    fee_index setByFee;
+    priority_index setByPriority;
+    int nPriorityHeight;
+    // entries whose inputs are to be read by the next updateIndexes()
+    std::set<uint256> setInputsStale;
+    // the latest additions in order, for block templates to catch up with;
+    // vAdded[i] was addition number nAddedBase + i
+    std::vector<uint256> vAdded;
+    uint64 nAddedBase;
+    uint64 nRemoved;
+
+    CTxMemPool() : nPriorityHeight(-1), nAddedBase(0), nRemoved(0) {}
 
     bool accept(CValidationState &state, CTransaction &tx, bool fCheckInputs, bool fLimitFree, bool* pfMissingInputs);
     bool addUnchecked(const uint256& hash, const CTransaction &tx);
@@ -2198,6 +2388,8 @@ public:
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
+    void updateIndexes(CCoinsViewCache &view, int nHeight);
+
 
     unsigned long size()
     {
@@ -2212,8 +2404,14 @@ public:
 
     CTransaction& lookup(uint256 hash)
     {
-        return mapTx[hash];
+        return mapTx[hash].tx;
     }
+
+private:
+    bool readInputs(CTxMemPoolEntry &entry, CCoinsViewCache &view);
+    void index(const uint256& hash, const CTxMemPoolEntry &entry);
+    void unindex(const uint256& hash, const CTxMemPoolEntry &entry);
+    void markInputsStale(const uint256& hash);
 };
 
 extern CTxMemPool mempool;
@@ -2337,6 +2535,20 @@ struct CBlockTemplate
     CBlock block;
     std::vector<int64_t> vTxFees;
     std::vector<int64_t> vTxSigOps;
+
+    // where assembly stopped, for UpdateBlockTemplate() to carry on from:
+    // the coins and Syscoin services with the block's transactions applied,
+    // and the mempool additions and removals seen
+    CBlockIndex* pindexPrev;
+    boost::shared_ptr<CCoinsViewCache> pview;
+    std::map<std::vector<unsigned char>, uint256> mapTestPool;
+    uint64 nMempoolNext;
+    uint64 nMempoolRemoved;
+    uint64 nBlockSize;
+    int nBlockSigOps;
+    int64 nFees;
+
+    CBlockTemplate() : pindexPrev(NULL), nMempoolNext(0), nMempoolRemoved(0), nBlockSize(1000), nBlockSigOps(100), nFees(0) {}
 };
 
 #if defined(_M_IX86) || defined(__i386__) || defined(__i386) || defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64)
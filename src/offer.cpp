@@ -5,11 +5,13 @@
 #include "auxpow.h"
 #include "script.h"
 #include "main.h"
+#include "decodecache.h"
 
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_writer_template.h"
 
 #include <boost/xpressive/xpressive_dynamic.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -20,7 +22,13 @@ std::map<std::vector<unsigned char>, uint256> mapMyOffers;
 std::map<std::vector<unsigned char>, uint256> mapMyOfferAccepts;
 std::map<std::vector<unsigned char>, std::set<uint256> > mapOfferPending;
 std::map<std::vector<unsigned char>, std::set<uint256> > mapOfferAcceptPending;
-std::list<COfferFee> lstOfferFees;
+CFeeWindow offerFeeWindow;
+// offer ops and decoded offers of recent Syscoin transactions
+static CDecodeCache<CServiceTxDecode> offerDecodeCache(10000);
+static CDecodeCache<COffer> offerPayloadCache(1000);
+
+// span of the long fee subsidy window, in seconds
+static const unsigned int OFFER_FEE_WINDOW = 360 * 12;
 
 #ifdef GUI
 extern std::map<uint160, std::vector<unsigned char> > mapMyOfferHashes;
@@ -126,24 +134,37 @@ string offerFromOp(int op) {
 }
 
 bool COffer::UnserializeFromTx(const CTransaction &tx) {
+	uint256 hash = tx.GetHash();
+	if (offerPayloadCache.Get(hash, *this))
+		return true;
 	try {
-		CDataStream dsOffer(vchFromString(DecodeBase64(stringFromVch(tx.data))), SER_NETWORK, PROTOCOL_VERSION);
-		dsOffer >> *this;
+		if (tx.IsBinaryData()) {
+			// parsed in place, after the version byte
+			const char *pbegin = (const char*) &tx.data[0];
+			CDataStream dsOffer(pbegin + 1, pbegin + tx.data.size(), SER_NETWORK, PROTOCOL_VERSION);
+			dsOffer >> *this;
+		} else {
+			CDataStream dsOffer(vchFromString(DecodeBase64(stringFromVch(tx.data))), SER_NETWORK, PROTOCOL_VERSION);
+			dsOffer >> *this;
+		}
 	} catch (std::exception &e) {
 		return false;
 	}
+	offerPayloadCache.Insert(hash, *this);
 	return true;
 }
 
-void COffer::SerializeToTx(CTransaction &tx) {
-	vector<unsigned char> vchData = vchFromString(SerializeToString());
+void COffer::SerializeToTx(CTransaction &tx, int nHeight) {
+	vector<unsigned char> vchData = vchFromString(SerializeToString(nHeight));
 	tx.data = vchData;
 }
 
-string COffer::SerializeToString() {
+string COffer::SerializeToString(int nHeight) {
 	// serialize offer object
 	CDataStream dsOffer(SER_NETWORK, PROTOCOL_VERSION);
 	dsOffer << *this;
+	if (nHeight >= GetBinaryPayloadStartBlock())
+		return string(1, (char) SYSCOIN_PAYLOAD_BINARY) + string(dsOffer.begin(), dsOffer.end());
 	vector<unsigned char> vchData(dsOffer.begin(), dsOffer.end());
 	return EncodeBase64(vchData.data(), vchData.size());
 }
@@ -151,171 +172,94 @@ string COffer::SerializeToString() {
 //TODO implement
 bool COfferDB::ScanOffers(const std::vector<unsigned char>& vchOffer, unsigned int nMax,
 		std::vector<std::pair<std::vector<unsigned char>, COffer> >& offerScan) {
-    leveldb::Iterator *pcursor = pofferdb->NewIterator();
-
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair(string("offeri"), vchOffer);
-    string sType;
-    pcursor->Seek(ssKeySet.str());
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-
-            ssKey >> sType;
-            if(sType == "offeri") {
-            	vector<unsigned char> vchOffer;
-                ssKey >> vchOffer;
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                vector<COffer> vtxPos;
-                ssValue >> vtxPos;
-                COffer txPos;
-                if (!vtxPos.empty())
-                    txPos = vtxPos.back();
-                offerScan.push_back(make_pair(vchOffer, txPos));
-            }
-            if (offerScan.size() >= nMax)
-                break;
-
-            pcursor->Next();
-        } catch (std::exception &e) {
-            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
-        }
-    }
-    delete pcursor;
-    return true;
+	return history.Scan(vchOffer, nMax, offerScan);
 }
 
-/**
- * [COfferDB::ReconstructOfferIndex description]
- * @param  pindexRescan [description]
- * @return              [description]
- */
-bool COfferDB::ReconstructOfferIndex(CBlockIndex *pindexRescan) {
-    CBlockIndex* pindex = pindexRescan;
-    
-    {
-	TRY_LOCK(pwalletMain->cs_wallet, cs_trylock);
+bool COfferDB::ReconstructBlock(const CBlock &block, CBlockIndex *pindex) {
+    int nHeight = pindex->nHeight;
 
-	uint64 startHeight = pindexRescan->nHeight;
-	while(pindex->pnext != NULL) pindex = pindex->pnext;
-	uint64 endHeight = pindex->nHeight;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
 
-	BOOST_FOREACH(COfferFee &oFee, lstOfferFees) {
-		if (oFee.nHeight >= startHeight && oFee.nHeight < endHeight) {
-			oFee.nFee = 0;
-			break;
-		}
-	}
+        if (tx.nVersion != SYSCOIN_TX_VERSION)
+            continue;
 
-    CBlockIndex* pindex = pindexRescan;
-    while (pindex) {  
+        vector<vector<unsigned char> > vvchArgs;
+        int op, nOut;
 
-        int nHeight = pindex->nHeight;
-        CBlock block;
-        block.ReadFromDisk(pindex);
-        uint256 txblkhash;
+        // decode the offer op, params, height
+        bool o = DecodeOfferTx(tx, op, nOut, vvchArgs, nHeight);
+        if (!o || !IsOfferOp(op)) continue;
         
-        BOOST_FOREACH(CTransaction& tx, block.vtx) {
-
-            if (tx.nVersion != SYSCOIN_TX_VERSION)
-                continue;
-
-            vector<vector<unsigned char> > vvchArgs;
-            int op, nOut;
-
-            // decode the offer op, params, height
-            bool o = DecodeOfferTx(tx, op, nOut, vvchArgs, nHeight);
-            if (!o || !IsOfferOp(op)) continue;
-            
-            if (op == OP_OFFER_NEW) continue;
-
-            vector<unsigned char> vchOffer = vvchArgs[0];
-        
-            // get the transaction
-            if(!GetTransaction(tx.GetHash(), tx, txblkhash, true))
-                continue;
+        if (op == OP_OFFER_NEW) continue;
 
-            // attempt to read offer from txn
-            COffer txOffer;
-            COfferAccept txCA;
-            if(!txOffer.UnserializeFromTx(tx))
-				return error("ReconstructOfferIndex() : failed to unserialize offer from tx");
-
-			// save serialized offer
-			COffer serializedOffer = txOffer;
-
-            // read offer from DB if it exists
-            vector<COffer> vtxPos;
-            if (ExistsOffer(vchOffer)) {
-                if (!ReadOffer(vchOffer, vtxPos))
-                    return error("ReconstructOfferIndex() : failed to read offer from DB");
-                if(vtxPos.size()!=0) {
-                	txOffer.nHeight = nHeight;
-                	txOffer.GetOfferFromList(vtxPos);
-                }
+        vector<unsigned char> vchOffer = vvchArgs[0];
+    
+        // attempt to read offer from txn
+        COffer txOffer;
+        COfferAccept txCA;
+        if(!txOffer.UnserializeFromTx(tx))
+			return error("ReconstructBlock() : failed to unserialize offer from tx");
+
+		// save serialized offer
+		COffer serializedOffer = txOffer;
+
+        // read the offer version at this height, or the latest, from DB if it exists
+        COffer dbOffer;
+        if (ReadOfferAt(vchOffer, nHeight, dbOffer))
+            txOffer = dbOffer;
+
+        // read the offer accept from db if exists
+        if(op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY) {
+        	bool bReadOffer = false;
+        	vector<unsigned char> vchOfferAccept = vvchArgs[1];
+            if (ExistsOfferAccept(vchOfferAccept)) {
+                if (!ReadOfferAccept(vchOfferAccept, vchOffer))
+                    LogPrint(LOG_OFFER, "ReconstructBlock() : warning - failed to read offer accept from offer DB\n");
+                else bReadOffer = true;
             }
+			if(!bReadOffer && !txOffer.GetAcceptByHash(vchOfferAccept, txCA))
+				LogPrint(LOG_OFFER, "ReconstructBlock() : failed to read offer accept from offer\n");
+
+			// add txn-specific values to offer accept object
+            txCA.vchRand = vvchArgs[1];
+	        txCA.nTime = pindex->nTime;
+	        txCA.txHash = tx.GetHash();
+	        txCA.nHeight = nHeight;
+			txOffer.PutOfferAccept(txCA);
+		}
 
-            // read the offer accept from db if exists
-            if(op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY) {
-            	bool bReadOffer = false;
-            	vector<unsigned char> vchOfferAccept = vvchArgs[1];
-	            if (ExistsOfferAccept(vchOfferAccept)) {
-	                if (!ReadOfferAccept(vchOfferAccept, vchOffer))
-	                    printf("ReconstructOfferIndex() : warning - failed to read offer accept from offer DB\n");
-	                else bReadOffer = true;
-	            }
-				if(!bReadOffer && !txOffer.GetAcceptByHash(vchOfferAccept, txCA))
-					printf("ReconstructOfferIndex() : failed to read offer accept from offer\n");
-
-				// add txn-specific values to offer accept object
-                txCA.vchRand = vvchArgs[1];
-		        txCA.nTime = pindex->nTime;
-		        txCA.txHash = tx.GetHash();
-		        txCA.nHeight = nHeight;
-				txOffer.PutOfferAccept(txCA);
-			}
-
-			// use the txn offer as master on updates,
-			// but grab the accepts from the DB first
-			if(op == OP_OFFER_UPDATE) {
-				serializedOffer.accepts = txOffer.accepts;
-				txOffer = serializedOffer;
-			}
+		// use the txn offer as master on updates,
+		// but grab the accepts from the DB first
+		if(op == OP_OFFER_UPDATE) {
+			serializedOffer.accepts = txOffer.accepts;
+			txOffer = serializedOffer;
+		}
 
-			// txn-specific values to offer object
-            txOffer.vchRand = vvchArgs[0];
-			txOffer.txHash = tx.GetHash();
-            txOffer.nHeight = nHeight;
-            txOffer.nTime = pindex->nTime;
-            txOffer.PutToOfferList(vtxPos);
-
-            if (!WriteOffer(vchOffer, vtxPos))
-                return error("ReconstructOfferIndex() : failed to write to offer DB");
-            if(op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY)
-	            if (!WriteOfferAccept(vvchArgs[1], vvchArgs[0]))
-	                return error("ReconstructOfferIndex() : failed to write to offer DB");
-			
-			// insert offers fees to regenerate list, write offer to
-			// master index
-			int64 nTheFee = GetOfferNetFee(tx);
-			InsertOfferFee(pindex, tx.GetHash(), nTheFee);
-
-			printf( "RECONSTRUCT OFFER: op=%s offer=%s title=%s qty=%llu hash=%s height=%d fees=%llu\n",
-					offerFromOp(op).c_str(),
-					stringFromVch(vvchArgs[0]).c_str(),
-					stringFromVch(txOffer.sTitle).c_str(),
-					txOffer.GetRemQty(),
-					tx.GetHash().ToString().c_str(), 
-					nHeight,
-					nTheFee);	            
-        }
-        pindex = pindex->pnext;
-        Flush();
-    }
+		// txn-specific values to offer object
+		txOffer.vchRand = vvchArgs[0];
+		txOffer.txHash = tx.GetHash();
+		txOffer.nHeight = nHeight;
+		txOffer.nTime = pindex->nTime;
+
+		// insert offers fees to regenerate list, write offer to
+		// master index
+		int64 nTheFee = GetOfferNetFee(tx);
+		InsertOfferFee(pindex, tx.GetHash(), nTheFee);
+
+		if (!WriteOffer(vchOffer, txOffer, offerFeeWindow))
+			return error("ReconstructBlock() : failed to write to offer DB");
+		if(op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY)
+			if (!WriteOfferAccept(vvchArgs[1], vvchArgs[0]))
+				return error("ReconstructBlock() : failed to write to offer DB");
+
+		LogPrint(LOG_OFFER, "RECONSTRUCT OFFER: op=%s offer=%s title=%s qty=%llu hash=%s height=%d fees=%llu\n",
+				offerFromOp(op).c_str(),
+				stringFromVch(vvchArgs[0]).c_str(),
+				stringFromVch(txOffer.sTitle).c_str(),
+				txOffer.GetRemQty(),
+				tx.GetHash().ToString().c_str(), 
+				nHeight,
+				nTheFee);	            
     }
     return true;
 }
@@ -340,80 +284,35 @@ int GetOfferTxHashHeight(const uint256 txHash) {
 
 uint64 GetOfferFeeSubsidy(unsigned int nHeight) {
 	uint64 hr1 = 1, hr12 = 1;
-	{
-		TRY_LOCK(cs_main, cs_trymain);
-		unsigned int h12 = 360 * 12;
-		unsigned int nTargetTime = 0;
-		unsigned int nTarget1hrTime = 0;
-		unsigned int blk1hrht = nHeight - 1;
-		unsigned int blk12hrht = nHeight - 1;
-		bool bFound = false;
-
-		BOOST_FOREACH(COfferFee &nmFee, lstOfferFees) {
-			if(nmFee.nHeight <= nHeight)
-				bFound = true;
-			if(bFound) {
-				if(nTargetTime==0) {
-					hr1 = hr12 = 0;
-					nTargetTime = nmFee.nTime - h12;
-					nTarget1hrTime = nmFee.nTime - (h12/12);
-				}
-				if(nmFee.nTime > nTargetTime) {
-					hr12 += nmFee.nFee;
-					blk12hrht = nmFee.nHeight;
-					if(nmFee.nTime > nTarget1hrTime) {
-						hr1 += nmFee.nFee;
-						blk1hrht = nmFee.nHeight;
-					}
-				}
-			}
-		}
-		hr12 /= (nHeight - blk12hrht) + 1;
-		hr1 /= (nHeight - blk1hrht) + 1;
-	}
+	offerFeeWindow.GetWindowAverages(nHeight, OFFER_FEE_WINDOW, hr1, hr12);
 	uint64 nSubsidyOut = hr1 > hr12 ? hr1 : hr12;
 	return nSubsidyOut;
 }
 
 bool RemoveOfferFee(COfferFee &txnVal) {
-	{
-		TRY_LOCK(cs_main, cs_trymain);
-
-		COfferFee *theval = NULL;
-
-		BOOST_FOREACH(COfferFee &nmTxnValue, lstOfferFees) {
-			if (txnVal.hash == nmTxnValue.hash
-			 && txnVal.nHeight == nmTxnValue.nHeight) {
-				theval = &nmTxnValue;
-				break;
-			}
-		}
-		if(theval)
-			lstOfferFees.remove(*theval);
-
-		return theval != NULL;
-	}
+	return offerFeeWindow.Remove(txnVal.hash, txnVal.nHeight);
 }
 
 bool InsertOfferFee(CBlockIndex *pindex, uint256 hash, uint64 nValue) {
-	TRY_LOCK(cs_main, cs_trymain);
-	list<COfferFee> txnDup;
-	COfferFee oFee;
-	oFee.nTime = pindex->nTime;
-	oFee.nHeight = pindex->nHeight;
-	oFee.nFee = nValue;
-	bool bFound = false;
-	BOOST_FOREACH(COfferFee &nmFee, lstOfferFees) {
-		if (oFee.hash == nmFee.hash
-				&& oFee.nHeight == nmFee.nHeight) {
-			bFound = true;
-			break;
-		}
-	}
-	if (!bFound)
-		lstOfferFees.push_front(oFee);
+	// offer fees have always been tracked by height alone (one per block),
+	// the first fee seen at a height is kept
+	return offerFeeWindow.Insert(
+			CFeeWindowEntry(0, pindex->nHeight, pindex->nTime, nValue), false);
+}
 
-	return bFound;
+bool LoadOfferFees(unsigned int nHeight) {
+	offerFeeWindow.Attach(pofferdb, "offerfee");
+
+	vector<COfferFee> vFees;
+	if (pofferdb->ReadLegacyOfferTxFees(vFees)) {
+		printf("LoadOfferFees() : upgrading %"PRIszu" offer fees to per-record storage\n", vFees.size());
+		offerFeeWindow.clear();
+		BOOST_REVERSE_FOREACH(const COfferFee &fee, vFees)
+			offerFeeWindow.push_back(
+					CFeeWindowEntry(fee.hash, fee.nHeight, fee.nTime, fee.nFee));
+		return pofferdb->UpgradeOfferTxFees(offerFeeWindow);
+	}
+	return offerFeeWindow.Load(nHeight, FEE_WINDOW_LOAD_DEPTH, OFFER_FEE_WINDOW);
 }
 
 int64 GetOfferNetFee(const CTransaction& tx) {
@@ -427,12 +326,10 @@ int64 GetOfferNetFee(const CTransaction& tx) {
 }
 
 int GetOfferHeight(vector<unsigned char> vchOffer) {
-	vector<COffer> vtxPos;
+	COffer txPos;
 	if (pofferdb->ExistsOffer(vchOffer)) {
-		if (!pofferdb->ReadOffer(vchOffer, vtxPos))
-			return error("GetOfferHeight() : failed to read from offer DB");
-		if (vtxPos.empty()) return -1;
-		COffer& txPos = vtxPos.back();
+		if (!pofferdb->ReadOfferLast(vchOffer, txPos))
+			return -1;
 		return txPos.nHeight;
 	}
 	return -1;
@@ -534,7 +431,7 @@ bool IsOfferMine(const CTransaction& tx) {
 
 	const CTxOut& txout = tx.vout[nOut];
 	if (IsMyOffer(tx, txout)) {
-		printf("IsOfferMine() : found my transaction %s nout %d\n",
+		LogPrint(LOG_OFFER, "IsOfferMine() : found my transaction %s nout %d\n",
 				tx.GetHash().GetHex().c_str(), nOut);
 		return true;
 	}
@@ -559,7 +456,7 @@ bool IsOfferMine(const CTransaction& tx, const CTxOut& txout,
 		return false;
 
 	if (IsMyOffer(tx, txout)) {
-		printf("IsOfferMine() : found my transaction %s value %d\n",
+		LogPrint(LOG_OFFER, "IsOfferMine() : found my transaction %s value %d\n",
 				tx.GetHash().GetHex().c_str(), (int) txout.nValue);
 		return true;
 	}
@@ -581,11 +478,10 @@ bool GetValueOfOfferTxHash(const uint256 &txHash,
 
 bool GetValueOfOffer(COfferDB& dbOffer, const vector<unsigned char> &vchOffer,
 		vector<unsigned char>& vchValue, int& nHeight) {
-	vector<COffer> vtxPos;
-	if (!pofferdb->ReadOffer(vchOffer, vtxPos) || vtxPos.empty())
+	COffer txPos;
+	if (!pofferdb->ReadOfferLast(vchOffer, txPos))
 		return false;
 
-	COffer& txPos = vtxPos.back();
 	nHeight = txPos.nHeight;
 	vchValue = txPos.vchRand;
 	return true;
@@ -593,10 +489,9 @@ bool GetValueOfOffer(COfferDB& dbOffer, const vector<unsigned char> &vchOffer,
 
 bool GetTxOfOffer(COfferDB& dbOffer, const vector<unsigned char> &vchOffer,
 		CTransaction& tx) {
-	vector<COffer> vtxPos;
-	if (!pofferdb->ReadOffer(vchOffer, vtxPos) || vtxPos.empty())
+	COffer txPos;
+	if (!pofferdb->ReadOfferLast(vchOffer, txPos))
 		return false;
-	COffer& txPos = vtxPos.back();
 	int nHeight = txPos.nHeight;
 	if (nHeight + GetOfferExpirationDepth(pindexBest->nHeight)
 			< pindexBest->nHeight) {
@@ -614,11 +509,9 @@ bool GetTxOfOffer(COfferDB& dbOffer, const vector<unsigned char> &vchOffer,
 
 bool GetTxOfOfferAccept(COfferDB& dbOffer, const vector<unsigned char> &vchOfferAccept,
 		COffer &txPos, CTransaction& tx) {
-	vector<COffer> vtxPos;
 	vector<unsigned char> vchOffer;
 	if (!pofferdb->ReadOfferAccept(vchOfferAccept, vchOffer)) return false;
-	if (!pofferdb->ReadOffer(vchOffer, vtxPos)) return false;
-	txPos = vtxPos.back();
+	if (!pofferdb->ReadOfferLast(vchOffer, txPos)) return false;
 	int nHeight = txPos.nHeight;
 	if (nHeight + GetOfferExpirationDepth(pindexBest->nHeight)
 			< pindexBest->nHeight) {
@@ -634,11 +527,10 @@ bool GetTxOfOfferAccept(COfferDB& dbOffer, const vector<unsigned char> &vchOffer
 	return true;
 }
 
-bool DecodeOfferTx(const CTransaction& tx, int& op, int& nOut,
-		vector<vector<unsigned char> >& vvch, int nHeight) {
+static bool DecodeOfferTxOutputs(const CTransaction& tx, int& op, int& nOut,
+		vector<vector<unsigned char> >& vvch) {
 	bool found = false;
 
-
 	// Strict check - bug disallowed
 	for (unsigned int i = 0; i < tx.vout.size(); i++) {
 		const CTxOut& out = tx.vout[i];
@@ -649,7 +541,22 @@ bool DecodeOfferTx(const CTransaction& tx, int& op, int& nOut,
 		}
 	}
 	if (!found) vvch.clear();
-	return found && IsOfferOp(op);
+	return found;
+}
+
+bool DecodeOfferTx(const CTransaction& tx, int& op, int& nOut,
+		vector<vector<unsigned char> >& vvch, int nHeight) {
+	// other transactions are not worth hashing to look them up
+	if (tx.nVersion != SYSCOIN_TX_VERSION)
+		return DecodeOfferTxOutputs(tx, op, nOut, vvch) && IsOfferOp(op);
+
+	uint256 hash = tx.GetHash();
+	CServiceTxDecode decode;
+	if (!offerDecodeCache.Get(hash, decode)) {
+		decode.fFound = DecodeOfferTxOutputs(tx, decode.op, decode.nOut, decode.vvch);
+		offerDecodeCache.Insert(hash, decode);
+	}
+	return decode.Get(op, nOut, vvch) && IsOfferOp(op);
 }
 
 bool GetValueOfOfferTx(const CCoins& tx, vector<unsigned char>& value) {
@@ -988,13 +895,13 @@ CScript RemoveOfferScriptPrefix(const CScript& scriptIn) {
 	return CScript(pc, scriptIn.end());
 }
 
-bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+bool VerifyOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 		CValidationState &state, CCoinsViewCache &inputs,
 		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
 		bool fJustCheck) {
 
 	if (!tx.IsCoinBase()) {
-		printf("*** %d %d %s %s %s %s\n", pindexBlock->nHeight,
+		LogPrint(LOG_OFFER, "*** %d %d %s %s %s %s\n", pindexBlock->nHeight,
 				pindexBest->nHeight, tx.GetHash().ToString().c_str(),
 				fBlock ? "BLOCK" : "", fMiner ? "MINER" : "",
 				fJustCheck ? "JUSTCHECK" : "");
@@ -1032,7 +939,12 @@ bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 		bool good = DecodeOfferTx(tx, op, nOut, vvchArgs, pindexBlock->nHeight);
 		if (!good)
 			return error("CheckOfferInputs() : could not decode a syscoin tx");
-		int nPrevHeight;
+
+		// binary payloads are only valid from the fork on; the mempool and
+		// the miner check for the next block
+		int nTxHeight = fBlock ? pindexBlock->nHeight : pindexBlock->nHeight + 1;
+		if (tx.IsBinaryData() && nTxHeight < GetBinaryPayloadStartBlock())
+			return error("CheckOfferInputs() : binary offer payload before block %d", GetBinaryPayloadStartBlock());
 		int nDepth;
 		int64 nNetFee;
 
@@ -1105,13 +1017,6 @@ bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 					return error(
 							"CheckOfferInputs() : offeractivate cannot be mined if offernew is not already in chain and unexpired");
 
-				nPrevHeight = GetOfferHeight(vchOffer);
-				if (!fBlock && nPrevHeight >= 0
-						&& pindexBlock->nHeight - nPrevHeight
-								< GetOfferExpirationDepth(pindexBlock->nHeight))
-					return error(
-							"CheckOfferInputs() : offeractivate on an unexpired offer.");
-
 				if(pindexBlock->nHeight == pindexBest->nHeight) {
 					BOOST_FOREACH(const MAPTESTPOOLTYPE& s, mapTestPool) {
 	                    if (vvchArgs[0] == s.first) {
@@ -1168,11 +1073,8 @@ bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 
 			if (fBlock && !fJustCheck) {
 				// Check hash
-				const vector<unsigned char> &vchOffer = vvchArgs[0];
 				const vector<unsigned char> &vchAcceptRand = vvchArgs[1];
 
-				nPrevHeight = GetOfferHeight(vchOffer);
-
 				// check for existence of offeraccept in txn offer obj
 				if(!theOffer.GetAcceptByHash(vchAcceptRand, theOfferAccept))
 					return error("could not read accept from offer txn");
@@ -1214,8 +1116,6 @@ bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 							"CheckOfferInputs() : offerpay prev hash mismatch : %s vs %s",
 							HexStr(stringFromVch(vvchPrevArgs[2])).c_str(), HexStr(stringFromVch(vchToHash)).c_str());
 
-				nPrevHeight = GetOfferHeight(vchOffer);
-
 				// check for existence of offeraccept in txn offer obj
 				if(!theOffer.GetAcceptByHash(vchOfferAccept, theOfferAccept))
 					return error("could not read accept from offer txn");
@@ -1247,153 +1147,171 @@ bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
 			return error( "CheckOfferInputs() : offer transaction has unknown op");
 		}
 
-		// save serialized offer for later use
-		COffer serializedOffer = theOffer;
+	}
+	return true;
+}
 
-		// if not an offernew, load the offer data from the DB
-		vector<COffer> vtxPos;
-		if(op != OP_OFFER_NEW)
-			if (pofferdb->ExistsOffer(vvchArgs[0])) {
-				if (!pofferdb->ReadOffer(vvchArgs[0], vtxPos))
-					return error(
-							"CheckOfferInputs() : failed to read from offer DB");
-			}
+bool ConnectOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
+		bool fJustCheck) {
 
-		//todo fucking suspect
-		// // for offerupdate or offerpay check to make sure the previous txn exists and is valid
-		// if (!fBlock && fJustCheck && (op == OP_OFFER_UPDATE || op == OP_OFFER_PAY)) {
-		// 	if (!CheckOfferTxPos(vtxPos, prevCoins->nHeight))
-		// 		return error(
-		// 				"CheckOfferInputs() : tx %s rejected, since previous tx (%s) is not in the offer DB\n",
-		// 				tx.GetHash().ToString().c_str(),
-		// 				prevOutput->hash.ToString().c_str());
-		// }
-
-		// these ifs are problably total bullshit except for the offernew
-		if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
-			if (op != OP_OFFER_NEW) {
-				if (!fMiner && !fJustCheck && pindexBlock->nHeight != pindexBest->nHeight) {
-					int nHeight = pindexBlock->nHeight;
-
-					// get the latest offer from the db
-                	theOffer.nHeight = nHeight;
-                	theOffer.GetOfferFromList(vtxPos);
-					
-					// If update, we make the serialized offer the master
-					// but first we assign the accepts from the DB since
-					// they are not shipped in an update txn to keep size down
-					if(op == OP_OFFER_UPDATE) {
-						serializedOffer.accepts = theOffer.accepts;
-						theOffer = serializedOffer;
-					}
+	if (tx.IsCoinBase() || tx.nVersion != SYSCOIN_TX_VERSION)
+		return true;
 
-					if (op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY) {
-						// get the accept out of the offer object in the txn
-						if(!serializedOffer.GetAcceptByHash(vvchArgs[1], theOfferAccept))
-							return error("could not read accept from offer txn");
-
-						if(op == OP_OFFER_ACCEPT) {
-							// get the offer accept qty, validate acceptance. txn is still valid
-							// if qty cannot be fulfilled, first-to-mine makes it
-							if(theOfferAccept.nQty < 1 || theOfferAccept.nQty > theOffer.GetRemQty()) {
-								printf("txn %s accepted but offer not fulfilled because desired"
-									" qty %llu is more than available qty %llu for offer accept %s\n", 
-									tx.GetHash().GetHex().c_str(), 
-									theOfferAccept.nQty, 
-									theOffer.GetRemQty(), 
-									stringFromVch(theOfferAccept.vchRand).c_str());
-								{
-									TRY_LOCK(cs_main, cs_trymain);
-									std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = 
-										mapOfferAcceptPending.find(vvchArgs[1]);
-									if (mi != mapOfferAcceptPending.end())
-										mi->second.erase(tx.GetHash());
-								}
-								return true;
+	vector<vector<unsigned char> > vvchArgs;
+	int op;
+	int nOut;
+	if (!DecodeOfferTx(tx, op, nOut, vvchArgs, pindexBlock->nHeight))
+		return error("ConnectOfferInputs() : could not decode a syscoin tx");
+
+	COffer theOffer(tx);
+	COfferAccept theOfferAccept;
+
+	// save serialized offer for later use
+	COffer serializedOffer = theOffer;
+
+	//todo fucking suspect
+	// // for offerupdate or offerpay check to make sure the previous txn exists and is valid
+	// if (!fBlock && fJustCheck && (op == OP_OFFER_UPDATE || op == OP_OFFER_PAY)) {
+	// 	if (!CheckOfferTxPos(vtxPos, prevCoins->nHeight))
+	// 		return error(
+	// 				"CheckOfferInputs() : tx %s rejected, since previous tx (%s) is not in the offer DB\n",
+	// 				tx.GetHash().ToString().c_str(),
+	// 				prevOutput->hash.ToString().c_str());
+	// }
+
+	// these ifs are problably total bullshit except for the offernew
+	if (fBlock || (!fBlock && !fMiner && !fJustCheck)) {
+		if (op != OP_OFFER_NEW) {
+			if (!fMiner && !fJustCheck && pindexBlock->nHeight != pindexBest->nHeight) {
+				int nHeight = pindexBlock->nHeight;
+
+				// get the offer version at this height, or the latest, from the db
+				theOffer.nHeight = nHeight;
+				COffer dbOffer;
+				if (pofferdb->ReadOfferAt(vvchArgs[0], nHeight, dbOffer))
+					theOffer = dbOffer;
+				
+				// If update, we make the serialized offer the master
+				// but first we assign the accepts from the DB since
+				// they are not shipped in an update txn to keep size down
+				if(op == OP_OFFER_UPDATE) {
+					serializedOffer.accepts = theOffer.accepts;
+					theOffer = serializedOffer;
+				}
+
+				if (op == OP_OFFER_ACCEPT || op == OP_OFFER_PAY) {
+					// get the accept out of the offer object in the txn
+					if(!serializedOffer.GetAcceptByHash(vvchArgs[1], theOfferAccept))
+						return error("could not read accept from offer txn");
+
+					if(op == OP_OFFER_ACCEPT) {
+						// get the offer accept qty, validate acceptance. txn is still valid
+						// if qty cannot be fulfilled, first-to-mine makes it
+						if(theOfferAccept.nQty < 1 || theOfferAccept.nQty > theOffer.GetRemQty()) {
+							LogPrint(LOG_OFFER, "txn %s accepted but offer not fulfilled because desired"
+								" qty %llu is more than available qty %llu for offer accept %s\n", 
+								tx.GetHash().GetHex().c_str(), 
+								theOfferAccept.nQty, 
+								theOffer.GetRemQty(), 
+								stringFromVch(theOfferAccept.vchRand).c_str());
+							{
+								TRY_LOCK(cs_main, cs_trymain);
+								std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = 
+									mapOfferAcceptPending.find(vvchArgs[1]);
+								if (mi != mapOfferAcceptPending.end())
+									mi->second.erase(tx.GetHash());
 							}
-						} 
-
-						if(op == OP_OFFER_PAY) {
-							// validate the offer accept is in the database,
-							// this is one of the ways we validate that the accept
-							// can be fulfilled
-							COfferAccept ca;
-							if(!theOffer.GetAcceptByHash(vvchArgs[1], ca))
-								return error("could not read accept from DB offer");
-							// if the accept exists in the database, great. 
-							// we don't need to use it, however, the serialized
-							// version is just fine
-							theOfferAccept.bPaid = true;
+							return true;
 						}
-
-						// set the offer accept txn-dependent values and add to the txn
-						theOfferAccept.vchRand = vvchArgs[1];
-						theOfferAccept.txHash = tx.GetHash();
-						theOfferAccept.nTime = pindexBlock->nTime;
-						theOfferAccept.nHeight = nHeight;
-						theOffer.PutOfferAccept(theOfferAccept);
-						mapTestPool[vvchArgs[1]] = tx.GetHash();
-
-						// write the offer / offer accept mapping to the database
-						if (!pofferdb->WriteOfferAccept(vvchArgs[1], vvchArgs[0]))
-							return error( "CheckOfferInputs() : failed to write to offer DB");
+					} 
+
+					if(op == OP_OFFER_PAY) {
+						// validate the offer accept is in the database,
+						// this is one of the ways we validate that the accept
+						// can be fulfilled
+						COfferAccept ca;
+						if(!theOffer.GetAcceptByHash(vvchArgs[1], ca))
+							return error("could not read accept from DB offer");
+						// if the accept exists in the database, great. 
+						// we don't need to use it, however, the serialized
+						// version is just fine
+						theOfferAccept.bPaid = true;
 					}
-					
-					// only modify the offer's height on an activate or update
-					if(op == OP_OFFER_ACTIVATE || op == OP_OFFER_UPDATE)
-						theOffer.nHeight = pindexBlock->nHeight;
 
-					// set the offer's txn-dependent values
-                    theOffer.vchRand = vvchArgs[0];
-					theOffer.txHash = tx.GetHash();
-					theOffer.nTime = pindexBlock->nTime;
-					theOffer.PutToOfferList(vtxPos);
+					// set the offer accept txn-dependent values and add to the txn
+					theOfferAccept.vchRand = vvchArgs[1];
+					theOfferAccept.txHash = tx.GetHash();
+					theOfferAccept.nTime = pindexBlock->nTime;
+					theOfferAccept.nHeight = nHeight;
+					theOffer.PutOfferAccept(theOfferAccept);
+					mapTestPool[vvchArgs[1]] = tx.GetHash();
 
-					// write offer
-					if (!pofferdb->WriteOffer(vvchArgs[0], vtxPos))
+					// write the offer / offer accept mapping to the database
+					if (!pofferdb->WriteOfferAccept(vvchArgs[1], vvchArgs[0]))
 						return error( "CheckOfferInputs() : failed to write to offer DB");
-					mapTestPool[vvchArgs[0]] = tx.GetHash();
+				}
+				
+				// only modify the offer's height on an activate or update
+				if(op == OP_OFFER_ACTIVATE || op == OP_OFFER_UPDATE)
+					theOffer.nHeight = pindexBlock->nHeight;
+
+				// set the offer's txn-dependent values
+                    theOffer.vchRand = vvchArgs[0];
+				theOffer.txHash = tx.GetHash();
+				theOffer.nTime = pindexBlock->nTime;
 
-                    // compute verify and write fee data to DB
+                    // compute verify and track fee data
                     int64 nTheFee = GetOfferNetFee(tx);
-					InsertOfferFee(pindexBlock, tx.GetHash(), nTheFee);
-					if(nTheFee > 0) printf("OFFER FEES: Added %lf in fees to track for regeneration.\n", (double) nTheFee / COIN);
-					vector<COfferFee> vOfferFees(lstOfferFees.begin(), lstOfferFees.end());
-					if (!pofferdb->WriteOfferTxFees(vOfferFees))
-						return error( "CheckOfferInputs() : failed to write fees to offer DB");
-
-					// remove offer from pendings
-					// activate or update - seller txn
-                    if (op == OP_OFFER_ACTIVATE || op == OP_OFFER_UPDATE) {
-						vector<unsigned char> vchOffer = op == OP_OFFER_NEW ? vchFromString(HexStr(vvchArgs[0])) : vvchArgs[0];
-						TRY_LOCK(cs_main, cs_trymain);
-						std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapOfferPending.find(vchOffer);
-						if (mi != mapOfferPending.end())
-							mi->second.erase(tx.GetHash());
-					}
-					// accept or pay - buyer txn
-					else {
-						TRY_LOCK(cs_main, cs_trymain);
-						std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapOfferAcceptPending.find(vvchArgs[1]);
-						if (mi != mapOfferAcceptPending.end())
-							mi->second.erase(tx.GetHash());
-					}
+				InsertOfferFee(pindexBlock, tx.GetHash(), nTheFee);
+				if(nTheFee > 0) LogPrint(LOG_OFFER, "OFFER FEES: Added %lf in fees to track for regeneration.\n", (double) nTheFee / COIN);
 
-					// debug
-					printf( "CONNECTED OFFER: op=%s offer=%s title=%s qty=%llu hash=%s height=%d fees=%llu\n",
-							offerFromOp(op).c_str(),
-							stringFromVch(vvchArgs[0]).c_str(),
-							stringFromVch(theOffer.sTitle).c_str(),
-							theOffer.GetRemQty(),
-							tx.GetHash().ToString().c_str(), 
-							nHeight, nTheFee / COIN);
+				// write offer and fee changes together
+				if (!pofferdb->WriteOffer(vvchArgs[0], theOffer, offerFeeWindow))
+					return error( "CheckOfferInputs() : failed to write to offer DB");
+				mapTestPool[vvchArgs[0]] = tx.GetHash();
+
+				// remove offer from pendings
+				// activate or update - seller txn
+                    if (op == OP_OFFER_ACTIVATE || op == OP_OFFER_UPDATE) {
+					vector<unsigned char> vchOffer = op == OP_OFFER_NEW ? vchFromString(HexStr(vvchArgs[0])) : vvchArgs[0];
+					TRY_LOCK(cs_main, cs_trymain);
+					std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapOfferPending.find(vchOffer);
+					if (mi != mapOfferPending.end())
+						mi->second.erase(tx.GetHash());
 				}
+				// accept or pay - buyer txn
+				else {
+					TRY_LOCK(cs_main, cs_trymain);
+					std::map<std::vector<unsigned char>, std::set<uint256> >::iterator mi = mapOfferAcceptPending.find(vvchArgs[1]);
+					if (mi != mapOfferAcceptPending.end())
+						mi->second.erase(tx.GetHash());
+				}
+
+				// debug
+				LogPrint(LOG_OFFER, "CONNECTED OFFER: op=%s offer=%s title=%s qty=%llu hash=%s height=%d fees=%llu\n",
+						offerFromOp(op).c_str(),
+						stringFromVch(vvchArgs[0]).c_str(),
+						stringFromVch(theOffer.sTitle).c_str(),
+						theOffer.GetRemQty(),
+						tx.GetHash().ToString().c_str(), 
+						nHeight, nTheFee / COIN);
 			}
 		}
 	}
 	return true;
 }
 
+bool CheckOfferInputs(CBlockIndex *pindexBlock, const CTransaction &tx,
+		CValidationState &state, CCoinsViewCache &inputs,
+		map<vector<unsigned char>, uint256> &mapTestPool, bool fBlock, bool fMiner,
+		bool fJustCheck) {
+	return VerifyOfferInputs(pindexBlock, tx, state, inputs, mapTestPool,
+			fBlock, fMiner, fJustCheck)
+			&& ConnectOfferInputs(pindexBlock, tx, mapTestPool, fBlock,
+					fMiner, fJustCheck);
+}
+
 bool ExtractOfferAddress(const CScript& script, string& address) {
 	if (script.size() == 1 && script[0] == OP_RETURN) {
 		address = string("network fee");
@@ -1423,11 +1341,6 @@ bool ExtractOfferAddress(const CScript& script, string& address) {
 	return true;
 }
 
-void rescanforoffers(CBlockIndex *pindexRescan) {
-    printf("Scanning blockchain for offers to create fast index...\n");
-    pofferdb->ReconstructOfferIndex(pindexRescan);
-}
-
 int GetOfferTxPosHeight(const CDiskTxPos& txPos) {
     // Read block header
     CBlock block;
@@ -1538,7 +1451,7 @@ Value offernew(const Array& params, bool fHelp) {
 	newOffer.nQty = nQty;
 	newOffer.nPrice = nPrice * COIN;
 
-	string bdata = newOffer.SerializeToString();
+	string bdata = newOffer.SerializeToString(nBestHeight + 1);
 
 	// create transaction keys
 	CPubKey newDefaultKey;
@@ -1648,7 +1561,7 @@ Value offeractivate(const Array& params, bool fHelp) {
         newOffer.vchRand = vchOffer;
 		newOffer.nFee = nNetFee;
 
-		string bdata = newOffer.SerializeToString();
+		string bdata = newOffer.SerializeToString(nBestHeight + 1);
 		vector<unsigned char> vchbdata = vchFromString(bdata);
 
 		// check this hash against previous, ensure they match
@@ -1757,10 +1670,8 @@ Value offerupdate(const Array& params, bool fHelp) {
 			throw runtime_error("cannot unserialize offer from txn");
 
 		// get the offer from DB
-		vector<COffer> vtxPos;
-		if (!pofferdb->ReadOffer(vchOffer, vtxPos))
+		if (!pofferdb->ReadOfferLast(vchOffer, theOffer))
 			throw runtime_error("could not read offer from DB");
-		theOffer = vtxPos.back();
 		theOffer.accepts.clear();
 
 		// calculate network fees
@@ -1776,7 +1687,7 @@ Value offerupdate(const Array& params, bool fHelp) {
 		theOffer.nFee += nNetFee;
 
 		// serialize offer object
-		string bdata = theOffer.SerializeToString();
+		string bdata = theOffer.SerializeToString(nBestHeight + 1);
 
 		CWalletTx& wtxIn = pwalletMain->mapWallet[wtxInHash];
 		string strError = SendOfferMoneyWithInputTx(scriptPubKey, MIN_AMOUNT, nNetFee,
@@ -1851,10 +1762,8 @@ Value offeraccept(const Array& params, bool fHelp) {
 			throw runtime_error("could not unserialize offer from txn");
 
 		// get the offer id from DB
-		vector<COffer> vtxPos;
-		if (!pofferdb->ReadOffer(vchOffer, vtxPos))
+		if (!pofferdb->ReadOfferLast(vchOffer, theOffer))
 			throw runtime_error("could not read offer with this name from DB");
-		theOffer = vtxPos.back();
 
 		if(theOffer.GetRemQty() < nQty)
 			throw runtime_error("not enough remaining quantity to fulfill this orderaccept");
@@ -1868,7 +1777,7 @@ Value offeraccept(const Array& params, bool fHelp) {
 		theOffer.PutOfferAccept(txAccept);
 
 		// serialize offer object
-		string bdata = theOffer.SerializeToString();
+		string bdata = theOffer.SerializeToString(nBestHeight + 1);
 
 		string strError = pwalletMain->SendMoney(scriptPubKey, MIN_AMOUNT, wtx,
 				false, bdata);
@@ -1983,13 +1892,13 @@ Value offerpay(const Array& params, bool fHelp) {
     // send payment to offer address
     CBitcoinAddress address(stringFromVch(theOffer.vchPaymentAddress));
     string strError = pwalletMain->SendMoneyToDestination(address.Get(), nTotalValue, 
-    	wtxPay, false, offerCopy.SerializeToString());
+    	wtxPay, false, offerCopy.SerializeToString(nBestHeight + 1));
     if (strError != "") throw JSONRPCError(RPC_WALLET_ERROR, strError);
 
 	// send the offer pay txn 
 	CWalletTx& wtxIn = pwalletMain->mapWallet[wtxInHash];
 	strError = SendOfferMoneyWithInputTx(scriptPubKey, MIN_AMOUNT, nNetFee,
-			wtxIn, wtx, false, theOffer.SerializeToString());
+			wtxIn, wtx, false, theOffer.SerializeToString(nBestHeight + 1));
 	if (strError != "")
 		throw JSONRPCError(RPC_WALLET_ERROR, strError);
 	}
@@ -2012,22 +1921,18 @@ Value offerinfo(const Array& params, bool fHelp) {
 	vector<unsigned char> vchOffer = vchFromValue(params[0]);
 	string offer = stringFromVch(vchOffer);
 	{
-		vector<COffer> vtxPos;
-		if (!pofferdb->ReadOffer(vchOffer, vtxPos))
+		COffer theOffer;
+		if (!pofferdb->ReadOfferLast(vchOffer, theOffer))
 			throw JSONRPCError(RPC_WALLET_ERROR,
 					"failed to read from offer DB");
-		if (vtxPos.size() < 1)
-			throw JSONRPCError(RPC_WALLET_ERROR, "no result returned");
 
         // get transaction pointed to by offer
         CTransaction tx;
         uint256 blockHash;
-        uint256 txHash = vtxPos.back().txHash;
+        uint256 txHash = theOffer.txHash;
         if (!GetTransaction(txHash, tx, blockHash, true))
             throw JSONRPCError(RPC_WALLET_ERROR, "failed to read transaction from disk");
 
-        COffer theOffer = vtxPos.back();
-
 		Object oOffer;
 		vector<unsigned char> vchValue;
 		Array aoOfferAccepts;
@@ -2108,12 +2013,15 @@ Value offerlist(const Array& params, bool fHelp) {
         vector<unsigned char> vchValue;
         int nHeight;
 
-        BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet)
+        // only the wallet's transactions on offers
+        vector<uint256> vHashes;
+        pwalletMain->ListServiceTxs(pwalletMain->mapOfferTxs, vchNameUniq, vHashes);
+        BOOST_FOREACH(const uint256& hashTx, vHashes)
         {
-            // get txn hash, read txn index
-            hash = item.second.GetHash();
+            // get txn hash, read the wallet's copy
+            hash = hashTx;
 
-            if (!GetTransaction(hash, tx, blockHash, true))
+            if (!pwalletMain->GetServiceTx(hash, tx))
                 continue;
 
             // skip non-syscoin txns
@@ -2199,12 +2107,15 @@ Value offeracceptlist(const Array& params, bool fHelp) {
         vector<unsigned char> vchValue;
         int nHeight;
 
-        BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, pwalletMain->mapWallet)
+        // only the wallet's transactions on offers
+        vector<uint256> vHashes;
+        pwalletMain->ListServiceTxs(pwalletMain->mapOfferTxs, vchNameUniq, vHashes);
+        BOOST_FOREACH(const uint256& hashTx, vHashes)
         {
-            // get txn hash, read txn index
-            hash = item.second.GetHash();
+            // get txn hash, read the wallet's copy
+            hash = hashTx;
 
-            if (!GetTransaction(hash, tx, blockHash, true))
+            if (!pwalletMain->GetServiceTx(hash, tx))
                 continue;
 
             // skip non-syscoin txns
@@ -2364,57 +2275,62 @@ Value offerfilter(const Array& params, bool fHelp) {
 	//COfferDB dbOffer("r");
 	Array oRes;
 
-	vector<unsigned char> vchOffer;
-	vector<pair<vector<unsigned char>, COffer> > offerScan;
-	if (!pofferdb->ScanOffers(vchOffer, 100000000, offerScan))
-		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
+	// max age: only the offers updated since nMinHeight are looked at
+	int64 nMinHeight = 0;
+	if (nMaxAge != 0)
+		nMinHeight = max((int64) 0, (int64) pindexBest->nHeight - nMaxAge + 1);
+	boost::scoped_ptr<CServiceHistory<COffer>::CScanCursor> pcursor(nMaxAge != 0
+			? pofferdb->NewUpdatedOfferCursor(nMinHeight)
+			: pofferdb->NewOfferCursor(vector<unsigned char>(), false));
 
-	pair<vector<unsigned char>, COffer> pairScan;
-	BOOST_FOREACH(pairScan, offerScan) {
-		string offer = stringFromVch(pairScan.first);
+	using namespace boost::xpressive;
+	sregex cregex;
+	if (strRegexp != "")
+		cregex = sregex::compile(strRegexp);
 
-		// regexp
-		using namespace boost::xpressive;
-		smatch offerparts;
-		sregex cregex = sregex::compile(strRegexp);
-		if (strRegexp != "" && !regex_search(offer, offerparts, cregex))
-			continue;
+	vector<unsigned char> vchOffer;
+	try {
+		while (pcursor->NextName(vchOffer)) {
+			string offer = stringFromVch(vchOffer);
 
-		COffer txOffer = pairScan.second;
-		int nHeight = txOffer.nHeight;
+			// regexp
+			smatch offerparts;
+			if (strRegexp != "" && !regex_search(offer, offerparts, cregex))
+				continue;
 
-		// max age
-		if (nMaxAge != 0 && pindexBest->nHeight - nHeight >= nMaxAge)
-			continue;
+			// from limits
+			nCountFrom++;
+			if (nCountFrom < nFrom + 1)
+				continue;
 
-		// from limits
-		nCountFrom++;
-		if (nCountFrom < nFrom + 1)
-			continue;
+			COffer txOffer;
+			if (!pofferdb->ReadOfferLast(vchOffer, txOffer))
+				continue;
+			int nHeight = txOffer.nHeight;
 
-		Object oOffer;
-		oOffer.push_back(Pair("offer", offer));
-		CTransaction tx;
-		uint256 blockHash;
-		uint256 txHash = txOffer.txHash;
-		if ((nHeight + GetOfferDisplayExpirationDepth(nHeight) - pindexBest->nHeight
-				<= 0) || !GetTransaction(txHash, tx, blockHash, true)) {
-			oOffer.push_back(Pair("expired", 1));
-		} else {
-			vector<unsigned char> vchValue = txOffer.sTitle;
-			string value = stringFromVch(vchValue);
-			oOffer.push_back(Pair("value", value));
-			oOffer.push_back(
-					Pair("expires_in",
-							nHeight + GetOfferDisplayExpirationDepth(nHeight)
-									- pindexBest->nHeight));
-		}
-		oRes.push_back(oOffer);
+			Object oOffer;
+			oOffer.push_back(Pair("offer", offer));
+			if (nHeight + GetOfferDisplayExpirationDepth(nHeight) - pindexBest->nHeight
+					<= 0) {
+				oOffer.push_back(Pair("expired", 1));
+			} else {
+				vector<unsigned char> vchValue = txOffer.sTitle;
+				string value = stringFromVch(vchValue);
+				oOffer.push_back(Pair("value", value));
+				oOffer.push_back(
+						Pair("expires_in",
+								nHeight + GetOfferDisplayExpirationDepth(nHeight)
+										- pindexBest->nHeight));
+			}
+			oRes.push_back(oOffer);
 
-		nCountNb++;
-		// nb limits
-		if (nNb > 0 && nCountNb >= nNb)
-			break;
+			nCountNb++;
+			// nb limits
+			if (nNb > 0 && nCountNb >= nNb)
+				break;
+		}
+	} catch (std::exception &e) {
+		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
 	}
 
 	if (fStat) {
@@ -2429,13 +2345,17 @@ Value offerfilter(const Array& params, bool fHelp) {
 }
 
 Value offerscan(const Array& params, bool fHelp) {
-	if (fHelp || 2 > params.size())
+	if (fHelp || 2 > params.size() || params.size() > 3)
 		throw runtime_error(
-				"offerscan [<start-offer>] [<max-returned>]\n"
-						"scan all offers, starting at start-offer and returning a maximum number of entries (default 500)\n");
+				"offerscan [<start-offer>] [<max-returned>] [<continuation>]\n"
+						"scan all offers, starting at start-offer and returning a maximum number of entries (default 500)\n"
+						"[continuation] : \"\" to start paging, or the continuation of the previous page; "
+						"returns {\"offers\", \"continuation\"}, with an empty continuation after the last page\n");
 
 	vector<unsigned char> vchOffer;
 	int nMax = 500;
+	bool fPaged = false;
+	bool fAfter = false;
 	if (params.size() > 0) {
 		vchOffer = vchFromValue(params[0]);
 	}
@@ -2446,43 +2366,61 @@ Value offerscan(const Array& params, bool fHelp) {
 		nMax = (int) vMax.get_real();
 	}
 
-	//COfferDB dbOffer("r");
-	Array oRes;
+	if (params.size() > 2) {
+		// the continuation is the last offer of the previous page
+		string strContinuation = params[2].get_str();
+		if (!IsHex(strContinuation) && strContinuation != "")
+			throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid continuation");
+		if (strContinuation != "") {
+			vchOffer = ParseHex(strContinuation);
+			fAfter = true;
+		}
+		fPaged = true;
+	}
 
-	vector<pair<vector<unsigned char>, COffer> > offerScan;
-	if (!pofferdb->ScanOffers(vchOffer, nMax, offerScan))
-		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
+	Array oRes;
 
-	pair<vector<unsigned char>, COffer> pairScan;
-	BOOST_FOREACH(pairScan, offerScan) {
-		Object oOffer;
-		string offer = stringFromVch(pairScan.first);
-		oOffer.push_back(Pair("offer", offer));
-		CTransaction tx;
-		COffer txOffer = pairScan.second;
-		uint256 blockHash;
+	boost::scoped_ptr<CServiceHistory<COffer>::CScanCursor> pcursor(pofferdb->NewOfferCursor(vchOffer, fAfter));
+	vector<unsigned char> vchKeyName;
+	COffer txOffer;
+	bool fMore = false;
+	try {
+		while ((int) oRes.size() < nMax && (fMore = pcursor->Next(vchKeyName, txOffer))) {
+			Object oOffer;
+			string offer = stringFromVch(vchKeyName);
+			oOffer.push_back(Pair("offer", offer));
 
-		int nHeight = txOffer.nHeight;
-		vector<unsigned char> vchValue = txOffer.sTitle;
-		if ((nHeight + GetOfferDisplayExpirationDepth(nHeight) - pindexBest->nHeight
-				<= 0) || !GetTransaction(txOffer.txHash, tx, blockHash, true)) {
-			oOffer.push_back(Pair("expired", 1));
-		} else {
-			string value = stringFromVch(vchValue);
-			//string strAddress = "";
-			//GetOfferAddress(tx, strAddress);
-			oOffer.push_back(Pair("value", value));
-			//oOffer.push_back(Pair("txid", tx.GetHash().GetHex()));
-			//oOffer.push_back(Pair("address", strAddress));
-			oOffer.push_back(
-					Pair("expires_in",
-							nHeight + GetOfferDisplayExpirationDepth(nHeight)
-									- pindexBest->nHeight));
+			int nHeight = txOffer.nHeight;
+			vector<unsigned char> vchValue = txOffer.sTitle;
+			if (nHeight + GetOfferDisplayExpirationDepth(nHeight) - pindexBest->nHeight
+					<= 0) {
+				oOffer.push_back(Pair("expired", 1));
+			} else {
+				string value = stringFromVch(vchValue);
+				oOffer.push_back(Pair("value", value));
+				oOffer.push_back(
+						Pair("expires_in",
+								nHeight + GetOfferDisplayExpirationDepth(nHeight)
+										- pindexBest->nHeight));
+			}
+			oRes.push_back(oOffer);
+		}
+		// a full page only has a next one if there is an offer left
+		if (fMore) {
+			COffer txNext;
+			vector<unsigned char> vchNext;
+			fMore = pcursor->Next(vchNext, txNext);
 		}
-		oRes.push_back(oOffer);
+	} catch (std::exception &e) {
+		throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
 	}
 
-	return oRes;
+	if (!fPaged)
+		return oRes;
+	Object oPage;
+	oPage.push_back(Pair("offers", oRes));
+	oPage.push_back(Pair("continuation", fMore ? HexStr(vchKeyName) : string()));
+	return oPage;
 }
 
 
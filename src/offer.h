@@ -2,8 +2,11 @@
 #define OFFER_H
 
 #include "bitcoinrpc.h"
-#include "leveldb.h"
+#include "servicedb.h"
+#include "feewindow.h"
+#include "servicehistory.h"
 
+class CBlock;
 class CTransaction;
 class CTxOut;
 class CValidationState;
@@ -16,6 +19,14 @@ class CDiskTxPos;
 
 bool CheckOfferInputs(CBlockIndex *pindex, const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs, 
     std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
+/** The checks of CheckOfferInputs() that only read the transaction, the
+ *  coins it spends and the chain; safe to run off the main thread. */
+bool VerifyOfferInputs(CBlockIndex *pindex, const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs,
+    std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
+/** The offer DB writes of CheckOfferInputs(), for a transaction that
+ *  VerifyOfferInputs() accepts. */
+bool ConnectOfferInputs(CBlockIndex *pindex, const CTransaction &tx,
+    std::map<std::vector<unsigned char>,uint256> &mapTestPool, bool fBlock, bool fMiner, bool fJustCheck);
 bool ExtractOfferAddress(const CScript& script, std::string& address);
 bool IsOfferMine(const CTransaction& tx);
 bool IsOfferMine(const CTransaction& tx, const CTxOut& txout, bool ignore_aliasnew = false);
@@ -184,17 +195,6 @@ public:
     	accepts.push_back(theOA);
     }
 
-    void PutToOfferList(std::vector<COffer> &offerList) {
-        for(unsigned int i=0;i<offerList.size();i++) {
-            COffer o = offerList[i];
-            if(o.nHeight == nHeight) {
-                offerList[i] = *this;
-                return;
-            }
-        }
-        offerList.push_back(*this);
-    }
-
     bool GetOfferFromList(const std::vector<COffer> &offerList) {
         if(offerList.size() == 0) return false;
         for(unsigned int i=0;i<offerList.size();i++) {
@@ -260,8 +260,10 @@ public:
     bool IsNull() const { return (n == 0 && txHash == 0 && hash == 0 && nHeight == 0 && nPrice == 0 && nQty == 0); }
 
     bool UnserializeFromTx(const CTransaction &tx);
-    void SerializeToTx(CTransaction &tx);
-    std::string SerializeToString();
+    /** nHeight is the height of the block the transaction is meant for,
+     *  which picks the payload format */
+    void SerializeToTx(CTransaction &tx, int nHeight);
+    std::string SerializeToString(int nHeight);
 };
 
 class COfferFee {
@@ -304,25 +306,59 @@ public:
     bool IsNull() const { return (nTime == 0 && nFee == 0 && hash == 0 && nHeight == 0); }
 };
 bool RemoveOfferFee(COfferFee &txnVal);
+bool LoadOfferFees(unsigned int nHeight);
 
-class COfferDB : public CLevelDB {
-public:
-	COfferDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB(GetDataDir() / "offers", nCacheSize, fMemory, fWipe) {}
+class COfferDB : public CServiceDB {
+private:
+	// one record per offer version, plus the height of the latest one
+	CServiceHistory<COffer> history;
 
-	bool WriteOffer(const std::vector<unsigned char>& name, std::vector<COffer>& vtxPos) {
-		return Write(make_pair(std::string("offeri"), name), vtxPos);
+public:
+	COfferDB(size_t nCacheSize, bool fMemory, bool fWipe) : CServiceDB(GetDataDir() / "offers", nCacheSize, fMemory, fWipe),
+		history(*this, "offerv", "offerl", "offeri", "offeru") {}
+
+	bool WriteOffer(const std::vector<unsigned char>& name, const COffer& offer, CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		history.Write(batch, name, offer);
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
 
-	bool EraseOffer(const std::vector<unsigned char>& name) {
-	    return Erase(make_pair(std::string("offeri"), name));
+	// drop the latest versions of name written by txHash
+	bool PopOffer(const std::vector<unsigned char>& name, const uint256& txHash, CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		if (!history.Pop(batch, name, txHash))
+			return false;
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
 
 	bool ReadOffer(const std::vector<unsigned char>& name, std::vector<COffer>& vtxPos) {
-		return Read(make_pair(std::string("offeri"), name), vtxPos);
+		return history.ReadAll(name, vtxPos);
+	}
+
+	bool ReadOfferLast(const std::vector<unsigned char>& name, COffer& offer) {
+		return history.ReadLatest(name, offer);
+	}
+
+	// the version written at nHeight, or else the latest one
+	bool ReadOfferAt(const std::vector<unsigned char>& name, uint64 nHeight, COffer& offer) {
+		return history.ReadVersion(name, nHeight, offer) || history.ReadLatest(name, offer);
 	}
 
 	bool ExistsOffer(const std::vector<unsigned char>& name) {
-	    return Exists(make_pair(std::string("offeri"), name));
+	    return history.Exists(name);
+	}
+
+	// walk the offers updated at nMinHeight or later, in name order
+	CServiceHistory<COffer>::CScanCursor *NewUpdatedOfferCursor(uint64 nMinHeight) {
+		return new CServiceHistory<COffer>::CScanCursor(history, nMinHeight);
+	}
+
+	// offers used to keep their whole history in one vector, and were
+	// not indexed by update height
+	bool UpgradeOfferIndex() {
+		return history.Upgrade();
 	}
 
 	bool WriteOfferAccept(const std::vector<unsigned char>& name, std::vector<unsigned char>& vchValue) {
@@ -341,14 +377,24 @@ public:
 	    return Exists(make_pair(std::string("offera"), name));
 	}
 
-	bool WriteOfferTxFees(std::vector<COfferFee>& vtxPos) {
-		return Write(make_pair(std::string("offera"), std::string("offertxf")), vtxPos);
+	bool WriteOfferTxFees(CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		fees.WriteChanges(batch);
+		return WriteBatch(batch);
 	}
 
-	bool ReadOfferTxFees(std::vector<COfferFee>& vtxPos) {
+	// fees used to be stored as one vector under a single key
+	bool ReadLegacyOfferTxFees(std::vector<COfferFee>& vtxPos) {
 		return Read(make_pair(std::string("offera"), std::string("offertxf")), vtxPos);
 	}
 
+	bool UpgradeOfferTxFees(CFeeWindow& fees) {
+		CLevelDBBatch batch;
+		fees.WriteChanges(batch);
+		batch.Erase(make_pair(std::string("offera"), std::string("offertxf")));
+		return WriteBatch(batch);
+	}
+
     bool WriteOfferIndex(std::vector<std::vector<unsigned char> >& vtxPos) {
         return Write(make_pair(std::string("offera"), std::string("offerndx")), vtxPos);
     }
@@ -362,9 +408,15 @@ public:
             unsigned int nMax,
             std::vector<std::pair<std::vector<unsigned char>, COffer> >& offerScan);
 
-    bool ReconstructOfferIndex(CBlockIndex *pindexRescan);
+    // walk the offers in name order from vchName, or from just after it
+    CServiceHistory<COffer>::CScanCursor *NewOfferCursor(const std::vector<unsigned char>& vchName, bool fAfter) {
+        return new CServiceHistory<COffer>::CScanCursor(history, vchName, fAfter);
+    }
+
+    // replay the operations of one block during a rescan
+    bool ReconstructBlock(const CBlock &block, CBlockIndex *pindex);
 };
-extern std::list<COfferFee> lstOfferFees;
+extern CFeeWindow offerFeeWindow;
 
 
 bool GetTxOfOffer(COfferDB& dbOffer, const std::vector<unsigned char> &vchOffer, CTransaction& tx);
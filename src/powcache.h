@@ -0,0 +1,61 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_POWCACHE_H
+#define SYSCOIN_POWCACHE_H
+
+#include "uint256.h"
+#include "sync.h"
+#include "mruset.h"
+
+#include <utility>
+
+/** Block headers whose proof of work checked out, keyed by block hash and
+ *  nBits, so that checking one again costs a lookup instead of a scrypt
+ *  hash. Only the nMaxSize most recently added headers are kept. */
+class CPoWCache
+{
+private:
+    typedef std::pair<uint256, unsigned int> key_type;
+
+    mutable CCriticalSection cs;
+    mruset<key_type> setChecked;
+    // lookups that found the header, and that did not
+    uint64 nHits;
+    uint64 nMisses;
+
+public:
+    CPoWCache(unsigned int nMaxSize) : setChecked(nMaxSize), nHits(0), nMisses(0) {}
+
+    /** Whether the header was checked; counted in the hit rate. */
+    bool Lookup(const uint256 &hash, unsigned int nBits) {
+        LOCK(cs);
+        if (setChecked.count(key_type(hash, nBits))) {
+            nHits++;
+            return true;
+        }
+        nMisses++;
+        return false;
+    }
+
+    /** Whether the header was checked, without counting the lookup. */
+    bool Contains(const uint256 &hash, unsigned int nBits) const {
+        LOCK(cs);
+        return setChecked.count(key_type(hash, nBits)) > 0;
+    }
+
+    void Insert(const uint256 &hash, unsigned int nBits) {
+        LOCK(cs);
+        setChecked.insert(key_type(hash, nBits));
+    }
+
+    void GetStats(unsigned int &nSize, unsigned int &nMaxSize, uint64 &nHitsOut, uint64 &nMissesOut) const {
+        LOCK(cs);
+        nSize = setChecked.size();
+        nMaxSize = setChecked.max_size();
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+    }
+};
+
+#endif
@@ -69,58 +69,50 @@ public:
     {
         cachedCertIssuerTable.clear();
         {
-            CBlockIndex* pindex = pindexGenesisBlock;
-            LOCK(wallet->cs_wallet);
-            while (pindex) {
-                int nHeight = pindex->nHeight;
-                CBlock block;
-                block.ReadFromDisk(pindex);
-                uint256 txblkhash;
-
-                BOOST_FOREACH(CTransaction& tx, block.vtx) {
-
-                    if (tx.nVersion != SYSCOIN_TX_VERSION)
-                        continue;
-
-                    int op, nOut;
-                    vector<vector<unsigned char> > vvchArgs;
-                    bool o = DecodeCertTx(tx, op, nOut, vvchArgs, nHeight);
-                    if (!o || !IsCertOp(op) || !IsCertMine(tx)) continue;
-
-                    // get the transaction
-                    if(!GetTransaction(tx.GetHash(), tx, txblkhash, true))
-                        continue;
-
-                    // attempt to read certissuer from txn
-                    CCertItem theCert;
-                    CCertIssuer theCertIssuer;
-                    if(!theCertIssuer.UnserializeFromTx(tx))
-                        continue;
-
-                    vector<CCertIssuer> vtxPos;
-                    if(!pcertdb->ReadCertIssuer(theCertIssuer.vchRand, vtxPos))
-                        continue;
-
-                    int nExpHeight = vtxPos.back().nHeight + GetCertExpirationDepth(vtxPos.back().nHeight);
-
-                    if(theCertIssuer.certs.size()) {
-                        theCert = theCertIssuer.certs.back();
-                        cachedCertIssuerTable.append(CertIssuerTableEntry(CertIssuerTableEntry::CertItem,
-                                          QString::fromStdString(stringFromVch(theCert.vchTitle)),
-                                          QString::fromStdString(HexStr(theCert.vchRand)),
-                                          QString::fromStdString("0")));
-                    } else {
-                        if(op == OP_CERTISSUER_ACTIVATE)
-                            cachedCertIssuerTable.append(CertIssuerTableEntry(CertIssuerTableEntry::CertIssuer,
-                                              QString::fromStdString(stringFromVch(theCertIssuer.vchTitle)),
-                                              QString::fromStdString(stringFromVch(theCertIssuer.vchRand)),
-                                              QString::fromStdString(strprintf("%d", nExpHeight ))));
-                    }
+            // only the wallet's transactions on cert issuers, as certissuerlist
+            vector<uint256> vHashes;
+            wallet->ListServiceTxs(wallet->mapCertIssuerTxs, vector<unsigned char>(), vHashes);
+            BOOST_FOREACH(const uint256& hash, vHashes) {
+                CTransaction tx;
+                if (!wallet->GetServiceTx(hash, tx))
+                    continue;
+
+                if (tx.nVersion != SYSCOIN_TX_VERSION)
+                    continue;
+
+                int op, nOut;
+                vector<vector<unsigned char> > vvchArgs;
+                if (!DecodeCertTx(tx, op, nOut, vvchArgs, -1) || !IsCertOp(op) || !IsCertMine(tx))
+                    continue;
+
+                // attempt to read certissuer from txn
+                CCertItem theCert;
+                CCertIssuer theCertIssuer;
+                if(!theCertIssuer.UnserializeFromTx(tx))
+                    continue;
+
+                CCertIssuer dbCertIssuer;
+                if(!pcertdb->ReadCertIssuerLast(theCertIssuer.vchRand, dbCertIssuer))
+                    continue;
+
+                int nExpHeight = dbCertIssuer.nHeight + GetCertExpirationDepth(dbCertIssuer.nHeight);
+
+                if(theCertIssuer.certs.size()) {
+                    theCert = theCertIssuer.certs.back();
+                    cachedCertIssuerTable.append(CertIssuerTableEntry(CertIssuerTableEntry::CertItem,
+                                      QString::fromStdString(stringFromVch(theCert.vchTitle)),
+                                      QString::fromStdString(HexStr(theCert.vchRand)),
+                                      QString::fromStdString("0")));
+                } else {
+                    if(op == OP_CERTISSUER_ACTIVATE)
+                        cachedCertIssuerTable.append(CertIssuerTableEntry(CertIssuerTableEntry::CertIssuer,
+                                          QString::fromStdString(stringFromVch(theCertIssuer.vchTitle)),
+                                          QString::fromStdString(stringFromVch(theCertIssuer.vchRand)),
+                                          QString::fromStdString(strprintf("%d", nExpHeight ))));
                 }
-                pindex = pindex->pnext;
             }
         }
-        
+
         // qLowerBound() and qUpperBound() require our cachedCertIssuerTable list to be sorted in asc order
         qSort(cachedCertIssuerTable.begin(), cachedCertIssuerTable.end(), CertIssuerTableEntryLessThan());
     }
@@ -8,6 +8,8 @@
 
 #include <QFont>
 
+#include <boost/scoped_ptr.hpp>
+
 using namespace std;
 
 const QString OfferTableModel::Offer = "O";
@@ -68,73 +70,87 @@ public:
     OfferTablePriv(CWallet *wallet, OfferTableModel *parent):
         wallet(wallet), parent(parent) {}
 
-		void refreshOfferTable(OfferModelType type)
+    // the row for theOffer, or for its last accept, with the expiration
+    // height of the offer as it is now
+    void appendOffer(const COffer &theOffer, int nHeight)
     {
+        COfferAccept theOfferAccept;
+        int nExpHeight = nHeight + GetOfferExpirationDepth(nHeight);
 
-        cachedOfferTable.clear();
-        {
-			
-            CBlockIndex* pindex = pindexGenesisBlock;
-            LOCK(wallet->cs_wallet);
-            while (pindex) {
-                int nHeight = pindex->nHeight;
-                CBlock block;
-                block.ReadFromDisk(pindex);
-                uint256 txblkhash;
-
-                BOOST_FOREACH(CTransaction& tx, block.vtx) {
-
-                    if (tx.nVersion != SYSCOIN_TX_VERSION)
-                        continue;
-
-                    int op, nOut;
-                    vector<vector<unsigned char> > vvchArgs;
-                    bool o = DecodeOfferTx(tx, op, nOut, vvchArgs, nHeight);
-					if (!o || !IsOfferOp(op) || (!IsOfferMine(tx) && type != AllOffers)) continue;
+        double nPrice = theOffer.nPrice / COIN;
+        int nQty = theOffer.nQty;
 
-                    // get the transaction
-                    if(!GetTransaction(tx.GetHash(), tx, txblkhash, true))
-                        continue;
+        if(theOffer.accepts.size()) {
+            theOfferAccept = theOffer.accepts.back();
+            nPrice = theOfferAccept.nPrice / COIN;
+            nQty = theOfferAccept.nQty;
+            nExpHeight = 0;
+        }
 
-                    // attempt to read offer from txn
-                    COffer theOffer;
-                    COfferAccept theOfferAccept;
-                    if(!theOffer.UnserializeFromTx(tx))
-                        continue;
+        cachedOfferTable.append(OfferTableEntry(theOffer.accepts.size() ? OfferTableEntry::OfferAccept : OfferTableEntry::Offer,
+                          QString::fromStdString(stringFromVch(theOffer.sTitle)),
+                          QString::fromStdString(stringFromVch(theOffer.vchRand)),
+                          QString::fromStdString(stringFromVch(theOffer.sCategory)),
+                          QString::fromStdString(strprintf("%lf", nPrice)),
+                          QString::fromStdString(strprintf("%d", nQty)),
+                          QString::fromStdString(strprintf("%d", nExpHeight)),
+                          QString::fromStdString(stringFromVch(theOffer.sDescription))));
+    }
 
-                    vector<COffer> vtxPos;
-                    if(!pofferdb->ReadOffer(theOffer.vchRand, vtxPos))
+    void refreshOfferTable(OfferModelType type)
+    {
+        cachedOfferTable.clear();
+        if (type == AllOffers)
+        {
+            // the current state of every offer, in name order, from the offer
+            // database rather than from the blocks
+            boost::scoped_ptr<CServiceHistory<COffer>::CScanCursor> pcursor(pofferdb->NewOfferCursor(vector<unsigned char>(), false));
+            vector<unsigned char> vchOffer;
+            COffer theOffer;
+            try {
+                while (size() <= 500 && pcursor->Next(vchOffer, theOffer)) {
+                    if (theOffer.IsNull())
                         continue;
-
-                    int nExpHeight = vtxPos.back().nHeight + GetOfferExpirationDepth(vtxPos.back().nHeight);
-
-                    double nPrice = theOffer.nPrice / COIN;
-                    int nQty = theOffer.nQty;
-
-                    if(theOffer.accepts.size()) {
-                        theOfferAccept = theOffer.accepts.back();
-                        nPrice = theOfferAccept.nPrice / COIN;
-                        nQty = theOfferAccept.nQty;
-                        nExpHeight = 0;
-                    }
-
-                    if(op == OP_OFFER_ACTIVATE)
-                        cachedOfferTable.append(OfferTableEntry(theOffer.accepts.size() ? OfferTableEntry::OfferAccept : OfferTableEntry::Offer,
-                                          QString::fromStdString(stringFromVch(theOffer.sTitle)),
-                                          QString::fromStdString(stringFromVch(theOffer.vchRand)),
-                                          QString::fromStdString(stringFromVch(theOffer.sCategory)),
-                                          QString::fromStdString(strprintf("%lf", nPrice)),
-                                          QString::fromStdString(strprintf("%d", nQty)),
-                                          QString::fromStdString(strprintf("%d", nExpHeight)),
-										  QString::fromStdString(stringFromVch(theOffer.sDescription))));
+                    // listed as offers, as when they were taken from their activation
+                    theOffer.accepts.clear();
+                    appendOffer(theOffer, theOffer.nHeight);
                 }
-				if(size() > 500 && type == AllOffers)
-					break;
-                pindex = pindex->pnext;
+            } catch (std::exception &e) {
+                printf("refreshOfferTable() : %s\n", e.what());
             }
         }
-        
-        // qLowerBound() and qUpperBound() require our cachedCertIssuerTable list to be sorted in asc order
+        else
+        {
+            // only the wallet's transactions on offers, as offerlist
+            vector<uint256> vHashes;
+            wallet->ListServiceTxs(wallet->mapOfferTxs, vector<unsigned char>(), vHashes);
+            BOOST_FOREACH(const uint256& hash, vHashes) {
+                CTransaction tx;
+                if (!wallet->GetServiceTx(hash, tx))
+                    continue;
+
+                if (tx.nVersion != SYSCOIN_TX_VERSION)
+                    continue;
+
+                int op, nOut;
+                vector<vector<unsigned char> > vvchArgs;
+                if (!DecodeOfferTx(tx, op, nOut, vvchArgs, -1) || op != OP_OFFER_ACTIVATE || !IsOfferMine(tx))
+                    continue;
+
+                // attempt to read offer from txn
+                COffer theOffer;
+                if(!theOffer.UnserializeFromTx(tx))
+                    continue;
+
+                COffer dbOffer;
+                if(!pofferdb->ReadOfferLast(theOffer.vchRand, dbOffer))
+                    continue;
+
+                appendOffer(theOffer, dbOffer.nHeight);
+            }
+        }
+
+        // qLowerBound() and qUpperBound() require our cachedOfferTable list to be sorted in asc order
         qSort(cachedOfferTable.begin(), cachedOfferTable.end(), OfferTableEntryLessThan());
     }
 
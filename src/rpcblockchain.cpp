@@ -247,6 +247,39 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
     return ret;
 }
 
+Value getcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcacheinfo\n"
+            "Returns the size and hit rate of the in-memory proof of work and block caches.");
+
+    unsigned int nSize, nMaxSize;
+    uint64 nHits, nMisses;
+    powCache.GetStats(nSize, nMaxSize, nHits, nMisses);
+    Object pow;
+    pow.push_back(Pair("size", (boost::int64_t)nSize));
+    pow.push_back(Pair("maxsize", (boost::int64_t)nMaxSize));
+    pow.push_back(Pair("hits", (boost::int64_t)nHits));
+    pow.push_back(Pair("misses", (boost::int64_t)nMisses));
+    pow.push_back(Pair("hitrate", nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+
+    uint64 nBytes, nMaxBytes;
+    blockCache.GetStats(nSize, nBytes, nMaxBytes, nHits, nMisses);
+    Object blocks;
+    blocks.push_back(Pair("size", (boost::int64_t)nSize));
+    blocks.push_back(Pair("bytes", (boost::int64_t)nBytes));
+    blocks.push_back(Pair("maxbytes", (boost::int64_t)nMaxBytes));
+    blocks.push_back(Pair("hits", (boost::int64_t)nHits));
+    blocks.push_back(Pair("misses", (boost::int64_t)nMisses));
+    blocks.push_back(Pair("hitrate", nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+
+    Object ret;
+    ret.push_back(Pair("powcache", pow));
+    ret.push_back(Pair("blockcache", blocks));
+    return ret;
+}
+
 Value gettxout(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
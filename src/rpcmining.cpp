@@ -86,6 +86,35 @@ void ShutdownRPCMining()
     delete pMiningKey; pMiningKey = NULL;
 }
 
+// Block templates kept for one tip by each of the work calls. Every
+// update of a template is a copy, so past this the oldest is freed, and
+// work handed out on it can no longer be submitted.
+static const unsigned int MAX_BLOCK_TEMPLATES = 8;
+
+static CBlock* BlockOfWork(CBlock* pblock) { return pblock; }
+template<typename T>
+static CBlock* BlockOfWork(const pair<CBlock*, T>& work) { return work.first; }
+
+// keep pblocktemplate, the newest template, dropping the oldest one and the
+// work handed out on it when there are too many
+template<typename MapNewBlock>
+static void KeepBlockTemplate(vector<CBlockTemplate*>& vNewBlockTemplate, MapNewBlock& mapNewBlock, CBlockTemplate* pblocktemplate)
+{
+    vNewBlockTemplate.push_back(pblocktemplate);
+    if (vNewBlockTemplate.size() <= MAX_BLOCK_TEMPLATES)
+        return;
+    CBlockTemplate* pblocktemplateOld = vNewBlockTemplate.front();
+    vNewBlockTemplate.erase(vNewBlockTemplate.begin());
+    for (typename MapNewBlock::iterator mi = mapNewBlock.begin(); mi != mapNewBlock.end(); )
+    {
+        if (BlockOfWork(mi->second) == &pblocktemplateOld->block)
+            mapNewBlock.erase(mi++);
+        else
+            ++mi;
+    }
+    delete pblocktemplateOld;
+}
+
 Value getgenerate(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -190,8 +219,28 @@ Value getworkex(const Array& params, bool fHelp)
         static CBlockIndex* pindexPrev;
         static int64 nStart;
         static CBlockTemplate* pblocktemplate;
-        if (pindexPrev != pindexBest ||
-            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+        bool fNewBlock = pindexPrev != pindexBest ||
+            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60);
+        if (!fNewBlock && nTransactionsUpdated != nTransactionsUpdatedLast)
+        {
+            // Add the transactions that came in since, to a copy of the block
+            // so that work already handed out stays good, or make a new block
+            // when they cannot just be added
+            unsigned int nTransactionsUpdatedNew = nTransactionsUpdated;
+            CBlockTemplate* pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+            if (!pblocktemplateNew)
+                fNewBlock = true;
+            else
+            {
+                nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+                if (pblocktemplateNew != pblocktemplate)
+                {
+                    pblocktemplate = pblocktemplateNew;
+                    KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
+                }
+            }
+        }
+        if (fNewBlock)
         {
             if (pindexPrev != pindexBest)
             {
@@ -214,7 +263,7 @@ Value getworkex(const Array& params, bool fHelp)
             pblocktemplate = CreateNewBlockWithKey(*pMiningKey);
             if (!pblocktemplate)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-            vNewBlockTemplate.push_back(pblocktemplate);
+            KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
 
             // Need to update only after we know CreateNewBlock succeeded
             pindexPrev = pindexPrevNew;
@@ -238,7 +287,7 @@ Value getworkex(const Array& params, bool fHelp)
         char phash1[64];
         FormatHashBuffers(pblock, pmidstate, pdata, phash1);
 
-        uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+        uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
         CTransaction coinbaseTx = pblock->vtx[0];
         std::vector<uint256> merkle = pblock->GetMerkleBranch(0);
@@ -329,8 +378,28 @@ Value getwork(const Array& params, bool fHelp)
         static CBlockIndex* pindexPrev;
         static int64 nStart;
         static CBlockTemplate* pblocktemplate;
-        if (pindexPrev != pindexBest ||
-            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+        bool fNewBlock = pindexPrev != pindexBest ||
+            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60);
+        if (!fNewBlock && nTransactionsUpdated != nTransactionsUpdatedLast)
+        {
+            // Add the transactions that came in since, to a copy of the block
+            // so that work already handed out stays good, or make a new block
+            // when they cannot just be added
+            unsigned int nTransactionsUpdatedNew = nTransactionsUpdated;
+            CBlockTemplate* pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+            if (!pblocktemplateNew)
+                fNewBlock = true;
+            else
+            {
+                nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+                if (pblocktemplateNew != pblocktemplate)
+                {
+                    pblocktemplate = pblocktemplateNew;
+                    KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
+                }
+            }
+        }
+        if (fNewBlock)
         {
             if (pindexPrev != pindexBest)
             {
@@ -353,7 +422,7 @@ Value getwork(const Array& params, bool fHelp)
             pblocktemplate = CreateNewBlockWithKey(*pMiningKey);
             if (!pblocktemplate)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-            vNewBlockTemplate.push_back(pblocktemplate);
+            KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
 
             // Need to update only after we know CreateNewBlock succeeded
             pindexPrev = pindexPrevNew;
@@ -377,7 +446,7 @@ Value getwork(const Array& params, bool fHelp)
         char phash1[64];
         FormatHashBuffers(pblock, pmidstate, pdata, phash1);
 
-        uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+        uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
         Object result;
         result.push_back(Pair("midstate", HexStr(BEGIN(pmidstate), END(pmidstate)))); // deprecated
@@ -465,8 +534,27 @@ Value getblocktemplate(const Array& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64 nStart;
     static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != pindexBest ||
-        (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+    bool fNewBlock = pindexPrev != pindexBest ||
+        (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 5);
+    if (!fNewBlock && nTransactionsUpdated != nTransactionsUpdatedLast)
+    {
+        // Add the transactions that came in since, or make a new block when
+        // they cannot just be added
+        unsigned int nTransactionsUpdatedNew = nTransactionsUpdated;
+        CBlockTemplate* pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+        if (!pblocktemplateNew)
+            fNewBlock = true;
+        else
+        {
+            nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+            if (pblocktemplateNew != pblocktemplate)
+            {
+                delete pblocktemplate;
+                pblocktemplate = pblocktemplateNew;
+            }
+        }
+    }
+    if (fNewBlock)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
@@ -533,7 +621,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
     Object aux;
     aux.push_back(Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
 
-    uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+    uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
     static Array aMutable;
     if (aMutable.empty())
@@ -637,9 +725,29 @@ Value getworkaux(const Array& params, bool fHelp)
         static CBlockIndex* pindexPrev;
         static int64 nStart;
         static CBlockTemplate* pblocktemplate;
-        if (pindexPrev != pindexBest ||
+        bool fNewBlock = pindexPrev != pindexBest ||
             vchAux != vchAuxPrev ||
-            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60);
+        if (!fNewBlock && nTransactionsUpdated != nTransactionsUpdatedLast)
+        {
+            // Add the transactions that came in since, to a copy of the block
+            // so that work already handed out stays good, or make a new block
+            // when they cannot just be added
+            unsigned int nTransactionsUpdatedNew = nTransactionsUpdated;
+            CBlockTemplate* pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+            if (!pblocktemplateNew)
+                fNewBlock = true;
+            else
+            {
+                nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+                if (pblocktemplateNew != pblocktemplate)
+                {
+                    pblocktemplate = pblocktemplateNew;
+                    KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
+                }
+            }
+        }
+        if (fNewBlock)
         {
             if (pindexPrev != pindexBest)
             {
@@ -658,7 +766,7 @@ Value getworkaux(const Array& params, bool fHelp)
             pblocktemplate = CreateNewBlockWithKey(reservekey);
             if (!pblocktemplate)
                 throw JSONRPCError(-7, "Out of memory");
-            vNewBlockTemplate.push_back(pblocktemplate);
+            KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
         }
         CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
@@ -679,7 +787,7 @@ Value getworkaux(const Array& params, bool fHelp)
         char phash1[64];
         FormatHashBuffers(pblock, pmidstate, pdata, phash1);
 
-        uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+        uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
         Object result;
         result.push_back(Pair("midstate", HexStr(BEGIN(pmidstate), END(pmidstate))));
@@ -800,8 +908,26 @@ Value getauxblock(const Array& params, bool fHelp)
         static int64 nStart;
 	static CBlock* pblock;
         static CBlockTemplate* pblocktemplate;
-        if (pindexPrev != pindexBest ||
-            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60))
+        CBlockTemplate* pblocktemplateNew = NULL;
+        bool fNewBlock = pindexPrev != pindexBest ||
+            (nTransactionsUpdated != nTransactionsUpdatedLast && GetTime() - nStart > 60);
+        if (!fNewBlock && nTransactionsUpdated != nTransactionsUpdatedLast)
+        {
+            // Add the transactions that came in since, to a copy of the block
+            // so that work already handed out stays good, or make a new block
+            // when they cannot just be added
+            unsigned int nTransactionsUpdatedNew = nTransactionsUpdated;
+            pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+            if (!pblocktemplateNew)
+                fNewBlock = true;
+            else
+            {
+                nTransactionsUpdatedLast = nTransactionsUpdatedNew;
+                if (pblocktemplateNew == pblocktemplate)
+                    pblocktemplateNew = NULL;
+            }
+        }
+        if (fNewBlock)
         {
             if (pindexPrev != pindexBest)
             {
@@ -816,10 +942,13 @@ Value getauxblock(const Array& params, bool fHelp)
             nStart = GetTime();
 
             // Create new block with nonce = 0 and extraNonce = 1
-            pblocktemplate = CreateNewBlockWithKey(reservekey);
-            if (!pblocktemplate)
+            pblocktemplateNew = CreateNewBlockWithKey(reservekey);
+            if (!pblocktemplateNew)
                 throw JSONRPCError(-7, "Out of memory");
-
+        }
+        if (pblocktemplateNew)
+        {
+            pblocktemplate = pblocktemplateNew;
 	    pblock = &pblocktemplate->block;
             // Update nTime
             pblock->nTime = max(pindexPrev->GetMedianTimePast()+1, GetAdjustedTime());
@@ -834,10 +963,10 @@ Value getauxblock(const Array& params, bool fHelp)
             // Save
             mapNewBlock[pblock->GetHash()] = pblock;
 
-            vNewBlockTemplate.push_back(pblocktemplate);
+            KeepBlockTemplate(vNewBlockTemplate, mapNewBlock, pblocktemplate);
         }
 
-        uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+        uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
         Object result;
         result.push_back(Pair("target",   HexStr(BEGIN(hashTarget), END(hashTarget))));
@@ -877,6 +877,8 @@ Value addmultisigaddress(const Array& params, bool fHelp)
     CScript inner = _createmultisig(params);
     CScriptID innerID = inner.GetID();
     pwalletMain->AddCScript(inner);
+    // coins already in the wallet may pay to the script
+    pwalletMain->MarkDirty();
 
     pwalletMain->SetAddressBookName(innerID, strAccount);
     return CBitcoinAddress(innerID).ToString();
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2009 Colin Percival, 2011 ArtForz, 2012-2013 pooler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file was originally written by Colin Percival as part of the Tarsnap
+ * online backup system.
+ */
+
+#include "scrypt.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <immintrin.h>
+
+#define ROTL_8WAY(a, b) _mm256_or_si256(_mm256_slli_epi32((a), (b)), _mm256_srli_epi32((a), 32 - (b)))
+#define STEP_8WAY(d, a, b, r) x[d] = _mm256_xor_si256(x[d], ROTL_8WAY(_mm256_add_epi32(x[a], x[b]), r))
+
+/* Salsa20/8 of eight independent states, word k of lane l in lane l of B[k]. */
+static inline void xor_salsa8_8way(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm256_xor_si256(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		STEP_8WAY( 4,  0, 12,  7);  STEP_8WAY( 9,  5,  1,  7);
+		STEP_8WAY(14, 10,  6,  7);  STEP_8WAY( 3, 15, 11,  7);
+
+		STEP_8WAY( 8,  4,  0,  9);  STEP_8WAY(13,  9,  5,  9);
+		STEP_8WAY( 2, 14, 10,  9);  STEP_8WAY( 7,  3, 15,  9);
+
+		STEP_8WAY(12,  8,  4, 13);  STEP_8WAY( 1, 13,  9, 13);
+		STEP_8WAY( 6,  2, 14, 13);  STEP_8WAY(11,  7,  3, 13);
+
+		STEP_8WAY( 0, 12,  8, 18);  STEP_8WAY( 5,  1, 13, 18);
+		STEP_8WAY(10,  6,  2, 18);  STEP_8WAY(15, 11,  7, 18);
+
+		/* Operate on rows. */
+		STEP_8WAY( 1,  0,  3,  7);  STEP_8WAY( 6,  5,  4,  7);
+		STEP_8WAY(11, 10,  9,  7);  STEP_8WAY(12, 15, 14,  7);
+
+		STEP_8WAY( 2,  1,  0,  9);  STEP_8WAY( 7,  6,  5,  9);
+		STEP_8WAY( 8, 11, 10,  9);  STEP_8WAY(13, 12, 15,  9);
+
+		STEP_8WAY( 3,  2,  1, 13);  STEP_8WAY( 4,  7,  6, 13);
+		STEP_8WAY( 9,  8, 11, 13);  STEP_8WAY(14, 13, 12, 13);
+
+		STEP_8WAY( 0,  3,  2, 18);  STEP_8WAY( 5,  4,  7, 18);
+		STEP_8WAY(10,  9,  8, 18);  STEP_8WAY(15, 14, 13, 18);
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = _mm256_add_epi32(B[i], x[i]);
+}
+
+/* Hash eight 80-byte inputs at once into eight 32-byte outputs, running the
+ * Salsa20/8 core of all eight side by side in the lanes of each register.
+ * The scratchpad must hold 8 * 131072 + 63 bytes. */
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m256i i256[32];
+		uint32_t u32[32 * 8];
+	} X;
+	__m256i *V;
+	uint32_t *V32;
+	uint32_t i, j, k, l;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (uint32_t *)V;
+
+	for (l = 0; l < 8; l++) {
+		PBKDF2_SHA256((const uint8_t *)input + l * 80, 80, (const uint8_t *)input + l * 80, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k * 8 + l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i256[k];
+		xor_salsa8_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_8way(&X.i256[16], &X.i256[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < 8; l++) {
+			j = 32 * (X.u32[16 * 8 + l] & 1023);
+			for (k = 0; k < 32; k++)
+				X.u32[k * 8 + l] ^= V32[(j + k) * 8 + l];
+		}
+		xor_salsa8_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_8way(&X.i256[16], &X.i256[0]);
+	}
+
+	for (l = 0; l < 8; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k * 8 + l]);
+		PBKDF2_SHA256((const uint8_t *)input + l * 80, 80, B, 128, 1, (uint8_t *)output + l * 32, 32);
+	}
+}
@@ -134,3 +134,91 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
+
+#define ROTL_4WAY(a, b) _mm_or_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+#define STEP_4WAY(d, a, b, r) x[d] = _mm_xor_si128(x[d], ROTL_4WAY(_mm_add_epi32(x[a], x[b]), r))
+
+/* Salsa20/8 of four independent states, word k of lane l in lane l of B[k]. */
+static inline void xor_salsa8_4way(__m128i B[16], const __m128i Bx[16])
+{
+	__m128i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm_xor_si128(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		STEP_4WAY( 4,  0, 12,  7);  STEP_4WAY( 9,  5,  1,  7);
+		STEP_4WAY(14, 10,  6,  7);  STEP_4WAY( 3, 15, 11,  7);
+
+		STEP_4WAY( 8,  4,  0,  9);  STEP_4WAY(13,  9,  5,  9);
+		STEP_4WAY( 2, 14, 10,  9);  STEP_4WAY( 7,  3, 15,  9);
+
+		STEP_4WAY(12,  8,  4, 13);  STEP_4WAY( 1, 13,  9, 13);
+		STEP_4WAY( 6,  2, 14, 13);  STEP_4WAY(11,  7,  3, 13);
+
+		STEP_4WAY( 0, 12,  8, 18);  STEP_4WAY( 5,  1, 13, 18);
+		STEP_4WAY(10,  6,  2, 18);  STEP_4WAY(15, 11,  7, 18);
+
+		/* Operate on rows. */
+		STEP_4WAY( 1,  0,  3,  7);  STEP_4WAY( 6,  5,  4,  7);
+		STEP_4WAY(11, 10,  9,  7);  STEP_4WAY(12, 15, 14,  7);
+
+		STEP_4WAY( 2,  1,  0,  9);  STEP_4WAY( 7,  6,  5,  9);
+		STEP_4WAY( 8, 11, 10,  9);  STEP_4WAY(13, 12, 15,  9);
+
+		STEP_4WAY( 3,  2,  1, 13);  STEP_4WAY( 4,  7,  6, 13);
+		STEP_4WAY( 9,  8, 11, 13);  STEP_4WAY(14, 13, 12, 13);
+
+		STEP_4WAY( 0,  3,  2, 18);  STEP_4WAY( 5,  4,  7, 18);
+		STEP_4WAY(10,  9,  8, 18);  STEP_4WAY(15, 14, 13, 18);
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = _mm_add_epi32(B[i], x[i]);
+}
+
+/* Hash four 80-byte inputs at once into four 32-byte outputs, running the
+ * Salsa20/8 core of all four side by side in the lanes of each register.
+ * The scratchpad must hold 4 * 131072 + 63 bytes. */
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m128i i128[32];
+		uint32_t u32[32 * 4];
+	} X;
+	__m128i *V;
+	uint32_t *V32;
+	uint32_t i, j, k, l;
+
+	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (uint32_t *)V;
+
+	for (l = 0; l < 4; l++) {
+		PBKDF2_SHA256((const uint8_t *)input + l * 80, 80, (const uint8_t *)input + l * 80, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k * 4 + l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i128[k];
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < 4; l++) {
+			j = 32 * (X.u32[16 * 4 + l] & 1023);
+			for (k = 0; k < 32; k++)
+				X.u32[k * 4 + l] ^= V32[(j + k) * 4 + l];
+		}
+		xor_salsa8_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_4way(&X.i128[16], &X.i128[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k * 4 + l]);
+		PBKDF2_SHA256((const uint8_t *)input + l * 80, 80, B, 128, 1, (uint8_t *)output + l * 32, 32);
+	}
+}
@@ -34,7 +34,7 @@
 #include <string.h>
 #include <openssl/sha.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
+#if defined(USE_SSE2) && (!defined(USE_SSE2_ALWAYS) || defined(USE_AVX2))
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
 #include <intrin.h>
@@ -286,14 +286,65 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+// kernel hashing several inputs at once, and how many; none until detected
+static void (*scrypt_multi_kernel)(const char *input, char *output, char *scratchpad) = NULL;
+static int scrypt_multi_ways = 1;
+
 #if defined(USE_SSE2)
 // By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
 void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
 
+#if defined(USE_AVX2)
+static bool scrypt_detect_avx2()
+{
+    unsigned int cpuid_ecx=0, cpuid_ebx7=0;
+#if defined(_MSC_VER)
+    int x86cpuid[4];
+    __cpuid(x86cpuid, 1);
+    cpuid_ecx = (unsigned int)x86cpuid[2];
+    if (!(cpuid_ecx & 1<<27) || !(cpuid_ecx & 1<<28))
+        return false;
+    // the OS must save the ymm registers
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(x86cpuid, 7, 0);
+    cpuid_ebx7 = (unsigned int)x86cpuid[1];
+#else // _MSC_VER
+    unsigned int eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &cpuid_ecx, &edx))
+        return false;
+    // AVX and OSXSAVE
+    if (!(cpuid_ecx & 1<<27) || !(cpuid_ecx & 1<<28))
+        return false;
+    // the OS must save the ymm registers
+    unsigned int xcr0_eax, xcr0_edx;
+    __asm__ ("xgetbv" : "=a" (xcr0_eax), "=d" (xcr0_edx) : "c" (0));
+    if ((xcr0_eax & 6) != 6)
+        return false;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, cpuid_ebx7, cpuid_ecx, edx);
+#endif // _MSC_VER
+    return (cpuid_ebx7 & 1<<5) != 0;
+}
+#endif // USE_AVX2
+
 void scrypt_detect_sse2()
 {
+#if defined(USE_AVX2)
+    if (scrypt_detect_avx2())
+    {
+        scrypt_multi_kernel = &scrypt_1024_1_1_256_sp_avx2_8way;
+        scrypt_multi_ways = 8;
+    }
+#endif // USE_AVX2
 #if defined(USE_SSE2_ALWAYS)
     printf("scrypt: using scrypt-sse2 as built.\n");
+    if (scrypt_multi_ways == 1)
+    {
+        scrypt_multi_kernel = &scrypt_1024_1_1_256_sp_sse2_4way;
+        scrypt_multi_ways = 4;
+    }
 #else // USE_SSE2_ALWAYS
     // 32bit x86 Linux or Windows, detect cpuid features
     unsigned int cpuid_edx=0;
@@ -312,6 +363,11 @@ void scrypt_detect_sse2()
     {
         scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
         printf("scrypt: using scrypt-sse2 as detected.\n");
+        if (scrypt_multi_ways == 1)
+        {
+            scrypt_multi_kernel = &scrypt_1024_1_1_256_sp_sse2_4way;
+            scrypt_multi_ways = 4;
+        }
     }
     else
     {
@@ -319,9 +375,41 @@ void scrypt_detect_sse2()
         printf("scrypt: using scrypt-generic, SSE2 unavailable.\n");
     }
 #endif // USE_SSE2_ALWAYS
+    printf("scrypt: hashing %d inputs at once in batches.\n", scrypt_multi_ways);
 }
 #endif
 
+int scrypt_ways()
+{
+    return scrypt_multi_ways;
+}
+
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, char *scratchpad, int nCount)
+{
+    // full batches through the interleaved kernel, the rest one by one
+    if (scrypt_multi_kernel != NULL) {
+        for (; nCount >= scrypt_multi_ways; nCount -= scrypt_multi_ways) {
+            scrypt_multi_kernel(input, output, scratchpad);
+            input += 80 * scrypt_multi_ways;
+            output += 32 * scrypt_multi_ways;
+        }
+    }
+    for (; nCount > 0; nCount--) {
+        scrypt_1024_1_1_256_sp(input, output, scratchpad);
+        input += 80;
+        output += 32;
+    }
+}
+
+void scrypt_1024_1_1_256_multi(const char *input, char *output, int nCount)
+{
+    char *scratchpad = (char *)malloc(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    if (scratchpad == NULL)
+        throw std::bad_alloc();
+    scrypt_1024_1_1_256_sp_multi(input, output, scratchpad, nCount);
+    free(scratchpad);
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
 	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
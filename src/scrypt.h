@@ -4,6 +4,9 @@
 #include <stdint.h>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
+// most inputs any kernel hashes at once, and the scratchpad they need
+static const int SCRYPT_MAX_WAYS = 8;
+static const int SCRYPT_MULTI_SCRATCHPAD_SIZE = SCRYPT_MAX_WAYS * 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output, unsigned char Nfactor);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad, unsigned char Nfactor);
@@ -21,11 +24,23 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 void scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad);
+#if defined(USE_AVX2)
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad);
+#endif
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
 
+/** Hash nCount 80-byte inputs laid out back to back into nCount 32-byte
+ *  outputs, as many at a time as scrypt_ways() tells. The scratchpad must
+ *  hold SCRYPT_MULTI_SCRATCHPAD_SIZE bytes. */
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, char *scratchpad, int nCount);
+void scrypt_1024_1_1_256_multi(const char *input, char *output, int nCount);
+/** How many inputs the kernel picked for this CPU hashes at once. */
+int scrypt_ways();
+
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
@@ -1359,4 +1359,79 @@ public:
     }
 };
 
+/** Stream to deserialize from memory it does not own, such as a mapped
+ *  file, without copying it first. Offers the reading interface of
+ *  CBufferedFile, with every position within reach of SetPos(). */
+class CMemoryStream
+{
+private:
+    const char *pbegin;
+    uint64 nSize;
+    uint64 nReadPos;
+    uint64 nReadLimit;
+
+public:
+    int nType;
+    int nVersion;
+
+    CMemoryStream(const char *pbeginIn, uint64 nSizeIn, int nTypeIn, int nVersionIn) :
+        pbegin(pbeginIn), nSize(nSizeIn), nReadPos(0), nReadLimit((uint64)(-1)), nType(nTypeIn), nVersion(nVersionIn) {
+    }
+
+    bool good() const {
+        return true;
+    }
+
+    bool eof() const {
+        return nReadPos >= nSize;
+    }
+
+    CMemoryStream& read(char *pch, size_t nReadSize) {
+        if (nReadSize + nReadPos > nReadLimit)
+            throw std::ios_base::failure("Read attempted past buffer limit");
+        if (nReadSize > nSize - std::min(nReadPos, nSize))
+            throw std::ios_base::failure("CMemoryStream::read : end of data");
+        memcpy(pch, pbegin + nReadPos, nReadSize);
+        nReadPos += nReadSize;
+        return (*this);
+    }
+
+    uint64 GetPos() {
+        return nReadPos;
+    }
+
+    bool SetPos(uint64 nPos) {
+        nReadPos = std::min(nPos, nSize);
+        return nReadPos == nPos;
+    }
+
+    bool Seek(uint64 nPos) {
+        return SetPos(nPos);
+    }
+
+    bool SetLimit(uint64 nPos = (uint64)(-1)) {
+        if (nPos < nReadPos)
+            return false;
+        nReadLimit = nPos;
+        return true;
+    }
+
+    template<typename T>
+    CMemoryStream& operator>>(T& obj) {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    void FindByte(char ch) {
+        const char *p = NULL;
+        if (nReadPos < nSize)
+            p = (const char*)memchr(pbegin + nReadPos, ch, nSize - nReadPos);
+        if (p == NULL) {
+            nReadPos = nSize;
+            throw std::ios_base::failure("CMemoryStream::FindByte : end of data");
+        }
+        nReadPos = p - pbegin;
+    }
+};
+
 #endif
@@ -0,0 +1,374 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_SERVICEDB_H
+#define SYSCOIN_SERVICEDB_H
+
+#include "uint256.h"
+#include "leveldb.h"
+#include "sync.h"
+
+#include <map>
+#include <string>
+#include <utility>
+
+/** Iterator over a CLevelDB iterator with a set of queued changes laid on
+ *  top: a queued write hides the stored value of its key, and a queued
+ *  erase hides the key altogether. The iterator keeps its own copy of the
+ *  changes, so changes queued later do not affect it.
+ */
+class CLevelDBOverlayIterator : public leveldb::Iterator
+{
+public:
+    // serialized key -> (erased, serialized value)
+    typedef std::map<std::string, std::pair<bool, std::string> > change_map;
+
+private:
+    leveldb::Iterator *pbase;
+    const change_map changes;
+    change_map::const_iterator it;
+    bool fForward;
+    bool fValid;
+    // whether the current entry is it rather than pbase
+    bool fChange;
+
+    int Compare() const {
+        return leveldb::Slice(it->first).compare(pbase->key());
+    }
+
+    void StepBack() {
+        if (it == changes.begin())
+            it = changes.end();
+        else
+            --it;
+    }
+
+    // settle on the first visible entry at or after both positions
+    void FindNext() {
+        while (true) {
+            if (it == changes.end()) {
+                fChange = false;
+                fValid = pbase->Valid();
+                return;
+            }
+            int c = pbase->Valid() ? Compare() : -1;
+            if (c > 0) {
+                fChange = false;
+                fValid = true;
+                return;
+            }
+            if (!it->second.first) {
+                fChange = true;
+                fValid = true;
+                return;
+            }
+            if (c == 0)
+                pbase->Next();
+            ++it;
+        }
+    }
+
+    // settle on the last visible entry at or before both positions
+    void FindPrev() {
+        while (true) {
+            if (it == changes.end()) {
+                fChange = false;
+                fValid = pbase->Valid();
+                return;
+            }
+            int c = pbase->Valid() ? Compare() : 1;
+            if (c < 0) {
+                fChange = false;
+                fValid = true;
+                return;
+            }
+            if (!it->second.first) {
+                fChange = true;
+                fValid = true;
+                return;
+            }
+            if (c == 0)
+                pbase->Prev();
+            StepBack();
+        }
+    }
+
+public:
+    CLevelDBOverlayIterator(leveldb::Iterator *pbaseIn, const change_map &changesIn) :
+        pbase(pbaseIn), changes(changesIn), it(changes.end()), fForward(true), fValid(false), fChange(false) {}
+
+    ~CLevelDBOverlayIterator() {
+        delete pbase;
+    }
+
+    bool Valid() const {
+        return fValid;
+    }
+
+    void SeekToFirst() {
+        pbase->SeekToFirst();
+        it = changes.begin();
+        fForward = true;
+        FindNext();
+    }
+
+    void SeekToLast() {
+        pbase->SeekToLast();
+        it = changes.end();
+        StepBack();
+        fForward = false;
+        FindPrev();
+    }
+
+    void Seek(const leveldb::Slice &target) {
+        pbase->Seek(target);
+        it = changes.lower_bound(target.ToString());
+        fForward = true;
+        FindNext();
+    }
+
+    void Next() {
+        // coming from Prev(), both positions may be behind the current key
+        if (!fForward)
+            Seek(key().ToString());
+        if (fChange) {
+            if (pbase->Valid() && Compare() == 0)
+                pbase->Next();
+            ++it;
+        } else
+            pbase->Next();
+        FindNext();
+    }
+
+    void Prev() {
+        // coming from Seek() or Next(), both positions may be past the current key
+        if (fForward) {
+            std::string strKey = key().ToString();
+            pbase->Seek(strKey);
+            if (!pbase->Valid())
+                pbase->SeekToLast();
+            else if (pbase->key().compare(strKey) > 0)
+                pbase->Prev();
+            it = changes.upper_bound(strKey);
+            StepBack();
+            fForward = false;
+            FindPrev();
+        }
+        if (fChange) {
+            if (pbase->Valid() && Compare() == 0)
+                pbase->Prev();
+            StepBack();
+        } else
+            pbase->Prev();
+        FindPrev();
+    }
+
+    leveldb::Slice key() const {
+        return fChange ? leveldb::Slice(it->first) : pbase->key();
+    }
+
+    leveldb::Slice value() const {
+        return fChange ? leveldb::Slice(it->second.second) : pbase->value();
+    }
+
+    leveldb::Status status() const {
+        return pbase->status();
+    }
+};
+
+/** CLevelDB for the alias, offer and cert indexes, which hold back their
+ *  writes so that they reach disk together with the coins they belong to.
+ *
+ *  Writes made while blocks are connected or disconnected are queued and
+ *  visible to reads at once. Flush() accepts them along with the coins view
+ *  being flushed into pcoinsTip, and Discard() drops them when the blocks
+ *  are not accepted. Commit() writes everything accepted in one batch,
+ *  together with the hash of the block it brings the database up to, after
+ *  the coins themselves have been written: the database is never ahead of
+ *  the coins on disk, and startup only replays the blocks after that hash.
+ */
+class CServiceDB : public CLevelDB
+{
+private:
+    typedef CLevelDBOverlayIterator::change_map change_map;
+
+    mutable CCriticalSection cs_changes;
+    // changes of the blocks being connected or disconnected
+    change_map mapBlock;
+    // changes accepted into the chain tip but not yet on disk
+    change_map mapPending;
+
+    class CChangeCollector : public leveldb::WriteBatch::Handler
+    {
+    private:
+        change_map &changes;
+
+    public:
+        CChangeCollector(change_map &changesIn) : changes(changesIn) {}
+
+        void Put(const leveldb::Slice &key, const leveldb::Slice &value) {
+            changes[key.ToString()] = std::make_pair(false, value.ToString());
+        }
+
+        void Delete(const leveldb::Slice &key) {
+            changes[key.ToString()] = std::make_pair(true, std::string());
+        }
+    };
+
+    template<typename K> static std::string SerializeKey(const K& key) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(ssKey.GetSerializeSize(key));
+        ssKey << key;
+        return std::string(ssKey.begin(), ssKey.end());
+    }
+
+    // the queued change of strKey, if any; cs_changes must be held
+    const std::pair<bool, std::string> *FindChange(const std::string &strKey) const {
+        change_map::const_iterator mi = mapBlock.find(strKey);
+        if (mi != mapBlock.end())
+            return &mi->second;
+        mi = mapPending.find(strKey);
+        if (mi != mapPending.end())
+            return &mi->second;
+        return NULL;
+    }
+
+public:
+    CServiceDB(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory = false, bool fWipe = false) :
+        CLevelDB(path, nCacheSize, fMemory, fWipe) {}
+
+    template<typename K, typename V> bool Read(const K& key, V& value) throw(leveldb_error) {
+        {
+            LOCK(cs_changes);
+            if (!mapBlock.empty() || !mapPending.empty()) {
+                const std::pair<bool, std::string> *pchange = FindChange(SerializeKey(key));
+                if (pchange) {
+                    if (pchange->first)
+                        return false;
+                    try {
+                        CDataStream ssValue(pchange->second.data(), pchange->second.data() + pchange->second.size(), SER_DISK, CLIENT_VERSION);
+                        ssValue >> value;
+                    } catch(std::exception &e) {
+                        return false;
+                    }
+                    return true;
+                }
+            }
+        }
+        return CLevelDB::Read(key, value);
+    }
+
+    template<typename K, typename V> bool Write(const K& key, const V& value) {
+        CLevelDBBatch batch;
+        batch.Write(key, value);
+        return WriteBatch(batch);
+    }
+
+    template<typename K> bool Exists(const K& key) throw(leveldb_error) {
+        {
+            LOCK(cs_changes);
+            if (!mapBlock.empty() || !mapPending.empty()) {
+                const std::pair<bool, std::string> *pchange = FindChange(SerializeKey(key));
+                if (pchange)
+                    return !pchange->first;
+            }
+        }
+        return CLevelDB::Exists(key);
+    }
+
+    template<typename K> bool Erase(const K& key) {
+        CLevelDBBatch batch;
+        batch.Erase(key);
+        return WriteBatch(batch);
+    }
+
+    /** Queue the changes in batch; nothing is written until Commit(). */
+    bool WriteBatch(CLevelDBBatch &batch) {
+        LOCK(cs_changes);
+        CChangeCollector collector(mapBlock);
+        return batch.batch.Iterate(&collector).ok();
+    }
+
+    /** Accept the queued changes of the blocks just connected or disconnected. */
+    bool Flush() {
+        LOCK(cs_changes);
+        for (change_map::const_iterator mi = mapBlock.begin(); mi != mapBlock.end(); ++mi)
+            mapPending[mi->first] = mi->second;
+        mapBlock.clear();
+        return true;
+    }
+
+    /** Drop the queued changes of blocks that were not accepted. */
+    void Discard() {
+        LOCK(cs_changes);
+        mapBlock.clear();
+    }
+
+    /** Write every accepted change, marking the database as up to date
+     *  with hashBlock. */
+    bool Commit(const uint256 &hashBlock) throw(leveldb_error) {
+        LOCK(cs_changes);
+        CLevelDBBatch batch;
+        for (change_map::const_iterator mi = mapPending.begin(); mi != mapPending.end(); ++mi) {
+            if (mi->second.first)
+                batch.batch.Delete(mi->first);
+            else
+                batch.batch.Put(mi->first, mi->second.second);
+        }
+        batch.Write(std::string("bestblock"), hashBlock);
+        if (!CLevelDB::WriteBatch(batch))
+            return false;
+        mapPending.clear();
+        return true;
+    }
+
+    /** Erase everything, queued changes included, before the database is
+     *  rebuilt from the genesis block. The marker is reset first, so that a
+     *  database left half erased is not taken as up to date with any block. */
+    bool Clear() throw(leveldb_error) {
+        LOCK(cs_changes);
+        mapBlock.clear();
+        mapPending.clear();
+        CLevelDBBatch batch;
+        batch.Write(std::string("bestblock"), uint256(0));
+        if (!CLevelDB::WriteBatch(batch, true))
+            return false;
+        batch.Clear();
+        leveldb::Iterator *pcursor = CLevelDB::NewIterator();
+        std::string strMarker = SerializeKey(std::string("bestblock"));
+        unsigned int nErased = 0;
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            if (pcursor->key() == leveldb::Slice(strMarker))
+                continue;
+            batch.batch.Delete(pcursor->key());
+            if (++nErased % 10000 == 0) {
+                if (!CLevelDB::WriteBatch(batch)) {
+                    delete pcursor;
+                    return false;
+                }
+                batch.Clear();
+            }
+        }
+        delete pcursor;
+        return CLevelDB::WriteBatch(batch);
+    }
+
+    /** Hash of the block the database was last committed at. */
+    bool ReadBestBlock(uint256 &hashBlock) throw(leveldb_error) {
+        return CLevelDB::Read(std::string("bestblock"), hashBlock);
+    }
+
+    /** Iterate over the database as it reads with the queued changes applied,
+     *  as of the time of the call. */
+    leveldb::Iterator *NewIterator() {
+        LOCK(cs_changes);
+        leveldb::Iterator *pcursor = CLevelDB::NewIterator();
+        if (!mapPending.empty())
+            pcursor = new CLevelDBOverlayIterator(pcursor, mapPending);
+        if (!mapBlock.empty())
+            pcursor = new CLevelDBOverlayIterator(pcursor, mapBlock);
+        return pcursor;
+    }
+};
+
+#endif
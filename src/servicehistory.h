@@ -0,0 +1,440 @@
+// Copyright (c) 2014 Syscoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file license.txt or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SYSCOIN_SERVICEHISTORY_H
+#define SYSCOIN_SERVICEHISTORY_H
+
+#include "uint256.h"
+#include "servicedb.h"
+#include "util.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+/** Version history of alias, offer and cert records in a CServiceDB.
+ *
+ * Each version of a record is stored under (strVersion, name, height), with
+ * the height big-endian so that the versions of one record sort oldest
+ * first, and (strLatest, name) holds the height of its newest version.
+ * Writing a version or reading the current state of a record touches a
+ * couple of keys however long its history is; only the history RPCs walk
+ * every version.
+ *
+ * (strUpdated, height, name) indexes the records by the height of their
+ * newest version, so the records updated since some height are one range
+ * of keys. Expiration depths only grow with the update height, so the same
+ * range also holds the records that have not expired yet.
+ *
+ * T needs nHeight and txHash members. Histories written by older versions
+ * as one vector under (strLegacy, name) are converted by Upgrade().
+ */
+template<typename T>
+class CServiceHistory
+{
+private:
+    CServiceDB &db;
+    std::string strVersion;
+    std::string strLatest;
+    std::string strLegacy;
+    std::string strUpdated;
+
+    typedef std::pair<std::string, std::vector<unsigned char> > name_key;
+    typedef std::pair<name_key, CBigEndianKey> version_key;
+
+    name_key LatestKey(const std::vector<unsigned char> &vchName) const {
+        return std::make_pair(strLatest, vchName);
+    }
+
+    std::pair<std::string, std::pair<CBigEndianKey, std::vector<unsigned char> > > UpdatedKey(const std::vector<unsigned char> &vchName, uint64 nHeight) const {
+        return std::make_pair(strUpdated, std::make_pair(CBigEndianKey(nHeight), vchName));
+    }
+
+    version_key VersionKey(const std::vector<unsigned char> &vchName, uint64 nHeight) const {
+        return std::make_pair(std::make_pair(strVersion, vchName), CBigEndianKey(nHeight));
+    }
+
+    // decode the cursor position as a version of vchName
+    bool ReadCursor(leveldb::Iterator *pcursor, const std::vector<unsigned char> &vchName, uint64 &nHeight, T &obj) {
+        if (!pcursor->Valid())
+            return false;
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        std::string strType;
+        std::vector<unsigned char> vchKeyName;
+        ssKey >> strType;
+        if (strType != strVersion)
+            return false;
+        ssKey >> vchKeyName;
+        if (vchKeyName != vchName)
+            return false;
+        CBigEndianKey key;
+        ssKey >> key;
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> obj;
+        nHeight = key.n;
+        return true;
+    }
+
+public:
+    CServiceHistory(CServiceDB &dbIn, const std::string &strVersionIn, const std::string &strLatestIn, const std::string &strLegacyIn, const std::string &strUpdatedIn) :
+        db(dbIn), strVersion(strVersionIn), strLatest(strLatestIn), strLegacy(strLegacyIn), strUpdated(strUpdatedIn) {}
+
+    bool Exists(const std::vector<unsigned char> &vchName) {
+        return db.Exists(LatestKey(vchName));
+    }
+
+    bool ReadLatestHeight(const std::vector<unsigned char> &vchName, uint64 &nHeight) {
+        return db.Read(LatestKey(vchName), nHeight);
+    }
+
+    bool ReadVersion(const std::vector<unsigned char> &vchName, uint64 nHeight, T &obj) {
+        return db.Read(VersionKey(vchName, nHeight), obj);
+    }
+
+    /** Current state of a record. */
+    bool ReadLatest(const std::vector<unsigned char> &vchName, T &obj) {
+        uint64 nHeight;
+        return ReadLatestHeight(vchName, nHeight) && ReadVersion(vchName, nHeight, obj);
+    }
+
+    /** Every version of a record, oldest first. */
+    bool ReadAll(const std::vector<unsigned char> &vchName, std::vector<T> &vtxPos) {
+        vtxPos.clear();
+        if (!Exists(vchName))
+            return false;
+        leveldb::Iterator *pcursor = db.NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << VersionKey(vchName, 0);
+        pcursor->Seek(ssKeySet.str());
+        try {
+            uint64 nHeight;
+            T obj;
+            while (ReadCursor(pcursor, vchName, nHeight, obj)) {
+                vtxPos.push_back(obj);
+                pcursor->Next();
+            }
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+        delete pcursor;
+        return true;
+    }
+
+    /** Queue obj as the version of vchName at obj.nHeight, replacing any
+     *  version already at that height. If the newest version was written by
+     *  the same transaction at another height, it is replaced too. */
+    void Write(CLevelDBBatch &batch, const std::vector<unsigned char> &vchName, const T &obj) {
+        uint64 nHeight = obj.nHeight;
+        uint64 nLatest;
+        T latest;
+        bool fExists = ReadLatestHeight(vchName, nLatest);
+        bool fLatest = fExists && ReadVersion(vchName, nLatest, latest);
+        if (fLatest && nLatest != nHeight && latest.txHash != 0 && latest.txHash == obj.txHash) {
+            batch.Erase(VersionKey(vchName, nLatest));
+            fLatest = false;
+        }
+        batch.Write(VersionKey(vchName, nHeight), obj);
+        if (!fLatest || nHeight >= nLatest) {
+            if (fExists)
+                batch.Erase(UpdatedKey(vchName, nLatest));
+            batch.Write(LatestKey(vchName), nHeight);
+            batch.Write(UpdatedKey(vchName, nHeight), '\0');
+        }
+    }
+
+    /** Queue removal of the newest versions of vchName written by txHash.
+     *  When none is left the record still exists, with an empty history. */
+    bool Pop(CLevelDBBatch &batch, const std::vector<unsigned char> &vchName, const uint256 &txHash) {
+        uint64 nLatest;
+        if (!ReadLatestHeight(vchName, nLatest))
+            return false;
+        leveldb::Iterator *pcursor = db.NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << VersionKey(vchName, nLatest);
+        pcursor->Seek(ssKeySet.str());
+        try {
+            uint64 nHeight;
+            T obj;
+            bool fFound = ReadCursor(pcursor, vchName, nHeight, obj);
+            while (fFound && obj.txHash == txHash) {
+                batch.Erase(VersionKey(vchName, nHeight));
+                pcursor->Prev();
+                fFound = ReadCursor(pcursor, vchName, nHeight, obj);
+            }
+            if (!fFound || nHeight != nLatest)
+                batch.Erase(UpdatedKey(vchName, nLatest));
+            if (fFound && nHeight != nLatest) {
+                batch.Write(LatestKey(vchName), nHeight);
+                batch.Write(UpdatedKey(vchName, nHeight), '\0');
+            }
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+        delete pcursor;
+        return true;
+    }
+
+    /** Walks the current state of the records in name order, reading one
+     *  record at a time, so that memory use does not grow with the number
+     *  of records walked. Like any iterator of the database, it does not
+     *  see changes queued after it was created. */
+    class CScanCursor
+    {
+    private:
+        CServiceHistory &history;
+        // NULL when walking the records updated since some height
+        leveldb::Iterator *pcursor;
+        // those records, by serialized name so that they sort as in the
+        // database, with the height of their newest version
+        std::vector<std::pair<std::string, uint64> > vUpdated;
+        unsigned int nNextUpdated;
+        bool fUpdatedFailed;
+
+        // name of the next record and height of its newest version
+        bool NextKey(std::vector<unsigned char> &vchName, uint64 &nHeight) {
+            if (pcursor == NULL) {
+                if (fUpdatedFailed)
+                    throw std::runtime_error("CScanCursor::NextKey() : cannot read the update height index");
+                if (nNextUpdated == vUpdated.size())
+                    return false;
+                const std::string &strName = vUpdated[nNextUpdated].first;
+                CDataStream ssName(strName.data(), strName.data() + strName.size(), SER_DISK, CLIENT_VERSION);
+                ssName >> vchName;
+                nHeight = vUpdated[nNextUpdated].second;
+                nNextUpdated++;
+                return true;
+            }
+            if (!pcursor->Valid())
+                return false;
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            std::string strType;
+            ssKey >> strType;
+            if (strType != history.strLatest)
+                return false;
+            ssKey >> vchName;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> nHeight;
+            pcursor->Next();
+            return true;
+        }
+
+    public:
+        /** Start at vchName, or just after it if fAfter. */
+        CScanCursor(CServiceHistory &historyIn, const std::vector<unsigned char> &vchName, bool fAfter) :
+            history(historyIn), pcursor(historyIn.db.NewIterator()), nNextUpdated(0), fUpdatedFailed(false) {
+            CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+            ssKeySet << history.LatestKey(vchName);
+            pcursor->Seek(ssKeySet.str());
+            if (fAfter && pcursor->Valid() && pcursor->key().compare(ssKeySet.str()) == 0)
+                pcursor->Next();
+        }
+
+        /** Walk only the records whose newest version is at nMinHeight or
+         *  above. Their names are taken from the update height index up
+         *  front and put in name order. */
+        CScanCursor(CServiceHistory &historyIn, uint64 nMinHeight) :
+            history(historyIn), pcursor(NULL), nNextUpdated(0), fUpdatedFailed(false) {
+            std::vector<std::pair<std::vector<unsigned char>, uint64> > vScan;
+            fUpdatedFailed = !history.ScanUpdated(nMinHeight, vScan);
+            vUpdated.reserve(vScan.size());
+            for (unsigned int i = 0; i < vScan.size(); i++) {
+                CDataStream ssName(SER_DISK, CLIENT_VERSION);
+                ssName << vScan[i].first;
+                vUpdated.push_back(std::make_pair(ssName.str(), vScan[i].second));
+            }
+            std::sort(vUpdated.begin(), vUpdated.end());
+        }
+
+        ~CScanCursor() {
+            delete pcursor;
+        }
+
+        /** Move to the next record, false once there is none left. Records
+         *  with an empty history come back as a null object. Throws if the
+         *  database cannot be decoded. */
+        bool Next(std::vector<unsigned char> &vchName, T &obj) {
+            uint64 nHeight;
+            if (!NextKey(vchName, nHeight))
+                return false;
+            if (!history.ReadVersion(vchName, nHeight, obj))
+                obj = T();
+            return true;
+        }
+
+        /** Move to the next record without reading it. */
+        bool NextName(std::vector<unsigned char> &vchName) {
+            uint64 nHeight;
+            return NextKey(vchName, nHeight);
+        }
+    };
+    friend class CScanCursor;
+
+    /** Current state of up to nMax records, in name order from vchName.
+     *  Records with an empty history come back as a null object. */
+    bool Scan(const std::vector<unsigned char> &vchName, unsigned int nMax,
+            std::vector<std::pair<std::vector<unsigned char>, T> > &vScan) {
+        CScanCursor cursor(*this, vchName, false);
+        try {
+            std::vector<unsigned char> vchKeyName;
+            T obj;
+            while (vScan.size() < nMax && cursor.Next(vchKeyName, obj)) {
+                boost::this_thread::interruption_point();
+                vScan.push_back(std::make_pair(vchKeyName, obj));
+            }
+        } catch (std::exception &e) {
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+        return true;
+    }
+
+    /** Names of the records whose newest version is at nMinHeight or
+     *  above, with that height, least recently updated first. Only the
+     *  index is read; the records themselves are left to the caller. */
+    bool ScanUpdated(uint64 nMinHeight, std::vector<std::pair<std::vector<unsigned char>, uint64> > &vScan) {
+        leveldb::Iterator *pcursor = db.NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << UpdatedKey(std::vector<unsigned char>(), nMinHeight);
+        pcursor->Seek(ssKeySet.str());
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                std::string strType;
+                ssKey >> strType;
+                if (strType != strUpdated)
+                    break;
+                CBigEndianKey key;
+                std::vector<unsigned char> vchKeyName;
+                ssKey >> key >> vchKeyName;
+                vScan.push_back(std::make_pair(vchKeyName, key.n));
+                pcursor->Next();
+            } catch (std::exception &e) {
+                delete pcursor;
+                return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+            }
+        }
+        delete pcursor;
+        return true;
+    }
+
+    /** Queue the index entries of every record, for databases written
+     *  before the update height index existed. */
+    bool BuildUpdatedIndex() {
+        leveldb::Iterator *pcursor = db.NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << strUpdated;
+        pcursor->Seek(ssKeySet.str());
+        CLevelDBBatch batch;
+        unsigned int nIndexed = 0;
+        try {
+            // nothing to do once any record is indexed
+            if (pcursor->Valid()) {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                std::string strType;
+                ssKey >> strType;
+                if (strType == strUpdated) {
+                    delete pcursor;
+                    return true;
+                }
+            }
+
+            CDataStream ssLatest(SER_DISK, CLIENT_VERSION);
+            ssLatest << strLatest;
+            for (pcursor->Seek(ssLatest.str()); pcursor->Valid(); pcursor->Next()) {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                std::string strType;
+                ssKey >> strType;
+                if (strType != strLatest)
+                    break;
+                std::vector<unsigned char> vchName;
+                ssKey >> vchName;
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                uint64 nHeight;
+                ssValue >> nHeight;
+                // records with an empty history have no version to index
+                if (!db.Exists(VersionKey(vchName, nHeight)))
+                    continue;
+                batch.Write(UpdatedKey(vchName, nHeight), '\0');
+                nIndexed++;
+            }
+        } catch (std::exception &e) {
+            delete pcursor;
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+        delete pcursor;
+        if (!nIndexed)
+            return true;
+        if (!db.WriteBatch(batch))
+            return error("%s() : failed to write %s", __PRETTY_FUNCTION__, strUpdated.c_str());
+        printf("Indexed %u %s records by update height\n", nIndexed, strLatest.c_str());
+        return true;
+    }
+
+    /** Queue the conversion of every history still stored in the old
+     *  single-vector layout, and index the records by update height. */
+    bool Upgrade() {
+        leveldb::Iterator *pcursor = db.NewIterator();
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << strLegacy;
+        pcursor->Seek(ssKeySet.str());
+        CLevelDBBatch batch;
+        unsigned int nUpgraded = 0;
+        while (pcursor->Valid()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                std::string strType;
+                ssKey >> strType;
+                if (strType != strLegacy)
+                    break;
+                std::vector<unsigned char> vchName;
+                ssKey >> vchName;
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                std::vector<T> vtxPos;
+                ssValue >> vtxPos;
+
+                uint64 nLatest = 0;
+                BOOST_FOREACH(const T &obj, vtxPos) {
+                    batch.Write(VersionKey(vchName, obj.nHeight), obj);
+                    if ((uint64)obj.nHeight > nLatest)
+                        nLatest = obj.nHeight;
+                }
+                if (!vtxPos.empty()) {
+                    batch.Write(LatestKey(vchName), nLatest);
+                    batch.Write(UpdatedKey(vchName, nLatest), '\0');
+                }
+                batch.Erase(std::make_pair(strLegacy, vchName));
+                nUpgraded++;
+                pcursor->Next();
+            } catch (std::exception &e) {
+                delete pcursor;
+                return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+            }
+        }
+        delete pcursor;
+        if (nUpgraded) {
+            // queued only once the cursor is gone
+            if (!db.WriteBatch(batch))
+                return error("%s() : failed to write %s", __PRETTY_FUNCTION__, strVersion.c_str());
+            printf("Upgraded %u %s records to per-version storage\n", nUpgraded, strLegacy.c_str());
+        }
+        return BuildUpdatedIndex();
+    }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockcache.h"
+#include "main.h"
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+static boost::shared_ptr<const CBlock> NewBlock(unsigned int nNonce)
+{
+    CBlock *pblock = new CBlock();
+    pblock->nNonce = nNonce;
+    return boost::shared_ptr<const CBlock>(pblock);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache(1000);
+    unsigned int nSize;
+    uint64 nBytes, nMaxBytes, nHits, nMisses;
+
+    BOOST_CHECK(!cache.Lookup(1));
+    boost::shared_ptr<const CBlock> pblock = NewBlock(1);
+    cache.Insert(1, pblock, 300);
+    // the block itself is handed out, not a copy
+    BOOST_CHECK(cache.Lookup(1) == pblock);
+    cache.Insert(2, NewBlock(2), 300);
+    cache.Insert(3, NewBlock(3), 300);
+    cache.GetStats(nSize, nBytes, nMaxBytes, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nSize, 3U);
+    BOOST_CHECK_EQUAL(nBytes, 900U);
+    BOOST_CHECK_EQUAL(nMaxBytes, 1000U);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+
+    // 1 was used after 2, so 2 makes room for 4
+    BOOST_CHECK(cache.Lookup(1));
+    cache.Insert(4, NewBlock(4), 300);
+    BOOST_CHECK(!cache.Lookup(2));
+    BOOST_CHECK(cache.Lookup(3));
+    BOOST_CHECK(cache.Lookup(4));
+    BOOST_CHECK_EQUAL(cache.Lookup(1)->nNonce, 1U);
+
+    // a big block pushes out as many as it needs to, least recently used first
+    cache.Insert(5, NewBlock(5), 650);
+    cache.GetStats(nSize, nBytes, nMaxBytes, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nSize, 2U);
+    BOOST_CHECK_EQUAL(nBytes, 950U);
+    BOOST_CHECK(cache.Lookup(1));
+    BOOST_CHECK(!cache.Lookup(3));
+
+    // one larger than the whole cache is not kept
+    cache.Insert(6, NewBlock(6), 1001);
+    BOOST_CHECK(!cache.Lookup(6));
+    BOOST_CHECK(cache.Lookup(5));
+
+    // a block still in use outlives its eviction
+    cache.Clear();
+    BOOST_CHECK(!cache.Lookup(1));
+    BOOST_CHECK_EQUAL(pblock->nNonce, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+#include <boost/test/unit_test.hpp>
+
+#include "decodecache.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(decodecache_tests)
+
+BOOST_AUTO_TEST_CASE(decodecache_bounded)
+{
+    CDecodeCache<int> cache(10);
+    int n;
+    BOOST_CHECK(!cache.Get(1, n));
+
+    for (int i = 0; i < 25; i++)
+        cache.Insert(i, i * 2);
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+
+    // only the most recently added are kept
+    BOOST_CHECK(!cache.Get(14, n));
+    for (int i = 15; i < 25; i++)
+    {
+        BOOST_CHECK(cache.Get(i, n));
+        BOOST_CHECK_EQUAL(n, i * 2);
+    }
+
+    // adding a transaction again keeps its first result
+    cache.Insert(20, 0);
+    BOOST_CHECK(cache.Get(20, n));
+    BOOST_CHECK_EQUAL(n, 40);
+    BOOST_CHECK(cache.Get(15, n));
+}
+
+BOOST_AUTO_TEST_CASE(decodecache_result)
+{
+    int op = 7, nOut = 3;
+    vector<vector<unsigned char> > vvch(1);
+
+    // nothing decoded leaves op and nOut alone
+    CServiceTxDecode decode;
+    BOOST_CHECK(!decode.Get(op, nOut, vvch));
+    BOOST_CHECK_EQUAL(op, 7);
+    BOOST_CHECK_EQUAL(nOut, 3);
+    BOOST_CHECK(vvch.empty());
+
+    // an op read from an output that did not match is still handed back
+    decode.op = 2;
+    BOOST_CHECK(!decode.Get(op, nOut, vvch));
+    BOOST_CHECK_EQUAL(op, 2);
+    BOOST_CHECK_EQUAL(nOut, 3);
+
+    decode.fFound = true;
+    decode.nOut = 1;
+    decode.vvch.resize(2);
+    BOOST_CHECK(decode.Get(op, nOut, vvch));
+    BOOST_CHECK_EQUAL(nOut, 1);
+    BOOST_CHECK_EQUAL(vvch.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
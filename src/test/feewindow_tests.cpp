@@ -0,0 +1,211 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <list>
+
+#include "feewindow.h"
+#include "util.h"
+
+using namespace std;
+
+// The newest-first list walk the fee subsidy was originally defined by.
+// Returns false where that walk divides by zero, which happens when the
+// oldest counted fee is a stale one from above nHeight left by a reorg.
+static bool ReferenceWindowAverages(const list<CFeeWindowEntry>& lst, unsigned int nHeight, unsigned int h12, uint64& hr1Out, uint64& hr12Out)
+{
+    uint64 hr1 = 1, hr12 = 1;
+    unsigned int nTargetTime = 0;
+    unsigned int nTarget1hrTime = 0;
+    unsigned int blk1hrht = nHeight - 1, blk12hrht = nHeight - 1;
+    bool bFound = false;
+
+    BOOST_FOREACH(const CFeeWindowEntry& fee, lst) {
+        if (fee.nHeight <= nHeight)
+            bFound = true;
+        if (bFound) {
+            if (nTargetTime == 0) {
+                hr1 = hr12 = 0;
+                nTargetTime = fee.nTime - h12;
+                nTarget1hrTime = fee.nTime - (h12 / 12);
+            }
+            if (fee.nTime > nTargetTime) {
+                hr12 += fee.nValue;
+                blk12hrht = fee.nHeight;
+                if (fee.nTime > nTarget1hrTime) {
+                    hr1 += fee.nValue;
+                    blk1hrht = fee.nHeight;
+                }
+            }
+        }
+    }
+    if (blk12hrht == nHeight + 1 || blk1hrht == nHeight + 1)
+        return false;
+    hr12 /= (nHeight - blk12hrht) + 1;
+    hr1 /= (nHeight - blk1hrht) + 1;
+    hr1Out = hr1;
+    hr12Out = hr12;
+    return true;
+}
+
+static void CheckAgainstReference(CFeeWindow& window, const list<CFeeWindowEntry>& lst, unsigned int nTip, unsigned int h12)
+{
+    for (unsigned int nHeight = (nTip > 50 ? nTip - 50 : 0); nHeight <= nTip + 2; nHeight++)
+    {
+        uint64 hr1, hr12, ref1, ref12;
+        if (!ReferenceWindowAverages(lst, nHeight, h12, ref1, ref12))
+            continue;
+        window.GetWindowAverages(nHeight, h12, hr1, hr12);
+        BOOST_CHECK_EQUAL(hr1, ref1);
+        BOOST_CHECK_EQUAL(hr12, ref12);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(feewindow_tests)
+
+BOOST_AUTO_TEST_CASE(feewindow_empty)
+{
+    CFeeWindow window;
+    uint64 hr1, hr12;
+    window.GetWindowAverages(1000, 60 * 60 * 12, hr1, hr12);
+    BOOST_CHECK_EQUAL(hr1, 0U);
+    BOOST_CHECK_EQUAL(hr12, 0U);
+}
+
+// Appending blocks with jittery timestamps, then reorganising: the window
+// must match the full list walk at every height, including after
+// disconnected fees are zeroed and stale heights are reused
+BOOST_AUTO_TEST_CASE(feewindow_matches_list_walk)
+{
+    const unsigned int windows[] = { 60 * 60 * 12, 360 * 12 };
+    BOOST_FOREACH(unsigned int h12, windows)
+    {
+        CFeeWindow window;
+        list<CFeeWindowEntry> lst;
+        uint64 nTime = 1400000000;
+        unsigned int nHeight = 1;
+        for (int nStep = 0; nStep < 1500; nStep++)
+        {
+            // block times drift forward but may step backwards, and the
+            // odd block is stamped up to two hours into the future
+            nTime = nTime - 60 + insecure_rand() % 240;
+            uint64 nBlockTime = nTime + (insecure_rand() % 50 == 0 ? insecure_rand() % 7200 : 0);
+            int nFees = insecure_rand() % 3;
+            for (int i = 0; i < nFees; i++)
+            {
+                uint256 hash = insecure_rand();
+                CFeeWindowEntry entry(hash, nHeight, nBlockTime, 1 + insecure_rand() % 100000);
+                BOOST_CHECK(!window.Insert(entry, true));
+                lst.push_front(entry);
+            }
+            if (nStep % 200 == 199)
+            {
+                // reorg: zero the newest fees in place, then reuse their heights
+                int nDepth = 1 + insecure_rand() % 5;
+                BOOST_FOREACH(CFeeWindowEntry& fee, lst)
+                {
+                    if (fee.nHeight + nDepth <= nHeight)
+                        break;
+                    fee.nValue = 0;
+                    BOOST_CHECK(window.Insert(fee, true));
+                }
+                nHeight -= nDepth;
+            }
+            nHeight++;
+            if (nStep % 50 == 0)
+                CheckAgainstReference(window, lst, nHeight, h12);
+        }
+        CheckAgainstReference(window, lst, nHeight, h12);
+
+        // a round trip through the newest-first serialized form is lossless
+        CFeeWindow window2;
+        BOOST_REVERSE_FOREACH(const CFeeWindowEntry& fee, lst)
+            window2.push_back(fee);
+        CheckAgainstReference(window2, lst, nHeight, h12);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(feewindow_remove)
+{
+    CFeeWindow window;
+    list<CFeeWindowEntry> lst;
+    for (unsigned int nHeight = 1; nHeight <= 100; nHeight++)
+    {
+        // an old block stamped into the future still lands in the window
+        uint64 nTime = 1400000000 + nHeight * 60 + (nHeight == 10 ? 5000 : 0);
+        CFeeWindowEntry entry(nHeight, nHeight, nTime, nHeight * 1000);
+        window.Insert(entry, false);
+        lst.push_front(entry);
+    }
+    CheckAgainstReference(window, lst, 100, 360 * 12);
+
+    BOOST_CHECK(window.Remove(10, 10));
+    BOOST_CHECK(!window.Remove(10, 10));
+    for (list<CFeeWindowEntry>::iterator it = lst.begin(); it != lst.end(); ++it)
+        if (it->nHeight == 10) { lst.erase(it); break; }
+    CheckAgainstReference(window, lst, 100, 360 * 12);
+    CheckAgainstReference(window, lst, 100, 60 * 60 * 12);
+}
+
+// Fees written record by record and read back with a partial Load() answer
+// every query like the full history does, paging older records in on demand
+BOOST_AUTO_TEST_CASE(feewindow_persist)
+{
+    CServiceDB db(GetTempPath() / "feewindow_tests", 1 << 20, true);
+    CFeeWindow window;
+    window.Attach(&db, "fee");
+    list<CFeeWindowEntry> lst;
+    uint64 nTime = 1400000000;
+    unsigned int nHeight;
+    for (nHeight = 1; nHeight <= 400; nHeight++)
+    {
+        nTime = nTime - 60 + insecure_rand() % 240;
+        CFeeWindowEntry entry(insecure_rand(), nHeight, nTime, 1 + insecure_rand() % 100000);
+        window.Insert(entry, false);
+        lst.push_front(entry);
+        if (nHeight % 10 == 0)
+        {
+            CLevelDBBatch batch;
+            window.WriteChanges(batch);
+            BOOST_CHECK(db.WriteBatch(batch));
+        }
+    }
+    nHeight--;
+
+    // a disconnected fee zeroed in place is rewritten on its own
+    lst.front().nValue = 0;
+    BOOST_CHECK(window.Insert(lst.front(), true));
+    CLevelDBBatch batch;
+    window.WriteChanges(batch);
+    BOOST_CHECK(db.WriteBatch(batch));
+
+    CFeeWindow window2;
+    window2.Attach(&db, "fee");
+    BOOST_CHECK(window2.Load(nHeight, 60, 360 * 12));
+    size_t nLoaded = window2.size();
+    BOOST_CHECK(nLoaded < lst.size());
+    CheckAgainstReference(window2, lst, nHeight, 360 * 12);
+    BOOST_CHECK_EQUAL(window2.size(), nLoaded);
+
+    // reaching back past the loaded tail reads the rest
+    CheckAgainstReference(window2, lst, nHeight - 80, 360 * 12);
+    BOOST_CHECK_EQUAL(window2.size(), lst.size());
+
+    // a record that cannot be read back fails the lookup instead of adding
+    // a second entry for a key that may already be on disk
+    BOOST_CHECK(db.Write(make_pair(string("fee"), CBigEndianKey(0)), string("x")));
+    CFeeWindow window3;
+    window3.Attach(&db, "fee");
+    BOOST_CHECK(window3.Load(nHeight, 60, 360 * 12));
+    BOOST_CHECK(!window3.Insert(lst.back(), true));
+    BOOST_CHECK_EQUAL(window3.size(), lst.size() - 1);
+
+    // record keys sort in insertion order
+    CDataStream ss1(SER_DISK, CLIENT_VERSION), ss2(SER_DISK, CLIENT_VERSION);
+    ss1 << make_pair(string("fee"), CBigEndianKey(0xff));
+    ss2 << make_pair(string("fee"), CBigEndianKey(0x100));
+    BOOST_CHECK(ss1.str() < ss2.str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
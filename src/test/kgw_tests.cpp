@@ -0,0 +1,171 @@
+#include <boost/test/unit_test.hpp>
+
+#include <math.h>
+#include <vector>
+
+#include "bignum.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+// The Kimoto Gravity Well as it was first written, walking every time and
+// on bignums, with the parameters GetNextWorkRequired() uses
+static unsigned int ReferenceKimotoGravityWell(const CBlockIndex* pindexLast)
+{
+    const uint64 TargetBlocksSpacingSeconds = 60;
+    const uint64 PastBlocksMin = 7;
+    const uint64 PastBlocksMax = 98;
+    const CBlockIndex *BlockLastSolved = pindexLast;
+    const CBlockIndex *BlockReading = pindexLast;
+
+    uint64 PastBlocksMass = 0;
+    int64 PastRateActualSeconds = 0;
+    int64 PastRateTargetSeconds = 0;
+    double PastRateAdjustmentRatio = double(1);
+    CBigNum PastDifficultyAverage;
+    CBigNum PastDifficultyAveragePrev;
+    double EventHorizonDeviation;
+    double EventHorizonDeviationFast;
+    double EventHorizonDeviationSlow;
+
+    CBigNum bnPOWLimit(~uint256(0) >> 20);
+    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0
+            || (uint64) BlockLastSolved->nHeight < PastBlocksMin)
+        return bnPOWLimit.GetCompact();
+
+    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
+        if (PastBlocksMax > 0 && i > PastBlocksMax)
+            break;
+
+        PastBlocksMass++;
+
+        if (i == 1)
+            PastDifficultyAverage.SetCompact(BlockReading->nBits);
+        else
+            PastDifficultyAverage = ((CBigNum().SetCompact(BlockReading->nBits)
+                    - PastDifficultyAveragePrev) / i)
+                    + PastDifficultyAveragePrev;
+
+        PastDifficultyAveragePrev = PastDifficultyAverage;
+        PastRateActualSeconds = BlockLastSolved->GetBlockTime()
+                - BlockReading->GetBlockTime();
+        PastRateTargetSeconds = TargetBlocksSpacingSeconds * PastBlocksMass;
+        PastRateAdjustmentRatio = double(1);
+
+        if (PastRateActualSeconds < 0)
+            PastRateActualSeconds = 0;
+        if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
+            PastRateAdjustmentRatio = double(PastRateTargetSeconds)
+                    / double(PastRateActualSeconds);
+
+        EventHorizonDeviation = 1 + (0.7084
+                * pow((double(PastBlocksMass) / double(144)), -1.228));
+        EventHorizonDeviationFast = EventHorizonDeviation;
+        EventHorizonDeviationSlow = 1 / EventHorizonDeviation;
+
+        if (PastBlocksMass >= PastBlocksMin) {
+            if ((PastRateAdjustmentRatio <= EventHorizonDeviationSlow)
+                    || (PastRateAdjustmentRatio >= EventHorizonDeviationFast))
+                break;
+        }
+        if (BlockReading->pprev == NULL)
+            break;
+        BlockReading = BlockReading->pprev;
+    }
+
+    CBigNum bnNew(PastDifficultyAverage);
+    if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0) {
+        bnNew *= PastRateActualSeconds;
+        bnNew /= PastRateTargetSeconds;
+    }
+
+    if (bnNew > bnPOWLimit)
+        bnNew = bnPOWLimit;
+
+    return bnNew.GetCompact();
+}
+
+// Link up a chain of nBlocks index entries, genesis first
+static void LinkChain(vector<CBlockIndex>& vIndex, unsigned int nBlocks)
+{
+    vIndex.assign(nBlocks, CBlockIndex());
+    for (unsigned int i = 0; i < nBlocks; i++)
+    {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+    }
+}
+
+// Every block of the chain, asked for twice so that the second answer comes
+// from the index entry, gives what the reference walk gives
+static void CheckChain(const vector<CBlockIndex>& vIndex)
+{
+    for (unsigned int i = 0; i < vIndex.size(); i++)
+    {
+        unsigned int nBits = ReferenceKimotoGravityWell(&vIndex[i]);
+        BOOST_CHECK_EQUAL(GetNextWorkRequired(&vIndex[i], NULL), nBits);
+        BOOST_CHECK_EQUAL(vIndex[i].nBitsNext, nBits);
+        BOOST_CHECK_EQUAL(GetNextWorkRequired(&vIndex[i], NULL), nBits);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(kgw_tests)
+
+// Blocks of random work and random, even backwards or years apart, timestamps
+BOOST_AUTO_TEST_CASE(kgw_synthetic)
+{
+    BOOST_CHECK_EQUAL(GetNextWorkRequired(NULL, NULL), ReferenceKimotoGravityWell(NULL));
+
+    vector<CBlockIndex> vIndex;
+    LinkChain(vIndex, 600);
+    unsigned int nTime = 1400000000;
+    for (unsigned int i = 0; i < vIndex.size(); i++)
+    {
+        // mostly close together, sometimes far apart or out of order
+        switch (insecure_rand() % 8)
+        {
+        case 0:
+            nTime -= insecure_rand() % 600;
+            break;
+        case 1:
+            nTime += insecure_rand() % 7200;
+            break;
+        case 2:
+            // far enough to take the target past the limit
+            if (insecure_rand() % 8 == 0)
+                nTime += insecure_rand() % 0x40000000;
+            break;
+        default:
+            nTime += insecure_rand() % 120;
+        }
+        vIndex[i].nTime = nTime;
+        vIndex[i].nBits = (0x1b + insecure_rand() % 4) << 24 | (0x008000 + insecure_rand() % 0x7f0000);
+    }
+    CheckChain(vIndex);
+}
+
+// A chain whose every block carries the work the reference asked of it,
+// solved by hash rate that ramps up, collapses and comes back
+BOOST_AUTO_TEST_CASE(kgw_replayed)
+{
+    vector<CBlockIndex> vIndex;
+    LinkChain(vIndex, 1500);
+    unsigned int nTime = 1400000000;
+    vIndex[0].nTime = nTime;
+    vIndex[0].nBits = ReferenceKimotoGravityWell(NULL);
+    for (unsigned int i = 1; i < vIndex.size(); i++)
+    {
+        uint64 nHashRate = i < 500 ? 1 + i / 10 : i < 900 ? 2 : 60;
+        CBigNum bnTarget;
+        bnTarget.SetCompact(ReferenceKimotoGravityWell(&vIndex[i - 1]));
+        // expected solve time of a target with hash rate, jittered
+        uint64 nSolve = (CBigNum(~uint256(0) >> 20) / bnTarget).getulong() * 30 / nHashRate;
+        nTime += 1 + nSolve * (50 + insecure_rand() % 100) / 100;
+        vIndex[i].nTime = nTime;
+        vIndex[i].nBits = bnTarget.GetCompact();
+    }
+    CheckChain(vIndex);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
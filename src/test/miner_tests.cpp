@@ -143,6 +143,18 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     tx.vout[0].nValue = 5900000000LL;
     hash = tx.GetHash();
     mempool.addUnchecked(hash, tx);
+    {
+        // both are indexed, the child knowing its parent
+        LOCK(mempool.cs);
+        CCoinsViewCache view(*pcoinsTip, true);
+        mempool.updateIndexes(view, pindexBest->nHeight + 1);
+        BOOST_CHECK_EQUAL(mempool.setByFee.size(), 2U);
+        BOOST_CHECK_EQUAL(mempool.setByPriority.size(), 2U);
+        BOOST_CHECK(mempool.setInputsStale.empty());
+        BOOST_CHECK(mempool.mapTx[hash].setParents.count(tx.vin[0].prevout.hash));
+        int64 nValueFirst = view.GetCoins(txFirst[0]->GetHash()).vout[0].nValue;
+        BOOST_CHECK_EQUAL(mempool.mapTx[hash].nFee, 4900000000LL + nValueFirst - 5900000000LL);
+    }
     BOOST_CHECK(pblocktemplate = CreateNewBlockWithKey(reservekey));
     delete pblocktemplate;
     mempool.clear();
@@ -190,6 +202,35 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     delete pblocktemplate;
     mempool.clear();
 
+    // a transaction taken in after the template was made goes into a copy;
+    // after a removal the template has to be made anew
+    BOOST_CHECK(pblocktemplate = CreateNewBlockWithKey(reservekey));
+    BOOST_CHECK(UpdateBlockTemplate(pblocktemplate) == pblocktemplate);
+    tx.vin[0].prevout.hash = txFirst[0]->GetHash();
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout[0].nValue = 4900000000LL;
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    hash = tx.GetHash();
+    mempool.addUnchecked(hash, tx);
+    CBlockTemplate *pblocktemplateNew = UpdateBlockTemplate(pblocktemplate);
+    BOOST_REQUIRE(pblocktemplateNew);
+    BOOST_REQUIRE(pblocktemplateNew != pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate->nMempoolNext, mempool.nAddedBase + mempool.vAdded.size());
+    BOOST_CHECK_EQUAL(pblocktemplateNew->block.vtx.size(), pblocktemplate->block.vtx.size() + 1);
+    BOOST_CHECK(pblocktemplateNew->block.vtx.back().GetHash() == hash);
+    BOOST_CHECK_EQUAL(pblocktemplateNew->vTxFees[0], -pblocktemplateNew->nFees);
+    delete pblocktemplate;
+    pblocktemplate = pblocktemplateNew;
+    // nothing new leaves the template as it is
+    BOOST_CHECK(UpdateBlockTemplate(pblocktemplate) == pblocktemplate);
+    mempool.remove(tx);
+    tx.vout[0].scriptPubKey = CScript() << OP_2;
+    hash = tx.GetHash();
+    mempool.addUnchecked(hash, tx);
+    BOOST_CHECK(!UpdateBlockTemplate(pblocktemplate));
+    delete pblocktemplate;
+    mempool.clear();
+
     // subsidy changing
     int nHeight = pindexBest->nHeight;
     pindexBest->nHeight = 209999;
@@ -0,0 +1,34 @@
+#include <boost/test/unit_test.hpp>
+
+#include "powcache.h"
+
+BOOST_AUTO_TEST_SUITE(powcache_tests)
+
+BOOST_AUTO_TEST_CASE(powcache_lookup)
+{
+    CPoWCache cache(10);
+    unsigned int nSize, nMaxSize;
+    uint64 nHits, nMisses;
+
+    BOOST_CHECK(!cache.Lookup(1, 0x1d00ffff));
+    cache.Insert(1, 0x1d00ffff);
+    BOOST_CHECK(cache.Lookup(1, 0x1d00ffff));
+    // the same header claiming other work is not known
+    BOOST_CHECK(!cache.Lookup(1, 0x1c00ffff));
+    // peeking does not count
+    BOOST_CHECK(cache.Contains(1, 0x1d00ffff));
+    cache.GetStats(nSize, nMaxSize, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+
+    // only the most recently added are kept
+    for (int i = 2; i < 25; i++)
+        cache.Insert(i, 0x1d00ffff);
+    cache.GetStats(nSize, nMaxSize, nHits, nMisses);
+    BOOST_CHECK_EQUAL(nSize, 10U);
+    BOOST_CHECK_EQUAL(nMaxSize, 10U);
+    BOOST_CHECK(!cache.Contains(14, 0x1d00ffff));
+    BOOST_CHECK(cache.Contains(15, 0x1d00ffff));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -30,4 +30,42 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi)
+{
+    // Batches of every size hash each input as the single-input function does
+    const char* inputhex = "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659";
+#if defined(USE_SSE2)
+    scrypt_detect_sse2();
+#endif
+    std::vector<unsigned char> header = ParseHex(inputhex);
+    std::vector<char> inputs(80 * 2 * SCRYPT_MAX_WAYS + 80);
+    std::vector<uint256> expected(2 * SCRYPT_MAX_WAYS + 1);
+    for (unsigned int i = 0; i < expected.size(); i++) {
+        memcpy(&inputs[80 * i], &header[0], 80);
+        // vary the nonce
+        inputs[80 * i + 76] = (char)i;
+        scrypt_1024_1_1_256(&inputs[80 * i], BEGIN(expected[i]));
+    }
+    std::vector<char> scratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    for (int nCount = 1; nCount <= (int)expected.size(); nCount++) {
+        std::vector<uint256> hashes(nCount);
+        scrypt_1024_1_1_256_sp_multi(&inputs[0], BEGIN(hashes[0]), &scratchpad[0], nCount);
+        for (int i = 0; i < nCount; i++)
+            BOOST_CHECK(hashes[i] == expected[i]);
+    }
+#if defined(USE_SSE2)
+    uint256 hashes[SCRYPT_MAX_WAYS];
+    scrypt_1024_1_1_256_sp_sse2_4way(&inputs[0], BEGIN(hashes[0]), &scratchpad[0]);
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(hashes[i] == expected[i]);
+#if defined(USE_AVX2)
+    if (scrypt_ways() == 8) {
+        scrypt_1024_1_1_256_sp_avx2_8way(&inputs[0], BEGIN(hashes[0]), &scratchpad[0]);
+        for (int i = 0; i < 8; i++)
+            BOOST_CHECK(hashes[i] == expected[i]);
+    }
+#endif
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
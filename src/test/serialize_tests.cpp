@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "serialize.h"
+#include "util.h"
 
 using namespace std;
 
@@ -42,4 +43,65 @@ BOOST_AUTO_TEST_CASE(varints)
 
 }
 
+// Records laid out like a block file, read back from the file mapped into
+// memory the way LoadExternalBlockFile() scans it
+BOOST_AUTO_TEST_CASE(memorystream)
+{
+    CDataStream ss(SER_DISK, 0);
+    vector<uint64> vPos;
+    for (int i = 0; i < 1000; i++) {
+        // gaps of zeros, as in preallocated space, between the records
+        for (int n = insecure_rand() % 64; n > 0; n--)
+            ss << (unsigned char)0;
+        ss << (unsigned char)0xf9;
+        vPos.push_back(ss.size());
+        ss << VARINT(i) << string(i % 100, 'x');
+    }
+    ss << (unsigned char)0xf9;
+
+    FILE *file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE(fwrite(&ss[0], 1, ss.size(), file) == ss.size());
+    fflush(file);
+    CMappedFile mapped;
+    BOOST_REQUIRE(mapped.Open(file, true));
+    fclose(file);
+    BOOST_CHECK_EQUAL(mapped.size(), ss.size());
+    BOOST_CHECK(memcmp(mapped.begin(), &ss[0], ss.size()) == 0);
+    mapped.WillNeed(mapped.size() / 2, mapped.size());
+
+    CMemoryStream stream(mapped.begin(), mapped.size(), SER_DISK, 0);
+    for (int i = 0; i < 1000; i++) {
+        stream.FindByte((char)0xf9);
+        BOOST_CHECK(stream.SetPos(stream.GetPos() + 1));
+        BOOST_CHECK_EQUAL(stream.GetPos(), vPos[i]);
+        int j = -1;
+        string str;
+        stream >> VARINT(j) >> str;
+        BOOST_CHECK_EQUAL(j, i);
+        BOOST_CHECK_EQUAL(str.size(), (unsigned int)(i % 100));
+    }
+
+    // limits and the end of the data stop reads
+    BOOST_CHECK(stream.SetPos(vPos[999]));
+    BOOST_CHECK(stream.SetLimit(vPos[999] + 1));
+    string str;
+    BOOST_CHECK_THROW(stream >> str, std::ios_base::failure);
+    BOOST_CHECK(stream.SetLimit());
+    BOOST_CHECK(stream.SetPos(mapped.size() - 1));
+    unsigned char ch;
+    stream >> ch;
+    BOOST_CHECK(stream.eof());
+    BOOST_CHECK_THROW(stream >> ch, std::ios_base::failure);
+    BOOST_CHECK_THROW(stream.FindByte((char)0xf9), std::ios_base::failure);
+    BOOST_CHECK(!stream.SetPos(mapped.size() + 1));
+
+    // an empty file cannot be mapped
+    file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_CHECK(!mapped.Open(file));
+    BOOST_CHECK(!mapped.IsOpen());
+    fclose(file);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
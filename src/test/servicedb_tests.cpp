@@ -0,0 +1,218 @@
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+#include "servicedb.h"
+#include "util.h"
+
+using namespace std;
+
+typedef pair<string, CBigEndianKey> test_key;
+
+template<typename T> static string Serialized(const T& obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    return ss.str();
+}
+
+static void CheckIterator(leveldb::Iterator *pcursor, const map<string, string>& ref)
+{
+    // a full walk in both directions
+    map<string, string>::const_iterator it = ref.begin();
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next(), ++it)
+    {
+        BOOST_REQUIRE(it != ref.end());
+        BOOST_CHECK(pcursor->key().ToString() == it->first);
+        BOOST_CHECK(pcursor->value().ToString() == it->second);
+    }
+    BOOST_CHECK(it == ref.end());
+    map<string, string>::const_reverse_iterator rit = ref.rbegin();
+    for (pcursor->SeekToLast(); pcursor->Valid(); pcursor->Prev(), ++rit)
+    {
+        BOOST_REQUIRE(rit != ref.rend());
+        BOOST_CHECK(pcursor->key().ToString() == rit->first);
+    }
+    BOOST_CHECK(rit == ref.rend());
+
+    // random seeks followed by steps changing direction
+    for (int i = 0; i < 20; i++)
+    {
+        string strTarget = Serialized(test_key("k", insecure_rand() % 80));
+        pcursor->Seek(strTarget);
+        it = ref.lower_bound(strTarget);
+        for (int j = 0; j < 10; j++)
+        {
+            BOOST_REQUIRE_EQUAL(pcursor->Valid(), it != ref.end());
+            if (!pcursor->Valid())
+                break;
+            BOOST_CHECK(pcursor->key().ToString() == it->first);
+            if (insecure_rand() % 2)
+            {
+                pcursor->Next();
+                ++it;
+            }
+            else
+            {
+                pcursor->Prev();
+                if (it == ref.begin())
+                    it = ref.end();
+                else
+                    --it;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(servicedb_tests)
+
+// Queued writes and erases read and iterate like the database they will
+// produce, through Flush(), Discard() and Commit()
+BOOST_AUTO_TEST_CASE(servicedb_overlay)
+{
+    CServiceDB db(GetTempPath() / "servicedb_overlay", 1 << 20, true);
+    map<string, string> refAccepted, refCurrent, refDisk;
+    for (int nStep = 0; nStep < 400; nStep++)
+    {
+        int n = insecure_rand() % 64;
+        test_key key("k", n);
+        if (insecure_rand() % 3)
+        {
+            int nValue = insecure_rand();
+            BOOST_CHECK(db.Write(key, nValue));
+            refCurrent[Serialized(key)] = Serialized(nValue);
+        }
+        else
+        {
+            BOOST_CHECK(db.Erase(key));
+            refCurrent.erase(Serialized(key));
+        }
+
+        int nValue;
+        bool fExists = refCurrent.count(Serialized(key)) > 0;
+        BOOST_CHECK_EQUAL(db.Exists(key), fExists);
+        BOOST_CHECK_EQUAL(db.Read(key, nValue), fExists);
+
+        switch (insecure_rand() % 10)
+        {
+        case 0:
+            db.Discard();
+            refCurrent = refAccepted;
+            break;
+        case 1:
+        case 2:
+            BOOST_CHECK(db.Flush());
+            refAccepted = refCurrent;
+            break;
+        case 3:
+            BOOST_CHECK(db.Flush());
+            refAccepted = refCurrent;
+            BOOST_CHECK(db.Commit(nStep));
+            // the marker is an entry of its own
+            refCurrent[Serialized(string("bestblock"))] = Serialized(uint256(nStep));
+            refAccepted[Serialized(string("bestblock"))] = Serialized(uint256(nStep));
+            refDisk = refAccepted;
+            break;
+        }
+
+        if (nStep % 20 == 0)
+        {
+            leveldb::Iterator *pcursor = db.NewIterator();
+            CheckIterator(pcursor, refCurrent);
+            delete pcursor;
+        }
+    }
+
+    // only committed changes are on disk
+    BOOST_CHECK(db.Flush());
+    leveldb::Iterator *pcursor = db.CLevelDB::NewIterator();
+    CheckIterator(pcursor, refDisk);
+    delete pcursor;
+
+    uint256 hashBlock;
+    BOOST_CHECK(db.Commit(12345));
+    refCurrent[Serialized(string("bestblock"))] = Serialized(uint256(12345));
+    BOOST_CHECK(db.ReadBestBlock(hashBlock));
+    BOOST_CHECK(hashBlock == 12345);
+    pcursor = db.NewIterator();
+    CheckIterator(pcursor, refCurrent);
+    delete pcursor;
+}
+
+BOOST_AUTO_TEST_CASE(servicedb_marker)
+{
+    CServiceDB db(GetTempPath() / "servicedb_marker", 1 << 20, true);
+    uint256 hashBlock;
+    BOOST_CHECK(!db.ReadBestBlock(hashBlock));
+
+    // accepted changes stay off disk, with the old marker, until committed
+    BOOST_CHECK(db.Commit(1));
+    BOOST_CHECK(db.Write(test_key("k", 1), 1));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(!db.CLevelDB::Exists(test_key("k", 1)));
+    BOOST_CHECK(db.ReadBestBlock(hashBlock));
+    BOOST_CHECK(hashBlock == 1);
+
+    // changes of blocks that were not accepted are never written
+    BOOST_CHECK(db.Erase(test_key("k", 1)));
+    db.Discard();
+    BOOST_CHECK(db.Exists(test_key("k", 1)));
+    BOOST_CHECK(db.Commit(2));
+    BOOST_CHECK(db.CLevelDB::Exists(test_key("k", 1)));
+    BOOST_CHECK(db.ReadBestBlock(hashBlock));
+    BOOST_CHECK(hashBlock == 2);
+}
+
+// an iterator keeps the view it was created with while changes are queued
+// and accepted
+BOOST_AUTO_TEST_CASE(servicedb_iterator_snapshot)
+{
+    CServiceDB db(GetTempPath() / "servicedb_iterator_snapshot", 1 << 20, true);
+    map<string, string> ref;
+    for (int n = 0; n < 8; n++)
+    {
+        BOOST_CHECK(db.Write(test_key("k", n), n));
+        ref[Serialized(test_key("k", n))] = Serialized(n);
+    }
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.Write(test_key("k", 8), 8));
+    ref[Serialized(test_key("k", 8))] = Serialized(8);
+
+    leveldb::Iterator *pcursor = db.NewIterator();
+    for (int n = 0; n < 16; n++)
+    {
+        if (n % 2)
+            BOOST_CHECK(db.Erase(test_key("k", n)));
+        else
+            BOOST_CHECK(db.Write(test_key("k", n), -n));
+    }
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.Write(test_key("k", 20), 20));
+    CheckIterator(pcursor, ref);
+    delete pcursor;
+}
+
+BOOST_AUTO_TEST_CASE(servicedb_clear)
+{
+    CServiceDB db(GetTempPath() / "servicedb_clear", 1 << 20, true);
+    for (int n = 0; n < 4; n++)
+        BOOST_CHECK(db.Write(test_key("k", n), n));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.Commit(1));
+    BOOST_CHECK(db.Write(test_key("k", 4), 4));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.Write(test_key("k", 5), 5));
+
+    // nothing is left but a marker that matches no block
+    BOOST_CHECK(db.Clear());
+    map<string, string> ref;
+    ref[Serialized(string("bestblock"))] = Serialized(uint256(0));
+    leveldb::Iterator *pcursor = db.NewIterator();
+    CheckIterator(pcursor, ref);
+    delete pcursor;
+    uint256 hashBlock;
+    BOOST_CHECK(db.ReadBestBlock(hashBlock));
+    BOOST_CHECK(hashBlock == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,319 @@
+#include <boost/test/unit_test.hpp>
+
+#include "servicehistory.h"
+#include "util.h"
+
+using namespace std;
+
+// Minimal stand-in for CAliasIndex, COffer and CCertIssuer
+class CTestVersion {
+public:
+    uint256 txHash;
+    uint64 nHeight;
+    int nValue;
+
+    CTestVersion() : txHash(0), nHeight(0), nValue(0) {}
+    CTestVersion(uint256 txHashIn, uint64 nHeightIn, int nValueIn) : txHash(txHashIn), nHeight(nHeightIn), nValue(nValueIn) {}
+
+    IMPLEMENT_SERIALIZE (
+        READWRITE(txHash);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+    )
+};
+
+static vector<unsigned char> Name(const string& str)
+{
+    return vector<unsigned char>(str.begin(), str.end());
+}
+
+static void WriteVersion(CServiceDB& db, CServiceHistory<CTestVersion>& history, const vector<unsigned char>& vchName, const CTestVersion& version)
+{
+    CLevelDBBatch batch;
+    history.Write(batch, vchName, version);
+    BOOST_CHECK(db.WriteBatch(batch));
+}
+
+BOOST_AUTO_TEST_SUITE(servicehistory_tests)
+
+BOOST_AUTO_TEST_CASE(servicehistory_versions)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_versions", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    vector<unsigned char> vchName = Name("name");
+    vector<unsigned char> vchOther = Name("name2");
+
+    CTestVersion version;
+    BOOST_CHECK(!history.Exists(vchName));
+    BOOST_CHECK(!history.ReadLatest(vchName, version));
+
+    // versions sort by height, including past 255 where a little-endian key would not
+    WriteVersion(db, history, vchName, CTestVersion(1, 10, 1));
+    WriteVersion(db, history, vchName, CTestVersion(2, 300, 2));
+    WriteVersion(db, history, vchOther, CTestVersion(3, 20, 3));
+    WriteVersion(db, history, vchName, CTestVersion(4, 1000, 4));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nValue, 4);
+
+    // a second write at the same height replaces that version
+    WriteVersion(db, history, vchName, CTestVersion(5, 1000, 5));
+    vector<CTestVersion> vtxPos;
+    BOOST_CHECK(history.ReadAll(vchName, vtxPos));
+    BOOST_CHECK_EQUAL(vtxPos.size(), 3U);
+    BOOST_CHECK_EQUAL(vtxPos[0].nHeight, 10U);
+    BOOST_CHECK_EQUAL(vtxPos[1].nHeight, 300U);
+    BOOST_CHECK_EQUAL(vtxPos[2].nValue, 5);
+
+    // popping only removes versions written by that transaction
+    CLevelDBBatch batch;
+    BOOST_CHECK(history.Pop(batch, vchName, 4));
+    BOOST_CHECK(db.WriteBatch(batch));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nValue, 5);
+
+    CLevelDBBatch batch2;
+    BOOST_CHECK(history.Pop(batch2, vchName, 5));
+    BOOST_CHECK(db.WriteBatch(batch2));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nHeight, 300U);
+
+    // a lower version only becomes the latest once the higher one is popped
+    WriteVersion(db, history, vchName, CTestVersion(6, 200, 6));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nHeight, 300U);
+    CLevelDBBatch batch3;
+    BOOST_CHECK(history.Pop(batch3, vchName, 2));
+    BOOST_CHECK(db.WriteBatch(batch3));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nValue, 6);
+
+    // the other record is untouched
+    BOOST_CHECK(history.ReadAll(vchOther, vtxPos));
+    BOOST_CHECK_EQUAL(vtxPos.size(), 1U);
+    BOOST_CHECK_EQUAL(vtxPos[0].nValue, 3);
+
+    vector<pair<vector<unsigned char>, CTestVersion> > vScan;
+    BOOST_CHECK(history.Scan(vector<unsigned char>(), 10, vScan));
+    BOOST_CHECK_EQUAL(vScan.size(), 2U);
+    BOOST_CHECK(vScan[0].first == vchName);
+    BOOST_CHECK_EQUAL(vScan[0].second.nValue, 6);
+    BOOST_CHECK(vScan[1].first == vchOther);
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_pop_all)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_pop_all", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    vector<unsigned char> vchName = Name("name");
+
+    WriteVersion(db, history, vchName, CTestVersion(1, 10, 1));
+    CLevelDBBatch batch;
+    BOOST_CHECK(history.Pop(batch, vchName, 1));
+    BOOST_CHECK(db.WriteBatch(batch));
+
+    // the record is still there, with an empty history
+    CTestVersion version;
+    vector<CTestVersion> vtxPos;
+    BOOST_CHECK(history.Exists(vchName));
+    BOOST_CHECK(!history.ReadLatest(vchName, version));
+    BOOST_CHECK(history.ReadAll(vchName, vtxPos));
+    BOOST_CHECK(vtxPos.empty());
+
+    // and a new version at a lower height becomes the latest
+    WriteVersion(db, history, vchName, CTestVersion(2, 5, 2));
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nValue, 2);
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_upgrade)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_upgrade", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    vector<unsigned char> vchName = Name("name");
+
+    vector<CTestVersion> vLegacy;
+    vLegacy.push_back(CTestVersion(1, 10, 1));
+    vLegacy.push_back(CTestVersion(2, 400, 2));
+    vLegacy.push_back(CTestVersion(3, 500, 3));
+    BOOST_CHECK(db.Write(make_pair(string("testi"), vchName), vLegacy));
+
+    BOOST_CHECK(history.Upgrade());
+    BOOST_CHECK(!db.Exists(make_pair(string("testi"), vchName)));
+    vector<CTestVersion> vtxPos;
+    BOOST_CHECK(history.ReadAll(vchName, vtxPos));
+    BOOST_CHECK_EQUAL(vtxPos.size(), 3U);
+    CTestVersion version;
+    BOOST_CHECK(history.ReadLatest(vchName, version));
+    BOOST_CHECK_EQUAL(version.nValue, 3);
+    vector<pair<vector<unsigned char>, uint64> > vScan;
+    BOOST_CHECK(history.ScanUpdated(0, vScan));
+    BOOST_CHECK_EQUAL(vScan.size(), 1U);
+    BOOST_CHECK_EQUAL(vScan[0].second, 500U);
+
+    // nothing left to upgrade the second time
+    BOOST_CHECK(history.Upgrade());
+    BOOST_CHECK(history.ReadAll(vchName, vtxPos));
+    BOOST_CHECK_EQUAL(vtxPos.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_cursor)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_cursor", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    WriteVersion(db, history, Name("a"), CTestVersion(1, 10, 1));
+    WriteVersion(db, history, Name("b"), CTestVersion(2, 20, 2));
+    WriteVersion(db, history, Name("b"), CTestVersion(3, 30, 3));
+    WriteVersion(db, history, Name("c"), CTestVersion(4, 40, 4));
+
+    // each record once, at its latest version
+    vector<unsigned char> vchName;
+    CTestVersion version;
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursor(history, Name("b"), false);
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("b"));
+        BOOST_CHECK_EQUAL(version.nValue, 3);
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("c"));
+        BOOST_CHECK(!cursor.Next(vchName, version));
+    }
+
+    // resuming after a record skips only that record, and resuming after
+    // a record that is gone still starts at the next one
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursor(history, Name("a"), true);
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("b"));
+    }
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursor(history, Name("0"), true);
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("a"));
+    }
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursor(history, Name("c"), true);
+        BOOST_CHECK(!cursor.Next(vchName, version));
+    }
+}
+
+static vector<pair<vector<unsigned char>, uint64> > Updated(CServiceHistory<CTestVersion>& history, uint64 nMinHeight)
+{
+    vector<pair<vector<unsigned char>, uint64> > vScan;
+    BOOST_CHECK(history.ScanUpdated(nMinHeight, vScan));
+    return vScan;
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_updated)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_updated", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    vector<unsigned char> vchName = Name("name");
+    vector<unsigned char> vchOther = Name("name2");
+
+    // each record is indexed once, at the height of its newest version
+    WriteVersion(db, history, vchName, CTestVersion(1, 10, 1));
+    WriteVersion(db, history, vchOther, CTestVersion(2, 300, 2));
+    WriteVersion(db, history, vchName, CTestVersion(3, 1000, 3));
+    vector<pair<vector<unsigned char>, uint64> > vScan = Updated(history, 0);
+    BOOST_CHECK_EQUAL(vScan.size(), 2U);
+    BOOST_CHECK(vScan[0].first == vchOther);
+    BOOST_CHECK_EQUAL(vScan[0].second, 300U);
+    BOOST_CHECK(vScan[1].first == vchName);
+    BOOST_CHECK_EQUAL(vScan[1].second, 1000U);
+    BOOST_CHECK_EQUAL(Updated(history, 301).size(), 1U);
+    BOOST_CHECK(Updated(history, 1001).empty());
+
+    // an older version does not move the record
+    WriteVersion(db, history, vchName, CTestVersion(4, 500, 4));
+    BOOST_CHECK_EQUAL(Updated(history, 1000).size(), 1U);
+
+    // popping moves it back to the version left, or out of the index
+    CLevelDBBatch batch;
+    BOOST_CHECK(history.Pop(batch, vchName, 3));
+    BOOST_CHECK(db.WriteBatch(batch));
+    vScan = Updated(history, 0);
+    BOOST_CHECK_EQUAL(vScan.size(), 2U);
+    BOOST_CHECK(vScan[0].first == vchOther);
+    BOOST_CHECK(vScan[1].first == vchName);
+    BOOST_CHECK_EQUAL(vScan[1].second, 500U);
+
+    CLevelDBBatch batch2;
+    BOOST_CHECK(history.Pop(batch2, vchOther, 2));
+    BOOST_CHECK(db.WriteBatch(batch2));
+    vScan = Updated(history, 0);
+    BOOST_CHECK_EQUAL(vScan.size(), 1U);
+    BOOST_CHECK(vScan[0].first == vchName);
+
+    // and a record with an empty history comes back when written again
+    WriteVersion(db, history, vchOther, CTestVersion(5, 20, 5));
+    vScan = Updated(history, 0);
+    BOOST_CHECK_EQUAL(vScan.size(), 2U);
+    BOOST_CHECK(vScan[0].first == vchOther);
+    BOOST_CHECK_EQUAL(vScan[0].second, 20U);
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_updated_cursor)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_updated_cursor", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+
+    // the names come back in the order of the database, shorter names
+    // first, and not in the order they were updated
+    WriteVersion(db, history, Name("b"), CTestVersion(1, 300, 1));
+    WriteVersion(db, history, Name("aa"), CTestVersion(2, 100, 2));
+    WriteVersion(db, history, Name("a"), CTestVersion(3, 200, 3));
+    WriteVersion(db, history, Name("c"), CTestVersion(4, 10, 4));
+
+    vector<unsigned char> vchName;
+    CTestVersion version;
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursor(history, 100);
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("a"));
+        BOOST_CHECK_EQUAL(version.nValue, 3);
+        BOOST_CHECK(cursor.NextName(vchName));
+        BOOST_CHECK(vchName == Name("b"));
+        BOOST_CHECK(cursor.Next(vchName, version));
+        BOOST_CHECK(vchName == Name("aa"));
+        BOOST_CHECK_EQUAL(version.nValue, 2);
+        BOOST_CHECK(!cursor.NextName(vchName));
+    }
+
+    // the same order as a cursor over all the records
+    {
+        CServiceHistory<CTestVersion>::CScanCursor cursorAll(history, vector<unsigned char>(), false);
+        CServiceHistory<CTestVersion>::CScanCursor cursorUpdated(history, 0);
+        vector<unsigned char> vchUpdated;
+        while (cursorAll.NextName(vchName)) {
+            BOOST_CHECK(cursorUpdated.NextName(vchUpdated));
+            BOOST_CHECK(vchName == vchUpdated);
+        }
+        BOOST_CHECK(!cursorUpdated.NextName(vchUpdated));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(servicehistory_build_updated)
+{
+    CServiceDB db(GetTempPath() / "servicehistory_build_updated", 1 << 20, true);
+    CServiceHistory<CTestVersion> history(db, "testv", "testl", "testi", "testu");
+    vector<unsigned char> vchName = Name("name");
+    vector<unsigned char> vchEmpty = Name("empty");
+
+    // records written before the index existed
+    BOOST_CHECK(db.Write(make_pair(make_pair(string("testv"), vchName), CBigEndianKey(300)), CTestVersion(1, 300, 1)));
+    BOOST_CHECK(db.Write(make_pair(string("testl"), vchName), (uint64)300));
+    BOOST_CHECK(db.Write(make_pair(string("testl"), vchEmpty), (uint64)40));
+    BOOST_CHECK(Updated(history, 0).empty());
+
+    BOOST_CHECK(history.Upgrade());
+    vector<pair<vector<unsigned char>, uint64> > vScan = Updated(history, 0);
+    BOOST_CHECK_EQUAL(vScan.size(), 1U);
+    BOOST_CHECK(vScan[0].first == vchName);
+    BOOST_CHECK_EQUAL(vScan[0].second, 300U);
+
+    // nothing left to index the second time
+    BOOST_CHECK(history.Upgrade());
+    BOOST_CHECK_EQUAL(Updated(history, 0).size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,13 @@
 #include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
 
+#include <vector>
+
+#include "bignum.h"
 #include "uint256.h"
+#include "util.h"
+
+using namespace std;
 
 BOOST_AUTO_TEST_SUITE(uint256_tests)
 
@@ -15,4 +22,116 @@ BOOST_AUTO_TEST_CASE(uint256_equality)
     BOOST_CHECK(num1+num2 == num3+num2);
 }
 
+// Numbers of every length from 0 to 256 bits
+static vector<uint256> TestNumbers()
+{
+    vector<uint256> vNum;
+    vNum.push_back(0);
+    vNum.push_back(1);
+    vNum.push_back(~uint256(0));
+    for (unsigned int nBits = 1; nBits <= 256; nBits++)
+    {
+        vNum.push_back(~uint256(0) >> (256 - nBits));
+        vNum.push_back(uint256(1) << (nBits - 1));
+        for (int i = 0; i < 4; i++)
+            vNum.push_back(GetRandHash() >> (256 - nBits));
+    }
+    return vNum;
+}
+
+// Every exponent, sign and a spread of mantissas read and written back the
+// way CBigNum reads and writes them
+BOOST_AUTO_TEST_CASE(uint256_compact)
+{
+    vector<unsigned int> vMantissa;
+    for (unsigned int n = 0; n < 0x100; n++)
+        vMantissa.push_back(n);
+    for (int nBit = 8; nBit < 23; nBit++)
+    {
+        vMantissa.push_back(1 << nBit);
+        vMantissa.push_back((1 << nBit) - 1);
+        vMantissa.push_back((1 << nBit) + 1);
+    }
+    for (int i = 0; i < 200; i++)
+        vMantissa.push_back(insecure_rand() & 0x007fffff);
+
+    for (unsigned int nSize = 0; nSize < 0x100; nSize++)
+    {
+        BOOST_FOREACH(unsigned int nMantissa, vMantissa)
+        {
+            for (int nSign = 0; nSign < 2; nSign++)
+            {
+                unsigned int nCompact = nSize << 24 | (nSign ? 0x00800000 : 0) | nMantissa;
+                CBigNum bn;
+                bn.SetCompact(nCompact);
+                bool fNegative, fOverflow;
+                uint256 num;
+                num.SetCompact(nCompact, &fNegative, &fOverflow);
+
+                BOOST_CHECK_EQUAL(fNegative, bn < 0);
+                BOOST_CHECK_EQUAL(fOverflow, BN_num_bits(&bn) > 256);
+                if (fOverflow)
+                    continue;
+                if (fNegative)
+                    bn = -bn;
+                BOOST_CHECK(num == bn.getuint256());
+                if (fNegative)
+                    bn = -bn;
+                BOOST_CHECK_EQUAL(num.GetCompact(fNegative), bn.GetCompact());
+            }
+        }
+    }
+
+    BOOST_FOREACH(const uint256& num, TestNumbers())
+        BOOST_CHECK_EQUAL(num.GetCompact(), CBigNum(num).GetCompact());
+}
+
+BOOST_AUTO_TEST_CASE(uint256_muldiv)
+{
+    vector<uint256> vNum = TestNumbers();
+    CBigNum bnModulus = CBigNum(1) << 256;
+    BOOST_FOREACH(const uint256& num, vNum)
+    {
+        CBigNum bn(num);
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t n32 = i == 0 ? 0xffffffff : insecure_rand() >> (insecure_rand() % 32);
+            if (n32 == 0)
+                n32 = 1;
+            BOOST_CHECK(num * n32 == ((bn * CBigNum(n32)) % bnModulus).getuint256());
+            BOOST_CHECK(num / n32 == (bn / CBigNum(n32)).getuint256());
+        }
+
+        const uint256& numDiv = vNum[insecure_rand() % vNum.size()];
+        if (numDiv != 0)
+            BOOST_CHECK(num / numDiv == (bn / CBigNum(numDiv)).getuint256());
+    }
+
+    BOOST_CHECK_THROW(uint256(1) / 0, uint_error);
+    BOOST_CHECK_THROW(uint256(1) / uint256(0), uint_error);
+}
+
+// The work of a block computed without 2**256, as CBlockIndex::GetBlockWork()
+// does, is the bignum quotient
+BOOST_AUTO_TEST_CASE(uint256_blockwork)
+{
+    BOOST_FOREACH(const uint256& num, TestNumbers())
+    {
+        if (num == 0 || num == ~uint256(0))
+            continue;
+        CBigNum bnWork = (CBigNum(1) << 256) / (CBigNum(num) + 1);
+        BOOST_CHECK((~num / (num + 1)) + 1 == bnWork.getuint256());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(uint256_bits)
+{
+    BOOST_CHECK_EQUAL(uint256(0).bits(), 0U);
+    for (unsigned int nBits = 1; nBits <= 256; nBits++)
+    {
+        BOOST_CHECK_EQUAL((uint256(1) << (nBits - 1)).bits(), nBits);
+        BOOST_CHECK_EQUAL((~uint256(0) >> (256 - nBits)).bits(), nBits);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
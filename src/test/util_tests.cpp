@@ -1,6 +1,8 @@
 #include <vector>
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem/fstream.hpp>
 
 #include "main.h"
 #include "wallet.h"
@@ -302,4 +304,63 @@ BOOST_AUTO_TEST_CASE(util_TimingResistantEqual)
     BOOST_CHECK(!TimingResistantEqual(std::string("abc"), std::string("aba")));
 }
 
+static int nLogArgsEvaluated = 0;
+
+static int LogArg()
+{
+    return ++nLogArgsEvaluated;
+}
+
+BOOST_AUTO_TEST_CASE(util_LogPrint)
+{
+    BOOST_CHECK_EQUAL(GetLogCategory("alias"), LOG_ALIAS);
+    BOOST_CHECK_EQUAL(GetLogCategory("net"), LOG_NET);
+    BOOST_CHECK_EQUAL(GetLogCategory("1"), 0U);
+
+    // the arguments of output that is turned off are never evaluated
+    unsigned int nSaved = nLogCategories;
+    nLogCategories = LOG_OFFER;
+    LogPrint(LOG_ALIAS | LOG_CERT, "%d\n", LogArg());
+    BOOST_CHECK_EQUAL(nLogArgsEvaluated, 0);
+    LogPrint(LOG_ALIAS | LOG_OFFER, "%d\n", LogArg());
+    BOOST_CHECK_EQUAL(nLogArgsEvaluated, 1);
+    nLogCategories = nSaved;
+}
+
+static void LogLines(int nThread)
+{
+    for (int i = 0; i < 1000; i++)
+        printf("util_DebugLog %d %d\n", nThread, i);
+}
+
+// Lines queued by several threads all reach debug.log, each thread's in
+// order, and an error reaches it without waiting for the writer
+BOOST_AUTO_TEST_CASE(util_DebugLog)
+{
+    fPrintToDebugger = false;
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&LogLines, i));
+    threads.join_all();
+    error("util_DebugLog done");
+    fPrintToDebugger = true;
+
+    boost::filesystem::ifstream file(GetDataDir() / "debug.log");
+    std::vector<int> vNext(4, 0);
+    bool fDone = false;
+    std::string strLine;
+    while (std::getline(file, strLine)) {
+        if (strLine.find("ERROR: util_DebugLog done") != std::string::npos)
+            fDone = true;
+        int nThread, n;
+        if (sscanf(strLine.c_str(), "util_DebugLog %d %d", &nThread, &n) != 2)
+            continue;
+        BOOST_CHECK_EQUAL(n, vNext[nThread]);
+        vNext[nThread] = n + 1;
+    }
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK_EQUAL(vNext[i], 1000);
+    BOOST_CHECK(fDone);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
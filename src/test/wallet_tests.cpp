@@ -1,5 +1,6 @@
 #include <boost/test/unit_test.hpp>
 
+#include "init.h"
 #include "main.h"
 #include "wallet.h"
 
@@ -29,11 +30,13 @@ static void add_coin(int64 nValue, int nAge = 6*24, bool fIsFromMe = false, int
     CWalletTx* wtx = new CWalletTx(&wallet, tx);
     if (fIsFromMe)
     {
-        // IsFromMe() returns (GetDebit() > 0), and GetDebit() is 0 if vin.empty(),
+        // IsFromMe() returns (GetDebitInclName() > 0), and the debits are 0 if vin.empty(),
         // so stop vin being empty, and cache a non-zero Debit to fake out IsFromMe()
         wtx->vin.resize(1);
         wtx->fDebitCached = true;
         wtx->nDebitCached = 1;
+        wtx->fDebitInclNameCached = true;
+        wtx->nDebitInclNameCached = 1;
     }
     COutput output(wtx, nInput, nAge);
     vCoins.push_back(output);
@@ -291,4 +294,93 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+// A transaction seen before the coin it spends has its debit worked out again
+// once that coin is added, and again once it is gone
+BOOST_AUTO_TEST_CASE(debit_follows_spent_tx)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKey(key));
+
+    CTransaction txPrev;
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 5*COIN;
+    txPrev.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    CTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 4*COIN;
+
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txSpend)));
+    const CWalletTx& wtxSpend = pwalletMain->mapWallet[txSpend.GetHash()];
+    BOOST_CHECK_EQUAL(wtxSpend.GetDebit(), 0);
+    BOOST_CHECK(!wtxSpend.IsFromMe());
+
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txPrev)));
+    BOOST_CHECK_EQUAL(wtxSpend.GetDebit(), 5*COIN);
+    BOOST_CHECK(wtxSpend.IsFromMe());
+
+    BOOST_CHECK(pwalletMain->EraseFromWallet(txPrev.GetHash()));
+    BOOST_CHECK_EQUAL(wtxSpend.GetDebit(), 0);
+    BOOST_CHECK(pwalletMain->EraseFromWallet(txSpend.GetHash()));
+}
+
+// A transaction is indexed as unspent while an output of ours in it is left
+// unspent, through spends, unspends, key imports and erasure
+BOOST_AUTO_TEST_CASE(unspent_index_follows_spends)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKey(key));
+    int64 nUnconfirmed = pwalletMain->GetUnconfirmedBalance();
+
+    CTransaction txPrev;
+    txPrev.vout.resize(2);
+    txPrev.vout[0].nValue = 5*COIN;
+    txPrev.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    txPrev.vout[1].nValue = 1*COIN;
+    uint256 hashPrev = txPrev.GetHash();
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txPrev)));
+    BOOST_CHECK(pwalletMain->setUnspentTxs.count(hashPrev));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed + 5*COIN);
+
+    // spending the output of ours leaves nothing of ours unspent
+    CTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(hashPrev, 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 4*COIN;
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txSpend)));
+    BOOST_CHECK(!pwalletMain->setUnspentTxs.count(hashPrev));
+    BOOST_CHECK(!pwalletMain->setUnspentTxs.count(txSpend.GetHash()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed);
+
+    UnspendInputs(pwalletMain->mapWallet[txSpend.GetHash()]);
+    BOOST_CHECK(pwalletMain->setUnspentTxs.count(hashPrev));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed + 5*COIN);
+
+    // an output becomes ours with the key it pays to
+    CKey keyLater;
+    keyLater.MakeNewKey(true);
+    CTransaction txLater;
+    txLater.vout.resize(1);
+    txLater.vout[0].nValue = 2*COIN;
+    txLater.vout[0].scriptPubKey.SetDestination(keyLater.GetPubKey().GetID());
+    BOOST_CHECK(pwalletMain->AddToWallet(CWalletTx(pwalletMain, txLater)));
+    BOOST_CHECK(!pwalletMain->setUnspentTxs.count(txLater.GetHash()));
+    BOOST_CHECK(pwalletMain->AddKey(keyLater));
+    pwalletMain->MarkDirty();
+    BOOST_CHECK(pwalletMain->setUnspentTxs.count(txLater.GetHash()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed + 7*COIN);
+
+    BOOST_CHECK(pwalletMain->EraseFromWallet(txLater.GetHash()));
+    BOOST_CHECK(pwalletMain->EraseFromWallet(txSpend.GetHash()));
+    BOOST_CHECK(pwalletMain->EraseFromWallet(hashPrev));
+    BOOST_CHECK(!pwalletMain->setUnspentTxs.count(txLater.GetHash()));
+    BOOST_CHECK(!pwalletMain->setUnspentTxs.count(hashPrev));
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), nUnconfirmed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
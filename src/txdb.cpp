@@ -71,7 +71,13 @@ CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevel
 
 bool CBlockTreeDB::WriteDiskBlockIndex(const CDiskBlockIndex& diskblockindex)
 {
-    return Write(boost::tuples::make_tuple('b', *diskblockindex.phashBlock, 'a'), diskblockindex);
+    // the auxpow goes under its own key, leaving the index entry the same
+    // small size for every block
+    CLevelDBBatch batch;
+    batch.Write(boost::tuples::make_tuple('b', *diskblockindex.phashBlock, 'a'), diskblockindex);
+    if ((diskblockindex.nVersion & BLOCK_VERSION_AUXPOW) && diskblockindex.auxpow.get() != NULL)
+        batch.Write(make_pair('x', *diskblockindex.phashBlock), *diskblockindex.auxpow);
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CBlockIndex& blockindex)
@@ -80,7 +86,21 @@ bool CBlockTreeDB::WriteBlockIndex(const CBlockIndex& blockindex)
 }
 
 bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blkid, CDiskBlockIndex &diskblockindex) {
-    return Read(boost::tuples::make_tuple('b', blkid, 'a'), diskblockindex);
+    if (!Read(boost::tuples::make_tuple('b', blkid, 'a'), diskblockindex))
+        return false;
+    if (diskblockindex.nVersion & BLOCK_VERSION_AUXPOW)
+        return ReadAuxPow(blkid, diskblockindex.auxpow);
+    diskblockindex.auxpow.reset();
+    return true;
+}
+
+bool CBlockTreeDB::ReadAuxPow(const uint256 &blkid, boost::shared_ptr<CAuxPow>& auxpow) {
+    auxpow.reset(new CAuxPow());
+    if (!Read(make_pair('x', blkid), *auxpow)) {
+        auxpow.reset();
+        return false;
+    }
+    return true;
 }
 
 bool CBlockTreeDB::ReadBestInvalidWork(CBigNum& bnBestInvalidWork)
@@ -198,6 +218,9 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    // entries written before auxpows were kept apart, moved as they are met
+    CLevelDBBatch batchMove;
+    unsigned int nMoved = 0, nMovedBatch = 0;
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << boost::tuples::make_tuple('b', uint256(0), 'a'); // 'b' is the prefix for BlockIndex, 'a' sigifies the first part
@@ -223,6 +246,21 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 CDiskBlockIndex diskindex;
                 ssValue_immutable >> diskindex; // read all immutable data
 
+                // an older entry still carries the auxpow after the header
+                if ((diskindex.nVersion & BLOCK_VERSION_AUXPOW) && !ssValue_immutable.empty()) {
+                    CAuxPow auxpow;
+                    ssValue_immutable >> auxpow;
+                    batchMove.Write(make_pair('x', hash), auxpow);
+                    batchMove.Write(boost::tuples::make_tuple('b', hash, 'a'), diskindex);
+                    nMoved++;
+                    if (++nMovedBatch == 1000) {
+                        if (!WriteBatch(batchMove))
+                            return error("LoadBlockIndex() : failed to move auxpow of %s", hash.ToString().c_str());
+                        batchMove.Clear();
+                        nMovedBatch = 0;
+                    }
+                }
+
                 // Construct immutable parts of block index object
                 CBlockIndex* pindexNew = InsertBlockIndex(hash);
                 assert(diskindex.CalcBlockHash() == *pindexNew->phashBlock); // paranoia check
@@ -261,5 +299,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         }
     }
 
+    if (nMovedBatch > 0 && !WriteBatch(batchMove))
+        return error("LoadBlockIndex() : failed to move auxpows out of the block index");
+    if (nMoved > 0)
+        printf("LoadBlockIndex(): moved %u auxpows out of the block index\n", nMoved);
+
     return true;
 }
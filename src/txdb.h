@@ -37,6 +37,7 @@ public:
     bool WriteDiskBlockIndex(const CDiskBlockIndex& diskblockindex);
     bool WriteBlockIndex(const CBlockIndex& blockindex);
     bool ReadDiskBlockIndex(const uint256 &blkid, CDiskBlockIndex& diskblockindex);
+    bool ReadAuxPow(const uint256 &blkid, boost::shared_ptr<CAuxPow>& auxpow);
     bool ReadBestInvalidWork(CBigNum& bnBestInvalidWork);
     bool WriteBestInvalidWork(const CBigNum& bnBestInvalidWork);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
@@ -9,6 +9,7 @@
 #define _POSIX_C_SOURCE 200112L
 #endif
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
 #endif
@@ -72,6 +73,7 @@ map<string, string> mapArgs;
 map<string, vector<string> > mapMultiArgs;
 bool fDebug = false;
 bool fDebugNet = false;
+unsigned int nLogCategories = LOG_ALL;
 bool fPrintToConsole = false;
 bool fPrintToDebugger = false;
 bool fDaemon = false;
@@ -221,7 +223,21 @@ static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
 // We use boost::call_once() to make sure these are initialized in
 // in a thread-safe manner the first time it is called:
 static FILE* fileout = NULL;
+// guards the queue below; held only to append to it or take it
 static boost::mutex* mutexDebugLog = NULL;
+// held while writing to fileout
+static boost::mutex* mutexDebugLogFile = NULL;
+static boost::condition_variable* condDebugLog = NULL;
+// output waiting for the writer thread
+static std::string* pstrDebugLogQueue = NULL;
+static bool fStartedNewLine = true;
+static boost::thread* pthreadDebugLog = NULL;
+// set by StopDebugLog(): output is written by the thread producing it
+static bool fDebugLogDirect = false;
+
+// queue past which output is written by the thread producing it, so that
+// no more than this is lost if the process dies before the writer runs
+static const unsigned int MAX_DEBUG_LOG_QUEUE = 64 * 1024;
 
 static void DebugPrintInit()
 {
@@ -230,9 +246,106 @@ static void DebugPrintInit()
 
     boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
     fileout = fopen(pathDebug.string().c_str(), "a");
-    if (fileout) setbuf(fileout, NULL); // unbuffered
+    if (fileout) setvbuf(fileout, NULL, _IOFBF, 64 * 1024);
 
     mutexDebugLog = new boost::mutex();
+    mutexDebugLogFile = new boost::mutex();
+    condDebugLog = new boost::condition_variable();
+    pstrDebugLogQueue = new std::string();
+}
+
+// write out what is queued; mutexDebugLog must not be held
+static void WriteDebugLog()
+{
+    boost::mutex::scoped_lock scoped_lock_file(*mutexDebugLogFile);
+    std::string str;
+    {
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        str.swap(*pstrDebugLogQueue);
+    }
+
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
+            setvbuf(fileout, NULL, _IOFBF, 64 * 1024);
+    }
+
+    if (!str.empty()) {
+        fwrite(str.data(), 1, str.size(), fileout);
+        fflush(fileout);
+    }
+}
+
+// writes the log in batches, so that threads that log only append to the
+// queue; runs from the first output until StopDebugLog()
+static void ThreadDebugLogWriter()
+{
+    RenameThread("bitcoin-log");
+    while (true) {
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+            while (pstrDebugLogQueue->empty() && !fReopenDebugLog && !fDebugLogDirect)
+                condDebugLog->timed_wait(scoped_lock, boost::posix_time::seconds(1));
+            if (fDebugLogDirect)
+                break;
+        }
+        WriteDebugLog();
+    }
+    WriteDebugLog();
+}
+
+static void DebugLogWriterInit()
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    if (fileout)
+        pthreadDebugLog = new boost::thread(&ThreadDebugLogWriter);
+}
+
+static boost::once_flag debugLogWriterInitFlag = BOOST_ONCE_INIT;
+
+void FlushDebugLog()
+{
+    if (fPrintToConsole || fPrintToDebugger)
+        return;
+    boost::call_once(&DebugLogWriterInit, debugLogWriterInitFlag);
+    if (fileout == NULL)
+        return;
+    WriteDebugLog();
+}
+
+void StopDebugLog()
+{
+    if (fPrintToConsole || fPrintToDebugger)
+        return;
+    boost::call_once(&DebugLogWriterInit, debugLogWriterInitFlag);
+    if (fileout == NULL)
+        return;
+    {
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        if (fDebugLogDirect)
+            return;
+        fDebugLogDirect = true;
+    }
+    condDebugLog->notify_one();
+    pthreadDebugLog->join();
+    delete pthreadDebugLog;
+    pthreadDebugLog = NULL;
+    WriteDebugLog();
+}
+
+unsigned int GetLogCategory(const std::string& strName)
+{
+    if (strName == "alias")
+        return LOG_ALIAS;
+    if (strName == "offer")
+        return LOG_OFFER;
+    if (strName == "cert")
+        return LOG_CERT;
+    if (strName == "net")
+        return LOG_NET;
+    return 0;
 }
 
 int OutputDebugStringF(const char* pszFormat, ...)
@@ -248,34 +361,38 @@ int OutputDebugStringF(const char* pszFormat, ...)
     }
     else if (!fPrintToDebugger)
     {
-        static bool fStartedNewLine = true;
-        boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+        boost::call_once(&DebugLogWriterInit, debugLogWriterInitFlag);
 
         if (fileout == NULL)
             return ret;
 
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-        // reopen the log file, if requested
-        if (fReopenDebugLog) {
-            fReopenDebugLog = false;
-            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-            if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
-                setbuf(fileout, NULL); // unbuffered
-        }
-
-        // Debug print useful for profiling
-        if (fLogTimestamps && fStartedNewLine)
-            ret += fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-        if (pszFormat[strlen(pszFormat) - 1] == '\n')
-            fStartedNewLine = true;
-        else
-            fStartedNewLine = false;
-
+        // format before taking the lock, which is held only to queue the result
         va_list arg_ptr;
         va_start(arg_ptr, pszFormat);
-        ret += vfprintf(fileout, pszFormat, arg_ptr);
+        std::string str = vstrprintf(pszFormat, arg_ptr);
         va_end(arg_ptr);
+        std::string strTime;
+        if (fLogTimestamps)
+            strTime = DateTimeStrFormat("%Y-%m-%d %H:%M:%S ", GetTime());
+
+        bool fWrite;
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+
+            // Debug print useful for profiling
+            if (fLogTimestamps && fStartedNewLine) {
+                pstrDebugLogQueue->append(strTime);
+                ret += strTime.size();
+            }
+            fStartedNewLine = !str.empty() && str[str.size() - 1] == '\n';
+            pstrDebugLogQueue->append(str);
+            ret += str.size();
+            fWrite = fDebugLogDirect || pstrDebugLogQueue->size() > MAX_DEBUG_LOG_QUEUE;
+        }
+        if (fWrite)
+            WriteDebugLog();
+        else
+            condDebugLog->notify_one();
     }
 
 #ifdef WIN32
@@ -363,6 +480,7 @@ bool error(const char *format, ...)
     std::string str = vstrprintf(format, arg_ptr);
     va_end(arg_ptr);
     printf("ERROR: %s\n", str.c_str());
+    FlushDebugLog();
     return false;
 }
 
@@ -1010,6 +1128,7 @@ void LogException(std::exception* pex, const char* pszThread)
 {
     std::string message = FormatException(pex, pszThread);
     printf("\n%s", message.c_str());
+    FlushDebugLog();
 }
 
 void PrintException(std::exception* pex, const char* pszThread)
@@ -1017,6 +1136,7 @@ void PrintException(std::exception* pex, const char* pszThread)
     std::string message = FormatException(pex, pszThread);
     printf("\n\n************************\n%s\n", message.c_str());
     fprintf(stderr, "\n\n************************\n%s\n", message.c_str());
+    FlushDebugLog();
     strMiscWarning = message;
     throw;
 }
@@ -1026,6 +1146,7 @@ void PrintExceptionContinue(std::exception* pex, const char* pszThread)
     std::string message = FormatException(pex, pszThread);
     printf("\n\n************************\n%s\n", message.c_str());
     fprintf(stderr, "\n\n************************\n%s\n", message.c_str());
+    FlushDebugLog();
     strMiscWarning = message;
 }
 
@@ -1149,6 +1270,73 @@ void CreatePidFile(const boost::filesystem::path &path, pid_t pid)
 }
 #endif
 
+CMappedFile::CMappedFile() : pbegin(NULL), nSize(0) {
+#ifdef WIN32
+    hMapping = NULL;
+#endif
+}
+
+bool CMappedFile::Open(FILE *file, bool fSequential) {
+    Close();
+#ifdef WIN32
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(file));
+    LARGE_INTEGER nFileSize;
+    if (!GetFileSizeEx(hFile, &nFileSize) || nFileSize.QuadPart == 0
+            || (uint64)nFileSize.QuadPart != (size_t)nFileSize.QuadPart)
+        return false;
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL)
+        return false;
+    pbegin = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (pbegin == NULL) {
+        CloseHandle(hMapping);
+        hMapping = NULL;
+        return false;
+    }
+    nSize = nFileSize.QuadPart;
+#else
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || st.st_size <= 0
+            || (uint64)st.st_size != (size_t)st.st_size)
+        return false;
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (p == MAP_FAILED)
+        return false;
+    pbegin = (const char*)p;
+    nSize = st.st_size;
+    if (fSequential)
+        posix_madvise(p, nSize, POSIX_MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void CMappedFile::Close() {
+    if (pbegin == NULL)
+        return;
+#ifdef WIN32
+    UnmapViewOfFile(pbegin);
+    CloseHandle(hMapping);
+    hMapping = NULL;
+#else
+    munmap((void*)pbegin, nSize);
+#endif
+    pbegin = NULL;
+    nSize = 0;
+}
+
+void CMappedFile::WillNeed(uint64 nPos, uint64 nLength) const {
+#ifndef WIN32
+    if (nPos >= nSize)
+        return;
+    if (nLength > nSize - nPos)
+        nLength = nSize - nPos;
+    // the range handed to posix_madvise has to start on a page
+    static const uint64 nPageSize = sysconf(_SC_PAGESIZE);
+    uint64 nStart = nPos - nPos % nPageSize;
+    posix_madvise((void*)(pbegin + nStart), nPos + nLength - nStart, POSIX_MADV_WILLNEED);
+#endif
+}
+
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest)
 {
 #ifdef WIN32
@@ -182,6 +182,26 @@ bool ATTR_WARN_PRINTF(1,2) error(const char *format, ...);
  */
 #define printf OutputDebugStringF
 
+/** Categories of debug output, which -debug=<category> turns on one by one */
+static const unsigned int LOG_ALIAS = (1U << 0);
+static const unsigned int LOG_OFFER = (1U << 1);
+static const unsigned int LOG_CERT = (1U << 2);
+static const unsigned int LOG_NET = (1U << 3);
+static const unsigned int LOG_ALL = ~0U;
+
+extern unsigned int nLogCategories;
+/** The category named strName, 0 for a name that is not one */
+unsigned int GetLogCategory(const std::string& strName);
+/** Log only when one of the categories nCategory is turned on. The category
+ *  is tested before the arguments are evaluated or formatted. */
+#define LogPrint(nCategory, ...) do { if (nLogCategories & (nCategory)) OutputDebugStringF(__VA_ARGS__); } while (0)
+/** Write out all queued debug output now. Called after error output, so
+ *  that it reaches debug.log even if the process dies right after. */
+void FlushDebugLog();
+/** Stop the background writer, write out what it left, and have later
+ *  output written as it comes. Called at shutdown. */
+void StopDebugLog();
+
 void LogException(std::exception* pex, const char* pszThread);
 void PrintException(std::exception* pex, const char* pszThread);
 void PrintExceptionContinue(std::exception* pex, const char* pszThread);
@@ -515,6 +535,40 @@ public:
     }
 };
 
+/** Read-only mapping of a whole file into memory, for reading large files
+ *  without a read call per record. The mapping stays valid after the FILE
+ *  it was made from is closed.
+ */
+class CMappedFile
+{
+private:
+    const char *pbegin;
+    uint64 nSize;
+#ifdef WIN32
+    void *hMapping;
+#endif
+
+    // not copyable
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    CMappedFile();
+    ~CMappedFile() { Close(); }
+
+    /** Map all of file; false, leaving nothing mapped, when the file is empty
+     *  or cannot be mapped. fSequential hints that it will be read in order. */
+    bool Open(FILE *file, bool fSequential = false);
+    void Close();
+
+    bool IsOpen() const { return pbegin != NULL; }
+    const char *begin() const { return pbegin; }
+    uint64 size() const { return nSize; }
+
+    /** Hint that the bytes from nPos on are about to be read. */
+    void WillNeed(uint64 nPos, uint64 nLength) const;
+};
+
 bool NewThread(void(*pfn)(void*), void* parg);
 
 #ifdef WIN32
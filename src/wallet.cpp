@@ -363,6 +363,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx)
                 {
                     printf("WalletUpdateSpent found spent coin %sbc %s\n", FormatMoney(wtx.GetCredit()).c_str(), wtx.GetHash().ToString().c_str());
                     wtx.MarkSpent(txin.prevout.n);
+                    IndexUnspent(txin.prevout.hash, wtx);
                     wtx.WriteToDisk();
                     NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
 
@@ -393,10 +394,128 @@ void CWallet::MarkDirty()
     {
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+        {
             item.second.MarkDirty();
+            // new keys can only make more outputs ours, so only transactions
+            // not indexed yet may have to be
+            if (!setUnspentTxs.count(item.first))
+                IndexUnspent(item.first, item.second);
+        }
     }
 }
 
+void CWallet::IndexUnspent(const uint256& hash, const CWalletTx& wtx)
+{
+    assert(mapWallet.count(hash));
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        if (!wtx.IsSpent(i) && IsMine(wtx.vout[i]))
+        {
+            setUnspentTxs.insert(hash);
+            return;
+        }
+    }
+    setUnspentTxs.erase(hash);
+}
+
+void CWallet::ReindexUnspent()
+{
+    LOCK(cs_wallet);
+    setUnspentTxs.clear();
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        IndexUnspent((*it).first, (*it).second);
+}
+
+void CWallet::IndexSpends(const uint256& hash, const CWalletTx& wtx, bool fErase)
+{
+    BOOST_FOREACH(const CTxIn& txin, wtx.vin)
+    {
+        if (!fErase)
+            mapTxSpenders[txin.prevout.hash].insert(hash);
+        else
+        {
+            map<uint256, set<uint256> >::iterator mi = mapTxSpenders.find(txin.prevout.hash);
+            if (mi == mapTxSpenders.end())
+                continue;
+            mi->second.erase(hash);
+            if (mi->second.empty())
+                mapTxSpenders.erase(mi);
+        }
+    }
+}
+
+// Only the debits of the wallet transactions spending hash depend on whether
+// it is in the wallet; everything else cached stays good.
+void CWallet::MarkSpendersDirty(const uint256& hash)
+{
+    map<uint256, set<uint256> >::const_iterator mi = mapTxSpenders.find(hash);
+    if (mi == mapTxSpenders.end())
+        return;
+    BOOST_FOREACH(const uint256& hashSpender, mi->second)
+    {
+        map<uint256, CWalletTx>::iterator it = mapWallet.find(hashSpender);
+        if (it != mapWallet.end())
+            it->second.MarkDebitDirty();
+    }
+}
+
+static void IndexServiceName(CWallet::service_tx_index& mapIndex, const vector<unsigned char>& vchName, const uint256& hash, bool fErase)
+{
+    if (!fErase)
+    {
+        mapIndex[vchName].insert(hash);
+        return;
+    }
+    CWallet::service_tx_index::iterator mi = mapIndex.find(vchName);
+    if (mi == mapIndex.end())
+        return;
+    mi->second.erase(hash);
+    if (mi->second.empty())
+        mapIndex.erase(mi);
+}
+
+// (un)index a wallet transaction under the names it operates on; cs_wallet must be held
+void CWallet::IndexServiceTx(const CWalletTx& wtx, bool fErase)
+{
+    if (wtx.nVersion != SYSCOIN_TX_VERSION)
+        return;
+    uint256 hash = wtx.GetHash();
+    vector<vector<unsigned char> > vvchArgs;
+    int op, nOut;
+    if (DecodeAliasTx(wtx, op, nOut, vvchArgs, -1) && IsAliasOp(op))
+        IndexServiceName(mapAliasTxs, vvchArgs[0], hash, fErase);
+    if (DecodeOfferTx(wtx, op, nOut, vvchArgs, -1))
+        IndexServiceName(mapOfferTxs, vvchArgs[0], hash, fErase);
+    if (DecodeCertTx(wtx, op, nOut, vvchArgs, -1))
+        IndexServiceName(mapCertIssuerTxs, vvchArgs[0], hash, fErase);
+}
+
+// hashes of the indexed transactions on vchName, or on any name if it is empty
+void CWallet::ListServiceTxs(const service_tx_index& mapIndex, const vector<unsigned char>& vchName, vector<uint256>& vHashes) const
+{
+    LOCK(cs_wallet);
+    service_tx_index::const_iterator mi = vchName.empty() ? mapIndex.begin() : mapIndex.find(vchName);
+    for (; mi != mapIndex.end(); ++mi)
+    {
+        vHashes.insert(vHashes.end(), mi->second.begin(), mi->second.end());
+        if (!vchName.empty())
+            break;
+    }
+}
+
+// the wallet's copy of a transaction in the main chain or the memory pool
+bool CWallet::GetServiceTx(const uint256& hash, CTransaction& tx) const
+{
+    LOCK(cs_wallet);
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return false;
+    if (!mi->second.IsInMainChain() && !mempool.exists(hash))
+        return false;
+    tx = mi->second;
+    return true;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
@@ -409,6 +528,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
+            IndexServiceTx(wtx);
+            IndexSpends(hash, wtx);
+            MarkSpendersDirty(hash);
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
 
@@ -481,6 +603,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
             }
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
+        IndexUnspent(hash, wtx);
 
         //// debug print
         printf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString().c_str(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -577,8 +700,16 @@ bool CWallet::EraseFromWallet(uint256 hash)
         return false;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+        {
+            IndexServiceTx(mi->second, true);
+            setUnspentTxs.erase(hash);
+            IndexSpends(hash, mi->second, true);
+            mapWallet.erase(mi);
+            MarkSpendersDirty(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     
     return true;
@@ -957,6 +1088,7 @@ void CWallet::ReacceptWalletTransactions()
                 {
                     printf("ReacceptWalletTransactions found spent coin %sbc %s\n", FormatMoney(wtx.GetCredit()).c_str(), wtx.GetHash().ToString().c_str());
                     wtx.MarkDirty();
+                    IndexUnspent(item.first, wtx);
                     wtx.WriteToDisk();
                 }
             }
@@ -1053,9 +1185,12 @@ int64 CWallet::GetBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, setUnspentTxs)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &(*mi).second;
             if (pcoin->IsConfirmed())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1069,9 +1204,12 @@ int64 CWallet::GetUnconfirmedBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, setUnspentTxs)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &(*mi).second;
             if (!pcoin->IsFinal() || !pcoin->IsConfirmed())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1084,9 +1222,12 @@ int64 CWallet::GetImmatureBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        BOOST_FOREACH(const uint256& hash, setUnspentTxs)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &(*mi).second;
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -1100,9 +1241,13 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        // only transactions with outputs of ours left unspent can add any
+        BOOST_FOREACH(const uint256& hash, setUnspentTxs)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &(*mi).second;
 
             if (!pcoin->IsFinal())
                 continue;
@@ -1115,8 +1260,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
                 if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) &&
-                    !IsLockedCoin((*it).first, i) && pcoin->vout[i].nValue >= nMinimumInputValue &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i))) 
+                    !IsLockedCoin(hash, i) && pcoin->vout[i].nValue >= nMinimumInputValue &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected(hash, i))) 
                         vCoins.push_back(COutput(pcoin, i, pcoin->GetDepthInMainChain()));
             }
         }
@@ -1169,7 +1314,7 @@ static void ApproximateBestSubset(vector<pair<int64, pair<const CWalletTx*,unsig
     }
 }
 
-bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,
+bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
 {
     setCoinsRet.clear();
@@ -1182,10 +1327,15 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfThe
     vector<pair<int64, pair<const CWalletTx*,unsigned int> > > vValue;
     int64 nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    // visit the coins in random order without copying them
+    vector<unsigned int> vOrder(vCoins.size());
+    for (unsigned int i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    random_shuffle(vOrder.begin(), vOrder.end(), GetRandInt);
 
-    BOOST_FOREACH(COutput output, vCoins)
+    BOOST_FOREACH(unsigned int nCoin, vOrder)
     {
+        const COutput& output = vCoins[nCoin];
         const CWalletTx *pcoin = output.tx;
 
         if (output.nDepth < (pcoin->IsFromMe() ? nConfMine : nConfTheirs))
@@ -1317,7 +1467,7 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64> >& v
         return false;
     }
 
-    wtxNew.data = vchFromString(txData.c_str());
+    wtxNew.data = vchFromString(txData);
 
     {
         LOCK2(cs_main, cs_wallet);
@@ -1500,6 +1650,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
                 CWalletTx &coin = mapWallet[txin.prevout.hash];
                 coin.BindWallet(this);
                 coin.MarkSpent(txin.prevout.n);
+                IndexUnspent(txin.prevout.hash, coin);
                 coin.WriteToDisk();
                 
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
@@ -1654,6 +1805,13 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
+    ReindexUnspent();
+    {
+        LOCK(cs_wallet);
+        mapTxSpenders.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            IndexSpends((*it).first, (*it).second);
+    }
 
     return DB_LOAD_OK;
 }
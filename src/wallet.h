@@ -125,11 +125,27 @@ public:
 
     std::set<COutPoint> setLockedCoins;
 
+    // Syscoin transactions in mapWallet by the alias, offer or cert issuer
+    // they operate on, so that listing them only visits those transactions
+    typedef std::map<std::vector<unsigned char>, std::set<uint256> > service_tx_index;
+    service_tx_index mapAliasTxs;
+    service_tx_index mapOfferTxs;
+    service_tx_index mapCertIssuerTxs;
+
+    // transactions in mapWallet that may have outputs of ours left unspent,
+    // so that balances and coin selection only visit these; an entry leaves
+    // before its transaction leaves mapWallet
+    std::set<uint256> setUnspentTxs;
+
+    // wallet transactions spending outputs of each transaction, whose cached
+    // debits go stale when that transaction enters or leaves the wallet
+    std::map<uint256, std::set<uint256> > mapTxSpenders;
+
     // check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf) { return nWalletMaxVersion >= wf; }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl=NULL) const;
-    bool SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
+    bool SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
     bool IsLockedCoin(uint256 hash, unsigned int n) const;
     void LockCoin(COutPoint& output);
     void UnlockCoin(COutPoint& output);
@@ -172,6 +188,13 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    void IndexServiceTx(const CWalletTx& wtx, bool fErase = false);
+    void IndexUnspent(const uint256& hash, const CWalletTx& wtx);
+    void ReindexUnspent();
+    void IndexSpends(const uint256& hash, const CWalletTx& wtx, bool fErase = false);
+    void MarkSpendersDirty(const uint256& hash);
+    void ListServiceTxs(const service_tx_index& mapIndex, const std::vector<unsigned char>& vchName, std::vector<uint256>& vHashes) const;
+    bool GetServiceTx(const uint256& hash, CTransaction& tx) const;
     bool AddToWallet(const CWalletTx& wtxIn);
     bool AddToWalletIfInvolvingMe(const uint256 &hash, const CTransaction& tx, const CBlock* pblock, bool fUpdate = false, bool fFindBlock = false);
     bool EraseFromWallet(uint256 hash);
@@ -462,11 +485,13 @@ public:
         strFromAccount.clear();
         vfSpent.clear();
         fDebitCached = false;
+        fDebitInclNameCached = false;
         fCreditCached = false;
         fImmatureCreditCached = false;
         fAvailableCreditCached = false;
         fChangeCached = false;
         nDebitCached = 0;
+        nDebitInclNameCached = 0;
         nCreditCached = 0;
         nImmatureCreditCached = 0;
         nAvailableCreditCached = 0;
@@ -555,11 +580,20 @@ public:
     void MarkDirty()
     {
         fCreditCached = false;
+        fImmatureCreditCached = false;
         fAvailableCreditCached = false;
         fDebitCached = false;
+        fDebitInclNameCached = false;
         fChangeCached = false;
     }
 
+    // the debits, which depend on the transactions spent rather than on this one
+    void MarkDebitDirty()
+    {
+        fDebitCached = false;
+        fDebitInclNameCached = false;
+    }
+
     void BindWallet(CWallet *pwalletIn)
     {
         pwallet = pwalletIn;
@@ -255,7 +255,10 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             ssValue >> wtx;
             CValidationState state;
             if (wtx.CheckTransaction(state) && (wtx.GetHash() == hash) && state.IsValid())
+            {
                 wtx.BindWallet(pwallet);
+                pwallet->IndexServiceTx(wtx);
+            }
             else
             {
                 pwallet->mapWallet.erase(hash);
@@ -179,6 +179,12 @@ HEADERS += src/qt/bitcoingui.h \
     src/init.h \
     src/bloom.h \
     src/mruset.h \
+    src/feewindow.h \
+    src/servicehistory.h \
+    src/servicedb.h \
+    src/decodecache.h \
+    src/powcache.h \
+    src/blockcache.h \
     src/checkqueue.h \
     src/alias.h \
     src/offer.h \
@@ -389,6 +395,14 @@ gccsse2.output = $$PWD/build/${QMAKE_FILE_BASE}.o
 gccsse2.commands = $(CXX) -c $(CXXFLAGS) $(INCPATH) -o ${QMAKE_FILE_OUT} ${QMAKE_FILE_NAME} -msse2 -mstackrealign
 QMAKE_EXTRA_COMPILERS += gccsse2
 SOURCES_SSE2 += src/scrypt-sse2.cpp
+contains(USE_AVX2, 1) {
+DEFINES += USE_AVX2
+gccavx2.input  = SOURCES_AVX2
+gccavx2.output = $$PWD/build/${QMAKE_FILE_BASE}.o
+gccavx2.commands = $(CXX) -c $(CXXFLAGS) $(INCPATH) -o ${QMAKE_FILE_OUT} ${QMAKE_FILE_NAME} -mavx2 -mstackrealign
+QMAKE_EXTRA_COMPILERS += gccavx2
+SOURCES_AVX2 += src/scrypt-avx2.cpp
+}
 }
 
 # Todo: Remove this line when switching to Qt5, as that option was removed